@@ -0,0 +1,129 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Erase and program the bridge's own QSPI flash while both cores are running FreeRTOS.
+//
+// XIP is unavailable while the flash is busy, so nothing may execute from flash on either core. The calling
+// core disables its interrupts, the other core is parked in a RAM loop by a lockout task pinned to it. One
+// lockout task per core is created so the caller can run on either core.
+
+#include <pico/stdlib.h>
+#include "ubp_config.h"
+#include "esp_log.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "bridge_flash.h"
+
+static const char *TAG = "bridge_flash";
+
+extern char __flash_binary_end;
+
+static TaskHandle_t lockout_task_handle[configNUM_CORES];
+static volatile bool lockout_parked[configNUM_CORES];
+static volatile bool lockout_release;
+
+static SemaphoreHandle_t flash_mutex_handle;
+static StaticSemaphore_t flash_mutex_def;
+
+static void __not_in_flash_func(lockout_task)(void *param)
+{
+	const uint32_t core = (uint32_t) param;
+
+	for (;;)
+	{
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		uint32_t irq = save_and_disable_interrupts();
+		lockout_parked[core] = true;
+		__sev();
+		while (!lockout_release)
+		{
+			tight_loop_contents();
+		}
+		lockout_parked[core] = false;
+		restore_interrupts(irq);
+	}
+}
+
+void bridge_flash_init(void)
+{
+	flash_mutex_handle = xSemaphoreCreateMutexStatic(&flash_mutex_def);
+
+	for (uint32_t core = 0; core < configNUM_CORES; core++)
+	{
+		xTaskCreateAffinitySet(lockout_task, "flash_lockout", STACK_SIZE_FROM_BYTES(512), (void *) core,
+		                       configMAX_PRIORITIES - 1, 1 << core, &lockout_task_handle[core]);
+	}
+}
+
+uint32_t bridge_flash_binary_end(void)
+{
+	return (uint32_t)&__flash_binary_end - XIP_BASE;
+}
+
+// Returns with interrupts disabled on this core and the other core parked
+static uint32_t __not_in_flash_func(flash_lockout_start)(void)
+{
+	xSemaphoreTake(flash_mutex_handle, portMAX_DELAY);
+
+	// Stay on this core from here on, the lockout task of the other core gets woken up
+	vTaskPreemptionDisable(NULL);
+	const uint32_t other = get_core_num() ^ 1;
+
+	lockout_release = false;
+	xTaskNotifyGive(lockout_task_handle[other]);
+	while (!lockout_parked[other])
+	{
+		tight_loop_contents();
+	}
+
+	return save_and_disable_interrupts();
+}
+
+static void __not_in_flash_func(flash_lockout_end)(uint32_t irq)
+{
+	const uint32_t other = get_core_num() ^ 1;
+
+	lockout_release = true;
+	__sev();
+	while (lockout_parked[other])
+	{
+		tight_loop_contents();
+	}
+	restore_interrupts(irq);
+
+	vTaskPreemptionEnable(NULL);
+	xSemaphoreGive(flash_mutex_handle);
+}
+
+void bridge_flash_erase(uint32_t offset, size_t count)
+{
+	ESP_LOGD(TAG, "erase %#08x %u", offset, count);
+
+	uint32_t irq = flash_lockout_start();
+	flash_range_erase(offset, count);
+	flash_lockout_end(irq);
+}
+
+void bridge_flash_program(uint32_t offset, const uint8_t *data, size_t count)
+{
+	ESP_LOGD(TAG, "program %#08x %u", offset, count);
+
+	uint32_t irq = flash_lockout_start();
+	flash_range_program(offset, data, count);
+	flash_lockout_end(irq);
+}
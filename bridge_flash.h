@@ -0,0 +1,27 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hardware/flash.h"
+
+// Offsets are relative to the start of the RP2040 flash, not XIP_BASE
+#define BRIDGE_FLASH_PTR(offset) ((const uint8_t *)(XIP_BASE + (offset)))
+
+void bridge_flash_init(void);
+uint32_t bridge_flash_binary_end(void);
+void bridge_flash_erase(uint32_t offset, size_t count);
+void bridge_flash_program(uint32_t offset, const uint8_t *data, size_t count);
@@ -0,0 +1,216 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+
+
+// Sampling profiler, see bridge_profile.h.
+//
+// The sample of a core is taken by that core's alarm ISR, which is the only writer of the core's table and
+// can't interrupt itself, so the tables need no lock. The dump pauses sampling and sends them as they are.
+
+#include <string.h>
+#include "ubp_config.h"
+#include "pico.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+#include "pico/time.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "bridge_profile.h"
+
+#if PICO_ON_DEVICE
+#include "hardware/structs/xip_ctrl.h"
+#endif
+
+#if PROFILE_ENABLED
+
+_Static_assert((PROFILE_SLOTS & (PROFILE_SLOTS - 1)) == 0 && PROFILE_SLOTS <= 65536, "PROFILE_SLOTS must be a power of two up to 65536");
+_Static_assert(PROFILE_HZ > 0 && PROFILE_HZ <= 100000, "PROFILE_HZ is out of range");
+_Static_assert(NUM_CORES == 2, "bridge_profile_header_t has room for two cores");
+_Static_assert(sizeof(bridge_profile_header_t) + NUM_CORES * PROFILE_SLOTS * sizeof(bridge_profile_slot_t) <= 0xFFFF,
+	"the dump has to fit into one control transfer, PROFILE_SLOTS is too large");
+
+// Slots tried for a PC before its sample is given up
+#define PROFILE_PROBES		16
+
+typedef struct
+{
+	bridge_profile_header_t header;
+	bridge_profile_slot_t slots[NUM_CORES][PROFILE_SLOTS];
+} bridge_profile_dump_t;
+
+static bridge_profile_dump_t s_profile;
+static volatile bool s_paused;
+static bool s_reset_on_resume;
+static uint32_t s_start_us;
+
+void __not_in_flash_func(bridge_profile_sample)(uint32_t pc, bool isr)
+{
+	if (s_paused)
+		return;
+
+	const uint core = get_core_num();
+	bridge_profile_slot_t *const table = s_profile.slots[core];
+	s_profile.header.samples[core]++;
+	if (isr)
+		s_profile.header.isr_samples[core]++;
+
+	// Thumb PCs are even, hash the halfword address
+	uint32_t n = ((pc >> 1) * 2654435761u) >> 16;
+	for (uint probe = 0; probe < PROFILE_PROBES; probe++, n++)
+	{
+		bridge_profile_slot_t *const slot = &table[n & (PROFILE_SLOTS - 1)];
+		if (slot->count == 0)
+		{
+			slot->pc = pc;
+			slot->count = 1;
+			return;
+		}
+		if (slot->pc == pc)
+		{
+			slot->count++;
+			return;
+		}
+	}
+	s_profile.header.missed[core]++;
+}
+
+static void xip_counters(uint32_t *hit, uint32_t *acc, bool clear)
+{
+#if PICO_ON_DEVICE
+	*hit = xip_ctrl_hw->ctr_hit;
+	*acc = xip_ctrl_hw->ctr_acc;
+	if (clear)
+	{
+		// Any write clears them
+		xip_ctrl_hw->ctr_hit = 0;
+		xip_ctrl_hw->ctr_acc = 0;
+	}
+#else
+	*hit = 0;
+	*acc = 0;
+#endif
+}
+
+const uint8_t *bridge_profile_dump(size_t *len, bool reset)
+{
+	s_paused = true;
+	// Let a sample that got past the check on the other core finish
+	busy_wait_us_32(2);
+
+	bridge_profile_header_t *const header = &s_profile.header;
+	header->magic = BRIDGE_PROFILE_MAGIC;
+	header->version = BRIDGE_PROFILE_VERSION;
+	header->header_size = sizeof(bridge_profile_header_t);
+	header->cores = NUM_CORES;
+	header->slot_size = sizeof(bridge_profile_slot_t);
+	header->rate_hz = PROFILE_HZ;
+	header->slots = PROFILE_SLOTS;
+	header->elapsed_us = time_us_32() - s_start_us;
+	xip_counters(&header->xip_hit, &header->xip_acc, false);
+
+	s_reset_on_resume = reset;
+	*len = sizeof(s_profile);
+	return (const uint8_t *) &s_profile;
+}
+
+void bridge_profile_resume(void)
+{
+	if (s_reset_on_resume)
+	{
+		uint32_t hit, acc;
+		memset(&s_profile, 0, sizeof(s_profile));
+		xip_counters(&hit, &acc, true);
+		s_start_us = time_us_32();
+		s_reset_on_resume = false;
+	}
+	s_paused = false;
+}
+
+void bridge_profile_task(void *pvParameters)
+{
+	uint32_t hit, acc;
+	xip_counters(&hit, &acc, true);
+	s_start_us = time_us_32();
+	bridge_profile_start();
+	vTaskDelete(NULL);
+}
+
+#if PICO_ON_DEVICE
+
+#define PROFILE_PERIOD_US	(1000000 / PROFILE_HZ)
+
+static uint s_alarm[NUM_CORES];
+static uint32_t s_next[NUM_CORES];
+
+// Entered from profile_isr with the exception frame of the interrupted code (r0-r3, r12, lr, pc, xpsr)
+static void __attribute__((used)) __not_in_flash_func(profile_alarm)(const uint32_t *frame, uint32_t exc_return)
+{
+	const uint core = get_core_num();
+	const uint alarm = s_alarm[core];
+	timer_hw->intr = 1u << alarm;
+
+	// Keep the rate, unless the alarm fell so far behind that the next one would be in the past
+	const uint32_t now = timer_hw->timerawl;
+	uint32_t next = s_next[core] + PROFILE_PERIOD_US;
+	if ((int32_t) (next - now) <= 0)
+		next = now + PROFILE_PERIOD_US;
+	s_next[core] = next;
+	timer_hw->alarm[alarm] = next;
+
+	// EXC_RETURN bit 3 is clear when the exception was taken from handler mode
+	bridge_profile_sample(frame[6], (exc_return & 0x8) == 0);
+}
+
+// The frame is on the process stack when a task was interrupted (EXC_RETURN bit 2), else on the main
+// stack. LR still holds EXC_RETURN when profile_alarm returns through it.
+static void __attribute__((naked)) __not_in_flash_func(profile_isr)(void)
+{
+	__asm volatile(
+		"mov r1, lr\n"
+		"movs r0, #4\n"
+		"tst r0, r1\n"
+		"bne 1f\n"
+		"mrs r0, msp\n"
+		"b 2f\n"
+		"1:\n"
+		"mrs r0, psp\n"
+		"2:\n"
+		"ldr r2, =profile_alarm\n"
+		"bx r2\n"
+		".ltorg\n");
+}
+
+void bridge_profile_start(void)
+{
+	const uint core = get_core_num();
+	const uint alarm = (uint) hardware_alarm_claim_unused(true);
+	const uint irq = TIMER_IRQ_0 + alarm;
+
+	s_alarm[core] = alarm;
+	// The IRQ is only enabled in this core's NVIC, so this core takes all of its samples
+	irq_set_exclusive_handler(irq, profile_isr);
+	// Above every other interrupt, so ISRs get sampled too
+	irq_set_priority(irq, 0);
+	hw_set_bits(&timer_hw->inte, 1u << alarm);
+	s_next[core] = timer_hw->timerawl + PROFILE_PERIOD_US;
+	timer_hw->alarm[alarm] = s_next[core];
+	irq_set_enabled(irq, true);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "ubp_config.h"
+
+/*
+ * Sampling profiler (PROFILE_ENABLED). A timer alarm per core interrupts it PROFILE_HZ times a second and
+ * counts the interrupted PC in a hash table of PROFILE_SLOTS entries for that core. VEND_PROFILE reads the
+ * tables, tools/profile_report.py turns them into a per-function profile with the symbols of the ELF.
+ *
+ * The dump is little endian: bridge_profile_header_t, then PROFILE_SLOTS bridge_profile_slot_t per core.
+ * Slots with a count of 0 are unused. Samples whose PC didn't find a slot are only counted in missed.
+ * Code running with interrupts disabled can't be sampled, its time goes to the instruction that
+ * enables them again. Sampling is paused while a dump is transferred.
+ */
+
+#define BRIDGE_PROFILE_MAGIC		0x46525042	// "BPRF"
+#define BRIDGE_PROFILE_VERSION		1
+
+// Vendor control request (IN) on the JTAG interface, next to VEND_JTAG_* in jtag.c
+#define VEND_PROFILE				18
+
+// wValue bit of VEND_PROFILE: start a new profile once the dump has been sent
+#define BRIDGE_PROFILE_RESET		(1 << 0)
+
+typedef struct __attribute__((packed))
+{
+	uint32_t pc;
+	uint32_t count;
+} bridge_profile_slot_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;
+	uint8_t version;
+	uint8_t header_size;
+	uint8_t cores;
+	uint8_t slot_size;
+	uint32_t rate_hz;
+	uint32_t slots;
+	uint32_t elapsed_us;		// since the last reset
+	uint32_t samples[2];
+	uint32_t isr_samples[2];	// of samples, taken with an ISR interrupted
+	uint32_t missed[2];			// of samples, the table had no slot left for the PC
+	uint32_t xip_hit;			// XIP cache hits and accesses since the last reset
+	uint32_t xip_acc;
+} bridge_profile_header_t;
+
+#if PROFILE_ENABLED
+
+// Starts sampling the calling core, call it once on each core
+void bridge_profile_start(void);
+
+// Task that starts sampling its core and deletes itself, main() creates one pinned to each core
+void bridge_profile_task(void *pvParameters);
+
+// Counts one sample of the calling core, called by the sampler
+void bridge_profile_sample(uint32_t pc, bool isr);
+
+// Pauses sampling and returns the dump, which stays valid until bridge_profile_resume(). Called from the USB task.
+const uint8_t *bridge_profile_dump(size_t *len, bool reset);
+void bridge_profile_resume(void);
+
+#endif
@@ -0,0 +1,93 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+// Run time statistics, see bridge_stats.h.
+
+#include <string.h>
+#include "ubp_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "tusb.h"
+#include "jtag.h"
+#include "hardware/timer.h"
+#include "bridge_stats.h"
+
+_Static_assert(sizeof(bridge_stats_task_t) == 28, "the layout of bridge_stats_task_t is part of the protocol");
+
+volatile uint32_t bridge_stats_high_water[STATS_BUF_COUNT];
+
+// Must match the sizes used in jtag.c, serial.c and pio_uart_logger.c
+static const uint32_t s_capacity[STATS_BUF_COUNT] =
+{
+	[STATS_BUF_USB_SEND] = USB_SNDBUF_SIZE,
+	[STATS_BUF_UART_TO_CDC] = PROG_UART_BUF_SIZE,
+	[STATS_BUF_CDC_RX] = CFG_TUD_CDC_RX_BUFSIZE,
+	[STATS_BUF_CDC_TX] = CFG_TUD_CDC_TX_BUFSIZE,
+	[STATS_BUF_VENDOR_RX] = CFG_TUD_VENDOR_RX_BUFSIZE,
+	[STATS_BUF_VENDOR_TX] = CFG_TUD_VENDOR_TX_BUFSIZE,
+	[STATS_BUF_LOG] = LOGGER_RING_SIZE,
+};
+
+static TaskStatus_t s_task_status[BRIDGE_STATS_MAX_TASKS];
+static uint8_t s_snapshot[BRIDGE_STATS_SNAPSHOT_MAX];
+
+const uint8_t *bridge_stats_snapshot(size_t *len, bool reset)
+{
+	uint32_t run_time_total = 0;
+	const UBaseType_t task_count = uxTaskGetSystemState(s_task_status, BRIDGE_STATS_MAX_TASKS, &run_time_total);
+
+	bridge_stats_header_t header =
+	{
+		.magic = BRIDGE_STATS_MAGIC,
+		.version = BRIDGE_STATS_VERSION,
+		.header_size = sizeof(bridge_stats_header_t),
+		.buffer_count = STATS_BUF_COUNT,
+		.task_count = task_count,
+		.time_us = time_us_64(),
+		.run_time_total = run_time_total,
+	};
+	uint8_t *p = s_snapshot;
+	memcpy(p, &header, sizeof(header));
+	p += sizeof(header);
+
+	for (uint32_t n = 0; n < STATS_BUF_COUNT; n++)
+	{
+		const bridge_stats_buffer_t buffer = { .capacity = s_capacity[n], .high_water = bridge_stats_high_water[n] };
+		memcpy(p, &buffer, sizeof(buffer));
+		p += sizeof(buffer);
+		if (reset)
+			bridge_stats_high_water[n] = 0;
+	}
+
+	for (UBaseType_t n = 0; n < task_count; n++)
+	{
+		const TaskStatus_t *status = &s_task_status[n];
+		bridge_stats_task_t task =
+		{
+			.run_time = status->ulRunTimeCounter,
+			.stack_free_min = status->usStackHighWaterMark * sizeof(StackType_t),
+			.priority = status->uxCurrentPriority,
+			.state = status->eCurrentState,
+		};
+		// Not NUL terminated when the name takes all BRIDGE_STATS_NAME_LEN bytes
+		memcpy(task.name, status->pcTaskName, strnlen(status->pcTaskName, sizeof(task.name)));
+		memcpy(p, &task, sizeof(task));
+		p += sizeof(task);
+	}
+
+	*len = p - s_snapshot;
+	return s_snapshot;
+}
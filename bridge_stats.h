@@ -0,0 +1,97 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Run time statistics, read with the VEND_STATS vendor control request (see tools/stats_decode.py).
+ *
+ * The snapshot is little endian:
+ *   bridge_stats_header_t
+ *   bridge_stats_buffer_t[buffer_count], in bridge_stats_buf_t order
+ *   bridge_stats_task_t[task_count]
+ * Task run times are microseconds of the 1 MHz timer (FreeRTOS run time stats). They are 32 bit counters
+ * and wrap after about 71 minutes, the decoder works with the difference between two snapshots.
+ */
+
+#define BRIDGE_STATS_MAGIC			0x53545342	// "BSTS"
+#define BRIDGE_STATS_VERSION		2
+#define BRIDGE_STATS_MAX_TASKS		24
+#define BRIDGE_STATS_NAME_LEN		16
+
+// Vendor control request (IN) on the JTAG interface, next to VEND_JTAG_* in jtag.c
+#define VEND_STATS					16
+
+// wValue bit of VEND_STATS: clear the high-water marks after the snapshot is taken
+#define BRIDGE_STATS_RESET			(1 << 0)
+
+typedef enum
+{
+	STATS_BUF_USB_SEND,			// usb_send_buf, TDO data waiting for usb_writer_task
+	STATS_BUF_UART_TO_CDC,		// uart_to_cdc_stream_handle
+	STATS_BUF_CDC_RX,			// TinyUSB CDC FIFOs
+	STATS_BUF_CDC_TX,
+	STATS_BUF_VENDOR_RX,		// TinyUSB vendor FIFOs, RX is vendor OUT data waiting for jtag_task
+	STATS_BUF_VENDOR_TX,
+	STATS_BUF_LOG,				// fullest of the logger's rings
+	STATS_BUF_COUNT
+} bridge_stats_buf_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;
+	uint8_t version;
+	uint8_t header_size;
+	uint8_t buffer_count;
+	uint8_t task_count;
+	uint64_t time_us;
+	uint32_t run_time_total;
+} bridge_stats_header_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t capacity;
+	uint32_t high_water;
+} bridge_stats_buffer_t;
+
+typedef struct __attribute__((packed))
+{
+	char name[BRIDGE_STATS_NAME_LEN];
+	uint32_t run_time;
+	uint32_t stack_free_min;	// bytes
+	uint8_t priority;
+	uint8_t state;				// eTaskState
+	uint16_t reserved;
+} bridge_stats_task_t;
+
+#define BRIDGE_STATS_SNAPSHOT_MAX	(sizeof(bridge_stats_header_t) + STATS_BUF_COUNT * sizeof(bridge_stats_buffer_t) + \
+									 BRIDGE_STATS_MAX_TASKS * sizeof(bridge_stats_task_t))
+
+extern volatile uint32_t bridge_stats_high_water[STATS_BUF_COUNT];
+
+// Records the fill level of a buffer. Racy by design: a lost update only costs a sample.
+static inline void bridge_stats_level(bridge_stats_buf_t buf, uint32_t level)
+{
+	if (level > bridge_stats_high_water[buf])
+		bridge_stats_high_water[buf] = level;
+}
+
+// Builds a snapshot into an internal buffer and returns it. Called from the USB task only.
+const uint8_t *bridge_stats_snapshot(size_t *len, bool reset);
@@ -0,0 +1,112 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+// Transaction latency tracer, see bridge_trace.h.
+//
+// Each core writes into its own ring only, with its interrupts masked for the few instructions it takes to
+// claim a slot and fill it. There is no lock between the cores: the dump pauses tracing, waits for a writer
+// that is still filling a slot on the other core and sends the rings as they are.
+
+#include <string.h>
+#include "ubp_config.h"
+#include "pico.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "pico/time.h"
+#include "FreeRTOS.h"
+#include "bridge_trace.h"
+
+#if TRACE_ENABLED
+
+_Static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of two");
+_Static_assert(NUM_CORES == 2, "bridge_trace_header_t has room for two cores");
+_Static_assert(sizeof(bridge_trace_header_t) + NUM_CORES * TRACE_RING_SIZE * sizeof(bridge_trace_event_t) <= 0xFFFF,
+	"the dump has to fit into one control transfer, TRACE_RING_SIZE is too large");
+
+typedef struct
+{
+	bridge_trace_header_t header;
+	bridge_trace_event_t events[NUM_CORES][TRACE_RING_SIZE];
+} bridge_trace_dump_t;
+
+static bridge_trace_dump_t s_trace;
+static volatile bool s_paused;
+static volatile bool s_writing[NUM_CORES];
+static bool s_clear_on_resume;
+
+void __not_in_flash_func(bridge_trace)(bridge_trace_id_t id, uint32_t arg)
+{
+	if (s_paused)
+		return;
+
+	const uint core = get_core_num();
+	const bridge_trace_event_t event =
+	{
+		.time_us = time_us_32(),
+		.id = id,
+		.flags = (core ? TRACE_FLAG_CORE1 : 0) | (portCHECK_IF_IN_ISR() ? TRACE_FLAG_ISR : 0),
+		.arg = arg,
+	};
+
+	// Raised before s_paused is read again, so either this writer sees the pause or the dump sees it writing
+	const uint32_t irq = save_and_disable_interrupts();
+	s_writing[core] = true;
+	__dmb();
+	if (!s_paused)
+	{
+		const uint32_t n = s_trace.header.count[core]++;
+		s_trace.events[core][n & (TRACE_RING_SIZE - 1)] = event;
+	}
+	__dmb();
+	s_writing[core] = false;
+	restore_interrupts(irq);
+}
+
+const uint8_t *bridge_trace_dump(size_t *len, bool clear)
+{
+	s_paused = true;
+	__dmb();
+	// Only a writer on the other core can be caught halfway, this one's run with its interrupts masked
+	for (uint core = 0; core < NUM_CORES; core++)
+	{
+		while (s_writing[core])
+			tight_loop_contents();
+	}
+	__dmb();
+
+	s_trace.header.magic = BRIDGE_TRACE_MAGIC;
+	s_trace.header.version = BRIDGE_TRACE_VERSION;
+	s_trace.header.header_size = sizeof(bridge_trace_header_t);
+	s_trace.header.cores = NUM_CORES;
+	s_trace.header.event_size = sizeof(bridge_trace_event_t);
+	s_trace.header.ring_size = TRACE_RING_SIZE;
+
+	s_clear_on_resume = clear;
+	*len = sizeof(s_trace);
+	return (const uint8_t *) &s_trace;
+}
+
+void bridge_trace_resume(void)
+{
+	if (s_clear_on_resume)
+	{
+		memset(s_trace.header.count, 0, sizeof(s_trace.header.count));
+		s_clear_on_resume = false;
+	}
+	s_paused = false;
+}
+
+#endif
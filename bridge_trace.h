@@ -0,0 +1,103 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "ubp_config.h"
+
+/*
+ * Transaction latency tracer (TRACE_ENABLED). TRACE() stores a timestamped event into a RAM ring of the
+ * calling core, the oldest events are overwritten. VEND_TRACE reads the rings, tools/trace_latency.py
+ * pairs the events up into JTAG flushes, esptool command round trips and UF2 block writes.
+ *
+ * The dump is little endian: bridge_trace_header_t, then TRACE_RING_SIZE bridge_trace_event_t per core.
+ * count[core] events have been written into the ring of that core so far, the last
+ * MIN(count, TRACE_RING_SIZE) of them are valid, the oldest at index (count - valid) % TRACE_RING_SIZE.
+ * Tracing is paused while a dump is transferred.
+ */
+
+#define BRIDGE_TRACE_MAGIC			0x43525442	// "BTRC"
+#define BRIDGE_TRACE_VERSION		1
+
+// Vendor control request (IN) on the JTAG interface, next to VEND_JTAG_* in jtag.c
+#define VEND_TRACE					17
+
+// wValue bit of VEND_TRACE: empty the rings once the dump has been sent
+#define BRIDGE_TRACE_CLEAR			(1 << 0)
+
+#define TRACE_FLAG_CORE1			(1 << 0)
+#define TRACE_FLAG_ISR				(1 << 1)
+
+// The numbers are part of the dump format, only ever append
+typedef enum
+{
+	TRACE_VENDOR_RX = 1,		// arg: bytes read from the vendor OUT FIFO
+	TRACE_JTAG_DECODE_START,	// arg: command bytes taken from the vendor FIFO
+	TRACE_JTAG_DECODE_END,
+	TRACE_JTAG_DMA_START,		// arg: TDO words
+	TRACE_JTAG_DMA_DONE,
+	TRACE_JTAG_FLUSH,
+	TRACE_USB_SEND_QUEUED,		// arg: bytes put into usb_send_buf
+	TRACE_VENDOR_TX_DONE,		// arg: bytes the host took
+	TRACE_CDC_RX,				// arg: bytes read from the CDC OUT FIFO
+	TRACE_UART_TX_START,		// arg: bytes
+	TRACE_UART_TX_DONE,
+	TRACE_UART_RX,				// arg: bytes
+	TRACE_CDC_TX,				// arg: bytes written to the CDC IN FIFO
+	TRACE_CDC_TX_DONE,
+	TRACE_MSC_WRITE,			// arg: LBA (low 16 bits)
+	TRACE_MSC_WRITE_DONE,
+	TRACE_UF2_BLOCK_START,		// arg: block number (low 16 bits)
+	TRACE_UF2_BLOCK_DONE,
+} bridge_trace_id_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t time_us;
+	uint8_t id;
+	uint8_t flags;
+	uint16_t arg;
+} bridge_trace_event_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;
+	uint8_t version;
+	uint8_t header_size;
+	uint8_t cores;
+	uint8_t event_size;
+	uint32_t ring_size;
+	uint32_t count[2];
+} bridge_trace_header_t;
+
+#if TRACE_ENABLED
+
+#define TRACE(id, arg)				bridge_trace((id), (arg))
+
+void bridge_trace(bridge_trace_id_t id, uint32_t arg);
+
+// Pauses tracing and returns the dump, which stays valid until bridge_trace_resume(). Called from the USB task.
+const uint8_t *bridge_trace_dump(size_t *len, bool clear);
+void bridge_trace_resume(void);
+
+#else
+
+#define TRACE(id, arg)				do { } while (0)
+
+#endif
@@ -118,6 +118,22 @@ esp_loader_error_t esp_loader_connect(esp_loader_connect_args_t *connect_args);
  */
 target_chip_t esp_loader_get_target(void);
 
+/**
+ * @brief   Reads the factory MAC address of the attached target from its eFuses.
+ *
+ * @warning This function can only be called after connection with target
+ *          has been successfully established by calling esp_loader_connect().
+ *
+ * @param mac[out]         Six bytes, most significant byte first.
+ *
+ * @return
+ *     - ESP_LOADER_SUCCESS Success
+ *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+ *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+ *     - ESP_LOADER_ERROR_UNSUPPORTED_FUNC Unsupported on the target
+ */
+esp_loader_error_t esp_loader_read_mac(uint8_t *mac);
+
 /**
  * @brief Initiates flash operation
  *
@@ -146,6 +162,10 @@ esp_loader_error_t esp_loader_flash_start(uint32_t offset, uint32_t image_size,
  *        remaining bytes of payload buffer will be padded with 0xff.
  *        Therefore, size of payload buffer has to be equal or greater than block_size.
  *
+ * @note  A block that fails with a checksum error or a timeout is resent a few times with
+ *        the same sequence number before the error is returned. The call can be repeated
+ *        with the same block after an error, e.g. at a lower baud rate.
+ *
  * @return
  *     - ESP_LOADER_SUCCESS Success
  *     - ESP_LOADER_ERROR_TIMEOUT Timeout
@@ -165,6 +185,76 @@ esp_loader_error_t esp_loader_flash_write(void *payload, uint32_t size);
  */
 esp_loader_error_t esp_loader_flash_finish(bool reboot);
 
+/**
+ * @brief Initiates a load of one segment into target's RAM.
+ *
+ * @param offset[in]       RAM address the segment is loaded to.
+ * @param size[in]         Size of the segment.
+ * @param block_size[in]   Size of the blocks passed to esp_loader_mem_write, only the last one may be shorter.
+ *
+ * @return
+ *     - ESP_LOADER_SUCCESS Success
+ *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+ *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+ */
+esp_loader_error_t esp_loader_mem_start(uint32_t offset, uint32_t size, uint32_t block_size);
+
+/**
+ * @brief Writes one block of the segment started by esp_loader_mem_start.
+ *
+ * @param payload[in]      Data to be written to target's RAM.
+ * @param size[in]         Size of payload in bytes, not padded.
+ *
+ * @return
+ *     - ESP_LOADER_SUCCESS Success
+ *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+ *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+ */
+esp_loader_error_t esp_loader_mem_write(const void *payload, uint32_t size);
+
+/**
+ * @brief Ends a RAM load and starts the loaded code.
+ *
+ * @note  The ROM may jump to entrypoint without answering, a timeout is treated as success then.
+ *
+ * @param entrypoint[in]   Address to jump to, 0 stays in the loader.
+ *
+ * @return
+ *     - ESP_LOADER_SUCCESS Success
+ *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+ *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+ */
+esp_loader_error_t esp_loader_mem_finish(uint32_t entrypoint);
+
+/**
+ * @brief Reads target's flash.
+ *
+ * @note  Uses the ROM loader's READ_FLASH_SLOW command, 64 bytes per command.
+ *
+ * @param address[in]      Flash address to read from.
+ * @param dest[out]        Buffer of at least size bytes.
+ * @param size[in]         Number of bytes to read.
+ *
+ * @return
+ *     - ESP_LOADER_SUCCESS Success
+ *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+ *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+ */
+esp_loader_error_t esp_loader_flash_read(uint32_t address, uint8_t *dest, uint32_t size);
+
+/**
+ * @brief Detects the size of target's flash from its JEDEC ID.
+ *
+ * @param flash_size[out]  Flash size in bytes.
+ *
+ * @return
+ *     - ESP_LOADER_SUCCESS Success
+ *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+ *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+ *     - ESP_LOADER_ERROR_UNSUPPORTED_CHIP Unknown flash size ID
+ */
+esp_loader_error_t esp_loader_flash_detect_size(uint32_t *flash_size);
+
 /**
  * @brief Writes register.
  *
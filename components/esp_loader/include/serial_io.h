@@ -22,6 +22,14 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Marks a function of the FLASH_DATA path. A port that runs from cached flash can
+ *        define it to place these functions in RAM, e.g. with a section attribute.
+ */
+#ifndef LOADER_RAM_FUNC
+#define LOADER_RAM_FUNC(func) func
+#endif
+
 /**
  * @brief Changes baud rate of serial peripheral.
  */
@@ -100,6 +108,37 @@ void loader_port_reset_target(void);
  */
 void loader_port_debug_print(const char *str);
 
+/**
+ * @brief Returns bit mask of targets that take part in the current session.
+ *
+ * @note  Ports driving a single target do not need to define this function,
+ *        weak implementation returning 1 (target 0 only) is used, otherwise.
+ *
+ * @return   Bit mask of active targets.
+ */
+uint32_t loader_port_active_targets(void);
+
+/**
+ * @brief Selects the target subsequent loader_port_serial_read calls read from.
+ *        Writes always go to all active targets.
+ *
+ * @param target[in]   Target index.
+ *
+ * @note  Empty weak function is used, otherwise.
+ */
+void loader_port_select_target(uint32_t target);
+
+/**
+ * @brief Removes target from the set of active targets after it failed a command
+ *        the other targets completed.
+ *
+ * @param target[in]   Target index.
+ * @param error[in]    Error the target failed with.
+ *
+ * @note  Empty weak function is used, otherwise.
+ */
+void loader_port_drop_target(uint32_t target, esp_loader_error_t error);
+
 #ifdef __cplusplus
 }
 #endif
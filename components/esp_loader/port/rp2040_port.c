@@ -65,32 +65,106 @@ static void serial_debug_print(const uint8_t *data, uint16_t size, bool write) {
 
 static absolute_time_t s_time_end;
 
-static loader_rp2040_config_t loader_config;
+static loader_rp2040_config_t loader_config[LOADER_PORT_RP2040_MAX_TARGETS];
+static esp_loader_error_t s_target_status[LOADER_PORT_RP2040_MAX_TARGETS];
+static uint32_t s_target_count;
+static uint32_t s_active_targets;
+static uint32_t s_selected_target;
+
+#define FOR_EACH_ACTIVE_TARGET(t) \
+	for (uint32_t t = 0; t < s_target_count; t++) \
+		if (s_active_targets & (1u << t))
 
 esp_loader_error_t loader_port_rp2040_init(const loader_rp2040_config_t *config)
 {
-	memcpy(&loader_config, config, sizeof(loader_config));
+	memcpy(&loader_config[0], config, sizeof(loader_config[0]));
+	s_target_count = 1;
+	s_active_targets = 1;
+	s_selected_target = 0;
+	s_target_status[0] = ESP_LOADER_SUCCESS;
+
+	return ESP_LOADER_SUCCESS;
+}
+
+esp_loader_error_t loader_port_rp2040_add_target(const loader_rp2040_config_t *config, uint32_t *target)
+{
+	if (s_target_count >= LOADER_PORT_RP2040_MAX_TARGETS)
+		return ESP_LOADER_ERROR_FAIL;
+
+	memcpy(&loader_config[s_target_count], config, sizeof(loader_config[0]));
+	s_target_status[s_target_count] = ESP_LOADER_SUCCESS;
+	*target = s_target_count++;
 
 	return ESP_LOADER_SUCCESS;
 }
 
+void loader_port_rp2040_set_targets(uint32_t mask)
+{
+	s_active_targets = mask & ((1u << s_target_count) - 1);
+	s_selected_target = 0;
+
+	for (uint32_t t = 0; t < s_target_count; t++)
+		s_target_status[t] = ESP_LOADER_SUCCESS;
+}
+
+uint32_t loader_port_rp2040_target_count(void)
+{
+	return s_target_count;
+}
+
+esp_loader_error_t loader_port_rp2040_target_status(uint32_t target)
+{
+	return target < s_target_count ? s_target_status[target] : ESP_LOADER_ERROR_INVALID_PARAM;
+}
+
 void loader_port_esp32_deinit(void)
 {}
 
 
-esp_loader_error_t loader_port_serial_write(const uint8_t *data, uint16_t size, uint32_t timeout)
+uint32_t loader_port_active_targets(void)
+{
+	return s_active_targets;
+}
+
+
+void loader_port_select_target(uint32_t target)
+{
+	s_selected_target = target;
+}
+
+
+void loader_port_drop_target(uint32_t target, esp_loader_error_t error)
+{
+	ESP_LOGW("LOADER", "target %u dropped, error %d", target, error);
+	s_active_targets &= ~(1u << target);
+	s_target_status[target] = error;
+}
+
+
+esp_loader_error_t LOADER_RAM_FUNC(loader_port_serial_write)(const uint8_t *data, uint16_t size, uint32_t timeout)
 {
 	serial_debug_print(data, size, true);
 
-	if (loader_config.write_uart(data, size, timeout) != size)
-		return ESP_LOADER_ERROR_FAIL;
+	// All targets get the same bytes from the same buffer, a target that cannot keep up
+	// is dropped instead of holding back the others.
+	FOR_EACH_ACTIVE_TARGET(t)
+	{
+		if (loader_config[t].write_uart(loader_config[t].ctx, data, size, timeout) != size)
+		{
+			if (s_active_targets == (1u << t))
+				return ESP_LOADER_ERROR_FAIL;
+			loader_port_drop_target(t, ESP_LOADER_ERROR_FAIL);
+		}
+	}
+
 	return ESP_LOADER_SUCCESS;
 }
 
 
-esp_loader_error_t loader_port_serial_read(uint8_t *data, uint16_t size, uint32_t timeout)
+esp_loader_error_t LOADER_RAM_FUNC(loader_port_serial_read)(uint8_t *data, uint16_t size, uint32_t timeout)
 {
-	int read = loader_config.read_uart(data, size, timeout);
+	loader_rp2040_config_t *config = &loader_config[s_selected_target];
+	int read = config->read_uart(config->ctx, data, size, timeout);
 
 	serial_debug_print(data, read, false);
 
@@ -113,18 +187,22 @@ esp_loader_error_t loader_port_serial_read(uint8_t *data, uint16_t size, uint32_
 // assert reset pin for 50 milliseconds.
 void loader_port_enter_bootloader(void)
 {
-	loader_config.set_boot_pin(false);
+	FOR_EACH_ACTIVE_TARGET(t)
+		loader_config[t].set_boot_pin(loader_config[t].ctx, false);
 	loader_port_reset_target();
 	loader_port_delay_ms(50);
-	loader_config.set_boot_pin(true);
+	FOR_EACH_ACTIVE_TARGET(t)
+		loader_config[t].set_boot_pin(loader_config[t].ctx, true);
 }
 
 
 void loader_port_reset_target(void)
 {
-	loader_config.set_rst_pin(false);
+	FOR_EACH_ACTIVE_TARGET(t)
+		loader_config[t].set_rst_pin(loader_config[t].ctx, false);
 	loader_port_delay_ms(50);
-	loader_config.set_rst_pin(true);
+	FOR_EACH_ACTIVE_TARGET(t)
+		loader_config[t].set_rst_pin(loader_config[t].ctx, true);
 }
 
 
@@ -154,6 +232,10 @@ void loader_port_debug_print(const char *str)
 
 esp_loader_error_t loader_port_change_baudrate(uint32_t baudrate)
 {
-	uint32_t actual_baud_rate = loader_config.set_baud_rate(baudrate);
-	return actual_baud_rate > 0 ? ESP_LOADER_SUCCESS : ESP_LOADER_ERROR_FAIL;
+	FOR_EACH_ACTIVE_TARGET(t)
+	{
+		if (loader_config[t].set_baud_rate(loader_config[t].ctx, baudrate) == 0)
+			return ESP_LOADER_ERROR_FAIL;
+	}
+	return ESP_LOADER_SUCCESS;
 }
\ No newline at end of file
@@ -19,10 +19,13 @@
 #include "FreeRTOS.h"
 #include "queue.h"
 
-typedef void (*loader_set_pin_level_t)(bool level);
-typedef int32_t (*loader_uart_write_t)(const uint8_t* buf, uint32_t len, uint32_t timeout_ms);
-typedef int32_t (*loader_uart_read_t)(uint8_t* buf, uint32_t len, uint32_t timeout_ms);
-typedef uint32_t (*loader_uart_set_baudrate_t)(uint32_t baud_rate);
+// Maximum number of targets a single session can drive in parallel (see loader_port_rp2040_add_target)
+#define LOADER_PORT_RP2040_MAX_TARGETS 8
+
+typedef void (*loader_set_pin_level_t)(void *ctx, bool level);
+typedef int32_t (*loader_uart_write_t)(void *ctx, const uint8_t* buf, uint32_t len, uint32_t timeout_ms);
+typedef int32_t (*loader_uart_read_t)(void *ctx, uint8_t* buf, uint32_t len, uint32_t timeout_ms);
+typedef uint32_t (*loader_uart_set_baudrate_t)(void *ctx, uint32_t baud_rate);
 
 typedef struct
 {
@@ -31,6 +34,7 @@ typedef struct
 	loader_uart_read_t read_uart;
 	loader_uart_write_t write_uart;
 	loader_uart_set_baudrate_t set_baud_rate;
+	void *ctx;                  /*!< Passed to every callback above */
 } loader_rp2040_config_t;
 
 /**
@@ -44,7 +48,38 @@ typedef struct
  */
 esp_loader_error_t loader_port_rp2040_init(const loader_rp2040_config_t *config);
 
+/**
+ * @brief Registers an additional target. Commands are sent to all active targets at once,
+ *        responses are collected from each of them.
+ *
+ * @param config[in]    Serial interface of the target.
+ * @param target[out]   Index assigned to the target.
+ *
+ * @return
+ *     - ESP_LOADER_SUCCESS Success
+ *     - ESP_LOADER_ERROR_FAIL No free target slot
+ */
+esp_loader_error_t loader_port_rp2040_add_target(const loader_rp2040_config_t *config, uint32_t *target);
+
+/**
+ * @brief Sets the targets taking part in the next session and clears their status.
+ *
+ * @param mask[in]   Bit mask of target indexes, bits of unregistered targets are ignored.
+ */
+void loader_port_rp2040_set_targets(uint32_t mask);
+
+/**
+ * @brief Returns number of registered targets.
+ */
+uint32_t loader_port_rp2040_target_count(void);
+
+/**
+ * @brief Returns the error a target was dropped from the session with,
+ *        ESP_LOADER_SUCCESS if it is still active.
+ */
+esp_loader_error_t loader_port_rp2040_target_status(uint32_t target);
+
 /**
  * @brief Deinitialize serial interface.
  */
-void loader_port_rp2040_deinit(void);
\ No newline at end of file
+void loader_port_rp2040_deinit(void);
@@ -31,4 +31,5 @@ typedef struct
 
 esp_loader_error_t loader_detect_chip(target_chip_t *target, const target_registers_t **regs);
 esp_loader_error_t loader_read_spi_config(target_chip_t target_chip, uint32_t *spi_config);
+esp_loader_error_t loader_read_mac(target_chip_t target_chip, uint8_t *mac);
 bool encryption_in_begin_flash_cmd(target_chip_t target);
\ No newline at end of file
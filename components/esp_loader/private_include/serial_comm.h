@@ -27,6 +27,11 @@ esp_loader_error_t loader_flash_begin_cmd(uint32_t offset, uint32_t erase_size,
 
 esp_loader_error_t loader_flash_data_cmd(const uint8_t *data, uint32_t size);
 
+void loader_resync(void);
+
+// The error code the target failed the last command with, RESPONSE_OK if it didn't report one
+uint8_t loader_rom_error(void);
+
 esp_loader_error_t loader_flash_end_cmd(bool stay_in_loader);
 
 esp_loader_error_t loader_write_reg_cmd(uint32_t address, uint32_t value, uint32_t mask, uint32_t delay_us);
@@ -43,6 +48,14 @@ esp_loader_error_t loader_md5_cmd(uint32_t address, uint32_t size, uint8_t *md5_
 
 esp_loader_error_t loader_spi_parameters(uint32_t total_size);
 
+esp_loader_error_t loader_mem_begin_cmd(uint32_t offset, uint32_t size, uint32_t blocks_to_write, uint32_t block_size);
+
+esp_loader_error_t loader_mem_data_cmd(const uint8_t *data, uint32_t size);
+
+esp_loader_error_t loader_mem_end_cmd(uint32_t entrypoint);
+
+esp_loader_error_t loader_read_flash_slow_cmd(uint32_t address, uint32_t size, uint8_t *data_out);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -30,6 +30,12 @@ extern "C" {
 
 #define MD5_SIZE 32
 
+// The ROM loader returns at most this many bytes per READ_FLASH_SLOW command
+#define READ_FLASH_SLOW_SIZE 64
+
+// Largest response any command waits for, used to size scratch space for gang targets.
+#define MAX_RESPONSE_SIZE 128
+
 typedef enum __attribute__((packed))
 {
 	FLASH_BEGIN = 0x02,
@@ -44,6 +50,7 @@ typedef enum __attribute__((packed))
 
 	SPI_SET_PARAMS   = 0x0b,
 	SPI_ATTACH       = 0x0d,
+	READ_FLASH_SLOW  = 0x0e,
 	CHANGE_BAUDRATE  = 0x0f,
 	FLASH_DEFL_BEGIN = 0x10,
 	FLASH_DEFL_DATA  = 0x11,
@@ -174,6 +181,20 @@ typedef struct __attribute__((packed))
 	response_status_t status;
 } rom_md5_response_t;
 
+typedef struct __attribute__((packed))
+{
+	command_common_t common;
+	uint32_t address;
+	uint32_t size;
+} read_flash_slow_command_t;
+
+typedef struct __attribute__((packed))
+{
+	common_response_t common;
+	uint8_t data[READ_FLASH_SLOW_SIZE];
+	response_status_t status;
+} read_flash_slow_response_t;
+
 typedef struct __attribute__((packed))
 {
 	command_common_t common;
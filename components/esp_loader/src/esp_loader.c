@@ -33,6 +33,8 @@
 static const uint32_t DEFAULT_TIMEOUT = 1000;
 static const uint32_t DEFAULT_FLASH_TIMEOUT = 3000;        // timeout for most flash operations
 static const uint32_t ERASE_REGION_TIMEOUT_PER_MB = 10000; // timeout (per megabyte) for erasing a region
+static const uint32_t MEM_END_ROM_TIMEOUT = 200;
+static const uint32_t FLASH_WRITE_ATTEMPTS = 4;            // tries per FLASH_DATA block before giving up
 static const uint8_t PADDING_PATTERN = 0xFF;
 
 typedef enum {
@@ -129,6 +131,11 @@ target_chip_t esp_loader_get_target(void)
 	return s_target;
 }
 
+esp_loader_error_t esp_loader_read_mac(uint8_t *mac)
+{
+	return loader_read_mac(s_target, mac);
+}
+
 static esp_loader_error_t spi_set_data_lengths(size_t mosi_bits, size_t miso_bits)
 {
 	if (mosi_bits > 0)
@@ -253,6 +260,35 @@ static esp_loader_error_t detect_flash_size(size_t *flash_size)
 	return ESP_LOADER_SUCCESS;
 }
 
+esp_loader_error_t esp_loader_flash_detect_size(uint32_t *flash_size)
+{
+	size_t size = 0;
+
+	RETURN_ON_ERROR( detect_flash_size(&size) );
+	*flash_size = size;
+
+	return ESP_LOADER_SUCCESS;
+}
+
+
+esp_loader_error_t esp_loader_flash_read(uint32_t address, uint8_t *dest, uint32_t size)
+{
+	while (size > 0)
+	{
+		uint32_t chunk = MIN(size, READ_FLASH_SLOW_SIZE);
+
+		loader_port_start_timer(DEFAULT_TIMEOUT);
+		RETURN_ON_ERROR( loader_read_flash_slow_cmd(address, chunk, dest) );
+
+		address += chunk;
+		dest += chunk;
+		size -= chunk;
+	}
+
+	return ESP_LOADER_SUCCESS;
+}
+
+
 esp_loader_error_t esp_loader_flash_start(uint32_t offset, uint32_t image_size, uint32_t block_size)
 {
 	uint32_t blocks_to_write = (image_size + block_size - 1) / block_size;
@@ -294,11 +330,31 @@ esp_loader_error_t esp_loader_flash_write(void *payload, uint32_t size)
 		data[padding_index++] = PADDING_PATTERN;
 	}
 
-	md5_update(payload, (size + 3) & ~3);
+	esp_loader_error_t err;
+	for (uint32_t attempt = 1; ; attempt++)
+	{
+		loader_port_start_timer(DEFAULT_TIMEOUT);
+		err = loader_flash_data_cmd(data, s_flash_write_size);
 
-	loader_port_start_timer(DEFAULT_TIMEOUT);
+		// A checksum error or a lost response doesn't break the session, the block is resent.
+		// Anything else the target reports, a failed flash write say, would only fail again.
+		const bool resend = err == ESP_LOADER_ERROR_TIMEOUT ||
+		                    (err == ESP_LOADER_ERROR_INVALID_RESPONSE && loader_rom_error() == INVALID_CRC);
+		if (err == ESP_LOADER_SUCCESS || attempt == FLASH_WRITE_ATTEMPTS || !resend)
+		{
+			break;
+		}
 
-	return loader_flash_data_cmd(data, s_flash_write_size);
+		loader_port_debug_print("Resending FLASH_DATA block\n");
+		loader_resync();
+	}
+
+	if (err == ESP_LOADER_SUCCESS)
+	{
+		md5_update(payload, (size + 3) & ~3);
+	}
+
+	return err;
 }
 
 
@@ -310,6 +366,40 @@ esp_loader_error_t esp_loader_flash_finish(bool reboot)
 }
 
 
+esp_loader_error_t esp_loader_mem_start(uint32_t offset, uint32_t size, uint32_t block_size)
+{
+	uint32_t blocks_to_write = (size + block_size - 1) / block_size;
+
+	loader_port_start_timer(DEFAULT_TIMEOUT);
+
+	return loader_mem_begin_cmd(offset, size, blocks_to_write, block_size);
+}
+
+
+esp_loader_error_t esp_loader_mem_write(const void *payload, uint32_t size)
+{
+	loader_port_start_timer(DEFAULT_TIMEOUT);
+
+	return loader_mem_data_cmd((const uint8_t *)payload, size);
+}
+
+
+esp_loader_error_t esp_loader_mem_finish(uint32_t entrypoint)
+{
+	loader_port_start_timer(MEM_END_ROM_TIMEOUT);
+
+	esp_loader_error_t err = loader_mem_end_cmd(entrypoint);
+
+	// The ROM may jump to the entry point before its response is out
+	if (err == ESP_LOADER_ERROR_TIMEOUT && entrypoint != 0)
+	{
+		return ESP_LOADER_SUCCESS;
+	}
+
+	return err;
+}
+
+
 esp_loader_error_t esp_loader_read_register(uint32_t address, uint32_t *reg_value)
 {
 	loader_port_start_timer(DEFAULT_TIMEOUT);
@@ -24,6 +24,7 @@ typedef struct
 {
 	target_registers_t regs;
 	uint32_t efuse_base;
+	uint32_t mac_efuse_offset;	// two words, low word first, 0 if not supported
 	uint32_t chip_magic_value[MAX_MAGIC_VALUES];
 	read_spi_config_t read_spi_config;
 	bool encryption_in_begin_flash_cmd;
@@ -54,6 +55,7 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
 			.miso_dlen  = 0,
 		},
 		.efuse_base = 0,         // Not used
+		.mac_efuse_offset = 0,   // Not supported
 		.chip_magic_value  = { 0xfff0c101, 0 },
 		.read_spi_config = NULL, // Not used
 	},
@@ -70,6 +72,7 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
 			.miso_dlen = ESP32_SPI_REG_BASE + 0x2c,
 		},
 		.efuse_base = 0x3ff5A000,
+		.mac_efuse_offset = 0x04,
 		.chip_magic_value  = { 0x00f01d83, 0 },
 		.read_spi_config = spi_config_esp32,
 	},
@@ -86,6 +89,7 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
 			.miso_dlen = ESP32S2_SPI_REG_BASE + 0x28,
 		},
 		.efuse_base = 0x3f41A000,
+		.mac_efuse_offset = 0x44,
 		.chip_magic_value  = { 0x000007c6, 0 },
 		.read_spi_config = spi_config_esp32xx,
 	},
@@ -102,6 +106,7 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
 			.miso_dlen = ESP32xx_SPI_REG_BASE + 0x28,
 		},
 		.efuse_base = 0x60008800,
+		.mac_efuse_offset = 0x44,
 		.chip_magic_value = { 0x6921506f, 0x1b31506f },
 		.read_spi_config = spi_config_esp32xx,
 	},
@@ -118,6 +123,7 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
 			.miso_dlen = ESP32xx_SPI_REG_BASE + 0x28,
 		},
 		.efuse_base = 0x60007000,
+		.mac_efuse_offset = 0x44,
 		.chip_magic_value = { 0x00000009, 0 },
 		.read_spi_config = spi_config_esp32xx,
 	},
@@ -134,6 +140,7 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
 			.miso_dlen = ESP32xx_SPI_REG_BASE + 0x28,
 		},
 		.efuse_base = 0x60008800,
+		.mac_efuse_offset = 0x44,
 		.chip_magic_value = { 0x6f51306f, 0 },
 		.read_spi_config = spi_config_esp32xx,
 	},
@@ -149,6 +156,7 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
 			.miso_dlen = ESP32xx_SPI_REG_BASE + 0x28,
 		},
 		.efuse_base = 0x6001A000,
+		.mac_efuse_offset = 0x44,
 		.chip_magic_value = {0xca26cc22, 0x6881b06f}, // ESP32H2-BETA1, ESP32H2-BETA2
 		.read_spi_config = spi_config_esp32xx,
 	},
@@ -186,6 +194,28 @@ esp_loader_error_t loader_read_spi_config(target_chip_t target_chip, uint32_t *s
 	return target->read_spi_config(target->efuse_base, spi_config);
 }
 
+esp_loader_error_t loader_read_mac(target_chip_t target_chip, uint8_t *mac)
+{
+	if (target_chip >= ESP_MAX_CHIP || esp_target[target_chip].mac_efuse_offset == 0)
+	{
+		return ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
+	}
+
+	const esp_target_t *target = &esp_target[target_chip];
+	uint32_t mac0, mac1;
+	RETURN_ON_ERROR( esp_loader_read_register(target->efuse_base + target->mac_efuse_offset, &mac0) );
+	RETURN_ON_ERROR( esp_loader_read_register(target->efuse_base + target->mac_efuse_offset + 4, &mac1) );
+
+	mac[0] = (mac1 >> 8) & 0xff;
+	mac[1] = mac1 & 0xff;
+	mac[2] = (mac0 >> 24) & 0xff;
+	mac[3] = (mac0 >> 16) & 0xff;
+	mac[4] = (mac0 >> 8) & 0xff;
+	mac[5] = mac0 & 0xff;
+
+	return ESP_LOADER_SUCCESS;
+}
+
 static inline uint32_t efuse_word_addr(uint32_t efuse_base, uint32_t n)
 {
 	return efuse_base + (n * 4);
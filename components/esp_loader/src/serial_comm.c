@@ -22,6 +22,10 @@
 #define CMD_SIZE(cmd) ( sizeof(cmd) - sizeof(command_common_t) )
 
 static uint32_t s_sequence_number = 0;
+static uint8_t s_rom_error = RESPONSE_OK;
+
+// Quiet time that ends a resync, see loader_resync()
+static const uint32_t RESYNC_QUIET_MS = 10;
 
 static const uint8_t DELIMITER = 0xC0;
 static const uint8_t C0_REPLACEMENT[2] = {0xDB, 0xDC};
@@ -40,7 +44,7 @@ static inline esp_loader_error_t serial_write(const uint8_t *buff, size_t size)
 	return loader_port_serial_write(buff, size, loader_port_remaining_time());
 }
 
-static uint8_t compute_checksum(const uint8_t *data, uint32_t size)
+static uint8_t LOADER_RAM_FUNC(compute_checksum)(const uint8_t *data, uint32_t size)
 {
 	uint8_t checksum = 0xEF;
 
@@ -52,7 +56,7 @@ static uint8_t compute_checksum(const uint8_t *data, uint32_t size)
 	return checksum;
 }
 
-static esp_loader_error_t SLIP_receive_data(uint8_t *buff, uint32_t size)
+static esp_loader_error_t LOADER_RAM_FUNC(SLIP_receive_data)(uint8_t *buff, uint32_t size)
 {
 	uint8_t ch;
 
@@ -86,7 +90,7 @@ static esp_loader_error_t SLIP_receive_data(uint8_t *buff, uint32_t size)
 }
 
 
-static esp_loader_error_t SLIP_receive_packet(uint8_t *buff, uint32_t size)
+static esp_loader_error_t LOADER_RAM_FUNC(SLIP_receive_packet)(uint8_t *buff, uint32_t size)
 {
 	uint8_t ch;
 
@@ -116,7 +120,7 @@ static esp_loader_error_t SLIP_receive_packet(uint8_t *buff, uint32_t size)
 }
 
 
-static esp_loader_error_t SLIP_send(const uint8_t *data, uint32_t size)
+static esp_loader_error_t LOADER_RAM_FUNC(SLIP_send)(const uint8_t *data, uint32_t size)
 {
 	uint32_t to_write = 0;      // Bytes ready to write as they are
 	uint32_t written = 0;       // Bytes already written
@@ -160,13 +164,13 @@ static esp_loader_error_t SLIP_send(const uint8_t *data, uint32_t size)
 }
 
 
-static esp_loader_error_t SLIP_send_delimiter(void)
+static esp_loader_error_t LOADER_RAM_FUNC(SLIP_send_delimiter)(void)
 {
 	return serial_write(&DELIMITER, 1);
 }
 
 
-static esp_loader_error_t send_cmd(const void *cmd_data, uint32_t size, uint32_t *reg_value)
+static esp_loader_error_t LOADER_RAM_FUNC(send_cmd)(const void *cmd_data, uint32_t size, uint32_t *reg_value)
 {
 	response_t response;
 	command_t command = ((command_common_t *)cmd_data)->command;
@@ -231,7 +235,7 @@ static void log_loader_internal_error(error_code_t error)
 }
 
 
-static esp_loader_error_t check_response(command_t cmd, uint32_t *reg_value, void* resp, uint32_t resp_size)
+static esp_loader_error_t LOADER_RAM_FUNC(receive_response)(command_t cmd, uint32_t *reg_value, void* resp, uint32_t resp_size)
 {
 	esp_loader_error_t err;
 	common_response_t *response = (common_response_t *)resp;
@@ -250,6 +254,7 @@ static esp_loader_error_t check_response(command_t cmd, uint32_t *reg_value, voi
 	if (status->failed)
 	{
 		log_loader_internal_error(status->error);
+		s_rom_error = status->error;
 		return ESP_LOADER_ERROR_INVALID_RESPONSE;
 	}
 
@@ -261,6 +266,77 @@ static esp_loader_error_t check_response(command_t cmd, uint32_t *reg_value, voi
 	return ESP_LOADER_SUCCESS;
 }
 
+
+// Every active target receives the same command, so every one of them has to answer it.
+// Values are taken from the first target that answered, the others are read into scratch
+// space. Targets that fail while at least one other succeeds are dropped from the session,
+// if all of them fail the error is returned and the set of targets is left untouched.
+static esp_loader_error_t LOADER_RAM_FUNC(check_response)(command_t cmd, uint32_t *reg_value, void* resp, uint32_t resp_size)
+{
+	static uint8_t scratch[MAX_RESPONSE_SIZE];
+	uint32_t active = loader_port_active_targets();
+	uint32_t failed = 0;
+	esp_loader_error_t errors[32];
+	esp_loader_error_t first_err = ESP_LOADER_SUCCESS;
+	uint8_t first_rom_error = RESPONSE_OK;
+	bool answered = false;
+
+	s_rom_error = RESPONSE_OK;
+	if (active == 1)
+	{
+		loader_port_select_target(0);
+		return receive_response(cmd, reg_value, resp, resp_size);
+	}
+
+	if (resp_size > sizeof(scratch))
+	{
+		return ESP_LOADER_ERROR_INVALID_PARAM;
+	}
+
+	for (uint32_t target = 0; (active >> target) != 0; target++)
+	{
+		if (!(active & (1u << target)))
+		{
+			continue;
+		}
+
+		loader_port_select_target(target);
+
+		esp_loader_error_t err = answered ? receive_response(cmd, NULL, scratch, resp_size)
+		                                  : receive_response(cmd, reg_value, resp, resp_size);
+		if (err == ESP_LOADER_SUCCESS)
+		{
+			answered = true;
+			continue;
+		}
+
+		failed |= 1u << target;
+		errors[target] = err;
+		if (first_err == ESP_LOADER_SUCCESS)
+		{
+			first_err = err;
+			first_rom_error = s_rom_error;
+		}
+		s_rom_error = RESPONSE_OK;
+	}
+
+	if (!answered)
+	{
+		s_rom_error = first_rom_error;
+		return first_err;
+	}
+
+	for (uint32_t target = 0; (failed >> target) != 0; target++)
+	{
+		if (failed & (1u << target))
+		{
+			loader_port_drop_target(target, errors[target]);
+		}
+	}
+
+	return ESP_LOADER_SUCCESS;
+}
+
 esp_loader_error_t loader_flash_begin_cmd(uint32_t offset,
                                           uint32_t erase_size,
                                           uint32_t block_size,
@@ -289,7 +365,7 @@ esp_loader_error_t loader_flash_begin_cmd(uint32_t offset,
 }
 
 
-esp_loader_error_t loader_flash_data_cmd(const uint8_t *data, uint32_t size)
+esp_loader_error_t LOADER_RAM_FUNC(loader_flash_data_cmd)(const uint8_t *data, uint32_t size)
 {
 	data_command_t data_cmd = {
 		.common = {
@@ -299,10 +375,14 @@ esp_loader_error_t loader_flash_data_cmd(const uint8_t *data, uint32_t size)
 			.checksum = compute_checksum(data, size)
 		},
 		.data_size = size,
-		.sequence_number = s_sequence_number++,
+		.sequence_number = s_sequence_number,
 	};
 
-	return send_cmd_with_data(&data_cmd, sizeof(data_cmd), data, size);
+	// A failed block is sent again with the same sequence number
+	RETURN_ON_ERROR( send_cmd_with_data(&data_cmd, sizeof(data_cmd), data, size) );
+	s_sequence_number++;
+
+	return ESP_LOADER_SUCCESS;
 }
 
 
@@ -322,6 +402,65 @@ esp_loader_error_t loader_flash_end_cmd(bool stay_in_loader)
 }
 
 
+esp_loader_error_t loader_mem_begin_cmd(uint32_t offset,
+                                        uint32_t size,
+                                        uint32_t blocks_to_write,
+                                        uint32_t block_size)
+{
+	// Same layout as FLASH_BEGIN without the encryption field
+	begin_command_t begin_cmd = {
+		.common = {
+			.direction = WRITE_DIRECTION,
+			.command = MEM_BEGIN,
+			.size = CMD_SIZE(begin_cmd) - sizeof(uint32_t),
+			.checksum = 0
+		},
+		.erase_size = size,
+		.packet_count = blocks_to_write,
+		.packet_size = block_size,
+		.offset = offset,
+	};
+
+	s_sequence_number = 0;
+
+	return send_cmd(&begin_cmd, sizeof(begin_cmd) - sizeof(uint32_t), NULL);
+}
+
+
+esp_loader_error_t loader_mem_data_cmd(const uint8_t *data, uint32_t size)
+{
+	data_command_t data_cmd = {
+		.common = {
+			.direction = WRITE_DIRECTION,
+			.command = MEM_DATA,
+			.size = CMD_SIZE(data_cmd) + size,
+			.checksum = compute_checksum(data, size)
+		},
+		.data_size = size,
+		.sequence_number = s_sequence_number++,
+	};
+
+	return send_cmd_with_data(&data_cmd, sizeof(data_cmd), data, size);
+}
+
+
+esp_loader_error_t loader_mem_end_cmd(uint32_t entrypoint)
+{
+	mem_end_command_t end_cmd = {
+		.common = {
+			.direction = WRITE_DIRECTION,
+			.command = MEM_END,
+			.size = CMD_SIZE(end_cmd),
+			.checksum = 0
+		},
+		.stay_in_loader = (entrypoint == 0),
+		.entry_point_address = entrypoint
+	};
+
+	return send_cmd(&end_cmd, sizeof(end_cmd), NULL);
+}
+
+
 esp_loader_error_t loader_sync_cmd(void)
 {
 	sync_command_t sync_cmd = {
@@ -450,5 +589,64 @@ esp_loader_error_t loader_spi_parameters(uint32_t total_size)
 	return send_cmd(&spi_cmd, sizeof(spi_cmd), NULL);
 }
 
+esp_loader_error_t loader_read_flash_slow_cmd(uint32_t address, uint32_t size, uint8_t *data_out)
+{
+	read_flash_slow_command_t read_cmd = {
+		.common = {
+			.direction = WRITE_DIRECTION,
+			.command = READ_FLASH_SLOW,
+			.size = CMD_SIZE(read_cmd),
+			.checksum = 0
+		},
+		.address = address,
+		.size = size,
+	};
+	read_flash_slow_response_t response;
+
+	if (size > READ_FLASH_SLOW_SIZE)
+	{
+		return ESP_LOADER_ERROR_INVALID_PARAM;
+	}
+
+	RETURN_ON_ERROR( SLIP_send_delimiter() );
+	RETURN_ON_ERROR( SLIP_send((const uint8_t *)&read_cmd, sizeof(read_cmd)) );
+	RETURN_ON_ERROR( SLIP_send_delimiter() );
+
+	// The data field is always READ_FLASH_SLOW_SIZE bytes long, whatever the requested size
+	RETURN_ON_ERROR( check_response(READ_FLASH_SLOW, NULL, &response, sizeof(response)) );
+
+	memcpy(data_out, response.data, size);
+
+	return ESP_LOADER_SUCCESS;
+}
+
+// Drops whatever is left of a failed exchange (a late response, half a packet) so the
+// next command doesn't pick it up as its own response.
+void loader_resync(void)
+{
+	uint8_t ch;
+
+	do
+	{
+		loader_port_start_timer(RESYNC_QUIET_MS);
+	} while (serial_read(&ch, 1) == ESP_LOADER_SUCCESS);
+}
+
+uint8_t loader_rom_error(void)
+{
+	return s_rom_error;
+}
+
 __attribute__ ((weak)) void loader_port_debug_print(const char *str)
 {}
+
+__attribute__ ((weak)) uint32_t loader_port_active_targets(void)
+{
+	return 1;
+}
+
+__attribute__ ((weak)) void loader_port_select_target(uint32_t target)
+{}
+
+__attribute__ ((weak)) void loader_port_drop_target(uint32_t target, esp_loader_error_t error)
+{}
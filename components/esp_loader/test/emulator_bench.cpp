@@ -0,0 +1,318 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * End-to-end flashing benchmark against EspRomEmulator. Runs an image through esp_loader directly and
+ * through the bridge's MSC write path (msc.c -> uf2_flash.c -> esp_loader), checks the emulated flash
+ * afterwards and reports throughput in virtual time. Exits with 1 on any mismatch, so it can gate CI.
+ *
+ *   serial_flasher_emulator [--baud N] [--latency-us N] [--size BYTES] [--ber RATE]
+ */
+
+#include "esp_loader.h"
+#include "serial_io.h"
+#include "esp_rom_emulator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// The bridge headers are C11 only
+#define _Static_assert static_assert
+extern "C" {
+#include "uf2_flash.h"
+}
+#undef _Static_assert
+
+using namespace std;
+
+extern "C" int32_t tud_msc_write10_cb(const uint8_t lun, const uint32_t lba, const uint32_t offset, uint8_t *buffer,
+                                      const uint32_t bufsize);
+
+namespace {
+
+const uint32_t FLASH_OFFSET = 0x10000;
+const uint32_t BLOCK_SIZE = 1024;           // esptool's ROM block size
+const uint32_t UF2_PAYLOAD_SIZE = 256;
+const uint32_t UF2_FAMILY_ESP32C3 = 0xd42ba06c;
+const uint32_t UF2_FIRST_LBA = 1000;        // anywhere past the README cluster
+
+struct Options {
+    EmulatorTiming timing;
+    uint32_t size = 1024 * 1024;
+};
+
+struct Run {
+    EspRomEmulator emulator;
+    uint64_t start_us;
+    uint64_t start_commands;
+    chrono::steady_clock::time_point start_wall;
+
+    explicit Run(const EmulatorTiming &timing) : emulator(timing)
+    {
+        emulator.set_bit_error_rate(0);
+        serial_emulator_attach(&emulator);
+        start_us = emulator.now();
+        start_commands = 0;
+        start_wall = chrono::steady_clock::now();
+    }
+
+    void report(const char *name, size_t bytes)
+    {
+        const double seconds = (emulator.now() - start_us) / 1e6;
+        const double wall_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start_wall).count();
+        const EmulatorStats &stats = emulator.stats();
+
+        printf("%-12s %8zu bytes %9.3f s %8.3f MB/s %9.1f cmd/s  corrupted %llu, crc errors %llu  (wall %.1f ms)\n",
+               name, bytes, seconds, bytes / seconds / 1e6, (stats.commands - start_commands) / seconds,
+               (unsigned long long)stats.corrupted_bytes, (unsigned long long)stats.checksum_errors, wall_ms);
+    }
+
+    bool check(const char *name, const vector<uint8_t> &image)
+    {
+        const vector<uint8_t> &flash = emulator.flash();
+        if (!equal(image.begin(), image.end(), flash.begin() + FLASH_OFFSET)) {
+            printf("%s: flash content does not match the image\n", name);
+            return false;
+        }
+        return true;
+    }
+};
+
+vector<uint8_t> make_image(uint32_t size)
+{
+    vector<uint8_t> image(size);
+    uint32_t x = 0x12345678;
+
+    // Compressible enough for the DEFL run to be meaningful, random enough to catch misplaced blocks
+    for (uint32_t i = 0; i < size; i++) {
+        x = x * 1664525 + 1013904223;
+        image[i] = (i & 0x100) ? (x >> 24) : (uint8_t)(i >> 9);
+    }
+    return image;
+}
+
+bool bench_esp_loader(const Options &opt, const vector<uint8_t> &image)
+{
+    Run run(opt.timing);
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+
+    if (esp_loader_connect(&connect_config) != ESP_LOADER_SUCCESS) {
+        printf("esp_loader: connect failed\n");
+        return false;
+    }
+    if (esp_loader_change_baudrate(opt.timing.baudrate) != ESP_LOADER_SUCCESS ||
+            loader_port_change_baudrate(opt.timing.baudrate) != ESP_LOADER_SUCCESS) {
+        printf("esp_loader: cannot change baudrate\n");
+        return false;
+    }
+    if (esp_loader_flash_start(FLASH_OFFSET, image.size(), BLOCK_SIZE) != ESP_LOADER_SUCCESS) {
+        printf("esp_loader: FLASH_BEGIN failed\n");
+        return false;
+    }
+
+    // Only data blocks are retried, so only they see line errors
+    run.emulator.set_bit_error_rate(opt.timing.bit_error_rate);
+    vector<uint8_t> block(BLOCK_SIZE);
+    for (size_t offset = 0; offset < image.size(); offset += BLOCK_SIZE) {
+        const size_t size = min<size_t>(BLOCK_SIZE, image.size() - offset);
+        copy_n(image.begin() + offset, size, block.begin());
+        if (esp_loader_flash_write(block.data(), size) != ESP_LOADER_SUCCESS) {
+            printf("esp_loader: FLASH_DATA failed at %zu\n", offset);
+            return false;
+        }
+    }
+    run.emulator.set_bit_error_rate(0);
+
+    if (esp_loader_flash_verify() != ESP_LOADER_SUCCESS) {
+        printf("esp_loader: MD5 mismatch\n");
+        return false;
+    }
+    esp_loader_flash_finish(false);
+
+    run.report("esp_loader", image.size());
+    return run.check("esp_loader", image);
+}
+
+bool bench_msc(const Options &opt, const vector<uint8_t> &image)
+{
+    Run run(opt.timing);
+    const uint32_t blocks = (image.size() + UF2_PAYLOAD_SIZE - 1) / UF2_PAYLOAD_SIZE;
+
+    uf2_flash_init();
+    for (uint32_t n = 0; n < blocks; n++) {
+        uf2_block_t block = {};
+        block.magic0 = UF2_FIRST_MAGIC;
+        block.magic1 = UF2_SECOND_MAGIC;
+        block.flags = UF2_FLAG_FAMILYID_PRESENT;
+        block.addr = FLASH_OFFSET + n * UF2_PAYLOAD_SIZE;
+        block.payload_size = min<size_t>(UF2_PAYLOAD_SIZE, image.size() - n * UF2_PAYLOAD_SIZE);
+        block.block_no = n;
+        block.blocks = blocks;
+        block.chip_id = UF2_FAMILY_ESP32C3;
+        block.magic3 = UF2_FINAL_MAGIC;
+        memcpy(block.data, &image[n * UF2_PAYLOAD_SIZE], block.payload_size);
+
+        // Connecting and finishing aren't retried, keep them off the noisy line
+        run.emulator.set_bit_error_rate(n > 0 && n + 1 < blocks ? opt.timing.bit_error_rate : 0);
+        if (tud_msc_write10_cb(0, UF2_FIRST_LBA + n, 0, (uint8_t *)&block, UF2_BLOCK_SIZE) != UF2_BLOCK_SIZE) {
+            printf("msc: UF2 block %u rejected\n", n);
+            return false;
+        }
+    }
+
+    run.report("msc", image.size());
+    return run.check("msc", image);
+}
+
+#if HAVE_ZLIB
+// esp_loader has no compressed upload yet, so this drives FLASH_DEFL_* by hand
+bool defl_command(uint8_t command, const vector<uint8_t> &payload, uint8_t checksum)
+{
+    vector<uint8_t> packet = { 0x00, command, (uint8_t)payload.size(), (uint8_t)(payload.size() >> 8),
+                               checksum, 0, 0, 0 };
+    packet.insert(packet.end(), payload.begin(), payload.end());
+
+    vector<uint8_t> encoded = { 0xc0 };
+    for (uint8_t b : packet) {
+        if (b == 0xc0 || b == 0xdb) {
+            encoded.push_back(0xdb);
+            encoded.push_back(b == 0xc0 ? 0xdc : 0xdd);
+        } else {
+            encoded.push_back(b);
+        }
+    }
+    encoded.push_back(0xc0);
+    loader_port_serial_write(encoded.data(), encoded.size(), 100);
+
+    // Delimiter, direction, command, size, value, failed, error, two bytes of padding, delimiter.
+    // None of them needs escaping for these commands.
+    uint8_t response[14];
+    return loader_port_serial_read(response, sizeof(response), 3000) == ESP_LOADER_SUCCESS &&
+           response[2] == command && response[9] == 0;
+}
+
+vector<uint8_t> words(initializer_list<uint32_t> values)
+{
+    vector<uint8_t> out;
+    for (uint32_t v : values) {
+        for (int i = 0; i < 4; i++) {
+            out.push_back(v >> (8 * i));
+        }
+    }
+    return out;
+}
+
+bool bench_defl(const Options &opt, const vector<uint8_t> &image)
+{
+    Run run(opt.timing);
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+
+    if (esp_loader_connect(&connect_config) != ESP_LOADER_SUCCESS ||
+            esp_loader_change_baudrate(opt.timing.baudrate) != ESP_LOADER_SUCCESS ||
+            loader_port_change_baudrate(opt.timing.baudrate) != ESP_LOADER_SUCCESS) {
+        printf("defl: connect failed\n");
+        return false;
+    }
+
+    uLongf compressed_size = compressBound(image.size());
+    vector<uint8_t> compressed(compressed_size);
+    compress2(compressed.data(), &compressed_size, image.data(), image.size(), 9);
+    compressed.resize(compressed_size);
+
+    const uint32_t blocks = (compressed.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (!defl_command(0x10, words({ (uint32_t)image.size(), blocks, BLOCK_SIZE, FLASH_OFFSET }), 0)) {
+        printf("defl: FLASH_DEFL_BEGIN failed\n");
+        return false;
+    }
+
+    for (uint32_t n = 0; n < blocks; n++) {
+        const size_t offset = n * BLOCK_SIZE;
+        const size_t size = min<size_t>(BLOCK_SIZE, compressed.size() - offset);
+        vector<uint8_t> payload = words({ (uint32_t)size, n, 0, 0 });
+        payload.insert(payload.end(), compressed.begin() + offset, compressed.begin() + offset + size);
+
+        uint8_t checksum = 0xef;
+        for (size_t i = 0; i < size; i++) {
+            checksum ^= compressed[offset + i];
+        }
+        if (!defl_command(0x11, payload, checksum)) {
+            printf("defl: FLASH_DEFL_DATA %u failed\n", n);
+            return false;
+        }
+    }
+
+    if (!defl_command(0x12, words({ 1 }), 0)) {
+        printf("defl: FLASH_DEFL_END failed\n");
+        return false;
+    }
+
+    run.report("defl", image.size());
+    return run.check("defl", image);
+}
+#endif
+
+void usage(const char *name)
+{
+    printf("usage: %s [--baud N] [--latency-us N] [--size BYTES] [--ber RATE]\n", name);
+    exit(2);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    opt.timing.baudrate = 921600;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 == argc) {
+            usage(argv[0]);
+        }
+        if (!strcmp(argv[i], "--baud")) {
+            opt.timing.baudrate = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--latency-us")) {
+            opt.timing.command_latency_us = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--size")) {
+            opt.size = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--ber")) {
+            opt.timing.bit_error_rate = strtod(argv[++i], nullptr);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (opt.size == 0 || opt.size > EspRomEmulator::FLASH_SIZE - FLASH_OFFSET) {
+        printf("--size must be between 1 and %u\n", EspRomEmulator::FLASH_SIZE - FLASH_OFFSET);
+        return 2;
+    }
+
+    printf("%u baud, %u us command latency, bit error rate %g\n", opt.timing.baudrate,
+           opt.timing.command_latency_us, opt.timing.bit_error_rate);
+
+    const vector<uint8_t> image = make_image(opt.size);
+    bool ok = bench_esp_loader(opt, image);
+    ok = bench_msc(opt, image) && ok;
+#if HAVE_ZLIB
+    ok = bench_defl(opt, image) && ok;
+#endif
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,495 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "esp_rom_emulator.h"
+#include "md5_hash.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+enum : uint8_t {
+    FLASH_BEGIN = 0x02,
+    FLASH_DATA = 0x03,
+    FLASH_END = 0x04,
+    MEM_BEGIN = 0x05,
+    MEM_END = 0x06,
+    MEM_DATA = 0x07,
+    SYNC = 0x08,
+    WRITE_REG = 0x09,
+    READ_REG = 0x0a,
+    SPI_SET_PARAMS = 0x0b,
+    SPI_ATTACH = 0x0d,
+    READ_FLASH_SLOW = 0x0e,
+    CHANGE_BAUDRATE = 0x0f,
+    FLASH_DEFL_BEGIN = 0x10,
+    FLASH_DEFL_DATA = 0x11,
+    FLASH_DEFL_END = 0x12,
+    SPI_FLASH_MD5 = 0x13,
+};
+
+enum : uint8_t {
+    ERR_NONE = 0x00,
+    ERR_INVALID_COMMAND = 0x05,
+    ERR_COMMAND_FAILED = 0x06,
+    ERR_INVALID_CRC = 0x07,
+    ERR_DEFLATE = 0x0b,
+};
+
+// ESP32-C3
+const uint32_t CHIP_DETECT_MAGIC_REG = 0x40001000;
+const uint32_t CHIP_MAGIC = 0x6921506f;
+const uint32_t SPI_BASE = 0x60002000;
+const uint32_t SPI_CMD_REG = SPI_BASE + 0x00;
+const uint32_t SPI_USR2_REG = SPI_BASE + 0x20;
+const uint32_t SPI_W0_REG = SPI_BASE + 0x58;
+const uint32_t SPI_CMD_USR = 1u << 18;
+const uint32_t FLASH_JEDEC_ID = 0x1640ef;       // 4 MB W25Q32
+const uint32_t PAGE_SIZE = 256;
+const uint32_t READ_FLASH_SLOW_SIZE = 64;
+const uint32_t ROM_BAUDRATE = 115200;
+const uint32_t ROM_STATUS_BYTES = 4;            // the ESP32 family ROMs pad the status to a word
+
+inline uint32_t get_u32(const vector<uint8_t> &p, size_t offset)
+{
+    return p[offset] | (p[offset + 1] << 8) | (p[offset + 2] << 16) | ((uint32_t)p[offset + 3] << 24);
+}
+
+}
+
+EspRomEmulator::EspRomEmulator(const EmulatorTiming &timing)
+    : timing_(timing), host_baud_(ROM_BAUDRATE), target_baud_(ROM_BAUDRATE), flash_(FLASH_SIZE, 0xff)
+{
+}
+
+EspRomEmulator::~EspRomEmulator()
+{
+    inflate_end();
+}
+
+void EspRomEmulator::reset(bool download_mode)
+{
+    download_mode_ = download_mode;
+    target_baud_ = ROM_BAUDRATE;
+    tx_.clear();
+    rx_packet_.clear();
+    rx_in_packet_ = false;
+    rx_escape_ = false;
+    regs_.clear();
+    inflate_end();
+}
+
+void EspRomEmulator::host_set_baudrate(uint32_t baudrate)
+{
+    host_baud_ = baudrate;
+}
+
+void EspRomEmulator::host_write(const uint8_t *data, size_t size)
+{
+    const double byte_error = 1.0 - pow(1.0 - timing_.bit_error_rate, 8);
+    uniform_real_distribution<double> chance(0.0, 1.0);
+
+    for (size_t i = 0; i < size; i++) {
+        now_ += byte_time_us(host_baud_);
+        stats_.bytes_to_target++;
+
+        // Bytes sent at the wrong baud rate never make it into a packet
+        if (host_baud_ != target_baud_ || !download_mode_) {
+            continue;
+        }
+
+        uint8_t byte = data[i];
+        if (byte_error > 0 && chance(rng_) < byte_error) {
+            byte ^= 1 << (rng_() % 8);
+            stats_.corrupted_bytes++;
+        }
+        receive_byte(byte);
+    }
+}
+
+bool EspRomEmulator::host_read(uint8_t *byte, uint64_t deadline)
+{
+    while (!tx_.empty()) {
+        const TxByte next = tx_.front();
+        if (next.time > deadline) {
+            break;
+        }
+
+        now_ = max(now_, next.time);
+        tx_.pop_front();
+        if (next.baudrate != host_baud_) {
+            continue;
+        }
+
+        stats_.bytes_from_target++;
+        *byte = next.byte;
+        return true;
+    }
+
+    now_ = max(now_, deadline);
+    return false;
+}
+
+void EspRomEmulator::receive_byte(uint8_t byte)
+{
+    if (byte == 0xc0) {
+        if (rx_in_packet_ && !rx_packet_.empty()) {
+            handle_packet();
+            rx_in_packet_ = false;
+        } else {
+            rx_in_packet_ = true;
+        }
+        rx_packet_.clear();
+        rx_escape_ = false;
+        return;
+    }
+
+    if (!rx_in_packet_) {
+        return;
+    }
+
+    if (rx_escape_) {
+        rx_packet_.push_back(byte == 0xdc ? 0xc0 : byte == 0xdd ? 0xdb : byte);
+        rx_escape_ = false;
+    } else if (byte == 0xdb) {
+        rx_escape_ = true;
+    } else {
+        rx_packet_.push_back(byte);
+    }
+}
+
+void EspRomEmulator::respond(uint8_t command, uint32_t value, const vector<uint8_t> &data, uint8_t error,
+                             uint64_t busy_us)
+{
+    vector<uint8_t> packet = { 0x01, command };
+    const uint16_t size = data.size() + ROM_STATUS_BYTES;
+    packet.push_back(size & 0xff);
+    packet.push_back(size >> 8);
+    for (int i = 0; i < 4; i++) {
+        packet.push_back((value >> (8 * i)) & 0xff);
+    }
+    packet.insert(packet.end(), data.begin(), data.end());
+    packet.push_back(error != ERR_NONE);
+    packet.push_back(error);
+    packet.resize(packet.size() + ROM_STATUS_BYTES - 2, 0);
+
+    vector<uint8_t> encoded = { 0xc0 };
+    for (uint8_t b : packet) {
+        if (b == 0xc0) {
+            encoded.push_back(0xdb);
+            encoded.push_back(0xdc);
+        } else if (b == 0xdb) {
+            encoded.push_back(0xdb);
+            encoded.push_back(0xdd);
+        } else {
+            encoded.push_back(b);
+        }
+    }
+    encoded.push_back(0xc0);
+
+    uint64_t t = max(now_, target_busy_until_) + timing_.command_latency_us + busy_us;
+    for (uint8_t b : encoded) {
+        t += byte_time_us(target_baud_);
+        tx_.push_back({ b, t, target_baud_ });
+    }
+    target_busy_until_ = t;
+}
+
+uint32_t EspRomEmulator::read_reg(uint32_t addr)
+{
+    if (addr == CHIP_DETECT_MAGIC_REG) {
+        return CHIP_MAGIC;
+    }
+
+    auto reg = regs_.find(addr);
+    return reg == regs_.end() ? 0 : reg->second;
+}
+
+void EspRomEmulator::write_reg(uint32_t addr, uint32_t value)
+{
+    // Only the user command the loader uses for reading the JEDEC ID is modelled
+    if (addr == SPI_CMD_REG && (value & SPI_CMD_USR)) {
+        if ((read_reg(SPI_USR2_REG) & 0xff) == 0x9f) {
+            regs_[SPI_W0_REG] = FLASH_JEDEC_ID;
+        }
+        regs_[SPI_CMD_REG] = 0;
+        return;
+    }
+
+    regs_[addr] = value;
+}
+
+uint64_t EspRomEmulator::erase(uint32_t offset, uint32_t size)
+{
+    const uint32_t start = offset & ~(SECTOR_SIZE - 1);
+    const uint32_t end = min<uint64_t>(FLASH_SIZE, ((uint64_t)offset + size + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1));
+    if (start >= end) {
+        return 0;
+    }
+
+    fill(flash_.begin() + start, flash_.begin() + end, 0xff);
+
+    // Like the ROM: sectors up to the first block boundary, whole blocks, then the remaining sectors
+    uint64_t busy_us = 0;
+    for (uint32_t addr = start; addr < end;) {
+        if ((addr % BLOCK_SIZE) == 0 && end - addr >= BLOCK_SIZE) {
+            busy_us += timing_.block_erase_us;
+            addr += BLOCK_SIZE;
+        } else {
+            busy_us += timing_.sector_erase_us;
+            addr += SECTOR_SIZE;
+        }
+    }
+    return busy_us;
+}
+
+uint64_t EspRomEmulator::program(uint32_t offset, const uint8_t *data, uint32_t size)
+{
+    // NOR flash only clears bits, writing over data that wasn't erased corrupts it like real flash
+    for (uint32_t i = 0; i < size && offset + i < FLASH_SIZE; i++) {
+        flash_[offset + i] &= data[i];
+    }
+
+    return (uint64_t)(size + PAGE_SIZE - 1) / PAGE_SIZE * timing_.page_program_us;
+}
+
+bool EspRomEmulator::inflate_chunk(const uint8_t *data, uint32_t size, uint64_t *busy_us)
+{
+#if HAVE_ZLIB
+    uint8_t out[4096];
+
+    if (inflate_ == nullptr) {
+        return false;
+    }
+
+    inflate_->next_in = const_cast<uint8_t *>(data);
+    inflate_->avail_in = size;
+    do {
+        inflate_->next_out = out;
+        inflate_->avail_out = sizeof(out);
+        int ret = ::inflate(inflate_, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            return false;
+        }
+
+        const uint32_t produced = sizeof(out) - inflate_->avail_out;
+        *busy_us += program(inflate_offset_, out, produced);
+        inflate_offset_ += produced;
+        if (ret == Z_STREAM_END || (ret == Z_BUF_ERROR && produced == 0)) {
+            break;
+        }
+    } while (inflate_->avail_in > 0 || inflate_->avail_out == 0);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void EspRomEmulator::inflate_end()
+{
+#if HAVE_ZLIB
+    if (inflate_ != nullptr) {
+        inflateEnd(inflate_);
+        delete inflate_;
+        inflate_ = nullptr;
+    }
+#endif
+}
+
+void EspRomEmulator::handle_packet()
+{
+    const vector<uint8_t> &p = rx_packet_;
+
+    if (p.size() < 8 || p[0] != 0x00) {
+        return;
+    }
+
+    const uint8_t command = p[1];
+    const uint16_t size = p[2] | (p[3] << 8);
+    const uint32_t checksum = get_u32(p, 4);
+    if (p.size() < 8u + size) {
+        // A corrupted length, the ROM rejects the packet
+        respond(command, 0, {}, ERR_INVALID_COMMAND, 0);
+        return;
+    }
+
+    auto arg = [&](size_t n) {
+        return 8 + 4 * n + 4 <= 8u + size ? get_u32(p, 8 + 4 * n) : 0;
+    };
+
+    stats_.commands++;
+    stats_.per_command[command]++;
+
+    uint64_t busy_us = 0;
+    uint8_t error = ERR_NONE;
+    uint32_t value = 0;
+    vector<uint8_t> data;
+
+    switch (command) {
+    case SYNC:
+        break;
+
+    case READ_REG:
+        value = read_reg(arg(0));
+        break;
+
+    case WRITE_REG:
+        write_reg(arg(0), arg(1));
+        break;
+
+    case SPI_SET_PARAMS:
+    case SPI_ATTACH:
+        break;
+
+    case FLASH_BEGIN:
+    case FLASH_DEFL_BEGIN: {
+        // For FLASH_DEFL_BEGIN the size is the uncompressed one, the block count the compressed one
+        const uint32_t erase_size = arg(0);
+        write_block_size_ = arg(2);
+        write_offset_ = arg(3);
+        next_sequence_ = 0;
+        busy_us = erase(write_offset_, erase_size);
+#if HAVE_ZLIB
+        if (command == FLASH_DEFL_BEGIN) {
+            inflate_end();
+            inflate_ = new z_stream();
+            inflateInit(inflate_);
+            inflate_offset_ = write_offset_;
+        }
+#else
+        if (command == FLASH_DEFL_BEGIN) {
+            error = ERR_INVALID_COMMAND;
+        }
+#endif
+        break;
+    }
+
+    case FLASH_DATA:
+    case FLASH_DEFL_DATA:
+    case MEM_DATA: {
+        const uint32_t data_size = arg(0);
+        const uint32_t sequence = arg(1);
+        const uint8_t *payload = &p[8 + 16];
+
+        if (data_size + 16 > size) {
+            error = ERR_INVALID_COMMAND;
+            break;
+        }
+
+        uint8_t computed = 0xef;
+        for (uint32_t i = 0; i < data_size; i++) {
+            computed ^= payload[i];
+        }
+        if (computed != (checksum & 0xff)) {
+            stats_.checksum_errors++;
+            error = ERR_INVALID_CRC;
+            break;
+        }
+
+        // Only a resend of the last block may repeat its sequence number
+        if (sequence != next_sequence_ && sequence + 1 != next_sequence_) {
+            error = ERR_COMMAND_FAILED;
+            break;
+        }
+
+        if (command == MEM_DATA) {
+            for (uint32_t i = 0; i < data_size; i++) {
+                ram_[mem_offset_ + sequence * mem_block_size_ + i] = payload[i];
+            }
+        } else if (command == FLASH_DATA) {
+            busy_us = program(write_offset_ + sequence * write_block_size_, payload, data_size);
+        } else if (!inflate_chunk(payload, data_size, &busy_us)) {
+            error = ERR_DEFLATE;
+        }
+        next_sequence_ = sequence + 1;
+        break;
+    }
+
+    case FLASH_END:
+    case FLASH_DEFL_END:
+        inflate_end();
+        break;
+
+    case MEM_BEGIN:
+        mem_block_size_ = arg(2);
+        mem_offset_ = arg(3);
+        next_sequence_ = 0;
+        break;
+
+    case MEM_END:
+        // A non-zero entry point starts the code, the ROM is gone once the answer is out
+        if (arg(0) == 0) {
+            respond(command, 0, data, error, busy_us);
+            download_mode_ = false;
+            return;
+        }
+        break;
+
+    case SPI_FLASH_MD5: {
+        const uint32_t address = arg(0);
+        const uint32_t length = arg(1);
+        if ((uint64_t)address + length > FLASH_SIZE) {
+            error = ERR_COMMAND_FAILED;
+            break;
+        }
+
+        struct MD5Context ctx;
+        uint8_t digest[16];
+        MD5Init(&ctx);
+        MD5Update(&ctx, &flash_[address], length);
+        MD5Final(digest, &ctx);
+
+        static const char hex[] = "0123456789abcdef";
+        for (uint8_t b : digest) {
+            data.push_back(hex[b >> 4]);
+            data.push_back(hex[b & 0xf]);
+        }
+        // Reading back the region takes about as long as programming it
+        busy_us = (uint64_t)length / PAGE_SIZE * timing_.page_program_us / 8;
+        break;
+    }
+
+    case READ_FLASH_SLOW: {
+        const uint32_t address = arg(0);
+        const uint32_t length = arg(1);
+        if (length > READ_FLASH_SLOW_SIZE || (uint64_t)address + length > FLASH_SIZE) {
+            error = ERR_COMMAND_FAILED;
+            break;
+        }
+        data.assign(flash_.begin() + address, flash_.begin() + address + length);
+        data.resize(READ_FLASH_SLOW_SIZE, 0);
+        break;
+    }
+
+    case CHANGE_BAUDRATE:
+        // The answer still goes out at the old rate
+        respond(command, 0, data, error, busy_us);
+        target_baud_ = arg(0);
+        return;
+
+    default:
+        error = ERR_INVALID_COMMAND;
+        break;
+    }
+
+    respond(command, value, data, error, busy_us);
+}
@@ -0,0 +1,147 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <map>
+#include <random>
+#include <vector>
+
+/*
+ * In-process model of the ESP32-C3 ROM loader, driven byte by byte through the port layer
+ * (serial_io_emulator.cpp). Time is virtual: every byte costs 10 bit times at the current baud
+ * rate, commands and flash operations cost what the timing model says. Throughput figures are
+ * therefore reproducible and independent of the machine running them.
+ */
+
+struct EmulatorTiming {
+    uint32_t baudrate = 115200;
+    uint32_t command_latency_us = 100;      // ROM turnaround per command
+    uint32_t sector_erase_us = 45000;       // per 4 kB sector
+    uint32_t block_erase_us = 150000;       // per 64 kB block, used wherever a whole block is erased
+    uint32_t page_program_us = 700;         // per 256 B page
+    double bit_error_rate = 0;              // per host->target bit, corrupts the byte it hits
+};
+
+struct EmulatorStats {
+    uint64_t commands = 0;
+    uint64_t bytes_to_target = 0;
+    uint64_t bytes_from_target = 0;
+    uint64_t corrupted_bytes = 0;
+    uint64_t checksum_errors = 0;
+    std::map<uint8_t, uint64_t> per_command;
+};
+
+class EspRomEmulator {
+public:
+    static const uint32_t FLASH_SIZE = 4 * 1024 * 1024;
+    static const uint32_t SECTOR_SIZE = 4096;
+    static const uint32_t BLOCK_SIZE = 64 * 1024;
+
+    explicit EspRomEmulator(const EmulatorTiming &timing);
+    ~EspRomEmulator();
+
+    // Host side, called by the port layer. Times are in microseconds of virtual time. Both ends
+    // start at 115200 baud, like after a reset.
+    void host_write(const uint8_t *data, size_t size);
+    // Next response byte if it is on the wire by deadline; advances the clock either way
+    bool host_read(uint8_t *byte, uint64_t deadline);
+    void host_set_baudrate(uint32_t baudrate);
+    void reset(bool download_mode);
+    void advance(uint64_t us)
+    {
+        now_ += us;
+    }
+    uint64_t now() const
+    {
+        return now_;
+    }
+    // Time the last queued response byte is complete on the wire, 0 if there is none
+    uint64_t response_until() const
+    {
+        return tx_.empty() ? 0 : tx_.back().time;
+    }
+
+    const std::vector<uint8_t> &flash() const
+    {
+        return flash_;
+    }
+    const EmulatorStats &stats() const
+    {
+        return stats_;
+    }
+    void set_bit_error_rate(double bit_error_rate)
+    {
+        timing_.bit_error_rate = bit_error_rate;
+    }
+
+private:
+    void receive_byte(uint8_t byte);
+    void handle_packet();
+    void respond(uint8_t command, uint32_t value, const std::vector<uint8_t> &data, uint8_t error,
+                 uint64_t busy_us);
+    uint32_t read_reg(uint32_t addr);
+    void write_reg(uint32_t addr, uint32_t value);
+    uint64_t erase(uint32_t offset, uint32_t size);
+    uint64_t program(uint32_t offset, const uint8_t *data, uint32_t size);
+    bool inflate_chunk(const uint8_t *data, uint32_t size, uint64_t *busy_us);
+    void inflate_end();
+    uint64_t byte_time_us(uint32_t baudrate) const
+    {
+        return (10ull * 1000000 + baudrate - 1) / baudrate;
+    }
+
+    EmulatorTiming timing_;
+    EmulatorStats stats_;
+    uint64_t now_ = 0;
+    uint64_t target_busy_until_ = 0;
+    uint32_t host_baud_;
+    uint32_t target_baud_;
+    bool download_mode_ = false;
+
+    // SLIP receiver
+    std::vector<uint8_t> rx_packet_;
+    bool rx_in_packet_ = false;
+    bool rx_escape_ = false;
+
+    // Response bytes with the time each one is complete on the wire and the baud rate it was sent at
+    struct TxByte {
+        uint8_t byte;
+        uint64_t time;
+        uint32_t baudrate;
+    };
+    std::deque<TxByte> tx_;
+
+    std::vector<uint8_t> flash_;
+    std::map<uint32_t, uint32_t> regs_;
+    std::map<uint32_t, uint8_t> ram_;
+
+    // FLASH_BEGIN / FLASH_DEFL_BEGIN / MEM_BEGIN session
+    uint32_t write_offset_ = 0;
+    uint32_t write_block_size_ = 0;
+    uint32_t next_sequence_ = 0;
+    uint32_t mem_offset_ = 0;
+    uint32_t mem_block_size_ = 0;
+    struct z_stream_s *inflate_ = nullptr;
+    uint32_t inflate_offset_ = 0;
+
+    std::mt19937 rng_{12345};
+};
+
+// Routes the loader_port_* functions of serial_io_emulator.cpp to emulator
+void serial_emulator_attach(EspRomEmulator *emulator);
@@ -0,0 +1,125 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "tusb.h"
+#include "serial.h"
+#include "serial_io.h"
+
+// PROG_UART_BITRATE, the rate serial.c leaves the programming UART at
+#define HOST_SERIAL_BITRATE 115200
+
+// The one and only task
+static int host_task;
+static uint8_t last_sense = SCSI_SENSE_NONE;
+
+TickType_t xTaskGetTickCount(void)
+{
+    return 0;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return &host_task;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    (void) ticks;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    (void) task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    (void) task;
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    (void) clear_on_exit;
+    (void) ticks;
+    return 0;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer)
+{
+    buffer->holder = NULL;
+    buffer->count = 1;
+    return buffer;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer)
+{
+    buffer->holder = NULL;
+    buffer->count = 0;
+    return buffer;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    (void) ticks;
+
+    // Nobody else could ever give it, so waiting is pointless
+    if (sem->count == 0) {
+        return pdFALSE;
+    }
+    sem->count--;
+    sem->holder = xTaskGetCurrentTaskHandle();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    sem->count++;
+    sem->holder = NULL;
+    return pdTRUE;
+}
+
+TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t sem)
+{
+    return sem->holder;
+}
+
+void serial_set(const bool enable)
+{
+    // The bridge reconfigures the UART when it takes it over from the serial task
+    if (!enable) {
+        loader_port_change_baudrate(HOST_SERIAL_BITRATE);
+    }
+}
+
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, uint8_t add_sense_qualifier)
+{
+    (void) lun;
+    (void) add_sense_code;
+    (void) add_sense_qualifier;
+    last_sense = sense_key;
+    return true;
+}
+
+uint8_t host_shim_take_sense(void)
+{
+    uint8_t sense = last_sense;
+    last_sense = SCSI_SENSE_NONE;
+    return sense;
+}
@@ -0,0 +1,45 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    SCSI_SENSE_NONE = 0x00,
+    SCSI_SENSE_RECOVERED_ERROR = 0x01,
+    SCSI_SENSE_NOT_READY = 0x02,
+    SCSI_SENSE_MEDIUM_ERROR = 0x03,
+    SCSI_SENSE_HARDWARE_ERROR = 0x04,
+    SCSI_SENSE_ILLEGAL_REQUEST = 0x05,
+};
+
+enum {
+    SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL = 0x1e,
+};
+
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, uint8_t add_sense_qualifier);
+
+// Host only: the sense key last set by the MSC code, SCSI_SENSE_NONE once read
+uint8_t host_shim_take_sense(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,280 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Micro-benchmarks of the esp_loader protocol kernels: SLIP encode/decode on random and worst case
+ * (0xC0/0xDB only) data, the FLASH_DATA checksum, MD5Update and building a complete FLASH_DATA command
+ * including its response. The serial port is a memory sink/source, so only the CPU cost is measured.
+ *
+ * Results go to stdout as a JSON array, one object per kernel and data set. Every figure is the best of
+ * several repetitions. cycles_per_byte is only reported on x86, where it counts TSC ticks.
+ *
+ *   serial_flasher_bench [--size BYTES] [--min-time-ms N]
+ */
+
+#include "serial_io.h"
+#include "serial_comm.h"
+#include "serial_comm_prv.h"
+#include "serial_comm_kernels.h"
+#include "md5_hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+using namespace std;
+
+// ----------  Memory backed port  ----------
+
+static uint64_t sink_bytes;
+static const uint8_t *source;
+static size_t source_size;
+static size_t source_pos;
+
+static void set_source(const vector<uint8_t> &data)
+{
+    source = data.data();
+    source_size = data.size();
+    source_pos = 0;
+}
+
+esp_loader_error_t loader_port_serial_write(const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    sink_bytes += size;
+    return ESP_LOADER_SUCCESS;
+}
+
+esp_loader_error_t loader_port_serial_read(uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    if (source_size - source_pos < size) {
+        return ESP_LOADER_ERROR_TIMEOUT;
+    }
+    memcpy(data, source + source_pos, size);
+    source_pos += size;
+    return ESP_LOADER_SUCCESS;
+}
+
+esp_loader_error_t loader_port_change_baudrate(uint32_t baudrate)
+{
+    return ESP_LOADER_SUCCESS;
+}
+
+void loader_port_enter_bootloader(void)
+{
+}
+
+void loader_port_reset_target(void)
+{
+}
+
+void loader_port_delay_ms(uint32_t ms)
+{
+}
+
+void loader_port_start_timer(uint32_t ms)
+{
+}
+
+uint32_t loader_port_remaining_time(void)
+{
+    return 1000;
+}
+
+// ----------  Harness  ----------
+
+namespace {
+
+struct Options {
+    uint32_t size = 1024;               // one FLASH_DATA block, what the bridge handles most
+    uint32_t min_time_ms = 200;
+};
+
+const int REPETITIONS = 5;
+
+vector<uint8_t> slip_encode(const vector<uint8_t> &data)
+{
+    vector<uint8_t> out = { 0xc0 };
+    for (uint8_t b : data) {
+        if (b == 0xc0 || b == 0xdb) {
+            out.push_back(0xdb);
+            out.push_back(b == 0xc0 ? 0xdc : 0xdd);
+        } else {
+            out.push_back(b);
+        }
+    }
+    out.push_back(0xc0);
+    return out;
+}
+
+inline uint64_t ticks()
+{
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Runs kernel until min_time_ms has passed, REPETITIONS times, and prints the best run
+void run(const Options &opt, bool &first, const char *kernel, const char *data, uint32_t bytes,
+         const function<bool()> &kernel_fn)
+{
+    double best_ns = 0;
+    double best_ticks = 0;
+    uint64_t iterations = 0;
+
+    for (int rep = 0; rep < REPETITIONS; rep++) {
+        const auto start = chrono::steady_clock::now();
+        const uint64_t start_ticks = ticks();
+        const auto min_time = chrono::milliseconds(opt.min_time_ms / REPETITIONS + 1);
+        uint64_t n = 0;
+        chrono::steady_clock::time_point now;
+
+        do {
+            // Check the clock every few calls only
+            for (int i = 0; i < 16; i++) {
+                if (!kernel_fn()) {
+                    fprintf(stderr, "%s (%s) failed\n", kernel, data);
+                    exit(1);
+                }
+            }
+            n += 16;
+            now = chrono::steady_clock::now();
+        } while (now - start < min_time);
+
+        const double ns = chrono::duration<double, nano>(now - start).count() / n;
+        const double tk = (double)(ticks() - start_ticks) / n;
+        if (rep == 0 || ns < best_ns) {
+            best_ns = ns;
+            best_ticks = tk;
+            iterations = n;
+        }
+    }
+
+    printf("%s\n  {\"kernel\": \"%s\", \"data\": \"%s\", \"bytes\": %u, \"iterations\": %llu, "
+           "\"ns_per_call\": %.1f, \"ns_per_byte\": %.4f, \"mb_per_s\": %.1f",
+           first ? "" : ",", kernel, data, bytes, (unsigned long long)iterations, best_ns, best_ns / bytes,
+           bytes / best_ns * 1e3);
+#if HAVE_TSC
+    printf(", \"cycles_per_byte\": %.4f", best_ticks / bytes);
+#endif
+    printf("}");
+    first = false;
+}
+
+void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [--size BYTES] [--min-time-ms N]\n", name);
+    exit(2);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Options opt;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 == argc) {
+            usage(argv[0]);
+        }
+        if (!strcmp(argv[i], "--size")) {
+            opt.size = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--min-time-ms")) {
+            opt.min_time_ms = strtoul(argv[++i], nullptr, 0);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (opt.size == 0 || opt.size > 0xffff) {
+        fprintf(stderr, "--size must be between 1 and 65535\n");
+        return 2;
+    }
+
+    mt19937 rng(1);
+    vector<uint8_t> random_data(opt.size);
+    for (auto &b : random_data) {
+        b = rng();
+    }
+    vector<uint8_t> worst_data(opt.size);
+    for (size_t i = 0; i < worst_data.size(); i++) {
+        worst_data[i] = (i & 1) ? 0xdb : 0xc0;
+    }
+
+    const struct {
+        const char *name;
+        const vector<uint8_t> &data;
+    } data_sets[] = { { "random", random_data }, { "worst", worst_data } };
+
+    bool first = true;
+    printf("[");
+
+    for (const auto &set : data_sets) {
+        run(opt, first, "slip_send", set.name, opt.size, [&] {
+            return kernel_slip_send(set.data.data(), set.data.size()) == ESP_LOADER_SUCCESS;
+        });
+    }
+
+    for (const auto &set : data_sets) {
+        // Packets from the target start with the direction byte, which is never escaped
+        vector<uint8_t> packet = set.data;
+        packet[0] = READ_DIRECTION;
+        const vector<uint8_t> encoded = slip_encode(packet);
+        vector<uint8_t> decoded(packet.size());
+        run(opt, first, "slip_receive_packet", set.name, opt.size, [&] {
+            set_source(encoded);
+            return kernel_slip_receive_packet(decoded.data(), decoded.size()) == ESP_LOADER_SUCCESS;
+        });
+        if (decoded != packet) {
+            fprintf(stderr, "slip_receive_packet (%s) decoded wrong data\n", set.name);
+            return 1;
+        }
+    }
+
+    volatile uint8_t checksum;
+    run(opt, first, "compute_checksum", "random", opt.size, [&] {
+        checksum = kernel_compute_checksum(random_data.data(), random_data.size());
+        return true;
+    });
+    (void)checksum;
+
+    struct MD5Context md5;
+    MD5Init(&md5);
+    run(opt, first, "md5_update", "random", opt.size, [&] {
+        MD5Update(&md5, random_data.data(), random_data.size());
+        return true;
+    });
+
+    // What the target sends back for every block
+    const uint8_t response[] = { READ_DIRECTION, FLASH_DATA, 2, 0, 0, 0, 0, 0, 0, 0 };
+    const vector<uint8_t> encoded_response = slip_encode(vector<uint8_t>(response, response + sizeof(response)));
+    for (const auto &set : data_sets) {
+        run(opt, first, "flash_data_cmd", set.name, opt.size, [&] {
+            set_source(encoded_response);
+            return loader_flash_data_cmd(set.data.data(), set.data.size()) == ESP_LOADER_SUCCESS;
+        });
+    }
+
+    printf("\n]\n");
+    return 0;
+}
@@ -28,6 +28,14 @@ elif [ "$1" = "qemu" ]; then
 
     # Kill qemu process running in background
     kill -9 $(pidof qemu-system-xtensa)
+elif [ "$1" = "emulator" ]; then
+    # Extra arguments go to the benchmark, e.g. ./run_test.sh emulator --baud 460800 --ber 1e-5
+    shift
+    cmake -DQEMU_TEST=False .. && cmake --build . && ./serial_flasher_emulator "$@"
+elif [ "$1" = "bench" ]; then
+    # JSON results on stdout, e.g. ./run_test.sh bench --size 4096 > bench.json
+    shift
+    cmake -DQEMU_TEST=False -DCMAKE_BUILD_TYPE=Release .. && cmake --build . && ./serial_flasher_bench "$@"
 else
-    echo "Please select which test to run: qemu or host"
+    echo "Please select which test to run: qemu, host, emulator or bench"
 fi
\ No newline at end of file
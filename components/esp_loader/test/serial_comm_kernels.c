@@ -0,0 +1,37 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Exposes the static SLIP and checksum routines of serial_comm.c to serial_flasher_bench. The file is
+ * compiled into this translation unit so the benchmark measures exactly the code the bridge runs.
+ */
+
+#include "../src/serial_comm.c"
+#include "serial_comm_kernels.h"
+
+esp_loader_error_t kernel_slip_send(const uint8_t *data, uint32_t size)
+{
+    return SLIP_send(data, size);
+}
+
+esp_loader_error_t kernel_slip_receive_packet(uint8_t *buff, uint32_t size)
+{
+    return SLIP_receive_packet(buff, size);
+}
+
+uint8_t kernel_compute_checksum(const uint8_t *data, uint32_t size)
+{
+    return compute_checksum(data, size);
+}
@@ -0,0 +1,84 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "serial_io.h"
+#include "esp_rom_emulator.h"
+
+// Time the bootloader strapping and reset sequence takes on the bridge
+static const uint64_t RESET_SEQUENCE_US = 100000;
+
+static EspRomEmulator *emulator;
+static uint64_t timer_deadline;
+
+void serial_emulator_attach(EspRomEmulator *emu)
+{
+    emulator = emu;
+}
+
+esp_loader_error_t loader_port_serial_write(const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    emulator->host_write(data, size);
+
+    return ESP_LOADER_SUCCESS;
+}
+
+esp_loader_error_t loader_port_serial_read(uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    const uint64_t deadline = emulator->now() + (uint64_t)timeout * 1000;
+
+    for (uint16_t i = 0; i < size; i++) {
+        if (!emulator->host_read(&data[i], deadline)) {
+            return ESP_LOADER_ERROR_TIMEOUT;
+        }
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+esp_loader_error_t loader_port_change_baudrate(uint32_t baudrate)
+{
+    emulator->host_set_baudrate(baudrate);
+
+    return ESP_LOADER_SUCCESS;
+}
+
+void loader_port_enter_bootloader(void)
+{
+    emulator->advance(RESET_SEQUENCE_US);
+    emulator->reset(true);
+}
+
+void loader_port_reset_target(void)
+{
+    emulator->advance(RESET_SEQUENCE_US);
+    emulator->reset(false);
+}
+
+void loader_port_delay_ms(uint32_t ms)
+{
+    emulator->advance((uint64_t)ms * 1000);
+}
+
+void loader_port_start_timer(uint32_t ms)
+{
+    timer_deadline = emulator->now() + (uint64_t)ms * 1000;
+}
+
+uint32_t loader_port_remaining_time(void)
+{
+    const uint64_t now = emulator->now();
+
+    return now < timer_deadline ? (timer_deadline - now + 999) / 1000 : 0;
+}
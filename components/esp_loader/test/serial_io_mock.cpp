@@ -26,6 +26,8 @@ using namespace std;
 
 static vector<int8_t> write_buffer;
 static vector<int8_t> read_buffer;
+static vector<vector<int8_t>> packet_responses;
+static uint32_t delimiters_written = 0;
 static uint32_t receive_delay = 0;
 static int32_t timer = 0;
 
@@ -44,6 +46,15 @@ esp_loader_error_t loader_port_serial_write(const uint8_t *data, uint16_t size,
 {
     copy(&data[0], &data[size], back_inserter(write_buffer));
 
+    // Every second delimiter ends a packet, which releases the answer queued for it
+    for (uint16_t i = 0; i < size; i++) {
+        if (data[i] == 0xc0 && ++delimiters_written % 2 == 0 && !packet_responses.empty()) {
+            auto &response = packet_responses.front();
+            copy(response.begin(), response.end(), back_inserter(read_buffer));
+            packet_responses.erase(packet_responses.begin());
+        }
+    }
+
     return ESP_LOADER_SUCCESS;
 }
 
@@ -122,6 +133,8 @@ void clear_buffers()
 {
     write_buffer.clear();
     read_buffer.clear();
+    packet_responses.clear();
+    delimiters_written = 0;
 }
 
 int8_t *write_buffer_data()
@@ -139,6 +152,19 @@ void set_read_buffer(const void *data, size_t size)
     SLIP_encode((const int8_t *)data, size, read_buffer);
 }
 
+void queue_packet_response(const void *data, size_t size)
+{
+    packet_responses.emplace_back();
+    if (size != 0) {
+        SLIP_encode((const int8_t *)data, size, packet_responses.back());
+    }
+}
+
+void queue_late_response(const void *data, size_t size)
+{
+    SLIP_encode((const int8_t *)data, size, packet_responses.back());
+}
+
 void print_array(int8_t *data, uint32_t size)
 {
     for (uint32_t i = 0; i < size; i++) {
@@ -26,6 +26,11 @@ size_t write_buffer_size();
 int8_t* write_buffer_data();
 
 void set_read_buffer(const void *data, size_t size);
+// Answers a packet only once it has been written, so a resync can't eat the answer to a
+// retry. Each call answers the next packet, size 0 leaves it unanswered.
+void queue_packet_response(const void *data, size_t size);
+// Appends a stale response that arrives right after the last queued answer
+void queue_late_response(const void *data, size_t size);
 void print_array(int8_t *data, uint32_t size);
 void serial_set_time_delay(uint32_t miliseconds);
 
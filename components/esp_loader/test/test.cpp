@@ -25,6 +25,7 @@
 #include <map>
 #include <iostream>
 #include <algorithm>
+#include <vector>
 
 using namespace std;
 
@@ -252,6 +253,35 @@ TEST_CASE( "Register can be read correctly" )
 }
 
 
+TEST_CASE( "MAC address is read from the eFuses" )
+{
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    uint8_t mac[6] = { 0 };
+    const uint8_t expected[6] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+
+    SECTION( "ESP32C3" ) {
+        queue_connect_response(ESP32C3_CHIP);
+        REQUIRE_SUCCESS( esp_loader_connect(&connect_config) );
+
+        auto mac0 = read_reg_response;
+        auto mac1 = read_reg_response;
+        mac0.data.common.value = 0x33445566;
+        mac1.data.common.value = 0x00001122;
+        queue_response(mac0);
+        queue_response(mac1);
+
+        REQUIRE_SUCCESS( esp_loader_read_mac(mac) );
+        REQUIRE( memcmp(mac, expected, sizeof(mac)) == 0 );
+    }
+
+    SECTION( "Not supported on ESP8266" ) {
+        queue_connect_response(ESP8266_CHIP);
+        REQUIRE_SUCCESS( esp_loader_connect(&connect_config) );
+        REQUIRE( esp_loader_read_mac(mac) == ESP_LOADER_ERROR_UNSUPPORTED_FUNC );
+    }
+}
+
+
 TEST_CASE( "Register can be written correctly" )
 {
     write_reg_cmd_response expected;
@@ -265,6 +295,76 @@ TEST_CASE( "Register can be written correctly" )
     REQUIRE( memcmp(write_buffer_data(), &expected, sizeof(expected)) == 0 );
 }
 
+TEST_CASE( "Flash is read in chunks of READ_FLASH_SLOW_SIZE" )
+{
+    read_flash_slow_response_t responses[2];
+    uint8_t flash[2 * READ_FLASH_SLOW_SIZE];
+
+    for (size_t i = 0; i < sizeof(flash); i++) {
+        flash[i] = (uint8_t)(i * 7);
+    }
+
+    clear_buffers();
+    for (int i = 0; i < 2; i++) {
+        responses[i].common.direction = READ_DIRECTION;
+        responses[i].common.command = READ_FLASH_SLOW;
+        responses[i].common.size = READ_FLASH_SLOW_SIZE + 2;
+        responses[i].common.value = 0;
+        memcpy(responses[i].data, &flash[i * READ_FLASH_SLOW_SIZE], READ_FLASH_SLOW_SIZE);
+        responses[i].status.failed = STATUS_SUCCESS;
+        responses[i].status.error = 0;
+        set_read_buffer(&responses[i], sizeof(responses[i]));
+    }
+
+    uint8_t readout[100] = { 0 };
+    REQUIRE_SUCCESS( esp_loader_flash_read(0x1000, readout, sizeof(readout)) );
+    REQUIRE( memcmp(readout, flash, sizeof(readout)) == 0 );
+
+    // Second command asks for the remaining 36 bytes right after the first chunk
+    uint8_t expected_second[] = {
+        0xc0, 0x00, READ_FLASH_SLOW, 8, 0, 0, 0, 0, 0,
+        0x40, 0x10, 0, 0,   // Address
+        36, 0, 0, 0,        // Size
+        0xc0,
+    };
+    const size_t first_size = sizeof(expected_second);
+    REQUIRE( write_buffer_size() == 2 * first_size );
+    REQUIRE( memcmp(write_buffer_data() + first_size, expected_second, sizeof(expected_second)) == 0 );
+}
+
+TEST_CASE( "RAM segment is loaded with MEM_BEGIN and MEM_DATA" )
+{
+    expected_response mem_begin_response(MEM_BEGIN);
+    expected_response mem_data_response(MEM_DATA);
+    uint8_t data[] = { 1, 2, 3, 4 };
+
+    uint8_t expected[] = {
+        0xc0, 0x00, MEM_BEGIN, 16, 0, 0, 0, 0, 0,
+        6, 0, 0, 0,             // Size
+        2, 0, 0, 0,             // Blocks
+        4, 0, 0, 0,             // Block size
+        0x00, 0x00, 0xcb, 0x3f, // Address
+        0xc0,
+        0xc0, 0x00, MEM_DATA, 16 + sizeof(data), 0, 0xeb, 0, 0, 0,
+        sizeof(data), 0, 0, 0,  // Data size
+        0, 0, 0, 0,             // Sequence number
+        0, 0, 0, 0,
+        0, 0, 0, 0,
+        1, 2, 3, 4,
+        0xc0,
+    };
+
+    clear_buffers();
+    queue_response(mem_begin_response);
+    queue_response(mem_data_response);
+
+    REQUIRE_SUCCESS( esp_loader_mem_start(0x3fcb0000, 6, 4) );
+    REQUIRE_SUCCESS( esp_loader_mem_write(data, sizeof(data)) );
+
+    REQUIRE( write_buffer_size() == sizeof(expected) );
+    REQUIRE( memcmp(write_buffer_data(), expected, sizeof(expected)) == 0 );
+}
+
 // --------------------  Serial comm test  -----------------------
 
 TEST_CASE ( "SLIP is encoded correctly" )
@@ -299,6 +399,133 @@ TEST_CASE ( "SLIP is encoded correctly" )
 }
 
 
+TEST_CASE( "Failed FLASH_DATA block is resent with the same sequence number" )
+{
+    uint8_t data[] = { 1, 2, 3, 4 };
+    const size_t seq_offset = 1 + 8 + 4; // delimiter, common header, data size
+
+    loader_flash_begin_cmd(0, 0, 0, 0, ESP32_CHIP); // To reset sequence number counter
+
+    auto crc_error_response = flash_data_response;
+    crc_error_response.data.status.failed = STATUS_FAILURE;
+    crc_error_response.data.status.error = INVALID_CRC;
+
+    clear_buffers();
+    queue_response(crc_error_response);
+    REQUIRE( loader_flash_data_cmd(data, sizeof(data)) == ESP_LOADER_ERROR_INVALID_RESPONSE );
+    REQUIRE( write_buffer_data()[seq_offset] == 0 );
+
+    clear_buffers();
+    queue_response(flash_data_response);
+    REQUIRE_SUCCESS( loader_flash_data_cmd(data, sizeof(data)) );
+    REQUIRE( write_buffer_data()[seq_offset] == 0 );
+
+    clear_buffers();
+    queue_response(flash_data_response);
+    REQUIRE_SUCCESS( loader_flash_data_cmd(data, sizeof(data)) );
+    REQUIRE( write_buffer_data()[seq_offset] == 1 );
+}
+
+
+// Splits what was written into SLIP packets, delimiters included
+static vector<vector<int8_t>> written_packets()
+{
+    vector<vector<int8_t>> packets;
+    int8_t *data = write_buffer_data();
+    bool in_packet = false;
+
+    for (size_t i = 0; i < write_buffer_size(); i++) {
+        if (!in_packet) {
+            packets.emplace_back();
+        }
+        packets.back().push_back(data[i]);
+        if ((uint8_t)data[i] == 0xc0) {
+            in_packet = !in_packet;
+        }
+    }
+
+    return packets;
+}
+
+// Starts a 4 byte block session, flash size detection is left unanswered
+static void start_flash_session()
+{
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    queue_connect_response(ESP32_CHIP);
+    REQUIRE_SUCCESS( esp_loader_connect(&connect_config) );
+
+    clear_buffers();
+    queue_packet_response(NULL, 0);
+    queue_packet_response(&flash_begin_response, sizeof(flash_begin_response));
+    REQUIRE_SUCCESS( esp_loader_flash_start(0, 4, 4) );
+    clear_buffers();
+}
+
+
+TEST_CASE( "FLASH_DATA block with a checksum error is resent after a resync" )
+{
+    uint8_t data[] = { 1, 2, 3, 4 };
+    const size_t seq_offset = 1 + 8 + 4;
+
+    start_flash_session();
+
+    auto crc_error_response = flash_data_response;
+    crc_error_response.data.status.failed = STATUS_FAILURE;
+    crc_error_response.data.status.error = INVALID_CRC;
+
+    // A second, late error that must be dropped instead of being taken as the answer to the retry
+    queue_packet_response(&crc_error_response, sizeof(crc_error_response));
+    queue_late_response(&crc_error_response, sizeof(crc_error_response));
+    queue_packet_response(&flash_data_response, sizeof(flash_data_response));
+
+    REQUIRE_SUCCESS( esp_loader_flash_write(data, sizeof(data)) );
+
+    auto packets = written_packets();
+    REQUIRE( packets.size() == 2 );
+    REQUIRE( packets[0] == packets[1] );
+    REQUIRE( packets[0][seq_offset] == 0 );
+}
+
+
+TEST_CASE( "FLASH_DATA block the target failed to write is not resent" )
+{
+    uint8_t data[] = { 1, 2, 3, 4 };
+
+    start_flash_session();
+
+    auto write_error_response = flash_data_response;
+    write_error_response.data.status.failed = STATUS_FAILURE;
+    write_error_response.data.status.error = FLASH_WRITE_ERR;
+
+    queue_packet_response(&write_error_response, sizeof(write_error_response));
+    queue_packet_response(&flash_data_response, sizeof(flash_data_response));
+
+    REQUIRE( esp_loader_flash_write(data, sizeof(data)) == ESP_LOADER_ERROR_INVALID_RESPONSE );
+    REQUIRE( written_packets().size() == 1 );
+}
+
+
+TEST_CASE( "FLASH_DATA block that is never answered is given up after the retry limit" )
+{
+    uint8_t data[] = { 1, 2, 3, 4 };
+    const size_t flash_write_attempts = 4;
+
+    start_flash_session();
+
+    REQUIRE( esp_loader_flash_write(data, sizeof(data)) == ESP_LOADER_ERROR_TIMEOUT );
+
+    auto packets = written_packets();
+    REQUIRE( packets.size() == flash_write_attempts );
+    for (auto &packet : packets) {
+        REQUIRE( packet == packets[0] );
+    }
+
+    // Giving up leaves the session usable, the block can still be written
+    queue_packet_response(&flash_data_response, sizeof(flash_data_response));
+    REQUIRE_SUCCESS( esp_loader_flash_write(data, sizeof(data)) );
+}
+
+
 TEST_CASE( "Sync command is constructed correctly" )
 {
     uint8_t expected[] = {
@@ -5,7 +5,12 @@
 
 #define LOG_NL "\r\n"
 
-#if (LOGGING_ENABLED())
+#if (LOGGING_ENABLED()) && LOG_DEFERRED_ENABLED && !defined(__cplusplus)
+#include "pio_uart_logger/deferred_log.h"
+#define ESP_LOG_LEVEL_LOCAL(level, tag, format, ...) do {                                               \
+	if (level <= LOG_LEVEL) DEFERRED_LOG("[%s] " format LOG_NL, tag, ## __VA_ARGS__); \
+}while(0)
+#elif (LOGGING_ENABLED())
 #define ESP_LOG_LEVEL_LOCAL(level, tag, format, ...) do {                                               \
 	if (level <= LOG_LEVEL) printf("[%s] " format LOG_NL, tag, ## __VA_ARGS__); \
 }while(0)
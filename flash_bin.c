@@ -0,0 +1,289 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// FLASH.BIN on the MSC disk.
+//
+// Reads are served from two FLASH_BIN_LINE_SIZE cache lines filled by flash_bin_task() with esp_loader flash
+// reads. The MSC callback never waits for the target: a miss queues the line and reports "not ready", TinyUSB
+// calls it again later. When a read reaches the second half of a line, the following line is fetched into the
+// other slot while the host is still busy with the current one, so a sequential copy keeps the UART busy.
+//
+// The target stays in download mode while FLASH.BIN is read and is reset after MSC_FLASH_BIN_IDLE_MS without
+// a miss, or when a UF2 image is about to be flashed.
+
+#include <pico/stdlib.h>
+#include <string.h>
+#include "ubp_config.h"
+#include "esp_log.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "esp_loader.h"
+#include "serial_io.h"
+#include "serial.h"
+#include "uf2_flash.h"
+#include "target_settings.h"
+#include "flash_bin.h"
+
+#if MSC_FLASH_BIN_ENABLED
+
+static const char *TAG = "flash_bin";
+
+#define LINE_COUNT              2
+#define RELEASE_TIMEOUT_MS      3000
+
+_Static_assert((MSC_FLASH_BIN_SIZE % FLASH_BIN_LINE_SIZE) == 0, "MSC_FLASH_BIN_SIZE must be a multiple of FLASH_BIN_LINE_SIZE");
+
+typedef enum
+{
+	LINE_EMPTY,
+	LINE_PENDING,		// owned by flash_bin_task() until it leaves this state
+	LINE_READY,
+	LINE_FAILED,
+} line_state_t;
+
+typedef struct
+{
+	volatile line_state_t state;
+	volatile uint32_t addr;
+	uint8_t data[FLASH_BIN_LINE_SIZE];
+} cache_line_t;
+
+static cache_line_t lines[LINE_COUNT];
+static TaskHandle_t flash_bin_task_handle;
+static SemaphoreHandle_t released_handle;
+static StaticSemaphore_t released_def;
+static volatile bool release_requested;
+static volatile bool target_claimed;
+static uint32_t target_flash_size;
+
+static cache_line_t *find_line(uint32_t addr)
+{
+	for (int i = 0; i < LINE_COUNT; i++)
+	{
+		if (lines[i].state != LINE_EMPTY && lines[i].addr == addr)
+			return &lines[i];
+	}
+
+	return NULL;
+}
+
+// Queues addr in a slot that isn't being filled and doesn't hold keep
+static bool request_line(uint32_t addr, const cache_line_t *keep)
+{
+	if (addr >= MSC_FLASH_BIN_SIZE)
+		return false;
+
+	for (int i = 0; i < LINE_COUNT; i++)
+	{
+		cache_line_t *line = &lines[i];
+		if (line == keep || line->state == LINE_PENDING)
+			continue;
+
+		line->addr = addr;
+		line->state = LINE_PENDING;
+		xTaskNotifyGive(flash_bin_task_handle);
+		return true;
+	}
+
+	return false;
+}
+
+int32_t flash_bin_read(uint32_t offset, void *buffer, uint32_t size)
+{
+	const uint32_t addr = offset & ~(FLASH_BIN_LINE_SIZE - 1);
+	const uint32_t line_offset = offset - addr;
+	cache_line_t *line = find_line(addr);
+
+	if (line == NULL)
+	{
+		request_line(addr, NULL);
+		return 0;
+	}
+
+	switch (line->state)
+	{
+	case LINE_READY:
+		// A read crossing into the next line gets the rest from the next call
+		size = MIN(size, FLASH_BIN_LINE_SIZE - line_offset);
+		memcpy(buffer, line->data + line_offset, size);
+		if (line_offset + size > FLASH_BIN_LINE_SIZE / 2 && find_line(addr + FLASH_BIN_LINE_SIZE) == NULL)
+		{
+			request_line(addr + FLASH_BIN_LINE_SIZE, line);
+		}
+		return size;
+
+	case LINE_FAILED:
+		// Report it once, the next read tries again
+		line->state = LINE_EMPTY;
+		return -1;
+
+	default:
+		return 0;
+	}
+}
+
+static bool target_connect(void)
+{
+	if (!uf2_flash_claim_target())
+	{
+		ESP_LOGW(TAG, "target is being flashed");
+		return false;
+	}
+	target_claimed = true;
+	serial_set(false);
+
+	esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+	if (esp_loader_connect(&connect_config) != ESP_LOADER_SUCCESS)
+	{
+		ESP_LOGE(TAG, "ESP LOADER connection failed!");
+		return false;
+	}
+
+	uint32_t baudrate = MSC_FLASH_BIN_BAUDRATE;
+	target_flash_size = 0;
+#if TARGET_SETTINGS_ENABLED
+	target_settings_t settings;
+	const uint32_t key = target_settings_load(&settings);
+	baudrate = target_settings_baudrate(&settings, baudrate);
+	target_flash_size = settings.flash_size;
+#endif
+
+	if (esp_loader_get_target() != ESP8266_CHIP &&
+	    (esp_loader_change_baudrate(baudrate) != ESP_LOADER_SUCCESS ||
+	     loader_port_change_baudrate(baudrate) != ESP_LOADER_SUCCESS))
+	{
+		ESP_LOGW(TAG, "ESP LOADER cannot change baudrate to %d", baudrate);
+	}
+
+	if (target_flash_size == 0)
+	{
+		if (esp_loader_flash_detect_size(&target_flash_size) != ESP_LOADER_SUCCESS)
+		{
+			ESP_LOGW(TAG, "flash size detection failed");
+			target_flash_size = MSC_FLASH_BIN_SIZE;
+		}
+#if TARGET_SETTINGS_ENABLED
+		else
+		{
+			settings.flash_size = target_flash_size;
+			target_settings_store(key, &settings);
+		}
+#endif
+	}
+	ESP_LOGI(TAG, "target connected, %d bytes of flash", target_flash_size);
+
+	return true;
+}
+
+static void target_disconnect(void)
+{
+	if (!target_claimed)
+		return;
+
+	loader_port_change_baudrate(PROG_UART_BITRATE);
+	esp_loader_reset_target();
+	serial_set(true);
+	target_claimed = false;
+	uf2_flash_release_target();
+
+	// Pending lines are dropped too, the next read of them requests them again
+	for (int i = 0; i < LINE_COUNT; i++)
+	{
+		lines[i].state = LINE_EMPTY;
+	}
+	ESP_LOGI(TAG, "target released");
+}
+
+static void fill_line(cache_line_t *line)
+{
+	if (!target_claimed && !target_connect())
+	{
+		target_disconnect();
+		line->state = LINE_FAILED;
+		return;
+	}
+
+	if (line->addr >= target_flash_size)
+	{
+		memset(line->data, 0xFF, FLASH_BIN_LINE_SIZE);
+	}
+	else if (esp_loader_flash_read(line->addr, line->data, FLASH_BIN_LINE_SIZE) != ESP_LOADER_SUCCESS)
+	{
+		ESP_LOGE(TAG, "reading %#08x failed", line->addr);
+		target_disconnect();
+		line->state = LINE_FAILED;
+		return;
+	}
+
+	line->state = LINE_READY;
+}
+
+void flash_bin_release(void)
+{
+	if (!target_claimed)
+		return;
+
+	release_requested = true;
+	xTaskNotifyGive(flash_bin_task_handle);
+	if (xSemaphoreTake(released_handle, pdMS_TO_TICKS(RELEASE_TIMEOUT_MS)) != pdTRUE)
+	{
+		ESP_LOGE(TAG, "target was not released");
+	}
+}
+
+void flash_bin_task(void *pvParameters)
+{
+	flash_bin_task_handle = xTaskGetCurrentTaskHandle();
+	released_handle = xSemaphoreCreateBinaryStatic(&released_def);
+
+	for (;;)
+	{
+		const uint32_t notified = ulTaskNotifyTake(pdTRUE, target_claimed ? pdMS_TO_TICKS(MSC_FLASH_BIN_IDLE_MS) : portMAX_DELAY);
+
+		if (release_requested)
+		{
+			target_disconnect();
+			release_requested = false;
+			xSemaphoreGive(released_handle);
+			continue;
+		}
+
+		if (!notified)
+		{
+			target_disconnect();
+			continue;
+		}
+
+		// Lines requested while one is filled are picked up in the same pass
+		for (int i = 0; i < LINE_COUNT && !release_requested; i++)
+		{
+			if (lines[i].state == LINE_PENDING)
+				fill_line(&lines[i]);
+		}
+	}
+}
+
+#else
+
+int32_t flash_bin_read(uint32_t offset, void *buffer, uint32_t size)
+{
+	return -1;
+}
+
+void flash_bin_release(void)
+{}
+
+#endif // MSC_FLASH_BIN_ENABLED
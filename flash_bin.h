@@ -0,0 +1,32 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FLASH_BIN_LINE_SIZE             4096
+
+void flash_bin_task(void *pvParameters);
+
+/*
+ * Serves a read of FLASH.BIN from the line cache. Returns size when the data was copied, 0 when the line
+ * is still being fetched (the caller retries later) and -1 when the target could not be read.
+ */
+int32_t flash_bin_read(uint32_t offset, void *buffer, uint32_t size);
+
+// Hands the target back, blocks until it is reset. Called before a UF2 image is flashed.
+void flash_bin_release(void);
@@ -0,0 +1,254 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Progress and phase timings of the UF2 sessions, shown in STATUS.TXT on the MSC disk.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "pico/stdlib.h"
+#include "flash_status.h"
+
+#if MSC_STATUS_ENABLED
+
+typedef enum
+{
+	SESSION_RUNNING,
+	SESSION_DONE,
+	SESSION_FAILED,
+} session_state_t;
+
+typedef struct
+{
+	uint32_t number;
+	uint32_t chip_id;
+	uint32_t blocks;
+	uint32_t blocks_written;
+	uint32_t bytes;
+	uint32_t baudrate;
+	uint8_t backend;
+	uint8_t state;
+	bool ram;
+	flash_status_phase_t phase;
+	uint64_t start_us;
+	uint64_t phase_start_us;
+	uint64_t end_us;
+	uint32_t phase_us[FLASH_STATUS_PHASES];
+} session_t;
+
+static session_t s_sessions[MSC_STATUS_HISTORY];
+static uint32_t s_count;
+
+static const char *const s_phase_names[FLASH_STATUS_PHASES] = { "connect", "erase", "write", "finish" };
+static const char *const s_state_names[] = { "running", "done", "failed" };
+
+// Only called with a session running and inside the critical section
+static inline session_t *current(void)
+{
+	return &s_sessions[(s_count - 1) % MSC_STATUS_HISTORY];
+}
+
+static void close_phase(session_t *s, uint64_t now)
+{
+	s->phase_us[s->phase] += now - s->phase_start_us;
+	s->phase_start_us = now;
+}
+
+void flash_status_begin(uint32_t chip_id, uint32_t blocks, uf2_backend_t backend, bool ram)
+{
+	const uint64_t now = time_us_64();
+
+	taskENTER_CRITICAL();
+	// Block 0 of a new image ends an unfinished one
+	if (s_count && current()->state == SESSION_RUNNING)
+	{
+		close_phase(current(), now);
+		current()->end_us = now;
+		current()->state = SESSION_FAILED;
+	}
+	s_count++;
+	session_t *s = current();
+	memset(s, 0, sizeof(*s));
+	s->number = s_count;
+	s->chip_id = chip_id;
+	s->blocks = blocks;
+	s->backend = backend;
+	s->ram = ram;
+	s->state = SESSION_RUNNING;
+	s->phase = FLASH_STATUS_CONNECT;
+	s->start_us = s->phase_start_us = now;
+	taskEXIT_CRITICAL();
+}
+
+void flash_status_backend(uf2_backend_t backend)
+{
+	taskENTER_CRITICAL();
+	if (s_count)
+	{
+		current()->backend = backend;
+	}
+	taskEXIT_CRITICAL();
+}
+
+void flash_status_baudrate(uint32_t baudrate)
+{
+	taskENTER_CRITICAL();
+	if (s_count)
+	{
+		current()->baudrate = baudrate;
+	}
+	taskEXIT_CRITICAL();
+}
+
+void flash_status_enter(flash_status_phase_t phase)
+{
+	const uint64_t now = time_us_64();
+
+	taskENTER_CRITICAL();
+	if (s_count && current()->state == SESSION_RUNNING)
+	{
+		session_t *s = current();
+		close_phase(s, now);
+		s->phase = phase;
+	}
+	taskEXIT_CRITICAL();
+}
+
+void flash_status_block(uint32_t payload_size)
+{
+	taskENTER_CRITICAL();
+	if (s_count && current()->state == SESSION_RUNNING)
+	{
+		current()->blocks_written++;
+		current()->bytes += payload_size;
+	}
+	taskEXIT_CRITICAL();
+}
+
+void flash_status_end(bool ok)
+{
+	const uint64_t now = time_us_64();
+
+	taskENTER_CRITICAL();
+	if (s_count && current()->state == SESSION_RUNNING)
+	{
+		session_t *s = current();
+		close_phase(s, now);
+		s->end_us = now;
+		s->state = ok ? SESSION_DONE : SESSION_FAILED;
+	}
+	taskEXIT_CRITICAL();
+}
+
+static size_t render_session(char *buf, size_t size, const session_t *s, uint64_t now)
+{
+	const bool running = s->state == SESSION_RUNNING;
+	const uint64_t end_us = running ? now : s->end_us;
+	uint32_t phase_us[FLASH_STATUS_PHASES];
+
+	memcpy(phase_us, s->phase_us, sizeof(phase_us));
+	if (running)
+	{
+		phase_us[s->phase] += now - s->phase_start_us;
+	}
+
+	// Bytes over the write phase, USB transfers and slow hosts included
+	const uint32_t write_us = phase_us[FLASH_STATUS_WRITE];
+	const uint32_t bytes_per_s = write_us ? (uint32_t)((uint64_t)s->bytes * 1000000 / write_us) : 0;
+
+	const char *backend = s->ram ? "RAM over UART" : (s->backend == UF2_BACKEND_JTAG ? "JTAG" : "UART");
+	int n = snprintf(buf, size,
+	                 "Session %lu: %s%s%s\r\n"
+	                 "  target      %s, %s\r\n"
+	                 "  baud rate   %lu\r\n"
+	                 "  blocks      %lu of %lu, %lu bytes\r\n"
+	                 "  throughput  %lu.%lu kB/s\r\n"
+	                 "  elapsed     %lu ms\r\n",
+	                 (unsigned long)s->number, s_state_names[s->state], running ? ", " : "",
+	                 running ? s_phase_names[s->phase] : "",
+	                 uf2_chipid_to_name(s->chip_id), backend,
+	                 (unsigned long)s->baudrate,
+	                 (unsigned long)s->blocks_written, (unsigned long)s->blocks, (unsigned long)s->bytes,
+	                 (unsigned long)(bytes_per_s / 1000), (unsigned long)(bytes_per_s % 1000 / 100),
+	                 (unsigned long)((end_us - s->start_us) / 1000));
+
+	for (int i = 0; i < FLASH_STATUS_PHASES && n >= 0 && (size_t)n < size; i++)
+	{
+		n += snprintf(buf + n, size - n, "  %-11s %lu ms\r\n", s_phase_names[i], (unsigned long)(phase_us[i] / 1000));
+	}
+	if (n >= 0 && (size_t)n < size)
+	{
+		n += snprintf(buf + n, size - n, "\r\n");
+	}
+
+	return n < 0 ? 0 : MIN((size_t)n, size);
+}
+
+void flash_status_render(char *buf, size_t size)
+{
+	session_t sessions[MSC_STATUS_HISTORY];
+	uint32_t count;
+
+	// The USB task renders while a session may be updated from the MSC task
+	taskENTER_CRITICAL();
+	memcpy(sessions, s_sessions, sizeof(sessions));
+	count = s_count;
+	taskEXIT_CRITICAL();
+
+	const uint64_t now = time_us_64();
+	size_t used = snprintf(buf, size, "ESP USB Bridge flashing status, UF2 sessions since power up: %lu\r\n\r\n",
+	                       (unsigned long)count);
+	used = MIN(used, size);
+
+	for (uint32_t i = 0; i < MIN(count, MSC_STATUS_HISTORY); i++)
+	{
+		const session_t *s = &sessions[(count - 1 - i) % MSC_STATUS_HISTORY];
+		used += render_session(buf + used, size - used, s, now);
+	}
+
+	// The file has a fixed size, the text is padded to it
+	memset(buf + used, ' ', size - used);
+	if (size)
+	{
+		buf[size - 1] = '\n';
+	}
+}
+
+#else
+
+void flash_status_begin(uint32_t chip_id, uint32_t blocks, uf2_backend_t backend, bool ram)
+{}
+
+void flash_status_backend(uf2_backend_t backend)
+{}
+
+void flash_status_baudrate(uint32_t baudrate)
+{}
+
+void flash_status_enter(flash_status_phase_t phase)
+{}
+
+void flash_status_block(uint32_t payload_size)
+{}
+
+void flash_status_end(bool ok)
+{}
+
+void flash_status_render(char *buf, size_t size)
+{}
+
+#endif // MSC_STATUS_ENABLED
@@ -0,0 +1,56 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "ubp_config.h"
+#include "uf2_flash.h"
+
+/*
+ * Flashing status (MSC_STATUS_ENABLED). uf2_flash.c reports every UF2 session here: the target, the
+ * backend and baud rate, the blocks written so far and how long each phase took. The last
+ * MSC_STATUS_HISTORY sessions are kept and rendered as text for STATUS.TXT on the MSC disk.
+ *
+ * The phases follow each other, time is counted to a phase until the next one is entered:
+ *
+ *   FLASH_STATUS_CONNECT  esp_loader_connect() and the baud rate switch, or starting the JTAG stub
+ *   FLASH_STATUS_ERASE    esp_loader_flash_start(), or getting a RAM load ready
+ *   FLASH_STATUS_WRITE    from the first block to the last one, USB transfers included
+ *   FLASH_STATUS_FINISH   ending the flash session and resetting the target
+ */
+
+typedef enum
+{
+	FLASH_STATUS_CONNECT,
+	FLASH_STATUS_ERASE,
+	FLASH_STATUS_WRITE,
+	FLASH_STATUS_FINISH,
+	FLASH_STATUS_PHASES,
+} flash_status_phase_t;
+
+// Starts a new session in FLASH_STATUS_CONNECT, the oldest one is dropped from the history
+void flash_status_begin(uint32_t chip_id, uint32_t blocks, uf2_backend_t backend, bool ram);
+void flash_status_backend(uf2_backend_t backend);
+void flash_status_baudrate(uint32_t baudrate);
+void flash_status_enter(flash_status_phase_t phase);
+// A block of payload_size bytes was accepted
+void flash_status_block(uint32_t payload_size);
+void flash_status_end(bool ok);
+
+// Renders the sessions, newest first, and pads the rest of buf with spaces and a final newline
+void flash_status_render(char *buf, size_t size);
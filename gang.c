@@ -0,0 +1,406 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Gang programming targets.
+//
+// Every target listed in GANG_TARGETS gets its own UART, BOOT and RST pins and is registered with the
+// loader port next to the PROG_UART target. The loader sends each command once; the port hands the same
+// buffer to the TX DMA channel of every active target, so a UF2 block is read from USB once and streamed
+// to all targets in parallel. Responses are collected per target into their own RX stream buffers.
+
+#include <pico/stdlib.h>
+#include "ubp_config.h"
+#include "esp_log.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "stream_buffer.h"
+#include "hardware/uart.h"
+#include "hardware/irq.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "components/esp_loader/port/rp2040_port.h"
+#include "gang.h"
+
+#if GANG_ENABLED
+
+#include "uart_tx.pio.h"
+#include "uart_rx.pio.h"
+
+static const char *TAG = "gang";
+
+#define GANG_PIO pio1
+
+typedef struct
+{
+	const gang_target_config_t *cfg;
+	uint32_t loader_target;
+	int dma_channel;
+	uint sm_tx;
+	uint sm_rx;
+	uint32_t baudrate;
+	StaticSemaphore_t sem_tx_ready_def;
+	SemaphoreHandle_t sem_tx_ready;
+	StaticStreamBuffer_t rx_stream_def;
+	StreamBufferHandle_t rx_stream;
+	uint8_t rx_stream_buf[GANG_RX_BUF_SIZE];
+} gang_target_t;
+
+static const gang_target_config_t s_gang_config[] = { GANG_TARGETS };
+
+#define GANG_TARGET_COUNT (sizeof(s_gang_config) / sizeof(s_gang_config[0]))
+
+_Static_assert(GANG_TARGET_COUNT < LOADER_PORT_RP2040_MAX_TARGETS, "Too many gang targets");
+
+static gang_target_t s_targets[GANG_TARGET_COUNT];
+static uint32_t s_target_count;
+static gang_target_t *s_uart_target;
+static uint s_pio_tx_offset;
+static uint s_pio_rx_offset;
+static bool s_pio_loaded;
+static esp_loader_error_t s_results[GANG_TARGET_COUNT + 1];
+
+static inline void set_esp_pin(uint pin, bool val)
+{
+	if (val)
+	{
+		// set to input, enable pullup
+		gpio_put(pin, true);
+		gpio_set_dir(pin, true);
+		gpio_set_pulls(pin, true, false);
+		gpio_set_dir(pin, false);
+	}
+	else
+	{
+		// set low, set to output
+		gpio_put(pin, false);
+		gpio_set_dir(pin, true);
+	}
+}
+
+static void __not_in_flash_func(gang_dma_handler)(void)
+{
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+	for (uint32_t i = 0; i < s_target_count; i++)
+	{
+		if (dma_channel_get_irq0_status(s_targets[i].dma_channel))
+		{
+			dma_channel_acknowledge_irq0(s_targets[i].dma_channel);
+			xSemaphoreGiveFromISR(s_targets[i].sem_tx_ready, &higherPriorityTaskWoken);
+		}
+	}
+
+	portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+static void __not_in_flash_func(gang_uart_rx_isr)(void)
+{
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+	uint8_t temp_buffer[16];
+	uint32_t temp_buffer_len = 0;
+
+	while (uart_is_readable(s_uart_target->cfg->uart))
+	{
+		temp_buffer[temp_buffer_len++] = uart_getc(s_uart_target->cfg->uart);
+		if (temp_buffer_len == sizeof(temp_buffer))
+		{
+			xStreamBufferSendFromISR(s_uart_target->rx_stream, temp_buffer, temp_buffer_len, &higherPriorityTaskWoken);
+			temp_buffer_len = 0;
+		}
+	}
+	if (temp_buffer_len > 0)
+	{
+		xStreamBufferSendFromISR(s_uart_target->rx_stream, temp_buffer, temp_buffer_len, &higherPriorityTaskWoken);
+	}
+
+	portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+static void __not_in_flash_func(gang_pio_rx_isr)(void)
+{
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+	uint8_t temp_buffer[16];
+
+	for (uint32_t i = 0; i < s_target_count; i++)
+	{
+		gang_target_t *target = &s_targets[i];
+		uint32_t temp_buffer_len = 0;
+
+		if (target->cfg->type != GANG_TARGET_TYPE_PIO)
+			continue;
+
+		while (!pio_sm_is_rx_fifo_empty(GANG_PIO, target->sm_rx))
+		{
+			// Autopush of 8 bits with right shift leaves the byte in bits 31:24
+			temp_buffer[temp_buffer_len++] = (uint8_t)(pio_sm_get(GANG_PIO, target->sm_rx) >> 24);
+			if (temp_buffer_len == sizeof(temp_buffer))
+			{
+				xStreamBufferSendFromISR(target->rx_stream, temp_buffer, temp_buffer_len, &higherPriorityTaskWoken);
+				temp_buffer_len = 0;
+			}
+		}
+		if (temp_buffer_len > 0)
+		{
+			xStreamBufferSendFromISR(target->rx_stream, temp_buffer, temp_buffer_len, &higherPriorityTaskWoken);
+		}
+	}
+
+	portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+static int32_t gang_read_for_loader(void *ctx, uint8_t* buf, uint32_t len, uint32_t timeout_ms)
+{
+	gang_target_t *target = ctx;
+	int total_transferred = 0;
+	absolute_time_t timeout_time = make_timeout_time_ms(timeout_ms);
+
+	// A zero timeout still returns what already arrived, targets answering in parallel
+	// are read after the first one used up the time budget.
+	do
+	{
+		int64_t diff_time = absolute_time_diff_us(get_absolute_time(), timeout_time);
+		TickType_t ticks = diff_time > 0 ? pdMS_TO_TICKS(us_to_ms(diff_time)) : 0;
+		size_t rcv_length = xStreamBufferReceive(target->rx_stream, buf, len, ticks);
+		if (rcv_length == 0 && ticks == 0)
+			break;
+		buf += rcv_length;
+		total_transferred += rcv_length;
+		len -= rcv_length;
+	} while (len > 0);
+
+	return total_transferred;
+}
+
+static int32_t gang_write_for_loader(void *ctx, const uint8_t* buf, uint32_t len, uint32_t timeout_ms)
+{
+	gang_target_t *target = ctx;
+
+	if (xSemaphoreTake(target->sem_tx_ready, pdMS_TO_TICKS(timeout_ms)) != pdTRUE)
+		return 0;
+
+	dma_channel_set_read_addr(target->dma_channel, buf, false);
+	dma_channel_set_trans_count(target->dma_channel, len, true);
+	return len;
+}
+
+static uint32_t gang_set_baudrate_for_loader(void *ctx, uint32_t baudrate)
+{
+	gang_target_t *target = ctx;
+
+	// Let the last command leave the wire before the bit clock changes
+	xSemaphoreTake(target->sem_tx_ready, portMAX_DELAY);
+
+	if (target->cfg->type == GANG_TARGET_TYPE_UART)
+	{
+		uart_tx_wait_blocking(target->cfg->uart);
+		baudrate = uart_set_baudrate(target->cfg->uart, baudrate);
+	}
+	else
+	{
+		while (!pio_sm_is_tx_fifo_empty(GANG_PIO, target->sm_tx))
+			tight_loop_contents();
+		// Two characters at the old rate: the one in the OSR and the one being shifted out
+		sleep_us(2 * 10 * 1000000 / target->baudrate + 1);
+		pio_sm_set_clkdiv(GANG_PIO, target->sm_tx, (float)clock_get_hz(clk_sys) / (8 * baudrate));
+		pio_sm_set_clkdiv(GANG_PIO, target->sm_rx, (float)clock_get_hz(clk_sys) / (uart_rx_mini_cycles_per_bit * baudrate));
+	}
+
+	target->baudrate = baudrate;
+	xSemaphoreGive(target->sem_tx_ready);
+	return baudrate;
+}
+
+static void gang_set_boot_pin_for_loader(void *ctx, bool val)
+{
+	set_esp_pin(((gang_target_t *)ctx)->cfg->gpio_boot, val);
+}
+
+static void gang_set_rst_pin_for_loader(void *ctx, bool val)
+{
+	set_esp_pin(((gang_target_t *)ctx)->cfg->gpio_rst, val);
+}
+
+static bool gang_target_init(gang_target_t *target)
+{
+	const gang_target_config_t *cfg = target->cfg;
+	volatile void *tx_fifo;
+	uint tx_dreq;
+
+	if (cfg->type == GANG_TARGET_TYPE_UART)
+	{
+		if (cfg->uart == PROG_UART || s_uart_target)
+		{
+			ESP_LOGE(TAG, "uart%d is already in use", uart_get_index(cfg->uart));
+			return false;
+		}
+
+		uart_init(cfg->uart, PROG_UART_BITRATE);
+		gpio_set_function(cfg->gpio_txd, GPIO_FUNC_UART);
+		gpio_set_function(cfg->gpio_rxd, GPIO_FUNC_UART);
+		uart_set_hw_flow(cfg->uart, false, false);
+		uart_set_format(cfg->uart, 8, 1, UART_PARITY_NONE);
+		uart_set_fifo_enabled(cfg->uart, true);
+
+		s_uart_target = target;
+		int UART_IRQ = cfg->uart == uart0 ? UART0_IRQ : UART1_IRQ;
+		irq_set_exclusive_handler(UART_IRQ, gang_uart_rx_isr);
+		uart_set_irq_enables(cfg->uart, true, false);
+		irq_set_enabled(UART_IRQ, true);
+
+		tx_fifo = &uart_get_hw(cfg->uart)->dr;
+		tx_dreq = uart_get_dreq(cfg->uart, true);
+	}
+	else
+	{
+		if (!s_pio_loaded)
+		{
+			// 8N1 like PROG_UART, whatever stop bits the logger uses
+			s_pio_tx_offset = pio_add_program(GANG_PIO, &uart_tx_program);
+			s_pio_rx_offset = pio_add_program(GANG_PIO, &uart_rx_mini_program);
+			irq_set_exclusive_handler(PIO1_IRQ_0, gang_pio_rx_isr);
+			irq_set_enabled(PIO1_IRQ_0, true);
+			s_pio_loaded = true;
+		}
+
+		int sm_tx = pio_claim_unused_sm(GANG_PIO, false);
+		int sm_rx = pio_claim_unused_sm(GANG_PIO, false);
+		if (sm_tx < 0 || sm_rx < 0)
+		{
+			ESP_LOGE(TAG, "out of pio1 state machines");
+			if (sm_tx >= 0)
+				pio_sm_unclaim(GANG_PIO, sm_tx);
+			return false;
+		}
+		target->sm_tx = sm_tx;
+		target->sm_rx = sm_rx;
+
+		uart_tx_program_init(GANG_PIO, target->sm_tx, s_pio_tx_offset, cfg->gpio_txd, PROG_UART_BITRATE);
+		uart_rx_mini_program_init(GANG_PIO, target->sm_rx, s_pio_rx_offset, cfg->gpio_rxd, PROG_UART_BITRATE);
+		pio_set_irq0_source_enabled(GANG_PIO, pis_sm0_rx_fifo_not_empty + target->sm_rx, true);
+
+		tx_fifo = &GANG_PIO->txf[target->sm_tx];
+		tx_dreq = pio_get_dreq(GANG_PIO, target->sm_tx, true);
+	}
+
+	target->baudrate = PROG_UART_BITRATE;
+
+	gpio_init_mask((1 << cfg->gpio_boot) | (1 << cfg->gpio_rst));
+	set_esp_pin(cfg->gpio_boot, true);
+	set_esp_pin(cfg->gpio_rst, true);
+
+	target->rx_stream = xStreamBufferGenericCreateStatic(sizeof(target->rx_stream_buf), 1, pdFALSE, target->rx_stream_buf, &target->rx_stream_def);
+	target->sem_tx_ready = xSemaphoreCreateBinaryStatic(&target->sem_tx_ready_def);
+	xSemaphoreGive(target->sem_tx_ready);
+
+	target->dma_channel = dma_claim_unused_channel(true);
+	dma_channel_config c = dma_channel_get_default_config(target->dma_channel);
+
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, false);
+	channel_config_set_dreq(&c, tx_dreq);
+
+	dma_channel_configure(target->dma_channel, &c, tx_fifo, NULL, 0, false);
+	dma_channel_acknowledge_irq0(target->dma_channel);
+	dma_channel_set_irq0_enabled(target->dma_channel, true);
+
+	return true;
+}
+
+void gang_init(void)
+{
+	for (uint32_t i = 0; i < GANG_TARGET_COUNT; i++)
+	{
+		gang_target_t *target = &s_targets[s_target_count];
+		target->cfg = &s_gang_config[i];
+
+		if (!gang_target_init(target))
+		{
+			ESP_LOGE(TAG, "gang target %u disabled", i);
+			continue;
+		}
+
+		loader_rp2040_config_t loader_cfg =
+		{
+			.read_uart = gang_read_for_loader,
+			.write_uart = gang_write_for_loader,
+			.set_baud_rate = gang_set_baudrate_for_loader,
+			.set_boot_pin = gang_set_boot_pin_for_loader,
+			.set_rst_pin = gang_set_rst_pin_for_loader,
+			.ctx = target,
+		};
+		loader_port_rp2040_add_target(&loader_cfg, &target->loader_target);
+		s_target_count++;
+	}
+
+	irq_add_shared_handler(DMA_IRQ_0, gang_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+	irq_set_enabled(DMA_IRQ_0, true);
+
+	ESP_LOGI(TAG, "%u gang targets", s_target_count);
+}
+
+void gang_begin(void)
+{
+	for (uint32_t i = 0; i < s_target_count; i++)
+		xStreamBufferReset(s_targets[i].rx_stream);
+
+	loader_port_rp2040_set_targets(~0u);
+}
+
+void gang_end(void)
+{
+	uint32_t count = loader_port_rp2040_target_count();
+	uint32_t failed = 0;
+
+	for (uint32_t t = 0; t < count; t++)
+	{
+		s_results[t] = loader_port_rp2040_target_status(t);
+		if (s_results[t] != ESP_LOADER_SUCCESS)
+		{
+			ESP_LOGE(TAG, "target %u failed, error %d", t, s_results[t]);
+			failed++;
+		}
+		else
+		{
+			ESP_LOGI(TAG, "target %u done", t);
+		}
+	}
+	ESP_LOGI(TAG, "%u of %u targets flashed", count - failed, count);
+
+	// Bring failed targets back so that the final reset releases every board
+	loader_port_rp2040_set_targets(~0u);
+}
+
+#else
+
+void gang_init(void) {}
+void gang_begin(void) {}
+void gang_end(void) {}
+
+#endif // GANG_ENABLED
+
+uint32_t gang_target_count(void)
+{
+	return loader_port_rp2040_target_count();
+}
+
+esp_loader_error_t gang_target_result(uint32_t target)
+{
+#if GANG_ENABLED
+	if (target < gang_target_count())
+		return s_results[target];
+#endif
+	return target == GANG_PRIMARY_TARGET ? ESP_LOADER_SUCCESS : ESP_LOADER_ERROR_INVALID_PARAM;
+}
@@ -0,0 +1,49 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/uart.h"
+#include "esp_loader.h"
+
+typedef enum
+{
+	GANG_TARGET_TYPE_UART,		//!< Target on the PL011 UART not used by PROG_UART
+	GANG_TARGET_TYPE_PIO,		//!< Target on a pair of pio1 state machines
+} gang_target_type_t;
+
+typedef struct
+{
+	gang_target_type_t type;
+	uart_inst_t *uart;			// GANG_TARGET_TYPE_UART only
+	uint8_t gpio_txd;
+	uint8_t gpio_rxd;
+	uint8_t gpio_boot;
+	uint8_t gpio_rst;
+} gang_target_config_t;
+
+// Used to build GANG_TARGETS in ubp_config.h
+#define GANG_TARGET_UART(uart_, txd, rxd, boot, rst) { GANG_TARGET_TYPE_UART, (uart_), (txd), (rxd), (boot), (rst) }
+#define GANG_TARGET_PIO(txd, rxd, boot, rst) { GANG_TARGET_TYPE_PIO, NULL, (txd), (rxd), (boot), (rst) }
+
+// Index of the PROG_UART target, gang targets follow it
+#define GANG_PRIMARY_TARGET 0
+
+void gang_init(void);
+void gang_begin(void);
+void gang_end(void);
+uint32_t gang_target_count(void);
+esp_loader_error_t gang_target_result(uint32_t target);
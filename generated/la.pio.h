@@ -0,0 +1,47 @@
+// -------------------------------------------------- //
+// This file is autogenerated by pioasm; do not edit! //
+// -------------------------------------------------- //
+
+#pragma once
+
+#if !PICO_NO_HARDWARE
+#include "hardware/pio.h"
+#endif
+
+// --------- //
+// la_sample //
+// --------- //
+
+#define la_sample_wrap_target 0
+#define la_sample_wrap 0
+
+static const uint16_t la_sample_program_instructions[] = {
+            //     .wrap_target
+    0x4000, //  0: in     pins, 32                   @@@E:\GitHub\esp-usb-bridge-pico\la.pio:7
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program la_sample_program = {
+    .instructions = la_sample_program_instructions,
+    .length = 1,
+    .origin = -1,
+};
+
+static inline pio_sm_config la_sample_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + la_sample_wrap_target, offset + la_sample_wrap);
+    return c;
+}
+
+static inline void la_sample_program_init(PIO pio, uint sm, uint offset, uint32_t clkdiv) {
+    pio_sm_config c = la_sample_program_get_default_config(offset);
+    // The pins are only read, whoever drives them keeps them
+    sm_config_set_in_pins(&c, 0);
+    sm_config_set_in_shift(&c, false, true, 32);
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    sm_config_set_clkdiv_int_frac(&c, clkdiv, 0);
+    pio_sm_init(pio, sm, offset, &c);
+}
+
+#endif
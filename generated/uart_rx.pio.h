@@ -0,0 +1,62 @@
+// -------------------------------------------------- //
+// This file is autogenerated by pioasm; do not edit! //
+// -------------------------------------------------- //
+
+#pragma once
+
+#if !PICO_NO_HARDWARE
+#include "hardware/pio.h"
+#endif
+
+// ------------ //
+// uart_rx_mini //
+// ------------ //
+
+#define uart_rx_mini_wrap_target 0
+#define uart_rx_mini_wrap 3
+
+#define uart_rx_mini_cycles_per_bit 8
+
+static const uint16_t uart_rx_mini_program_instructions[] = {
+            //     .wrap_target
+    0x2020, //  0: wait   0 pin, 0                   @@@E:\GitHub\esp-usb-bridge-pico\uart_rx.pio:10
+    0xea27, //  1: set    x, 7                   [10] @@@E:\GitHub\esp-usb-bridge-pico\uart_rx.pio:12
+    0x4001, //  2: in     pins, 1                    @@@E:\GitHub\esp-usb-bridge-pico\uart_rx.pio:15
+    0x0642, //  3: jmp    x--, 2                 [6] @@@E:\GitHub\esp-usb-bridge-pico\uart_rx.pio:17
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program uart_rx_mini_program = {
+    .instructions = uart_rx_mini_program_instructions,
+    .length = 4,
+    .origin = -1,
+};
+
+static inline pio_sm_config uart_rx_mini_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + uart_rx_mini_wrap_target, offset + uart_rx_mini_wrap);
+    return c;
+}
+
+#include "hardware/clocks.h"
+static inline void uart_rx_mini_program_init(PIO pio, uint sm, uint offset, uint pin, uint baud) {
+    pio_sm_set_consecutive_pindirs(pio, sm, pin, 1, false);
+    pio_gpio_init(pio, pin);
+    gpio_pull_up(pin);
+
+    pio_sm_config c = uart_rx_mini_program_get_default_config(offset);
+    // for WAIT, IN
+    sm_config_set_in_pins(&c, pin);
+    // Shift to right, autopush enabled
+    sm_config_set_in_shift(&c, true, true, 8);
+    // Deeper FIFO as we're not doing any TX
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    float div = (float)clock_get_hz(clk_sys) / (uart_rx_mini_cycles_per_bit * baud);
+    sm_config_set_clkdiv(&c, div);
+    pio_sm_init(pio, sm, offset, &c);
+    pio_sm_set_enabled(pio, sm, true);
+}
+
+#endif
+
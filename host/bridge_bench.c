@@ -0,0 +1,1362 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmark and fuzzer for the host build of the bridge. Starts the firmware's tasks, then talks to
+ * them through the USB endpoints the way OpenOCD, a terminal and a file manager would:
+ *
+ * - jtag: IDCODE scan of the built-in TAP, a 2^18 clock idle run, then a BYPASS stream whose TDO must echo
+ *   TDI one bit late
+ * - tck: VEND_JTAG_TCK has to report a clock plan no faster than each VEND_JTAG_SETDIV asked for, on an
+ *   integer divider only within JTAG_TCK_INTEGER_DIV_TOLERANCE percent of it
+ * - serial: CDC <-> UART loopback through an echoing target, plus the DTR/RTS to BOOT/RST mapping
+ * - logger: a printf() has to come out of the PIO UART logger
+ * - jtag_flash: with JTAG_FLASH_ENABLED, a UF2 image tagged for the JTAG backend, in payloads that aren't
+ *   whole words, has to reach the flash of the RISC-V debug module model's stub without the UART, also right
+ *   after a copy that was dropped halfway
+ * - msc: a multi-sector read of the FAT sectors has to work, a UF2 image copied to the disk in 16 kB
+ *   writes has to end up in the flash of the ROM loader model, and STATUS.TXT has to show that session.
+ *   A block out of order has to end that session, and an image copied right after a dropped one has to make it.
+ * - stats: the VEND_STATS snapshot has to parse and show the JTAG stream in the buffer high-water marks
+ * - trace: with TRACE_ENABLED, the VEND_TRACE dump has to hold the JTAG flushes and UF2 blocks above
+ * - profile: with PROFILE_ENABLED, the VEND_PROFILE tables have to add up to the samples taken
+ * - settings: with TARGET_SETTINGS_ENABLED, the UF2 session has to leave an entry for the ROM loader
+ *   model, which has to survive enough KV store writes to wrap around all of its sectors and a re-mount,
+ *   and as many writes cut short by a power loss, each of which leaves the old value or the new one
+ * - capture: with JTAG_CAPTURE_ENABLED, a fresh capture has to hold the commands, the clock divider
+ *   request and the reply sizes of a BYPASS stream, and replaying it has to get the same replies
+ *
+ * --replay plays a saved capture (tools/jtag_capture.py, --capture) back as fast as the bridge takes it
+ * and reports the throughput instead of running the checks.
+ *
+ * With --fuzz the endpoints get random vendor commands, control requests, line state changes, CDC
+ * data and broken UF2 blocks, after which the checks above must still pass. Results are printed as
+ * JSON on stdout, failures go to stderr and make the exit code 1.
+ *
+ *   bridge_bench [--jtag-bits N] [--serial-bytes N] [--uf2-size BYTES] [--fuzz ITERATIONS] [--seed N]
+ *                [--trace FILE] [--profile FILE] [--capture FILE] [--replay FILE]
+ */
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ubp_config.h"
+#include "uf2_flash.h"
+#include "host_bridge.h"
+#include "deferred_log.h"
+#include "bridge_stats.h"
+#include "bridge_trace.h"
+#include "bridge_profile.h"
+#include "jtag_capture.h"
+#include "jtag.h"
+#include "jtag_flash.h"
+#include "hardware/clocks.h"
+#include "esp_loader.h"
+#include "kv_store.h"
+#include "target_settings.h"
+
+#define TAP_IDCODE              0x00005c25      // ESP32-C3
+#define UF2_FLASH_OFFSET        0x10000
+#define UF2_PAYLOAD_SIZE        256
+#define UF2_FAMILY_ESP32C3      0xd42ba06c
+#define UF2_FIRST_LBA           1000            // anywhere past the README cluster
+#define UF2_WRITE_BLOCKS        32              // blocks per SCSI write, like a 16 kB write of a file manager
+#define FAT_RAM_SECTORS         35              // boot sector, FAT, root directory and the README cluster
+#define JTAG_CHUNK_BITS         2048
+#define IDLE_RUN_CLOCKS         (1u << 18)      // CLK followed by nine REP3s
+#define SERIAL_CHUNK            256
+#define WATCHDOG_S              600
+#define JTAG_PIO_SM             1               // host_bridge_start() claims SM 0 for the logger first
+#define STUB_RAM_ADDR           0x3fc80000      // ESP32-C3 internal SRAM
+#define STUB_RAM_SIZE           (64 * 1024)
+#define STUB_RING_SIZE          (8 * 1024)
+#define STUB_FLASH_SIZE         (4 * 1024 * 1024)
+#define JTAG_FLASH_CHUNK        250             // not a multiple of 4, the stub must still get every byte in place
+
+// esp_usb_jtag protocol commands, two per byte, high nibble first
+enum {
+    CMD_CLK_0 = 0,              // CLK_n: bit 0 TDI, bit 1 TMS, bit 2 capture TDO
+    CMD_SRST0 = 8,
+    CMD_FLUSH = 10,
+    CMD_REP0 = 12,
+};
+
+#define CLK(tms, tdi, capture)  (CMD_CLK_0 | ((capture) << 2) | ((tms) << 1) | (tdi))
+
+typedef struct {
+    uint8_t bytes[4096];
+    size_t nibbles;
+} cmd_buf_t;
+
+typedef struct {
+    uint32_t jtag_bits;
+    uint32_t serial_bytes;
+    uint32_t uf2_size;
+    uint32_t fuzz;
+    uint32_t seed;
+    const char *trace_file;     // where bench_trace() saves the dump for tools/trace_latency.py
+    const char *profile_file;   // where bench_profile() saves the dump for tools/profile_report.py
+    const char *capture_file;   // where bench_capture() saves its capture
+    const char *replay_file;    // capture to play back instead of the checks
+} options_t;
+
+static host_jtag_tap_t s_tap;
+#if JTAG_FLASH_ENABLED
+static host_riscv_dm_t s_dm;
+static uint8_t s_dm_ram[STUB_RAM_SIZE];
+static uint8_t s_dm_flash[STUB_FLASH_SIZE];
+#endif
+static host_esp_rom_t *s_rom;
+static uint32_t s_rand;
+static bool s_first_result = true;
+
+static uint32_t rand32(void)
+{
+    // xorshift32, reproducible across libcs for a given --seed
+    s_rand ^= s_rand << 13;
+    s_rand ^= s_rand >> 17;
+    s_rand ^= s_rand << 5;
+    return s_rand;
+}
+
+static double wall_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void result(const char *name, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void result(const char *name, const char *fmt, ...)
+{
+    va_list args;
+
+    fprintf(stdout, "%s\"%s\": {", s_first_result ? "{\n  " : ",\n  ", name);
+    va_start(args, fmt);
+    vfprintf(stdout, fmt, args);
+    va_end(args);
+    fprintf(stdout, "}");
+    s_first_result = false;
+}
+
+static void cmd_reset(cmd_buf_t *buf)
+{
+    buf->nibbles = 0;
+}
+
+static void cmd_put(cmd_buf_t *buf, uint8_t cmd)
+{
+    uint8_t *byte = &buf->bytes[buf->nibbles / 2];
+
+    *byte = (buf->nibbles & 1) ? (*byte | cmd) : (uint8_t) (cmd << 4);
+    buf->nibbles++;
+}
+
+static void cmd_put_n(cmd_buf_t *buf, uint8_t cmd, int count)
+{
+    while (count-- > 0) {
+        cmd_put(buf, cmd);
+    }
+}
+
+// Sends the commands, ending in a flush so every captured bit comes back
+static bool cmd_send(cmd_buf_t *buf)
+{
+    cmd_put(buf, CMD_FLUSH);
+    if (buf->nibbles & 1) {
+        // A second flush has nothing left to send
+        cmd_put(buf, CMD_FLUSH);
+    }
+    const size_t size = buf->nibbles / 2;
+    return host_usb_vendor_write(buf->bytes, size, 1000) == size;
+}
+
+static bool vendor_read_all(uint8_t *data, size_t size)
+{
+    size_t received = 0;
+
+    while (received < size) {
+        const size_t n = host_usb_vendor_read(data + received, size - received, 1000);
+        if (n == 0) {
+            return false;
+        }
+        received += n;
+    }
+    return true;
+}
+
+// Drops whatever TDO the bridge still has queued
+static void vendor_drain(void)
+{
+    uint8_t flush = (CMD_FLUSH << 4) | CMD_FLUSH;
+    uint8_t data[512];
+
+    host_usb_vendor_write(&flush, 1, 1000);
+    while (host_usb_vendor_read(data, sizeof(data), 50)) {
+    }
+}
+
+static bool bench_jtag(const options_t *opt)
+{
+    static cmd_buf_t buf;
+    uint8_t tdo[JTAG_CHUNK_BITS / 8];
+
+    // Reset, Run-Test/Idle, Select-DR, Capture-DR, Shift-DR, then 32 bits of IDCODE
+    cmd_reset(&buf);
+    cmd_put(&buf, CMD_SRST0);
+    cmd_put(&buf, CLK(0, 0, 0));
+    cmd_put(&buf, CLK(1, 0, 0));
+    cmd_put(&buf, CLK(0, 0, 0));
+    cmd_put(&buf, CLK(0, 0, 0));
+    cmd_put_n(&buf, CLK(0, 0, 1), 31);
+    cmd_put(&buf, CLK(1, 0, 1));
+    cmd_put(&buf, CLK(1, 0, 0));
+    cmd_put(&buf, CLK(0, 0, 0));
+    if (!cmd_send(&buf) || !vendor_read_all(tdo, 4)) {
+        fprintf(stderr, "jtag: no reply to the IDCODE scan\n");
+        return false;
+    }
+    const uint32_t idcode = tdo[0] | (tdo[1] << 8) | (tdo[2] << 16) | ((uint32_t) tdo[3] << 24);
+    if (idcode != TAP_IDCODE) {
+        fprintf(stderr, "jtag: IDCODE 0x%08x, expected 0x%08x\n", idcode, TAP_IDCODE);
+        return false;
+    }
+
+    // A RUNTEST sized idle run from Run-Test/Idle: CLK then nine REP3s is 4^9 clocks, which has to go to the
+    // TAP in full. The captured clock after it makes the bridge answer once the run is over.
+    const uint64_t idle_start = s_tap.tck_cycles;
+    const double idle_wall_start = wall_s();
+    cmd_reset(&buf);
+    cmd_put(&buf, CLK(0, 0, 0));
+    cmd_put_n(&buf, CMD_REP0 + 3, 9);
+    cmd_put(&buf, CLK(0, 0, 1));
+    if (!cmd_send(&buf) || !vendor_read_all(tdo, 1)) {
+        fprintf(stderr, "jtag: no reply after the idle run\n");
+        return false;
+    }
+    const uint64_t idle_clocks = s_tap.tck_cycles - idle_start;
+    const double idle_s = wall_s() - idle_wall_start;
+    if (idle_clocks != IDLE_RUN_CLOCKS + 1) {
+        fprintf(stderr, "jtag: idle run took %llu clocks, expected %u\n",
+                (unsigned long long) idle_clocks, IDLE_RUN_CLOCKS + 1);
+        return false;
+    }
+
+    // All ones into IR selects BYPASS, then park in Shift-DR
+    cmd_reset(&buf);
+    cmd_put(&buf, CLK(1, 0, 0));
+    cmd_put(&buf, CLK(1, 0, 0));
+    cmd_put(&buf, CLK(0, 0, 0));
+    cmd_put(&buf, CLK(0, 0, 0));
+    cmd_put_n(&buf, CLK(0, 1, 0), 4);
+    cmd_put(&buf, CLK(1, 1, 0));
+    cmd_put(&buf, CLK(1, 0, 0));
+    cmd_put(&buf, CLK(0, 0, 0));
+    cmd_put(&buf, CLK(1, 0, 0));
+    cmd_put(&buf, CLK(0, 0, 0));
+    cmd_put(&buf, CLK(0, 0, 0));
+    if (!cmd_send(&buf)) {
+        fprintf(stderr, "jtag: cannot select BYPASS\n");
+        return false;
+    }
+
+    // BYPASS is a one bit register, every captured bit is the TDI of the clock before
+    const uint64_t busy_start = host_pio_busy_ns(0, JTAG_PIO_SM);
+    const double start = wall_s();
+    bool prev_tdi = false;
+    uint32_t bits = 0;
+    while (bits < opt->jtag_bits) {
+        const uint32_t chunk = opt->jtag_bits - bits < JTAG_CHUNK_BITS ? opt->jtag_bits - bits : JTAG_CHUNK_BITS;
+        const uint32_t pattern_seed = s_rand;
+
+        cmd_reset(&buf);
+        for (uint32_t i = 0; i < chunk; i++) {
+            cmd_put(&buf, CLK(0, rand32() & 1, 1));
+        }
+        if (!cmd_send(&buf) || !vendor_read_all(tdo, (chunk + 7) / 8)) {
+            fprintf(stderr, "jtag: no TDO for bits %u..%u\n", bits, bits + chunk);
+            return false;
+        }
+
+        s_rand = pattern_seed;
+        for (uint32_t i = 0; i < chunk; i++) {
+            const bool tdi = rand32() & 1;
+            if (((tdo[i / 8] >> (i % 8)) & 1) != prev_tdi) {
+                fprintf(stderr, "jtag: BYPASS bit %u doesn't echo TDI\n", bits + i);
+                return false;
+            }
+            prev_tdi = tdi;
+        }
+        bits += chunk;
+    }
+    const double seconds = wall_s() - start;
+    const double busy_s = (host_pio_busy_ns(0, JTAG_PIO_SM) - busy_start) / 1e9;
+
+    result("jtag", "\"idcode\": \"0x%08x\", \"bits\": %u, \"wall_s\": %.6f, \"bits_per_s\": %.0f, "
+           "\"pio_busy_s\": %.6f, \"pio_bits_per_s\": %.0f, \"tck_cycles\": %llu, "
+           "\"idle_run_clocks\": %u, \"idle_run_s\": %.6f",
+           idcode, bits, seconds, bits / seconds, busy_s, busy_s > 0 ? bits / busy_s : 0.0,
+           (unsigned long long) s_tap.tck_cycles, IDLE_RUN_CLOCKS, idle_s);
+    return true;
+}
+
+// Every VEND_JTAG_SETDIV has to come with a clock plan that doesn't run TCK faster than asked for. Within
+// JTAG_TCK_INTEGER_DIV_TOLERANCE percent of the request that is the fastest integer divider, otherwise a
+// fractional one.
+static bool bench_tck(void)
+{
+    static const uint16_t divs[] = { 1, 2, 3, 7, 20, 200 };
+    char plans[256];
+    char dividers[256];
+    size_t used = 0;
+    size_t div_used = 0;
+
+    for (size_t i = 0; i < sizeof(divs) / sizeof(divs[0]); i++) {
+        jtag_tck_plan_t plan;
+        uint16_t len = sizeof(plan);
+
+        host_usb_vendor_control(0, divs[i], 0, NULL, NULL);
+        if (!host_usb_vendor_control(VEND_JTAG_TCK, 0, 0, &plan, &len) || len != sizeof(plan)) {
+            fprintf(stderr, "tck: VEND_JTAG_TCK failed\n");
+            return false;
+        }
+        const uint32_t requested = 20000000 / divs[i];
+        const double div = plan.div_int + plan.div_frac / 256.0;
+        const uint32_t expected = (uint32_t) (clock_get_hz(clk_sys) / (div * plan.cycles_per_bit));
+        if (plan.requested_hz != requested || plan.actual_hz > requested || plan.actual_hz + 1 < expected ||
+            plan.actual_hz > expected) {
+            fprintf(stderr, "tck: %u Hz asked, plan says %u Hz at div %.3f\n", requested, plan.actual_hz, div);
+            return false;
+        }
+        const uint32_t int_div = plan.div_frac ? plan.div_int + 1 : plan.div_int;
+        const uint32_t int_hz = clock_get_hz(clk_sys) / (int_div * plan.cycles_per_bit);
+        const bool int_close = (uint64_t) int_hz * 100 >= (uint64_t) requested * (100 - JTAG_TCK_INTEGER_DIV_TOLERANCE);
+        if (int_close != !plan.div_frac) {
+            fprintf(stderr, "tck: %u Hz asked, div %.3f but the integer divider gives %u Hz\n", requested, div, int_hz);
+            return false;
+        }
+        if (!plan.div_frac && plan.div_int > 1 &&
+            clock_get_hz(clk_sys) / ((plan.div_int - 1) * plan.cycles_per_bit) <= requested) {
+            fprintf(stderr, "tck: %u Hz asked, div %.3f isn't the fastest integer divider\n", requested, div);
+            return false;
+        }
+        used += snprintf(plans + used, sizeof(plans) - used, "%s\"%u\": %u", used ? ", " : "", requested,
+                         plan.actual_hz);
+        div_used += snprintf(dividers + div_used, sizeof(dividers) - div_used, "%s\"%u\": %.3f", div_used ? ", " : "",
+                             requested, div);
+    }
+    host_usb_vendor_control(0, 1, 0, NULL, NULL);
+
+    result("tck", "\"clk_sys\": %u, \"actual_hz\": {%s}, \"div\": {%s}", clock_get_hz(clk_sys), plans, dividers);
+    return true;
+}
+
+#if JTAG_CAPTURE_ENABLED
+typedef struct {
+    uint32_t out_bytes;
+    uint32_t controls;
+    uint32_t replies;
+    uint32_t reply_bytes;
+    uint32_t flushes;
+} capture_stats_t;
+
+static uint8_t s_capture[sizeof(jtag_capture_header_t) + JTAG_CAPTURE_SIZE];
+
+// Walks the records of a dump, with replay the OUT data and control requests go to the bridge as well and
+// the TDO bytes that come back have to match the IN records
+static bool capture_walk(const uint8_t *dump, size_t len, bool replay, capture_stats_t *stats)
+{
+    jtag_capture_header_t header;
+    uint8_t tdo[512];
+    uint32_t received = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    if (len < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, dump, sizeof(header));
+    if (header.magic != JTAG_CAPTURE_MAGIC || header.version != JTAG_CAPTURE_VERSION ||
+            header.header_size + header.used > len) {
+        fprintf(stderr, "capture: not a JTAG capture\n");
+        return false;
+    }
+
+    for (size_t pos = header.header_size; pos < header.header_size + header.used;) {
+        jtag_capture_record_t record;
+        memcpy(&record, dump + pos, sizeof(record));
+        const uint8_t *data = dump + pos + sizeof(record);
+        pos += sizeof(record) + record.size;
+        if (pos > header.header_size + header.used) {
+            fprintf(stderr, "capture: truncated record\n");
+            return false;
+        }
+
+        switch (record.type) {
+        case JTAG_CAPTURE_OUT:
+            if (replay && host_usb_vendor_write(data, record.size, 1000) != record.size) {
+                fprintf(stderr, "capture: the bridge stopped taking commands\n");
+                return false;
+            }
+            stats->out_bytes += record.size;
+            break;
+        case JTAG_CAPTURE_CONTROL: {
+            jtag_capture_control_t control;
+            uint8_t reply[64];
+            uint16_t reply_len = sizeof(reply);
+            memcpy(&control, data, sizeof(control));
+            if (replay) {
+                host_usb_vendor_control(control.request, control.value, control.index, reply, &reply_len);
+            }
+            stats->controls++;
+            break;
+        }
+        case JTAG_CAPTURE_IN: {
+            uint16_t bytes;
+            memcpy(&bytes, data, sizeof(bytes));
+            stats->replies++;
+            stats->reply_bytes += bytes;
+            stats->flushes += (record.flags & JTAG_CAPTURE_FLUSH) ? 1 : 0;
+            break;
+        }
+        default:
+            break;
+        }
+
+        // Keep the IN side moving, the bridge only buffers USB_SNDBUF_SIZE bytes of TDO
+        while (replay && received < stats->reply_bytes) {
+            const size_t n = host_usb_vendor_read(tdo, sizeof(tdo), 0);
+            if (n == 0) {
+                break;
+            }
+            received += n;
+        }
+    }
+
+    while (replay && received < stats->reply_bytes) {
+        const size_t n = host_usb_vendor_read(tdo, sizeof(tdo), 1000);
+        if (n == 0) {
+            break;
+        }
+        received += n;
+    }
+    if (replay && (received != stats->reply_bytes || host_usb_vendor_read(tdo, sizeof(tdo), 50) != 0)) {
+        fprintf(stderr, "capture: replay got other TDO byte counts than the capture (%u of %u)\n", received,
+                stats->reply_bytes);
+        return false;
+    }
+    return true;
+}
+
+static bool capture_read(bool clear, size_t *len)
+{
+    uint16_t n = sizeof(s_capture);
+
+    if (!host_usb_vendor_control(VEND_JTAG_CAPTURE, clear ? JTAG_CAPTURE_CLEAR : 0, 0, s_capture, &n)) {
+        fprintf(stderr, "capture: VEND_JTAG_CAPTURE failed\n");
+        return false;
+    }
+    *len = n;
+    return true;
+}
+
+static bool bench_capture(const options_t *opt)
+{
+    static cmd_buf_t buf;
+    uint8_t tdo[JTAG_CHUNK_BITS / 8];
+    capture_stats_t stats, replayed;
+    uint32_t sent = 0, received = 0;
+    size_t len;
+
+    // Starts a new capture, bench_jtag() left the TAP in Shift-DR with BYPASS selected
+    if (!capture_read(true, &len)) {
+        return false;
+    }
+    host_usb_vendor_control(0, 2, 0, NULL, NULL);
+    for (int n = 0; n < 8; n++) {
+        const uint32_t bits = 1 + rand32() % JTAG_CHUNK_BITS;
+        cmd_reset(&buf);
+        for (uint32_t i = 0; i < bits; i++) {
+            cmd_put(&buf, CLK(0, rand32() & 1, 1));
+        }
+        if (!cmd_send(&buf) || !vendor_read_all(tdo, (bits + 7) / 8)) {
+            fprintf(stderr, "capture: no TDO\n");
+            return false;
+        }
+        sent += buf.nibbles / 2;
+        received += (bits + 7) / 8;
+    }
+    host_usb_vendor_control(0, 1, 0, NULL, NULL);
+
+    if (!capture_read(false, &len) || !capture_walk(s_capture, len, false, &stats)) {
+        return false;
+    }
+    if (opt->capture_file) {
+        FILE *f = fopen(opt->capture_file, "wb");
+        if (!f || fwrite(s_capture, 1, len, f) != len || fclose(f) != 0) {
+            fprintf(stderr, "capture: can't write %s\n", opt->capture_file);
+            return false;
+        }
+    }
+    if (stats.out_bytes != sent || stats.reply_bytes != received || stats.controls != 2 || stats.flushes != 8) {
+        fprintf(stderr, "capture: %u of %u command bytes, %u of %u TDO bytes, %u control requests, %u flushes\n",
+                stats.out_bytes, sent, stats.reply_bytes, received, stats.controls, stats.flushes);
+        return false;
+    }
+
+    // The capture grows while it is replayed, the copy doesn't
+    static uint8_t copy[sizeof(s_capture)];
+    memcpy(copy, s_capture, len);
+    const double start = wall_s();
+    if (!capture_walk(copy, len, true, &replayed)) {
+        return false;
+    }
+    result("capture", "\"bytes\": %zu, \"command_bytes\": %u, \"replies\": %u, \"replay_s\": %.6f", len,
+           stats.out_bytes, stats.replies, wall_s() - start);
+    return true;
+}
+
+static bool bench_replay(const options_t *opt)
+{
+    static uint8_t dump[sizeof(jtag_capture_header_t) + 0xFFFF];
+    capture_stats_t stats;
+
+    FILE *f = fopen(opt->replay_file, "rb");
+    if (!f) {
+        fprintf(stderr, "replay: can't read %s\n", opt->replay_file);
+        return false;
+    }
+    const size_t len = fread(dump, 1, sizeof(dump), f);
+    fclose(f);
+
+    const double start = wall_s();
+    if (!capture_walk(dump, len, true, &stats)) {
+        return false;
+    }
+    const double seconds = wall_s() - start;
+    result("replay", "\"command_bytes\": %u, \"controls\": %u, \"replies\": %u, \"reply_bytes\": %u, "
+           "\"wall_s\": %.6f, \"command_bytes_per_s\": %.0f", stats.out_bytes, stats.controls, stats.replies,
+           stats.reply_bytes, seconds, stats.out_bytes / seconds);
+    return true;
+}
+#endif
+
+static void echo_tx(void *ctx, const uint8_t *data, size_t size)
+{
+    (void) ctx;
+    host_uart_target_send(1, data, size);
+}
+
+static bool serial_roundtrip(const uint8_t *data, size_t size)
+{
+    uint8_t echo[SERIAL_CHUNK];
+    size_t received = 0;
+
+    if (host_usb_cdc_write(data, size, 1000) != size) {
+        return false;
+    }
+    while (received < size) {
+        const size_t n = host_usb_cdc_read(echo + received, size - received, 1000);
+        if (n == 0) {
+            return false;
+        }
+        received += n;
+    }
+    return memcmp(data, echo, size) == 0;
+}
+
+static bool check_line_state(bool dtr, bool rts, bool boot, bool rst)
+{
+    host_usb_cdc_set_line_state(dtr, rts);
+    if (host_gpio_level(GPIO_BOOT) != boot || host_gpio_level(GPIO_RST) != rst) {
+        fprintf(stderr, "serial: DTR %d RTS %d gave BOOT %d RST %d\n", dtr, rts,
+                host_gpio_level(GPIO_BOOT), host_gpio_level(GPIO_RST));
+        return false;
+    }
+    return true;
+}
+
+static bool bench_serial(const options_t *opt)
+{
+    const host_uart_target_t echo = { echo_tx, NULL, NULL };
+    uint8_t data[SERIAL_CHUNK];
+
+    host_uart_attach(1, &echo);
+    host_usb_cdc_set_line_coding(PROG_UART_BITRATE);
+
+    // The UART isn't paced, so data goes back and forth a chunk at a time
+    const double start = wall_s();
+    uint32_t bytes = 0;
+    while (bytes < opt->serial_bytes) {
+        for (size_t i = 0; i < sizeof(data); i++) {
+            data[i] = (uint8_t) rand32();
+        }
+        if (!serial_roundtrip(data, sizeof(data))) {
+            fprintf(stderr, "serial: loopback failed after %u bytes\n", bytes);
+            return false;
+        }
+        bytes += sizeof(data);
+    }
+    const double seconds = wall_s() - start;
+
+    double latency_us = 0;
+    const int rounds = 100;
+    for (int i = 0; i < rounds; i++) {
+        const double t = wall_s();
+        data[0] = (uint8_t) i;
+        if (!serial_roundtrip(data, 1)) {
+            fprintf(stderr, "serial: single byte loopback failed\n");
+            return false;
+        }
+        latency_us += (wall_s() - t) * 1e6;
+    }
+
+    // esptool's reset sequence, see tud_cdc_line_state_cb()
+    if (!check_line_state(false, true, true, false) || !check_line_state(true, false, false, true) ||
+            !check_line_state(false, false, true, true)) {
+        return false;
+    }
+
+    result("serial", "\"bytes\": %u, \"wall_s\": %.6f, \"bytes_per_s\": %.0f, \"roundtrip_us\": %.1f, "
+           "\"overruns\": %llu", bytes, seconds, bytes / seconds, latency_us / rounds,
+           (unsigned long long) host_uart_overruns(1));
+    return true;
+}
+
+static bool bench_logger(void)
+{
+    static char log[4096];
+    char marker[32];
+    size_t len = 0;
+
+    snprintf(marker, sizeof(marker), "bridge_bench %08x", rand32());
+    const double start = wall_s();
+#if LOG_DEFERRED_ENABLED
+    // The marker is copied into the record as a string argument, the frame around it is binary
+    DEFERRED_LOG("%s\n", marker);
+#else
+    printf("%s\n", marker);
+#endif
+    while (len < sizeof(log) - 1) {
+        const size_t n = host_logger_read(log + len, sizeof(log) - 1 - len, 1000);
+        if (n == 0) {
+            break;
+        }
+        len += n;
+        log[len] = '\0';
+        if (memmem(log, len, marker, strlen(marker))) {
+            result("logger", "\"latency_us\": %.1f", (wall_s() - start) * 1e6);
+            return true;
+        }
+    }
+    fprintf(stderr, "logger: \"%s\" didn't come out\n", marker);
+    return false;
+}
+
+static bool bench_stats(void)
+{
+    static const char *const names[STATS_BUF_COUNT] = {
+        "usb_send", "uart_to_cdc", "cdc_rx", "cdc_tx", "vendor_rx", "vendor_tx", "log",
+    };
+    static uint8_t snapshot[BRIDGE_STATS_SNAPSHOT_MAX];
+    uint16_t len = sizeof(snapshot);
+    bridge_stats_header_t header;
+    char buffers[512];
+    size_t used = 0;
+
+    if (!host_usb_vendor_control(VEND_STATS, 0, 0, snapshot, &len) || len < sizeof(header)) {
+        fprintf(stderr, "stats: VEND_STATS failed\n");
+        return false;
+    }
+    memcpy(&header, snapshot, sizeof(header));
+    if (header.magic != BRIDGE_STATS_MAGIC || header.buffer_count != STATS_BUF_COUNT ||
+            len != header.header_size + header.buffer_count * sizeof(bridge_stats_buffer_t) +
+            header.task_count * sizeof(bridge_stats_task_t)) {
+        fprintf(stderr, "stats: bad snapshot (%u bytes)\n", len);
+        return false;
+    }
+
+    bridge_stats_buffer_t buffer[STATS_BUF_COUNT];
+    memcpy(buffer, snapshot + header.header_size, sizeof(buffer));
+    for (int n = 0; n < STATS_BUF_COUNT; n++) {
+        used += snprintf(buffers + used, sizeof(buffers) - used, "%s\"%s\": %u", n ? ", " : "", names[n],
+                         buffer[n].high_water);
+    }
+    result("stats", "\"bytes\": %u, \"tasks\": %u, \"high_water\": {%s}", len, header.task_count, buffers);
+
+    if (header.task_count == 0 || buffer[STATS_BUF_VENDOR_RX].high_water == 0) {
+        fprintf(stderr, "stats: the JTAG stream didn't show up\n");
+        return false;
+    }
+    return true;
+}
+
+#if TRACE_ENABLED
+static bool bench_trace(const options_t *opt)
+{
+    static uint8_t dump[sizeof(bridge_trace_header_t) + NUM_CORES * TRACE_RING_SIZE * sizeof(bridge_trace_event_t)];
+    uint16_t len = sizeof(dump);
+    bridge_trace_header_t header;
+    uint32_t events[TRACE_UF2_BLOCK_DONE + 1] = { 0 };
+
+    if (!host_usb_vendor_control(VEND_TRACE, BRIDGE_TRACE_CLEAR, 0, dump, &len) || len != sizeof(dump)) {
+        fprintf(stderr, "trace: VEND_TRACE failed\n");
+        return false;
+    }
+    memcpy(&header, dump, sizeof(header));
+    if (header.magic != BRIDGE_TRACE_MAGIC || header.ring_size != TRACE_RING_SIZE) {
+        fprintf(stderr, "trace: bad dump\n");
+        return false;
+    }
+    if (opt->trace_file) {
+        FILE *f = fopen(opt->trace_file, "wb");
+        if (!f || fwrite(dump, 1, len, f) != len) {
+            fprintf(stderr, "trace: can't write %s\n", opt->trace_file);
+            return false;
+        }
+        fclose(f);
+    }
+
+    // Only the core 0 ring is used on the host
+    const bridge_trace_event_t *ring = (const bridge_trace_event_t *) (dump + header.header_size);
+    for (uint32_t n = 0; n < MIN(header.count[0], TRACE_RING_SIZE); n++) {
+        if (ring[n].id < TRACE_UF2_BLOCK_DONE + 1) {
+            events[ring[n].id]++;
+        }
+    }
+    result("trace", "\"events\": %u, \"jtag_flush\": %u, \"uf2_blocks\": %u", header.count[0],
+           events[TRACE_JTAG_FLUSH], events[TRACE_UF2_BLOCK_DONE]);
+
+    // The UF2 copy comes last, its blocks have to be in the ring
+    if (events[TRACE_UF2_BLOCK_START] == 0 || events[TRACE_UF2_BLOCK_DONE] == 0) {
+        fprintf(stderr, "trace: the UF2 blocks didn't show up\n");
+        return false;
+    }
+    return true;
+}
+#endif
+
+#if PROFILE_ENABLED
+static bool bench_profile(const options_t *opt)
+{
+    static uint8_t dump[sizeof(bridge_profile_header_t) + NUM_CORES * PROFILE_SLOTS * sizeof(bridge_profile_slot_t)];
+    uint16_t len = sizeof(dump);
+    bridge_profile_header_t header;
+    uint64_t counted = 0;
+    uint32_t used = 0;
+
+    if (!host_usb_vendor_control(VEND_PROFILE, BRIDGE_PROFILE_RESET, 0, dump, &len) || len != sizeof(dump)) {
+        fprintf(stderr, "profile: VEND_PROFILE failed\n");
+        return false;
+    }
+    memcpy(&header, dump, sizeof(header));
+    if (header.magic != BRIDGE_PROFILE_MAGIC || header.slots != PROFILE_SLOTS || header.rate_hz != PROFILE_HZ) {
+        fprintf(stderr, "profile: bad dump\n");
+        return false;
+    }
+    if (opt->profile_file) {
+        FILE *f = fopen(opt->profile_file, "wb");
+        if (!f || fwrite(dump, 1, len, f) != len) {
+            fprintf(stderr, "profile: can't write %s\n", opt->profile_file);
+            return false;
+        }
+        fclose(f);
+    }
+
+    // SIGPROF stands in for the alarm of core 0 on the host
+    const bridge_profile_slot_t *table = (const bridge_profile_slot_t *) (dump + header.header_size);
+    for (uint32_t n = 0; n < PROFILE_SLOTS; n++) {
+        counted += table[n].count;
+        used += table[n].count != 0;
+    }
+    result("profile", "\"samples\": %u, \"missed\": %u, \"pcs\": %u, \"elapsed_s\": %.3f", header.samples[0],
+           header.missed[0], used, header.elapsed_us / 1e6);
+
+    if (header.samples[0] == 0 || counted + header.missed[0] != header.samples[0]) {
+        fprintf(stderr, "profile: %u samples, %llu in the table and %u missed\n", header.samples[0],
+                (unsigned long long) counted, header.missed[0]);
+        return false;
+    }
+    return true;
+}
+#endif
+
+// Block n of image, cut into chunk sized payloads
+static void make_uf2_block(uf2_block_t *block, const uint8_t *image, uint32_t size, uint32_t chunk, uint32_t n)
+{
+    const uint32_t blocks = (size + chunk - 1) / chunk;
+
+    memset(block, 0, sizeof(*block));
+    block->magic0 = UF2_FIRST_MAGIC;
+    block->magic1 = UF2_SECOND_MAGIC;
+    block->flags = UF2_FLAG_FAMILYID_PRESENT;
+    block->addr = UF2_FLASH_OFFSET + n * chunk;
+    block->payload_size = size - n * chunk < chunk ? size - n * chunk : chunk;
+    block->block_no = n;
+    block->blocks = blocks;
+    block->chip_id = UF2_FAMILY_ESP32C3;
+    block->magic3 = UF2_FINAL_MAGIC;
+    memcpy(block->data, image + n * chunk, block->payload_size);
+}
+
+#if TARGET_SETTINGS_ENABLED
+static bool bench_settings(void)
+{
+    const uint32_t key = TARGET_SETTINGS_CHIP_KEY(ESP32C3_CHIP);  // the ROM model's eFuses read 0
+    const uint32_t writes = 3 * KV_STORE_SECTORS * (FLASH_SECTOR_SIZE / 32);   // goes around the sectors three times
+    target_settings_t settings;
+    uint32_t values[3];
+
+    if (!kv_store_get(key, &settings, sizeof(settings)) || settings.chip != ESP32C3_CHIP ||
+            settings.uart_baudrate == 0 || settings.uart_requested == 0) {
+        fprintf(stderr, "settings: the UF2 session didn't store the target's settings\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < writes; i++) {
+        if (!kv_store_set(0x100 + i % 3, &i, sizeof(i))) {
+            fprintf(stderr, "settings: write %u failed\n", i);
+            return false;
+        }
+    }
+    // Like a power cycle, the store is found again from the flash alone
+    kv_store_init();
+
+    target_settings_t stored;
+    for (uint32_t n = 0; n < 3; n++) {
+        if (!kv_store_get(0x100 + n, &values[n], sizeof(values[n])) || values[n] != writes - 3 + n) {
+            fprintf(stderr, "settings: key %u lost its value\n", 0x100 + n);
+            return false;
+        }
+    }
+    if (!kv_store_get(key, &stored, sizeof(stored)) || memcmp(&stored, &settings, sizeof(stored)) != 0) {
+        fprintf(stderr, "settings: the target's settings didn't survive the compactions\n");
+        return false;
+    }
+
+    // The power goes within the first few flash operations of a write, compactions included: the key
+    // has to come back with either its old value or the new one
+    uint32_t losses = 0;
+    for (uint32_t i = 0; i < writes; i++) {
+        const uint32_t n = i % 3;
+        uint32_t value;
+
+        host_flash_power_loss_after(rand32() % 4);
+        kv_store_set(0x100 + n, &i, sizeof(i));
+        host_flash_power_loss_after(-1);
+        kv_store_init();
+
+        if (!kv_store_get(0x100 + n, &value, sizeof(value)) || (value != values[n] && value != i)) {
+            fprintf(stderr, "settings: key %u lost its value to a power loss on write %u\n", 0x100 + n, i);
+            return false;
+        }
+        losses += value != i;
+        values[n] = value;
+    }
+    if (!kv_store_get(key, &stored, sizeof(stored)) || memcmp(&stored, &settings, sizeof(stored)) != 0) {
+        fprintf(stderr, "settings: the target's settings didn't survive the power losses\n");
+        return false;
+    }
+
+    result("settings", "\"writes\": %u, \"lost_writes\": %u, \"uart_baudrate\": %u, \"uart_requested\": %u",
+           writes, losses, settings.uart_baudrate, settings.uart_requested);
+    return true;
+}
+#endif
+
+#if MSC_STATUS_ENABLED
+// Finds STATUS.TXT through the boot sector and the root directory in sectors, and reads it
+static bool read_status_txt(const uint8_t *sectors, char *text, uint32_t size)
+{
+    const uint32_t per_cluster = sectors[13];
+    const uint32_t root = (sectors[14] | sectors[15] << 8) + sectors[16] * (sectors[22] | sectors[23] << 8);
+    const uint32_t data = root + (sectors[17] | sectors[18] << 8) * 32 / UF2_BLOCK_SIZE;
+
+    for (const uint8_t *entry = sectors + root * UF2_BLOCK_SIZE; entry < sectors + data * UF2_BLOCK_SIZE; entry += 32) {
+        if (memcmp(entry, "STATUS  TXT", 11) != 0) {
+            continue;
+        }
+        const uint32_t cluster = entry[26] | entry[27] << 8;
+        const uint32_t length = entry[28] | entry[29] << 8 | entry[30] << 16 | (uint32_t) entry[31] << 24;
+        if (length >= size) {
+            return false;
+        }
+        const int32_t n = host_usb_msc_read10(data + (cluster - 2) * per_cluster, text, length);
+        text[n > 0 ? n : 0] = '\0';
+        return n == (int32_t) length;
+    }
+    return false;
+}
+#endif
+
+static bool bench_msc(const options_t *opt)
+{
+    const uint32_t blocks = (opt->uf2_size + UF2_PAYLOAD_SIZE - 1) / UF2_PAYLOAD_SIZE;
+    uint8_t *image = malloc(opt->uf2_size);
+    uint8_t *flash = malloc(opt->uf2_size);
+    static uf2_block_t batch[UF2_WRITE_BLOCKS];
+    static uint8_t sectors[FAT_RAM_SECTORS * UF2_BLOCK_SIZE];
+    bool ok = true;
+
+    // The fixed sectors of the disk in one read, several per callback
+    if (host_usb_msc_read10(0, sectors, sizeof(sectors)) != sizeof(sectors) ||
+            sectors[510] != 0x55 || sectors[511] != 0xaa || sectors[UF2_BLOCK_SIZE] != 0xf8) {
+        fprintf(stderr, "msc: multi-sector read of the FAT sectors failed\n");
+        ok = false;
+    }
+
+    for (uint32_t i = 0; i < opt->uf2_size; i++) {
+        image[i] = (uint8_t) rand32();
+    }
+
+    const uint64_t commands = host_esp_rom_commands(s_rom);
+    const double start = wall_s();
+    for (uint32_t n = 0; n < blocks && ok; n += UF2_WRITE_BLOCKS) {
+        const uint32_t count = blocks - n < UF2_WRITE_BLOCKS ? blocks - n : UF2_WRITE_BLOCKS;
+        for (uint32_t i = 0; i < count; i++) {
+            make_uf2_block(&batch[i], image, opt->uf2_size, UF2_PAYLOAD_SIZE, n + i);
+        }
+        if (host_usb_msc_write10(UF2_FIRST_LBA + n, batch, count * UF2_BLOCK_SIZE) != (int32_t) (count * UF2_BLOCK_SIZE)) {
+            fprintf(stderr, "msc: UF2 blocks %u..%u rejected, sense key %u\n", n, n + count - 1,
+                    host_usb_msc_take_sense());
+            ok = false;
+        }
+    }
+    const double seconds = wall_s() - start;
+
+    host_esp_rom_read_flash(s_rom, UF2_FLASH_OFFSET, flash, opt->uf2_size);
+    if (ok && memcmp(image, flash, opt->uf2_size) != 0) {
+        fprintf(stderr, "msc: flash content does not match the image\n");
+        ok = false;
+    }
+#if MSC_STATUS_ENABLED
+    // The session just finished is the newest one in STATUS.TXT
+    static char status[8192];
+    char blocks_line[64];
+    snprintf(blocks_line, sizeof(blocks_line), "blocks      %u of %u, %u bytes", blocks, blocks, opt->uf2_size);
+    if (ok && (!read_status_txt(sectors, status, sizeof(status)) || !strstr(status, ": done\r\n") ||
+               !strstr(status, blocks_line) || !strstr(status, "ESP32-C3, UART"))) {
+        fprintf(stderr, "msc: STATUS.TXT doesn't show the session:\n%s\n", status);
+        ok = false;
+    }
+#endif
+    if (ok) {
+        result("msc", "\"bytes\": %u, \"wall_s\": %.6f, \"bytes_per_s\": %.0f, \"rom_commands\": %llu, "
+               "\"rom_resets\": %llu", opt->uf2_size, seconds, opt->uf2_size / seconds,
+               (unsigned long long) (host_esp_rom_commands(s_rom) - commands),
+               (unsigned long long) host_esp_rom_resets(s_rom));
+    }
+
+    // A block out of order aborts the session, it must not keep the target claimed
+    if (ok && blocks > 2) {
+        make_uf2_block(&batch[0], image, opt->uf2_size, UF2_PAYLOAD_SIZE, 0);
+        make_uf2_block(&batch[1], image, opt->uf2_size, UF2_PAYLOAD_SIZE, 2);
+        if (host_usb_msc_write10(UF2_FIRST_LBA, &batch[0], UF2_BLOCK_SIZE) != UF2_BLOCK_SIZE ||
+                host_usb_msc_write10(UF2_FIRST_LBA + 2, &batch[1], UF2_BLOCK_SIZE) == UF2_BLOCK_SIZE ||
+                uf2_flash_busy()) {
+            fprintf(stderr, "msc: a block out of order didn't end the session\n");
+            ok = false;
+        }
+        host_usb_msc_take_sense();
+    }
+
+    // A copy dropped after the switch to the flashing baud rate, then a complete one that has to start over
+    // from the default rate
+    if (ok && blocks > UF2_WRITE_BLOCKS) {
+        for (uint32_t i = 0; i < opt->uf2_size; i++) {
+            image[i] = (uint8_t) rand32();
+        }
+        for (uint32_t i = 0; i < UF2_WRITE_BLOCKS; i++) {
+            make_uf2_block(&batch[i], image, opt->uf2_size, UF2_PAYLOAD_SIZE, i);
+        }
+        ok = host_usb_msc_write10(UF2_FIRST_LBA, batch, sizeof(batch)) == (int32_t) sizeof(batch);
+
+        for (uint32_t i = 0; i < opt->uf2_size; i++) {
+            image[i] = (uint8_t) rand32();
+        }
+        for (uint32_t n = 0; n < blocks && ok; n += UF2_WRITE_BLOCKS) {
+            const uint32_t count = blocks - n < UF2_WRITE_BLOCKS ? blocks - n : UF2_WRITE_BLOCKS;
+            for (uint32_t i = 0; i < count; i++) {
+                make_uf2_block(&batch[i], image, opt->uf2_size, UF2_PAYLOAD_SIZE, n + i);
+            }
+            const int32_t bytes = (int32_t) (count * UF2_BLOCK_SIZE);
+            ok = host_usb_msc_write10(UF2_FIRST_LBA + n, batch, bytes) == bytes;
+        }
+        host_esp_rom_read_flash(s_rom, UF2_FLASH_OFFSET, flash, opt->uf2_size);
+        if (!ok || memcmp(image, flash, opt->uf2_size) != 0) {
+            fprintf(stderr, "msc: an image copied after an interrupted one didn't make it to flash, sense key %u\n",
+                    host_usb_msc_take_sense());
+            ok = false;
+        }
+    }
+    free(image);
+    free(flash);
+    return ok;
+}
+
+#if JTAG_FLASH_ENABLED
+// Stands in for a stub built with tools/jtag_stub_to_c.py, the debug module model runs the protocol
+static const uint8_t s_stub_code[] = { 0x6f, 0x00, 0x00, 0x00 };    // j .
+static const jtag_flash_stub_segment_t s_stub_segments[] = {
+    { STUB_RAM_ADDR, sizeof(s_stub_code), s_stub_code },
+};
+static const jtag_flash_stub_t s_stub = { STUB_RAM_ADDR, STUB_RAM_ADDR + 0x100, 1, s_stub_segments };
+
+const jtag_flash_stub_t *jtag_flash_stub_find(uint32_t uf2_family)
+{
+    return uf2_family == UF2_FAMILY_ESP32C3 ? &s_stub : NULL;
+}
+
+// Copies the first `count` blocks of an image tagged for the JTAG backend to the disk
+static bool jtag_flash_copy(const uint8_t *image, uint32_t size, uint32_t count)
+{
+    static uf2_block_t batch[UF2_WRITE_BLOCKS];
+
+    for (uint32_t n = 0; n < count; n += UF2_WRITE_BLOCKS) {
+        const uint32_t batch_count = count - n < UF2_WRITE_BLOCKS ? count - n : UF2_WRITE_BLOCKS;
+        for (uint32_t i = 0; i < batch_count; i++) {
+            make_uf2_block(&batch[i], image, size, JTAG_FLASH_CHUNK, n + i);
+        }
+        if (n == 0) {
+            // The backend tag of tools/uf2_backend.py, after the payload
+            const uint32_t tag = 5 | (UF2_TAG_BRIDGE_BACKEND << 8);
+            const uint32_t pos = (batch[0].payload_size + 3) & ~3u;
+            batch[0].flags |= UF2_FLAG_EXTENSION_TAGS;
+            memcpy(&batch[0].data[pos], &tag, sizeof(tag));
+            batch[0].data[pos + 4] = UF2_BACKEND_JTAG;
+        }
+        const int32_t bytes = (int32_t) (batch_count * UF2_BLOCK_SIZE);
+        if (host_usb_msc_write10(UF2_FIRST_LBA + n, batch, bytes) != bytes) {
+            fprintf(stderr, "jtag_flash: UF2 blocks %u..%u rejected, sense key %u\n", n, n + batch_count - 1,
+                    host_usb_msc_take_sense());
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool bench_jtag_flash(const options_t *opt)
+{
+    const uint32_t blocks = (opt->uf2_size + JTAG_FLASH_CHUNK - 1) / JTAG_FLASH_CHUNK;
+    uint8_t *image = malloc(opt->uf2_size);
+    bool ok = true;
+
+    const uint64_t commands = host_esp_rom_commands(s_rom);
+    const uint64_t starts = s_dm.stub_starts;
+
+    // A copy dropped halfway keeps its session open until the next block 0 starts over
+    for (uint32_t i = 0; i < opt->uf2_size; i++) {
+        image[i] = (uint8_t) rand32();
+    }
+    ok = jtag_flash_copy(image, opt->uf2_size, blocks / 2);
+
+    for (uint32_t i = 0; i < opt->uf2_size; i++) {
+        image[i] = (uint8_t) rand32();
+    }
+    const double start = wall_s();
+    ok = ok && jtag_flash_copy(image, opt->uf2_size, blocks);
+    const double seconds = wall_s() - start;
+
+    if (ok && (s_dm.stub_starts != starts + 2 || host_esp_rom_commands(s_rom) != commands)) {
+        fprintf(stderr, "jtag_flash: the image didn't go through the stub\n");
+        ok = false;
+    }
+    if (ok && memcmp(image, s_dm_flash + UF2_FLASH_OFFSET, opt->uf2_size) != 0) {
+        fprintf(stderr, "jtag_flash: stub flash content does not match the image\n");
+        ok = false;
+    }
+#if MSC_STATUS_ENABLED
+    static uint8_t sectors[FAT_RAM_SECTORS * UF2_BLOCK_SIZE];
+    static char status[8192];
+    if (ok && (host_usb_msc_read10(0, sectors, sizeof(sectors)) != sizeof(sectors) ||
+               !read_status_txt(sectors, status, sizeof(status)) || !strstr(status, "ESP32-C3, JTAG"))) {
+        fprintf(stderr, "jtag_flash: STATUS.TXT doesn't show the JTAG session:\n%s\n", status);
+        ok = false;
+    }
+#endif
+    if (ok) {
+        result("jtag_flash", "\"bytes\": %u, \"chunk\": %u, \"wall_s\": %.6f, \"bytes_per_s\": %.0f, "
+               "\"tck_cycles\": %llu", opt->uf2_size, JTAG_FLASH_CHUNK, seconds, opt->uf2_size / seconds,
+               (unsigned long long) s_tap.tck_cycles);
+    }
+    free(image);
+    return ok;
+}
+#endif
+
+// A capture run longer than the bridge's TDO buffer: CLK and eight REPs, the last one REP1, make 16385 to 32768
+// clocks. All of it has to come back and nothing more.
+static bool fuzz_long_capture(void)
+{
+    static cmd_buf_t buf;
+    static uint8_t tdo[32768 / 8];
+    uint8_t extra;
+    uint32_t bits = 1;
+
+    vendor_drain();
+    cmd_reset(&buf);
+    cmd_put(&buf, CLK(0, rand32() & 1, 1));
+    for (int i = 0; i < 7; i++) {
+        const uint32_t digit = rand32() % 4;
+        cmd_put(&buf, CMD_REP0 + digit);
+        bits += digit << (2 * i);
+    }
+    cmd_put(&buf, CMD_REP0 + 1);
+    bits += 1u << 14;
+
+    const size_t size = (bits + 7) / 8;
+    if (!cmd_send(&buf) || !vendor_read_all(tdo, size) || host_usb_vendor_read(&extra, 1, 50) != 0) {
+        fprintf(stderr, "fuzz: a %u bit capture run didn't come back as %zu bytes\n", bits, size);
+        return false;
+    }
+    return true;
+}
+
+static bool fuzz_vendor(void)
+{
+    static cmd_buf_t buf;
+    uint8_t data[512];
+    const size_t nibbles = 1 + rand32() % 1024;
+    int reps = 0;
+
+    if (rand32() % 8 == 0) {
+        return fuzz_long_capture();
+    }
+
+    cmd_reset(&buf);
+    for (size_t i = 0; i < nibbles; i++) {
+        uint8_t cmd = rand32() & 0x0f;
+        // Long REP runs are clocked out in real time, more than 5 REPs would make an iteration last seconds.
+        // Like jtag_task(), only a CLK, FLUSH or RSV command starts a new run.
+        if (cmd >= CMD_REP0 && ++reps > 5) {
+            cmd = CLK(0, 0, 0);
+        }
+        if (cmd < CMD_SRST0 || cmd == CMD_FLUSH || cmd == CMD_FLUSH + 1) {
+            reps = 0;
+        }
+        cmd_put(&buf, cmd);
+    }
+    host_usb_vendor_write(buf.bytes, (buf.nibbles + 1) / 2, 100);
+    while (host_usb_vendor_read(data, sizeof(data), 0)) {
+    }
+    return true;
+}
+
+static void fuzz_control(void)
+{
+    uint8_t data[64];
+    uint16_t len = sizeof(data);
+
+    // SETDIV, SETIO, GETTDO, SET_CHIPID and whatever comes after them
+    host_usb_vendor_control(rand32() % 6, (uint16_t) rand32(), (uint16_t) rand32(), data, &len);
+}
+
+static void fuzz_cdc(void)
+{
+    uint8_t data[SERIAL_CHUNK];
+    const size_t size = 1 + rand32() % sizeof(data);
+
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t) rand32();
+    }
+    switch (rand32() % 4) {
+    case 0:
+        host_usb_cdc_set_line_state(rand32() & 1, rand32() & 1);
+        break;
+    case 1:
+        host_usb_cdc_set_line_coding(rand32() % 3 ? 115200 : 9600 + rand32() % 2000000);
+        break;
+    default:
+        host_usb_cdc_write(data, size, 100);
+        break;
+    }
+    while (host_usb_cdc_read(data, sizeof(data), 0)) {
+    }
+}
+
+static void fuzz_msc(void)
+{
+    static const uint8_t image[UF2_PAYLOAD_SIZE * 4];
+    uf2_block_t block;
+
+    const uint32_t lba = rand32() % (UF2_FIRST_LBA + 64);
+    if (rand32() & 1) {
+        host_usb_msc_read10(lba, &block, sizeof(block));
+        return;
+    }
+
+    // A valid block with a few words scrambled, or plain garbage
+    make_uf2_block(&block, image, sizeof(image), UF2_PAYLOAD_SIZE, rand32() % 4);
+    if (rand32() % 4) {
+        uint32_t *words = (uint32_t *) &block;
+        for (int i = 1 + rand32() % 3; i > 0; i--) {
+            const uint32_t w = rand32() % 8;
+            words[w] = rand32() & 1 ? rand32() : words[w] ^ (1u << (rand32() % 32));
+        }
+    } else {
+        for (size_t i = 0; i < sizeof(block); i++) {
+            ((uint8_t *) &block)[i] = (uint8_t) rand32();
+        }
+    }
+    host_usb_msc_write10(lba, &block, sizeof(block));
+    host_usb_msc_take_sense();
+}
+
+static bool fuzz(const options_t *opt)
+{
+    const double start = wall_s();
+
+    for (uint32_t i = 0; i < opt->fuzz; i++) {
+        switch (rand32() % 5) {
+        case 0:
+            if (!fuzz_vendor()) {
+                return false;
+            }
+            break;
+        case 1:
+            fuzz_control();
+            break;
+        case 2:
+            fuzz_cdc();
+            break;
+        default:
+            fuzz_msc();
+            break;
+        }
+    }
+
+    // Back to a known state for the checks: line idle, JTAG at full speed, no TDO pending
+    host_usb_cdc_set_line_state(false, false);
+    host_usb_cdc_set_line_coding(PROG_UART_BITRATE);
+    host_usb_vendor_control(0, 1, 0, NULL, NULL);
+    vendor_drain();
+    result("fuzz", "\"iterations\": %u, \"seed\": %u, \"wall_s\": %.6f", opt->fuzz, opt->seed, wall_s() - start);
+    return true;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [--jtag-bits N] [--serial-bytes N] [--uf2-size BYTES] [--fuzz ITERATIONS] [--seed N] "
+            "[--trace FILE] [--profile FILE] [--capture FILE] [--replay FILE]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    options_t opt = {
+        .jtag_bits = 64 * 1024,
+        .serial_bytes = 64 * 1024,
+        .uf2_size = 64 * 1024,
+        .fuzz = 0,
+        .seed = 1,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        if (!strcmp(argv[i], "--jtag-bits")) {
+            opt.jtag_bits = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--serial-bytes")) {
+            opt.serial_bytes = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--uf2-size")) {
+            opt.uf2_size = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--fuzz")) {
+            opt.fuzz = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--seed")) {
+            opt.seed = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--trace")) {
+            opt.trace_file = argv[++i];
+        } else if (!strcmp(argv[i], "--profile")) {
+            opt.profile_file = argv[++i];
+        } else if (!strcmp(argv[i], "--capture")) {
+            opt.capture_file = argv[++i];
+        } else if (!strcmp(argv[i], "--replay")) {
+            opt.replay_file = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (opt.uf2_size == 0 || opt.uf2_size > 1024 * 1024) {
+        fprintf(stderr, "--uf2-size must be between 1 and 1048576\n");
+        return 2;
+    }
+    s_rand = opt.seed ? opt.seed : 1;
+
+    // A hang anywhere in the firmware fails the run instead of stalling CI
+    alarm(WATCHDOG_S);
+
+    host_jtag_tap_init(&s_tap, TAP_IDCODE);
+#if JTAG_FLASH_ENABLED
+    host_riscv_dm_init(&s_dm);
+    s_dm.ram_addr = STUB_RAM_ADDR;
+    s_dm.ram_size = sizeof(s_dm_ram);
+    s_dm.ram = s_dm_ram;
+    s_dm.ring_addr = STUB_RAM_ADDR + STUB_RAM_SIZE - STUB_RING_SIZE;
+    s_dm.ring_size = STUB_RING_SIZE;
+    s_dm.stub_entry = s_stub.entry;
+    s_dm.stub_ctrl = s_stub.ctrl_addr;
+    s_dm.flash = s_dm_flash;
+    s_dm.flash_size = sizeof(s_dm_flash);
+    s_tap.dm = &s_dm;
+#endif
+    const host_jtag_target_t tap = { host_jtag_tap_clock, &s_tap };
+    host_jtag_attach(&tap);
+
+    host_bridge_start();
+    // Let the tasks get through their start-up before the host shows up
+    usleep(100 * 1000);
+
+#if JTAG_CAPTURE_ENABLED
+    if (opt.replay_file) {
+        const bool replayed = bench_replay(&opt);
+        fprintf(stdout, "%s\"ok\": %s\n}\n", s_first_result ? "{\n  " : ",\n  ", replayed ? "true" : "false");
+        return replayed ? 0 : 1;
+    }
+#endif
+
+    bool ok = bench_jtag(&opt) && bench_tck();
+#if JTAG_CAPTURE_ENABLED
+    ok = ok && bench_capture(&opt);
+#endif
+    ok = ok && bench_serial(&opt) && bench_logger();
+
+    // The serial bench owns the UART until here, the MSC path needs a chip on it
+    s_rom = host_esp_rom_attach(1, GPIO_BOOT, GPIO_RST);
+#if JTAG_FLASH_ENABLED
+    ok = ok && bench_jtag_flash(&opt);
+#endif
+    ok = ok && bench_msc(&opt) && bench_stats();
+#if TARGET_SETTINGS_ENABLED
+    ok = ok && bench_settings();
+#endif
+#if TRACE_ENABLED
+    ok = ok && bench_trace(&opt);
+#endif
+#if PROFILE_ENABLED
+    ok = ok && bench_profile(&opt);
+#endif
+
+    if (ok && opt.fuzz) {
+        ok = fuzz(&opt) && bench_jtag(&opt) && bench_logger() && bench_msc(&opt) && bench_stats();
+    }
+
+    fprintf(stdout, "%s\"ok\": %s\n}\n", s_first_result ? "{\n  " : ",\n  ", ok ? "true" : "false");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * FreeRTOS API on POSIX threads for the host build, see src/freertos_posix.c.
+ *
+ * Every task is a thread and all kernel objects share one lock and one condition variable, so
+ * blocking calls behave like FreeRTOS (timeouts, trigger levels, suspension while blocked) without
+ * modelling priorities. The bridge's own FreeRTOSConfig.h is used for the tick rate.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#include "FreeRTOSConfig.h"
+
+#ifndef configTASK_NOTIFICATION_ARRAY_ENTRIES
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES   1
+#endif
+
+#define pdTRUE                  ((BaseType_t) 1)
+#define pdFALSE                 ((BaseType_t) 0)
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define errQUEUE_EMPTY          ((BaseType_t) 0)
+#define errQUEUE_FULL           ((BaseType_t) 0)
+
+#define portMAX_DELAY           ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS      ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t) (((uint64_t) (xTimeInMs) * configTICK_RATE_HZ) / 1000U))
+#define pdTICKS_TO_MS(xTicks)   ((TickType_t) (((uint64_t) (xTicks) * 1000U) / configTICK_RATE_HZ))
+
+// Interrupt handlers run on the thread that raised them, see host_isr_enter()
+#define portYIELD_FROM_ISR(x)   ((void) (x))
+#define portYIELD()
+#define portCHECK_IF_IN_ISR()   host_in_isr()
+#define portENTER_CRITICAL()    host_critical_enter()
+#define portEXIT_CRITICAL()     host_critical_exit()
+#define taskENTER_CRITICAL()    host_critical_enter()
+#define taskEXIT_CRITICAL()     host_critical_exit()
+#define taskYIELD()
+
+#define tskIDLE_PRIORITY        ((UBaseType_t) 0U)
+
+bool host_in_isr(void);
+void host_isr_enter(void);
+void host_isr_exit(void);
+void host_critical_enter(void);
+void host_critical_exit(void);
+
+// Semaphores and mutexes
+typedef struct host_sem {
+    uint8_t kind;
+    bool dynamic;
+    UBaseType_t count;
+    UBaseType_t max_count;
+    void *holder;
+    UBaseType_t recursion;
+} StaticSemaphore_t;
+
+// Stream buffers
+typedef struct host_stream {
+    uint8_t *storage;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    size_t trigger;
+    bool dynamic;
+} StaticStreamBuffer_t;
+
+// Tasks, the host never uses the stack buffer of a static task
+typedef struct host_task *TaskHandle_t;
+typedef struct {
+    uint8_t reserved;
+} StaticTask_t;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,38 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Interrupts are handler calls on the host, masking them is a critical section
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+// Tasks are threads, the firmware's barriers have to order their memory accesses too
+#define __dmb() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __dsb() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __isb()
+#define __sev()
+#define __wfe()
+#define __wfi()
+
+#ifdef __cplusplus
+}
+#endif
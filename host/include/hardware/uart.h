@@ -0,0 +1,88 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NUM_UARTS 2
+#define UART_FIFO_DEPTH 32
+
+// Only the data register is backed by a model, see src/hal_uart.c
+typedef struct {
+    io_rw_32 dr;
+    io_rw_32 rsr;
+    uint32_t _pad0[4];
+    io_ro_32 fr;
+} uart_hw_t;
+
+typedef struct uart_inst uart_inst_t;
+
+extern uart_hw_t host_uart_hw[NUM_UARTS];
+
+#define uart0_hw (&host_uart_hw[0])
+#define uart1_hw (&host_uart_hw[1])
+#define uart0 ((uart_inst_t *) uart0_hw)
+#define uart1 ((uart_inst_t *) uart1_hw)
+
+typedef enum {
+    UART_PARITY_NONE,
+    UART_PARITY_EVEN,
+    UART_PARITY_ODD
+} uart_parity_t;
+
+static inline uint uart_get_index(uart_inst_t *uart)
+{
+    return uart == uart1 ? 1 : 0;
+}
+
+static inline uart_hw_t *uart_get_hw(uart_inst_t *uart)
+{
+    return (uart_hw_t *) uart;
+}
+
+static inline uint uart_get_dreq(uart_inst_t *uart, bool is_tx)
+{
+    // DREQ_UART0_TX is 20, see hardware/dma.h
+    return 20 + uart_get_index(uart) * 2 + (is_tx ? 0 : 1);
+}
+
+uint uart_init(uart_inst_t *uart, uint baudrate);
+void uart_deinit(uart_inst_t *uart);
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate);
+uint uart_get_baudrate(uart_inst_t *uart);
+void uart_set_hw_flow(uart_inst_t *uart, bool cts, bool rts);
+void uart_set_format(uart_inst_t *uart, uint data_bits, uint stop_bits, uart_parity_t parity);
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data);
+void uart_set_fifo_enabled(uart_inst_t *uart, bool enabled);
+bool uart_is_enabled(uart_inst_t *uart);
+bool uart_is_writable(uart_inst_t *uart);
+bool uart_is_readable(uart_inst_t *uart);
+void uart_tx_wait_blocking(uart_inst_t *uart);
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len);
+void uart_read_blocking(uart_inst_t *uart, uint8_t *dst, size_t len);
+void uart_putc_raw(uart_inst_t *uart, char c);
+void uart_putc(uart_inst_t *uart, char c);
+void uart_puts(uart_inst_t *uart, const char *s);
+char uart_getc(uart_inst_t *uart);
+bool uart_is_readable_within_us(uart_inst_t *uart, uint32_t us);
+
+#ifdef __cplusplus
+}
+#endif
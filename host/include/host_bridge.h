@@ -0,0 +1,167 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Scripting interface of the host build: the USB host side of the bridge's endpoints, the far end
+ * of its UART and JTAG pins, and the captured logger output. Everything here may be called from
+ * any thread that isn't a bridge task.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Creates the bridge's tasks the way main.c does and starts them
+void host_bridge_start(void);
+
+// Microseconds since start, the clock behind get_absolute_time()
+uint64_t host_time_us(void);
+
+// USB device state, the bridge comes up mounted
+void host_usb_set_mounted(bool mounted);
+
+// Vendor (JTAG) interface. write blocks while the OUT FIFO is full, read returns what the device
+// has committed to the IN endpoint. Both give up after timeout_ms and return the bytes moved.
+size_t host_usb_vendor_write(const void *data, size_t size, uint32_t timeout_ms);
+size_t host_usb_vendor_read(void *data, size_t size, uint32_t timeout_ms);
+
+// Vendor control request. For IN requests *len is the buffer size on entry and the reply length on
+// return. Returns false if the device stalls the request.
+bool host_usb_vendor_control(uint8_t request, uint16_t value, uint16_t index, void *data, uint16_t *len);
+
+// CDC interface, same semantics as the vendor calls
+size_t host_usb_cdc_write(const void *data, size_t size, uint32_t timeout_ms);
+size_t host_usb_cdc_read(void *data, size_t size, uint32_t timeout_ms);
+void host_usb_cdc_set_line_coding(uint32_t bit_rate);
+void host_usb_cdc_set_line_state(bool dtr, bool rts);
+
+// MSC interface, transfers are split into CFG_TUD_MSC_EP_BUFSIZE callbacks like TinyUSB does.
+// Return the bytes transferred, -1 if the device failed the command.
+int32_t host_usb_msc_read10(uint32_t lba, void *data, uint32_t size);
+int32_t host_usb_msc_write10(uint32_t lba, const void *data, uint32_t size);
+// Sense key of the last failed command, cleared by reading it
+uint8_t host_usb_msc_take_sense(void);
+
+// Far end of a UART. tx gets every byte the bridge sends, baudrate every rate change. Both are
+// called on the bridge's thread and may call host_uart_target_send().
+typedef struct {
+    void (*tx)(void *ctx, const uint8_t *data, size_t size);
+    void (*baudrate)(void *ctx, uint32_t baudrate);
+    void *ctx;
+} host_uart_target_t;
+
+void host_uart_attach(unsigned uart_index, const host_uart_target_t *target);
+// Feeds the UART's RX FIFO and raises its interrupt; bytes that find the FIFO full are dropped
+void host_uart_target_send(unsigned uart_index, const uint8_t *data, size_t size);
+uint64_t host_uart_overruns(unsigned uart_index);
+
+// Pin level changes of the GPIOs, as seen from outside the bridge
+typedef void (*host_gpio_watch_t)(void *ctx, unsigned pin, bool level);
+void host_gpio_watch(host_gpio_watch_t watch, void *ctx);
+// Drives an input pin from outside, the level gpio_get() sees while the pin isn't an output
+void host_gpio_drive(unsigned pin, bool level);
+void host_gpio_release(unsigned pin);
+bool host_gpio_level(unsigned pin);
+
+// ESP ROM loader model of components/esp_loader/test on a UART. A rising edge on rst_pin resets
+// it, into download mode if boot_pin is low at that moment.
+typedef struct host_esp_rom host_esp_rom_t;
+
+host_esp_rom_t *host_esp_rom_attach(unsigned uart_index, unsigned boot_pin, unsigned rst_pin);
+// Copy of the model's flash, size bytes from addr
+void host_esp_rom_read_flash(host_esp_rom_t *rom, uint32_t addr, void *data, uint32_t size);
+uint64_t host_esp_rom_commands(host_esp_rom_t *rom);
+uint64_t host_esp_rom_resets(host_esp_rom_t *rom);
+
+// JTAG target clocked by the PIO model. clock() gets TMS and TDI of a rising TCK edge and returns
+// the TDO level after the following falling edge.
+typedef struct {
+    bool (*clock)(void *ctx, bool tms, bool tdi);
+    void *ctx;
+} host_jtag_target_t;
+
+void host_jtag_attach(const host_jtag_target_t *target);
+
+// RISC-V debug module (spec 0.13) with one hart and a system bus that reaches ram. A hart resumed
+// at stub_entry runs the flasher stub protocol of jtag_flash.h on the control block at stub_ctrl,
+// with its ring at ring_addr, and writes the image to flash.
+typedef struct {
+    uint32_t ram_addr;
+    uint32_t ram_size;
+    uint8_t *ram;
+    uint32_t stub_entry;
+    uint32_t stub_ctrl;
+    uint32_t ring_addr;
+    uint32_t ring_size;
+    uint8_t *flash;
+    uint32_t flash_size;
+    uint64_t stub_starts;
+    // Debug module and stub state
+    bool halted;
+    bool resumeack;
+    bool stub_running;
+    uint32_t dmi_data;
+    uint32_t data0;
+    uint32_t dpc;
+    uint32_t abstractcs;
+    uint32_t sbcs;
+    uint32_t sbaddress;
+    uint32_t sbdata;
+    uint32_t stub_addr;
+    uint32_t stub_size;
+    uint32_t stub_written;
+} host_riscv_dm_t;
+
+// Clears the debug module, the memory and stub fields are filled in afterwards
+void host_riscv_dm_init(host_riscv_dm_t *dm);
+
+// Built-in TAP with a 5 bit IR, IDCODE (0x01) and BYPASS (all other instructions). With a debug
+// module attached, DTMCS (0x10) and DMI (0x11) reach it.
+typedef struct {
+    uint32_t idcode;
+    host_riscv_dm_t *dm;
+    uint64_t tck_cycles;
+    uint64_t dr_scans;
+    uint64_t ir_scans;
+    uint8_t state;
+    uint8_t ir;
+    uint8_t ir_shift;
+    uint8_t dr_len;
+    uint64_t dr_shift;
+} host_jtag_tap_t;
+
+void host_jtag_tap_init(host_jtag_tap_t *tap, uint32_t idcode);
+bool host_jtag_tap_clock(void *tap, bool tms, bool tdi);
+
+// PIO state machine clock cycles spent on the words it was given, at the configured divider this
+// is the time the real state machine would have been busy
+uint64_t host_pio_busy_ns(unsigned pio_index, unsigned sm);
+
+// Bytes the PIO UART logger put on its pin
+size_t host_logger_read(char *data, size_t size, uint32_t timeout_ms);
+
+// The bridge's own flash loses power after ops more erases or programs: later ones leave it as it
+// is, until the next call. A negative ops keeps it powered.
+void host_flash_power_loss_after(int32_t ops);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,63 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * pico-sdk platform definitions for the host build. The headers under pico/ and hardware/ declare
+ * the part of the SDK the bridge uses, src/hal_*.c model the peripherals behind it.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+// The ARM toolchain's headers drag string.h in, some bridge sources rely on it
+#include <string.h>
+
+typedef unsigned int uint;
+
+typedef volatile uint32_t io_rw_32;
+typedef const volatile uint32_t io_ro_32;
+typedef volatile uint32_t io_wo_32;
+
+#define __not_in_flash(group)
+#define __not_in_flash_func(func_name) func_name
+#define __no_inline_not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __in_flash(group)
+#define __isr
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define PICO_FLASH_SIZE_BYTES   (2 * 1024 * 1024)
+#define NUM_CORES               2
+// Like the SDK's host platform, code for the RP2040 peripherals themselves is left out
+#define PICO_ON_DEVICE          0
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+
+#define tight_loop_contents()
+
+// Every task runs on core 0 as far as the firmware can tell
+static inline uint get_core_num(void)
+{
+    return 0;
+}
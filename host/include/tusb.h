@@ -0,0 +1,235 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * TinyUSB device API for the host build. The bridge's tusb_config.h sets the FIFO sizes, the
+ * endpoints themselves are driven from the host side through host_bridge.h (src/usb_device.c).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define OPT_OS_NONE             1
+#define OPT_OS_FREERTOS         2
+#define OPT_OS_PICO             5
+#define OPT_MCU_NONE            0
+#define OPT_MCU_RP2040          1900
+#define OPT_MODE_DEFAULT_SPEED  0x0000
+
+#include "tusb_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TU_ATTR_WEAK __attribute__ ((weak))
+#define TU_ATTR_PACKED __attribute__ ((packed))
+
+typedef enum {
+    TUSB_REQ_TYPE_STANDARD = 0,
+    TUSB_REQ_TYPE_CLASS,
+    TUSB_REQ_TYPE_VENDOR,
+    TUSB_REQ_TYPE_INVALID
+} tusb_request_type_t;
+
+typedef enum {
+    TUSB_REQ_RCPT_DEVICE = 0,
+    TUSB_REQ_RCPT_INTERFACE,
+    TUSB_REQ_RCPT_ENDPOINT,
+    TUSB_REQ_RCPT_OTHER
+} tusb_request_recipient_t;
+
+typedef enum {
+    TUSB_DIR_OUT = 0,
+    TUSB_DIR_IN = 1,
+} tusb_dir_t;
+
+enum {
+    CONTROL_STAGE_IDLE,
+    CONTROL_STAGE_SETUP,
+    CONTROL_STAGE_DATA,
+    CONTROL_STAGE_ACK
+};
+
+typedef struct TU_ATTR_PACKED {
+    union {
+        struct TU_ATTR_PACKED {
+            uint8_t recipient :  5;
+            uint8_t type      :  2;
+            uint8_t direction :  1;
+        } bmRequestType_bit;
+        uint8_t bmRequestType;
+    };
+    uint8_t bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+} tusb_control_request_t;
+
+typedef struct TU_ATTR_PACKED {
+    uint32_t bit_rate;
+    uint8_t stop_bits;
+    uint8_t parity;
+    uint8_t data_bits;
+} cdc_line_coding_t;
+
+enum {
+    SCSI_SENSE_NONE = 0x00,
+    SCSI_SENSE_RECOVERED_ERROR = 0x01,
+    SCSI_SENSE_NOT_READY = 0x02,
+    SCSI_SENSE_MEDIUM_ERROR = 0x03,
+    SCSI_SENSE_HARDWARE_ERROR = 0x04,
+    SCSI_SENSE_ILLEGAL_REQUEST = 0x05,
+    SCSI_SENSE_UNIT_ATTENTION = 0x06,
+    SCSI_SENSE_DATA_PROTECT = 0x07,
+};
+
+enum {
+    SCSI_CMD_TEST_UNIT_READY = 0x00,
+    SCSI_CMD_INQUIRY = 0x12,
+    SCSI_CMD_MODE_SELECT_6 = 0x15,
+    SCSI_CMD_MODE_SENSE_6 = 0x1A,
+    SCSI_CMD_START_STOP_UNIT = 0x1B,
+    SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL = 0x1E,
+    SCSI_CMD_READ_CAPACITY_10 = 0x25,
+    SCSI_CMD_REQUEST_SENSE = 0x03,
+    SCSI_CMD_READ_FORMAT_CAPACITY = 0x23,
+    SCSI_CMD_READ_10 = 0x28,
+    SCSI_CMD_WRITE_10 = 0x2A,
+};
+
+// Device stack
+bool tud_init(uint8_t rhport);
+void tud_task(void);
+bool tud_inited(void);
+bool tud_mounted(void);
+bool tud_ready(void);
+bool tud_connected(void);
+bool tud_suspended(void);
+bool tud_remote_wakeup(void);
+
+// Control transfers, valid inside tud_vendor_control_xfer_cb()
+bool tud_control_xfer(uint8_t rhport, tusb_control_request_t const *request, void *buffer, uint16_t len);
+bool tud_control_status(uint8_t rhport, tusb_control_request_t const *request);
+
+// Vendor class
+uint32_t tud_vendor_n_available(uint8_t itf);
+uint32_t tud_vendor_n_read(uint8_t itf, void *buffer, uint32_t bufsize);
+bool tud_vendor_n_peek(uint8_t itf, uint8_t *u8);
+void tud_vendor_n_read_flush(uint8_t itf);
+uint32_t tud_vendor_n_write(uint8_t itf, void const *buffer, uint32_t bufsize);
+uint32_t tud_vendor_n_write_available(uint8_t itf);
+uint32_t tud_vendor_n_flush(uint8_t itf);
+bool tud_vendor_n_mounted(uint8_t itf);
+
+static inline uint32_t tud_vendor_available(void)
+{
+    return tud_vendor_n_available(0);
+}
+
+static inline uint32_t tud_vendor_read(void *buffer, uint32_t bufsize)
+{
+    return tud_vendor_n_read(0, buffer, bufsize);
+}
+
+static inline uint32_t tud_vendor_write(void const *buffer, uint32_t bufsize)
+{
+    return tud_vendor_n_write(0, buffer, bufsize);
+}
+
+static inline uint32_t tud_vendor_write_available(void)
+{
+    return tud_vendor_n_write_available(0);
+}
+
+static inline uint32_t tud_vendor_flush(void)
+{
+    return tud_vendor_n_flush(0);
+}
+
+// CDC class
+bool tud_cdc_n_connected(uint8_t itf);
+uint8_t tud_cdc_n_get_line_state(uint8_t itf);
+void tud_cdc_n_get_line_coding(uint8_t itf, cdc_line_coding_t *coding);
+uint32_t tud_cdc_n_available(uint8_t itf);
+uint32_t tud_cdc_n_read(uint8_t itf, void *buffer, uint32_t bufsize);
+void tud_cdc_n_read_flush(uint8_t itf);
+uint32_t tud_cdc_n_write(uint8_t itf, void const *buffer, uint32_t bufsize);
+uint32_t tud_cdc_n_write_flush(uint8_t itf);
+uint32_t tud_cdc_n_write_available(uint8_t itf);
+bool tud_cdc_n_write_clear(uint8_t itf);
+
+static inline bool tud_cdc_connected(void)
+{
+    return tud_cdc_n_connected(0);
+}
+
+static inline uint32_t tud_cdc_available(void)
+{
+    return tud_cdc_n_available(0);
+}
+
+static inline uint32_t tud_cdc_read(void *buffer, uint32_t bufsize)
+{
+    return tud_cdc_n_read(0, buffer, bufsize);
+}
+
+static inline void tud_cdc_read_flush(void)
+{
+    tud_cdc_n_read_flush(0);
+}
+
+static inline uint32_t tud_cdc_write(void const *buffer, uint32_t bufsize)
+{
+    return tud_cdc_n_write(0, buffer, bufsize);
+}
+
+static inline uint32_t tud_cdc_write_flush(void)
+{
+    return tud_cdc_n_write_flush(0);
+}
+
+static inline uint32_t tud_cdc_write_available(void)
+{
+    return tud_cdc_n_write_available(0);
+}
+
+// MSC class
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, uint8_t add_sense_qualifier);
+
+// Callbacks, the ones the bridge doesn't implement have weak defaults in src/usb_device.c
+void tud_mount_cb(void);
+void tud_umount_cb(void);
+void tud_vendor_rx_cb(uint8_t itf);
+void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes);
+bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const *request);
+void tud_cdc_rx_cb(uint8_t itf);
+void tud_cdc_tx_complete_cb(uint8_t itf);
+void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts);
+void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const *p_line_coding);
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4]);
+bool tud_msc_test_unit_ready_cb(uint8_t lun);
+void tud_msc_capacity_cb(uint8_t lun, uint32_t *block_count, uint16_t *block_size);
+bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bool load_eject);
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void *buffer, uint32_t bufsize);
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *buffer, uint32_t bufsize);
+int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer, uint16_t bufsize);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,73 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The bridge's start-up from main.c, minus the parts that only concern the board
+
+#include "ubp_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "tusb.h"
+#include "hardware/clocks.h"
+#include "jtag.h"
+#include "serial.h"
+#include "msc.h"
+#include "uf2_flash.h"
+#include "flash_bin.h"
+#include "bridge_flash.h"
+#include "kv_store.h"
+#include "bridge_profile.h"
+#include "pio_uart_logger/pio_uart_logger.h"
+#include "host_bridge.h"
+
+static void tusb_device_task(void *pvParameters)
+{
+    (void) pvParameters;
+    while (1) {
+        tud_task();
+    }
+}
+
+void host_bridge_start(void)
+{
+#if RP2040_OVERCLOCK_ENABLED
+    set_sys_clock_khz(260000, true);
+#endif
+
+    // Always on here so the logger path can be exercised whatever LOG_LEVEL is
+    start_pio_uart_logger(pio0, LOGGER_UART_TX_PIN, LOGGER_UART_BITRATE);
+
+    tud_init(BOARD_TUD_RHPORT);
+
+#if TARGET_SETTINGS_ENABLED
+    bridge_flash_init();
+    kv_store_init();
+#endif
+
+    xTaskCreateAffinitySet(tusb_device_task, "tusb_device_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_USB_TASK, CORE_AFFINITY_USB_TASK, NULL);
+#if MSC_ENABLED
+    uf2_flash_init();
+    xTaskCreateAffinitySet(msc_task, "msc_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_BRIDGE_TASK, CORE_AFFINITY_MSC_TASK, NULL);
+#if MSC_FLASH_BIN_ENABLED
+    xTaskCreateAffinitySet(flash_bin_task, "flash_bin_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_BRIDGE_TASK, CORE_AFFINITY_FLASH_BIN_TASK, NULL);
+#endif
+#endif
+    xTaskCreateAffinitySet(start_serial_task, "start_serial_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_BRIDGE_TASK, CORE_AFFINITY_SERIAL_TASK, NULL);
+    xTaskCreateAffinitySet(jtag_task, "jtag_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_BRIDGE_TASK, CORE_AFFINITY_JTAG_TASK, NULL);
+#if PROFILE_ENABLED
+    xTaskCreateAffinitySet(bridge_profile_task, "profile_start", STACK_SIZE_FROM_BYTES(1024), NULL, configMAX_PRIORITIES - 1, 1 << 0, NULL);
+#endif
+
+    vTaskStartScheduler();
+}
@@ -0,0 +1,112 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// EspRomEmulator wired to a UART and the BOOT/RST pins of the host build
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include "esp_rom_emulator.h"
+#include "host_bridge.h"
+
+struct host_esp_rom {
+    EspRomEmulator emulator{EmulatorTiming()};
+    std::mutex lock;
+    unsigned uart_index;
+    unsigned boot_pin;
+    unsigned rst_pin;
+    bool rst_level = true;
+    uint64_t resets = 0;
+};
+
+static void rom_tx(void *ctx, const uint8_t *data, size_t size)
+{
+    host_esp_rom *rom = static_cast<host_esp_rom *>(ctx);
+    std::vector<uint8_t> response;
+
+    {
+        std::lock_guard<std::mutex> guard(rom->lock);
+        rom->emulator.host_write(data, size);
+
+        // The bridge is never too slow to take the response, virtual time jumps to its end
+        uint8_t byte;
+        const uint64_t until = rom->emulator.response_until();
+        while (rom->emulator.host_read(&byte, until)) {
+            response.push_back(byte);
+        }
+    }
+
+    if (!response.empty()) {
+        host_uart_target_send(rom->uart_index, response.data(), response.size());
+    }
+}
+
+static void rom_baudrate(void *ctx, uint32_t baudrate)
+{
+    host_esp_rom *rom = static_cast<host_esp_rom *>(ctx);
+    std::lock_guard<std::mutex> guard(rom->lock);
+
+    rom->emulator.host_set_baudrate(baudrate);
+}
+
+static void rom_gpio(void *ctx, unsigned pin, bool level)
+{
+    host_esp_rom *rom = static_cast<host_esp_rom *>(ctx);
+
+    if (pin != rom->rst_pin) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(rom->lock);
+    if (level && !rom->rst_level) {
+        rom->emulator.reset(!host_gpio_level(rom->boot_pin));
+        rom->resets++;
+    }
+    rom->rst_level = level;
+}
+
+host_esp_rom_t *host_esp_rom_attach(unsigned uart_index, unsigned boot_pin, unsigned rst_pin)
+{
+    host_esp_rom *rom = new host_esp_rom;
+    rom->uart_index = uart_index;
+    rom->boot_pin = boot_pin;
+    rom->rst_pin = rst_pin;
+    rom->rst_level = host_gpio_level(rst_pin);
+
+    const host_uart_target_t target = { rom_tx, rom_baudrate, rom };
+    host_uart_attach(uart_index, &target);
+    host_gpio_watch(rom_gpio, rom);
+    return rom;
+}
+
+void host_esp_rom_read_flash(host_esp_rom_t *rom, uint32_t addr, void *data, uint32_t size)
+{
+    std::lock_guard<std::mutex> guard(rom->lock);
+    const std::vector<uint8_t> &flash = rom->emulator.flash();
+
+    memcpy(data, flash.data() + addr, std::min<size_t>(size, flash.size() - addr));
+}
+
+uint64_t host_esp_rom_commands(host_esp_rom_t *rom)
+{
+    std::lock_guard<std::mutex> guard(rom->lock);
+    return rom->emulator.stats().commands;
+}
+
+uint64_t host_esp_rom_resets(host_esp_rom_t *rom)
+{
+    std::lock_guard<std::mutex> guard(rom->lock);
+    return rom->resets;
+}
@@ -0,0 +1,950 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * FreeRTOS on POSIX threads, see FreeRTOS.h.
+ *
+ * A task is a detached thread that waits for vTaskStartScheduler(). Suspension is honoured
+ * whenever the task is inside the kernel: a task suspended while it's blocked doesn't take the
+ * data or semaphore it was waiting for, one suspended while running stops at its next kernel call.
+ */
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "stream_buffer.h"
+#include "host_bridge.h"
+#include "host_internal.h"
+
+#define TASK_NAME_LEN   16
+
+enum {
+    SEM_BINARY,
+    SEM_COUNTING,
+    SEM_MUTEX,
+    SEM_RECURSIVE_MUTEX
+};
+
+enum {
+    NOTIFY_NONE,
+    NOTIFY_WAITING,
+    NOTIFY_RECEIVED
+};
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t code;
+    void *param;
+    char name[TASK_NAME_LEN];
+    UBaseType_t priority;
+    bool suspended;
+    bool deleted;
+    uint32_t notify_value[configTASK_NOTIFICATION_ARRAY_ENTRIES];
+    uint8_t notify_state[configTASK_NOTIFICATION_ARRAY_ENTRIES];
+    struct host_task *next;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond;
+static pthread_mutex_t s_critical;
+static bool s_scheduler_started;
+static struct host_task *s_tasks;
+static __thread struct host_task *s_self;
+static __thread int s_isr_depth;
+
+__attribute__((constructor)) static void kernel_init(void)
+{
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_cond, &cond_attr);
+
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical, &mutex_attr);
+}
+
+host_deadline_t host_deadline_ms(uint32_t ms)
+{
+    host_deadline_t deadline = { .forever = ms == UINT32_MAX };
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline.ts);
+    const uint64_t ns = deadline.ts.tv_nsec + (uint64_t) ms * 1000000;
+    deadline.ts.tv_sec += ns / 1000000000;
+    deadline.ts.tv_nsec = ns % 1000000000;
+    return deadline;
+}
+
+host_deadline_t host_deadline_ticks(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY) {
+        return host_deadline_ms(UINT32_MAX);
+    }
+    return host_deadline_ms(pdTICKS_TO_MS(ticks));
+}
+
+void host_kernel_lock(void)
+{
+    pthread_mutex_lock(&s_lock);
+}
+
+void host_kernel_unlock(void)
+{
+    pthread_mutex_unlock(&s_lock);
+}
+
+void host_kernel_notify(void)
+{
+    pthread_cond_broadcast(&s_cond);
+}
+
+// Threads the bridge didn't create (the scripts, the alarm thread) get a task on their first call
+static struct host_task *current_task(void)
+{
+    if (s_self == NULL) {
+        s_self = calloc(1, sizeof(struct host_task));
+        s_self->thread = pthread_self();
+        strcpy(s_self->name, "host");
+        s_self->next = s_tasks;
+        s_tasks = s_self;
+    }
+    return s_self;
+}
+
+static void wait_while_suspended(struct host_task *self)
+{
+    while (self->suspended) {
+        pthread_cond_wait(&s_cond, &s_lock);
+    }
+}
+
+bool host_kernel_wait(const host_deadline_t *deadline)
+{
+    bool in_time = true;
+
+    if (deadline->forever) {
+        pthread_cond_wait(&s_cond, &s_lock);
+    } else {
+        in_time = pthread_cond_timedwait(&s_cond, &s_lock, &deadline->ts) != ETIMEDOUT;
+    }
+    wait_while_suspended(current_task());
+    return in_time;
+}
+
+// Kernel lock plus the suspension point of a running task
+static struct host_task *kernel_enter(void)
+{
+    host_kernel_lock();
+    struct host_task *self = current_task();
+    if (s_isr_depth == 0) {
+        wait_while_suspended(self);
+    }
+    return self;
+}
+
+bool host_in_isr(void)
+{
+    return s_isr_depth > 0;
+}
+
+void host_isr_enter(void)
+{
+    s_isr_depth++;
+}
+
+void host_isr_exit(void)
+{
+    s_isr_depth--;
+}
+
+void host_critical_enter(void)
+{
+    pthread_mutex_lock(&s_critical);
+}
+
+void host_critical_exit(void)
+{
+    pthread_mutex_unlock(&s_critical);
+}
+
+/*
+ * Tasks
+ */
+
+static void *task_entry(void *arg)
+{
+    struct host_task *task = arg;
+
+    s_self = task;
+    host_kernel_lock();
+    while (!s_scheduler_started || task->suspended) {
+        pthread_cond_wait(&s_cond, &s_lock);
+    }
+    host_kernel_unlock();
+
+    task->code(task->param);
+
+    fprintf(stderr, "task %s returned\n", task->name);
+    abort();
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters,
+                       UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask)
+{
+    struct host_task *task = calloc(1, sizeof(struct host_task));
+    pthread_attr_t attr;
+
+    (void) usStackDepth;
+    task->code = pxTaskCode;
+    task->param = pvParameters;
+    task->priority = uxPriority;
+    snprintf(task->name, sizeof(task->name), "%s", pcName);
+
+    host_kernel_lock();
+    task->next = s_tasks;
+    s_tasks = task;
+    host_kernel_unlock();
+
+    if (pxCreatedTask) {
+        *pxCreatedTask = task;
+    }
+
+    // Host code needs more stack than the firmware sizes for, the thread keeps the default
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&task->thread, &attr, task_entry, task) != 0) {
+        return pdFAIL;
+    }
+    pthread_attr_destroy(&attr);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreateAffinitySet(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth,
+                                  void *pvParameters, UBaseType_t uxPriority, UBaseType_t uxCoreAffinityMask,
+                                  TaskHandle_t *pxCreatedTask)
+{
+    (void) uxCoreAffinityMask;
+    return xTaskCreate(pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t pxTaskCode, const char *pcName, uint32_t ulStackDepth,
+                               void *pvParameters, UBaseType_t uxPriority, StackType_t *puxStackBuffer,
+                               StaticTask_t *pxTaskBuffer)
+{
+    TaskHandle_t task = NULL;
+
+    (void) puxStackBuffer;
+    (void) pxTaskBuffer;
+    xTaskCreate(pxTaskCode, pcName, ulStackDepth, pvParameters, uxPriority, &task);
+    return task;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    struct host_task *self = kernel_enter();
+    struct host_task *task = xTaskToDelete ? xTaskToDelete : self;
+
+    // Another thread can't be stopped safely, it stays suspended at its next kernel call instead
+    task->deleted = true;
+    task->suspended = true;
+    host_kernel_notify();
+    host_kernel_unlock();
+
+    if (task == self) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    if (xTicksToDelay == 0) {
+        sched_yield();
+        return;
+    }
+
+    kernel_enter();
+    const host_deadline_t deadline = host_deadline_ticks(xTicksToDelay);
+    while (host_kernel_wait(&deadline)) {
+    }
+    host_kernel_unlock();
+}
+
+void vTaskDelayUntil(TickType_t *pxPreviousWakeTime, TickType_t xTimeIncrement)
+{
+    const TickType_t wake = *pxPreviousWakeTime + xTimeIncrement;
+    const TickType_t now = xTaskGetTickCount();
+
+    *pxPreviousWakeTime = wake;
+    if ((int32_t) (wake - now) > 0) {
+        vTaskDelay(wake - now);
+    }
+}
+
+void vTaskSuspend(TaskHandle_t xTaskToSuspend)
+{
+    struct host_task *self = kernel_enter();
+    struct host_task *task = xTaskToSuspend ? xTaskToSuspend : self;
+
+    task->suspended = true;
+    host_kernel_notify();
+    wait_while_suspended(self);
+    host_kernel_unlock();
+}
+
+void vTaskResume(TaskHandle_t xTaskToResume)
+{
+    host_kernel_lock();
+    if (!xTaskToResume->deleted) {
+        xTaskToResume->suspended = false;
+    }
+    host_kernel_notify();
+    host_kernel_unlock();
+}
+
+BaseType_t xTaskResumeFromISR(TaskHandle_t xTaskToResume)
+{
+    vTaskResume(xTaskToResume);
+    return pdFALSE;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask)
+{
+    host_kernel_lock();
+    const UBaseType_t priority = (xTask ? xTask : current_task())->priority;
+    host_kernel_unlock();
+    return priority;
+}
+
+void vTaskPrioritySet(TaskHandle_t xTask, UBaseType_t uxNewPriority)
+{
+    host_kernel_lock();
+    (xTask ? xTask : current_task())->priority = uxNewPriority;
+    host_kernel_unlock();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    host_kernel_lock();
+    struct host_task *self = current_task();
+    host_kernel_unlock();
+    return self;
+}
+
+TaskHandle_t xTaskGetHandle(const char *pcNameToQuery)
+{
+    struct host_task *task;
+
+    host_kernel_lock();
+    for (task = s_tasks; task != NULL; task = task->next) {
+        if (strncmp(task->name, pcNameToQuery, TASK_NAME_LEN - 1) == 0 && !task->deleted) {
+            break;
+        }
+    }
+    host_kernel_unlock();
+    return task;
+}
+
+const char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    return xTaskToQuery ? xTaskToQuery->name : xTaskGetCurrentTaskHandle()->name;
+}
+
+eTaskState eTaskGetState(TaskHandle_t xTask)
+{
+    host_kernel_lock();
+    const eTaskState state = xTask->deleted ? eDeleted : xTask->suspended ? eSuspended : eReady;
+    host_kernel_unlock();
+    return state;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t) (host_time_us() * configTICK_RATE_HZ / 1000000);
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+BaseType_t xTaskGetSchedulerState(void)
+{
+    return s_scheduler_started ? taskSCHEDULER_RUNNING : taskSCHEDULER_NOT_STARTED;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask)
+{
+    (void) xTask;
+    return 1024;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *pxTaskStatusArray, UBaseType_t uxArraySize, uint32_t *pulTotalRunTime)
+{
+    UBaseType_t count = 0;
+
+    host_kernel_lock();
+    for (struct host_task *task = s_tasks; task != NULL && count < uxArraySize; task = task->next) {
+        // Threads that merely called into the kernel aren't tasks, and they may be gone already
+        if (task->code == NULL || task->deleted) {
+            continue;
+        }
+        TaskStatus_t *status = &pxTaskStatusArray[count];
+        memset(status, 0, sizeof(*status));
+        status->xHandle = task;
+        status->pcTaskName = task->name;
+        status->xTaskNumber = ++count;
+        status->eCurrentState = task->suspended ? eSuspended : eReady;
+        status->uxCurrentPriority = task->priority;
+        status->uxBasePriority = task->priority;
+        status->usStackHighWaterMark = uxTaskGetStackHighWaterMark(task);
+
+        clockid_t clock;
+        struct timespec ts;
+        if (pthread_getcpuclockid(task->thread, &clock) == 0 && clock_gettime(clock, &ts) == 0) {
+            status->ulRunTimeCounter = (uint32_t) (ts.tv_sec * 1000000ull + ts.tv_nsec / 1000);
+        }
+    }
+    host_kernel_unlock();
+
+    if (pulTotalRunTime) {
+        *pulTotalRunTime = (uint32_t) host_time_us();
+    }
+    return count;
+}
+
+void vTaskStartScheduler(void)
+{
+    host_kernel_lock();
+    s_scheduler_started = true;
+    host_kernel_notify();
+    host_kernel_unlock();
+}
+
+void vTaskSuspendAll(void)
+{
+    host_critical_enter();
+}
+
+BaseType_t xTaskResumeAll(void)
+{
+    host_critical_exit();
+    return pdFALSE;
+}
+
+/*
+ * Task notifications
+ */
+
+static BaseType_t notify_locked(struct host_task *task, UBaseType_t index, uint32_t value, eNotifyAction action,
+                                uint32_t *previous)
+{
+    BaseType_t ret = pdPASS;
+
+    configASSERT(index < configTASK_NOTIFICATION_ARRAY_ENTRIES);
+    if (previous) {
+        *previous = task->notify_value[index];
+    }
+
+    const uint8_t state = task->notify_state[index];
+    switch (action) {
+    case eSetBits:
+        task->notify_value[index] |= value;
+        break;
+    case eIncrement:
+        task->notify_value[index]++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notify_value[index] = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (state == NOTIFY_RECEIVED) {
+            ret = pdFAIL;
+        } else {
+            task->notify_value[index] = value;
+        }
+        break;
+    case eNoAction:
+        break;
+    }
+    task->notify_state[index] = NOTIFY_RECEIVED;
+    host_kernel_notify();
+    return ret;
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, UBaseType_t uxIndexToNotify, uint32_t ulValue,
+                              eNotifyAction eAction, uint32_t *pulPreviousNotificationValue)
+{
+    kernel_enter();
+    const BaseType_t ret = notify_locked(xTaskToNotify, uxIndexToNotify, ulValue, eAction,
+                                         pulPreviousNotificationValue);
+    host_kernel_unlock();
+    return ret;
+}
+
+BaseType_t xTaskGenericNotifyFromISR(TaskHandle_t xTaskToNotify, UBaseType_t uxIndexToNotify, uint32_t ulValue,
+                                     eNotifyAction eAction, uint32_t *pulPreviousNotificationValue,
+                                     BaseType_t *pxHigherPriorityTaskWoken)
+{
+    host_kernel_lock();
+    const BaseType_t ret = notify_locked(xTaskToNotify, uxIndexToNotify, ulValue, eAction,
+                                         pulPreviousNotificationValue);
+    host_kernel_unlock();
+    if (pxHigherPriorityTaskWoken) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return ret;
+}
+
+BaseType_t xTaskGenericNotifyWait(UBaseType_t uxIndexToWaitOn, uint32_t ulBitsToClearOnEntry,
+                                  uint32_t ulBitsToClearOnExit, uint32_t *pulNotificationValue,
+                                  TickType_t xTicksToWait)
+{
+    struct host_task *self = kernel_enter();
+    const host_deadline_t deadline = host_deadline_ticks(xTicksToWait);
+    const UBaseType_t i = uxIndexToWaitOn;
+    BaseType_t ret = pdFALSE;
+
+    configASSERT(i < configTASK_NOTIFICATION_ARRAY_ENTRIES);
+    if (self->notify_state[i] != NOTIFY_RECEIVED) {
+        self->notify_value[i] &= ~ulBitsToClearOnEntry;
+        self->notify_state[i] = NOTIFY_WAITING;
+        while (self->notify_state[i] != NOTIFY_RECEIVED) {
+            if (xTicksToWait == 0 || !host_kernel_wait(&deadline)) {
+                break;
+            }
+        }
+    }
+
+    if (pulNotificationValue) {
+        *pulNotificationValue = self->notify_value[i];
+    }
+    if (self->notify_state[i] == NOTIFY_RECEIVED) {
+        self->notify_value[i] &= ~ulBitsToClearOnExit;
+        ret = pdTRUE;
+    }
+    self->notify_state[i] = NOTIFY_NONE;
+    host_kernel_unlock();
+    return ret;
+}
+
+uint32_t ulTaskGenericNotifyTake(UBaseType_t uxIndexToWaitOn, BaseType_t xClearCountOnExit,
+                                 TickType_t xTicksToWait)
+{
+    struct host_task *self = kernel_enter();
+    const host_deadline_t deadline = host_deadline_ticks(xTicksToWait);
+    const UBaseType_t i = uxIndexToWaitOn;
+
+    configASSERT(i < configTASK_NOTIFICATION_ARRAY_ENTRIES);
+    if (self->notify_value[i] == 0) {
+        self->notify_state[i] = NOTIFY_WAITING;
+        while (self->notify_value[i] == 0) {
+            if (xTicksToWait == 0 || !host_kernel_wait(&deadline)) {
+                break;
+            }
+        }
+    }
+
+    const uint32_t value = self->notify_value[i];
+    if (value != 0) {
+        self->notify_value[i] = xClearCountOnExit ? 0 : value - 1;
+    }
+    self->notify_state[i] = NOTIFY_NONE;
+    host_kernel_unlock();
+    return value;
+}
+
+BaseType_t xTaskGenericNotifyStateClear(TaskHandle_t xTask, UBaseType_t uxIndexToClear)
+{
+    host_kernel_lock();
+    struct host_task *task = xTask ? xTask : current_task();
+    const BaseType_t was_pending = task->notify_state[uxIndexToClear] == NOTIFY_RECEIVED;
+    if (was_pending) {
+        task->notify_state[uxIndexToClear] = NOTIFY_NONE;
+    }
+    host_kernel_unlock();
+    return was_pending;
+}
+
+uint32_t ulTaskGenericNotifyValueClear(TaskHandle_t xTask, UBaseType_t uxIndexToClear, uint32_t ulBitsToClear)
+{
+    host_kernel_lock();
+    struct host_task *task = xTask ? xTask : current_task();
+    const uint32_t value = task->notify_value[uxIndexToClear];
+    task->notify_value[uxIndexToClear] &= ~ulBitsToClear;
+    host_kernel_unlock();
+    return value;
+}
+
+/*
+ * Semaphores
+ */
+
+static SemaphoreHandle_t sem_init(StaticSemaphore_t *sem, uint8_t kind, UBaseType_t max_count,
+                                  UBaseType_t initial_count, bool dynamic)
+{
+    memset(sem, 0, sizeof(*sem));
+    sem->kind = kind;
+    sem->max_count = max_count;
+    sem->count = initial_count;
+    sem->dynamic = dynamic;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return sem_init(malloc(sizeof(StaticSemaphore_t)), SEM_BINARY, 1, 0, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *pxSemaphoreBuffer)
+{
+    return sem_init(pxSemaphoreBuffer, SEM_BINARY, 1, 0, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return sem_init(malloc(sizeof(StaticSemaphore_t)), SEM_MUTEX, 1, 1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *pxMutexBuffer)
+{
+    return sem_init(pxMutexBuffer, SEM_MUTEX, 1, 1, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return sem_init(malloc(sizeof(StaticSemaphore_t)), SEM_RECURSIVE_MUTEX, 1, 1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t *pxMutexBuffer)
+{
+    return sem_init(pxMutexBuffer, SEM_RECURSIVE_MUTEX, 1, 1, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
+{
+    return sem_init(malloc(sizeof(StaticSemaphore_t)), SEM_COUNTING, uxMaxCount, uxInitialCount, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCountingStatic(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount,
+                                                 StaticSemaphore_t *pxSemaphoreBuffer)
+{
+    return sem_init(pxSemaphoreBuffer, SEM_COUNTING, uxMaxCount, uxInitialCount, false);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore)
+{
+    if (xSemaphore->dynamic) {
+        free(xSemaphore);
+    }
+}
+
+static BaseType_t sem_take(SemaphoreHandle_t sem, TickType_t ticks, struct host_task *self)
+{
+    const host_deadline_t deadline = host_deadline_ticks(ticks);
+
+    if (sem->kind == SEM_RECURSIVE_MUTEX && sem->holder == self) {
+        sem->recursion++;
+        return pdTRUE;
+    }
+
+    while (sem->count == 0) {
+        if (ticks == 0 || !host_kernel_wait(&deadline)) {
+            return pdFALSE;
+        }
+    }
+
+    sem->count--;
+    if (sem->kind == SEM_MUTEX || sem->kind == SEM_RECURSIVE_MUTEX) {
+        sem->holder = self;
+        sem->recursion = 1;
+    }
+    return pdTRUE;
+}
+
+static BaseType_t sem_give(SemaphoreHandle_t sem, struct host_task *self)
+{
+    if (sem->kind == SEM_MUTEX || sem->kind == SEM_RECURSIVE_MUTEX) {
+        if (self != NULL && sem->holder != self) {
+            return pdFALSE;
+        }
+        if (--sem->recursion > 0) {
+            return pdTRUE;
+        }
+        sem->holder = NULL;
+    }
+
+    if (sem->count >= sem->max_count) {
+        return pdFALSE;
+    }
+    sem->count++;
+    host_kernel_notify();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xTicksToWait)
+{
+    struct host_task *self = kernel_enter();
+    const BaseType_t ret = sem_take(xSemaphore, xTicksToWait, self);
+    host_kernel_unlock();
+    return ret;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t xMutex, TickType_t xTicksToWait)
+{
+    return xSemaphoreTake(xMutex, xTicksToWait);
+}
+
+BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t xSemaphore, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    host_kernel_lock();
+    const BaseType_t ret = sem_take(xSemaphore, 0, NULL);
+    host_kernel_unlock();
+    if (pxHigherPriorityTaskWoken) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    struct host_task *self = kernel_enter();
+    const BaseType_t ret = sem_give(xSemaphore, self);
+    host_kernel_unlock();
+    return ret;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t xMutex)
+{
+    return xSemaphoreGive(xMutex);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t xSemaphore, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    host_kernel_lock();
+    const BaseType_t ret = sem_give(xSemaphore, NULL);
+    host_kernel_unlock();
+    if (pxHigherPriorityTaskWoken) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return ret;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t xSemaphore)
+{
+    host_kernel_lock();
+    const UBaseType_t count = xSemaphore->count;
+    host_kernel_unlock();
+    return count;
+}
+
+TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t xMutex)
+{
+    host_kernel_lock();
+    TaskHandle_t holder = xMutex->holder;
+    host_kernel_unlock();
+    return holder;
+}
+
+/*
+ * Stream buffers
+ */
+
+static StreamBufferHandle_t stream_init(StaticStreamBuffer_t *sb, uint8_t *storage, size_t capacity,
+                                        size_t trigger, bool dynamic)
+{
+    memset(sb, 0, sizeof(*sb));
+    sb->storage = storage;
+    sb->capacity = capacity;
+    sb->trigger = trigger ? trigger : 1;
+    sb->dynamic = dynamic;
+    return sb;
+}
+
+StreamBufferHandle_t xStreamBufferGenericCreate(size_t xBufferSizeBytes, size_t xTriggerLevelBytes,
+                                                BaseType_t xIsMessageBuffer)
+{
+    configASSERT(!xIsMessageBuffer);
+    return stream_init(malloc(sizeof(StaticStreamBuffer_t)), malloc(xBufferSizeBytes), xBufferSizeBytes,
+                       xTriggerLevelBytes, true);
+}
+
+StreamBufferHandle_t xStreamBufferGenericCreateStatic(size_t xBufferSizeBytes, size_t xTriggerLevelBytes,
+                                                      BaseType_t xIsMessageBuffer,
+                                                      uint8_t *const pucStreamBufferStorageArea,
+                                                      StaticStreamBuffer_t *const pxStaticStreamBuffer)
+{
+    configASSERT(!xIsMessageBuffer);
+    // Like FreeRTOS, one byte of a static buffer's storage is never used
+    return stream_init(pxStaticStreamBuffer, pucStreamBufferStorageArea, xBufferSizeBytes - 1,
+                       xTriggerLevelBytes, false);
+}
+
+void vStreamBufferDelete(StreamBufferHandle_t xStreamBuffer)
+{
+    if (xStreamBuffer->dynamic) {
+        free(xStreamBuffer->storage);
+        free(xStreamBuffer);
+    }
+}
+
+static size_t stream_write(StreamBufferHandle_t sb, const uint8_t *data, size_t size)
+{
+    const size_t n = MIN(size, sb->capacity - sb->count);
+    size_t tail = (sb->head + sb->count) % sb->capacity;
+
+    for (size_t i = 0; i < n; i++) {
+        sb->storage[tail] = data[i];
+        tail = tail + 1 == sb->capacity ? 0 : tail + 1;
+    }
+    sb->count += n;
+    if (n) {
+        host_kernel_notify();
+    }
+    return n;
+}
+
+static size_t stream_read(StreamBufferHandle_t sb, uint8_t *data, size_t size)
+{
+    const size_t n = MIN(size, sb->count);
+
+    for (size_t i = 0; i < n; i++) {
+        data[i] = sb->storage[sb->head];
+        sb->head = sb->head + 1 == sb->capacity ? 0 : sb->head + 1;
+    }
+    sb->count -= n;
+    if (n) {
+        host_kernel_notify();
+    }
+    return n;
+}
+
+size_t xStreamBufferSend(StreamBufferHandle_t xStreamBuffer, const void *pvTxData, size_t xDataLengthBytes,
+                         TickType_t xTicksToWait)
+{
+    StreamBufferHandle_t sb = xStreamBuffer;
+    kernel_enter();
+    const host_deadline_t deadline = host_deadline_ticks(xTicksToWait);
+    const size_t required = MIN(xDataLengthBytes, sb->capacity);
+
+    while (xTicksToWait != 0 && sb->capacity - sb->count < required) {
+        if (!host_kernel_wait(&deadline)) {
+            break;
+        }
+    }
+
+    const size_t sent = stream_write(sb, pvTxData, xDataLengthBytes);
+    host_kernel_unlock();
+    return sent;
+}
+
+size_t xStreamBufferSendFromISR(StreamBufferHandle_t xStreamBuffer, const void *pvTxData, size_t xDataLengthBytes,
+                                BaseType_t *const pxHigherPriorityTaskWoken)
+{
+    host_kernel_lock();
+    const size_t sent = stream_write(xStreamBuffer, pvTxData, xDataLengthBytes);
+    host_kernel_unlock();
+    if (pxHigherPriorityTaskWoken) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return sent;
+}
+
+size_t xStreamBufferReceive(StreamBufferHandle_t xStreamBuffer, void *pvRxData, size_t xBufferLengthBytes,
+                            TickType_t xTicksToWait)
+{
+    StreamBufferHandle_t sb = xStreamBuffer;
+    kernel_enter();
+    const host_deadline_t deadline = host_deadline_ticks(xTicksToWait);
+
+    // Only an empty buffer blocks, the trigger level decides when the blocked reader wakes up
+    if (sb->count == 0 && xTicksToWait != 0) {
+        while (sb->count < sb->trigger) {
+            if (!host_kernel_wait(&deadline)) {
+                break;
+            }
+        }
+    }
+
+    const size_t received = stream_read(sb, pvRxData, xBufferLengthBytes);
+    host_kernel_unlock();
+    return received;
+}
+
+size_t xStreamBufferReceiveFromISR(StreamBufferHandle_t xStreamBuffer, void *pvRxData, size_t xBufferLengthBytes,
+                                   BaseType_t *const pxHigherPriorityTaskWoken)
+{
+    host_kernel_lock();
+    const size_t received = stream_read(xStreamBuffer, pvRxData, xBufferLengthBytes);
+    host_kernel_unlock();
+    if (pxHigherPriorityTaskWoken) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return received;
+}
+
+size_t xStreamBufferBytesAvailable(StreamBufferHandle_t xStreamBuffer)
+{
+    host_kernel_lock();
+    const size_t count = xStreamBuffer->count;
+    host_kernel_unlock();
+    return count;
+}
+
+size_t xStreamBufferSpacesAvailable(StreamBufferHandle_t xStreamBuffer)
+{
+    host_kernel_lock();
+    const size_t space = xStreamBuffer->capacity - xStreamBuffer->count;
+    host_kernel_unlock();
+    return space;
+}
+
+BaseType_t xStreamBufferIsEmpty(StreamBufferHandle_t xStreamBuffer)
+{
+    return xStreamBufferBytesAvailable(xStreamBuffer) == 0;
+}
+
+BaseType_t xStreamBufferIsFull(StreamBufferHandle_t xStreamBuffer)
+{
+    return xStreamBufferSpacesAvailable(xStreamBuffer) == 0;
+}
+
+BaseType_t xStreamBufferReset(StreamBufferHandle_t xStreamBuffer)
+{
+    host_kernel_lock();
+    xStreamBuffer->head = 0;
+    xStreamBuffer->count = 0;
+    host_kernel_notify();
+    host_kernel_unlock();
+    return pdPASS;
+}
+
+BaseType_t xStreamBufferSetTriggerLevel(StreamBufferHandle_t xStreamBuffer, size_t xTriggerLevel)
+{
+    if (xTriggerLevel > xStreamBuffer->capacity) {
+        return pdFALSE;
+    }
+
+    host_kernel_lock();
+    xStreamBuffer->trigger = xTriggerLevel ? xTriggerLevel : 1;
+    host_kernel_unlock();
+    return pdTRUE;
+}
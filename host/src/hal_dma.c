@@ -0,0 +1,340 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * DMA. A triggered channel moves data on the triggering thread for as long as its DREQ lets it;
+ * a channel paced by an empty PIO RX FIFO stays busy and carries on when the PIO model pushes.
+ * Completion sets the channel's interrupt status and raises DMA_IRQ_0/1 like the hardware does.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/uart.h"
+#include "host_internal.h"
+
+typedef struct {
+    pthread_mutex_t transfer;
+    bool claimed;
+    dma_channel_config config;
+    const volatile uint8_t *read_addr;
+    volatile uint8_t *write_addr;
+    uint32_t trans_count;
+    uint32_t remaining;
+    bool busy;
+} channel_t;
+
+static pthread_mutex_t s_dma_lock = PTHREAD_MUTEX_INITIALIZER;
+static channel_t s_channels[NUM_DMA_CHANNELS];
+static uint32_t s_irq_status;
+static uint32_t s_irq_enabled[2];
+
+__attribute__((constructor)) static void dma_init(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; channel++) {
+        pthread_mutex_init(&s_channels[channel].transfer, &attr);
+    }
+}
+
+int dma_claim_unused_channel(bool required)
+{
+    pthread_mutex_lock(&s_dma_lock);
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; channel++) {
+        if (!s_channels[channel].claimed) {
+            s_channels[channel].claimed = true;
+            pthread_mutex_unlock(&s_dma_lock);
+            return (int) channel;
+        }
+    }
+    pthread_mutex_unlock(&s_dma_lock);
+
+    if (required) {
+        fprintf(stderr, "No DMA channels are available\n");
+        abort();
+    }
+    return -1;
+}
+
+void dma_channel_claim(uint channel)
+{
+    pthread_mutex_lock(&s_dma_lock);
+    s_channels[channel].claimed = true;
+    pthread_mutex_unlock(&s_dma_lock);
+}
+
+void dma_channel_unclaim(uint channel)
+{
+    pthread_mutex_lock(&s_dma_lock);
+    s_channels[channel].claimed = false;
+    pthread_mutex_unlock(&s_dma_lock);
+}
+
+bool dma_channel_is_claimed(uint channel)
+{
+    pthread_mutex_lock(&s_dma_lock);
+    const bool claimed = s_channels[channel].claimed;
+    pthread_mutex_unlock(&s_dma_lock);
+    return claimed;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    dma_channel_config c = {
+        .size = DMA_SIZE_32,
+        .read_increment = true,
+        .write_increment = false,
+        .dreq = DREQ_FORCE,
+        .chain_to = (uint8_t) channel,
+        .irq_quiet = false,
+        .enable = true,
+    };
+    return c;
+}
+
+dma_channel_config dma_get_channel_config(uint channel)
+{
+    pthread_mutex_lock(&s_channels[channel].transfer);
+    const dma_channel_config c = s_channels[channel].config;
+    pthread_mutex_unlock(&s_channels[channel].transfer);
+    return c;
+}
+
+// Runs a busy channel until it completes or its DREQ holds it back, with the channel's mutex held
+static bool channel_run(uint channel)
+{
+    channel_t *ch = &s_channels[channel];
+    const uint dreq = ch->config.dreq;
+    const uint size = 1u << ch->config.size;
+
+    while (ch->busy && ch->remaining) {
+        if (dreq < DREQ_UART0_TX && (dreq & 4)) {
+            PIO pio = &host_pio_hw[dreq / 8];
+            if (!host_pio_rxf_load(pio, dreq & 3)) {
+                return false;
+            }
+        }
+
+        memcpy((void *) ch->write_addr, (const void *) ch->read_addr, size);
+
+        if (dreq < DREQ_UART0_TX && !(dreq & 4)) {
+            host_pio_txf_written(&host_pio_hw[dreq / 8], dreq & 3);
+        } else if (dreq == DREQ_UART0_TX || dreq == DREQ_UART1_TX) {
+            host_uart_dr_written(dreq == DREQ_UART0_TX ? uart0 : uart1);
+        }
+
+        if (ch->config.read_increment) {
+            ch->read_addr += size;
+        }
+        if (ch->config.write_increment) {
+            ch->write_addr += size;
+        }
+        ch->remaining--;
+    }
+
+    const bool completed = ch->busy;
+    ch->busy = false;
+    return completed;
+}
+
+static void channel_complete(uint channel)
+{
+    bool raise[2];
+
+    pthread_mutex_lock(&s_dma_lock);
+    if (!s_channels[channel].config.irq_quiet) {
+        s_irq_status |= 1u << channel;
+    }
+    raise[0] = (s_irq_status & s_irq_enabled[0]) != 0;
+    raise[1] = (s_irq_status & s_irq_enabled[1]) != 0;
+    pthread_mutex_unlock(&s_dma_lock);
+
+    if (raise[0]) {
+        host_irq_raise(DMA_IRQ_0);
+    }
+    if (raise[1]) {
+        host_irq_raise(DMA_IRQ_1);
+    }
+}
+
+static void channel_trigger(uint channel)
+{
+    channel_t *ch = &s_channels[channel];
+
+    pthread_mutex_lock(&ch->transfer);
+    ch->remaining = ch->trans_count;
+    ch->busy = ch->config.enable;
+    const bool completed = ch->busy && channel_run(channel);
+    pthread_mutex_unlock(&ch->transfer);
+
+    if (completed) {
+        channel_complete(channel);
+    }
+}
+
+void host_dma_dreq(uint dreq)
+{
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; channel++) {
+        channel_t *ch = &s_channels[channel];
+
+        pthread_mutex_lock(&ch->transfer);
+        const bool completed = ch->busy && ch->config.dreq == dreq && channel_run(channel);
+        pthread_mutex_unlock(&ch->transfer);
+
+        if (completed) {
+            channel_complete(channel);
+        }
+    }
+}
+
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger)
+{
+    pthread_mutex_lock(&s_channels[channel].transfer);
+    s_channels[channel].config = *config;
+    pthread_mutex_unlock(&s_channels[channel].transfer);
+    if (trigger) {
+        channel_trigger(channel);
+    }
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger)
+{
+    pthread_mutex_lock(&s_channels[channel].transfer);
+    s_channels[channel].read_addr = read_addr;
+    pthread_mutex_unlock(&s_channels[channel].transfer);
+    if (trigger) {
+        channel_trigger(channel);
+    }
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger)
+{
+    pthread_mutex_lock(&s_channels[channel].transfer);
+    s_channels[channel].write_addr = write_addr;
+    pthread_mutex_unlock(&s_channels[channel].transfer);
+    if (trigger) {
+        channel_trigger(channel);
+    }
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger)
+{
+    pthread_mutex_lock(&s_channels[channel].transfer);
+    s_channels[channel].trans_count = trans_count;
+    pthread_mutex_unlock(&s_channels[channel].transfer);
+    if (trigger) {
+        channel_trigger(channel);
+    }
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger)
+{
+    dma_channel_set_read_addr(channel, read_addr, false);
+    dma_channel_set_write_addr(channel, write_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, false);
+    dma_channel_set_config(channel, config, trigger);
+}
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count)
+{
+    dma_channel_set_read_addr(channel, read_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, true);
+}
+
+void dma_channel_transfer_to_buffer_now(uint channel, volatile void *write_addr, uint32_t transfer_count)
+{
+    dma_channel_set_write_addr(channel, write_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, true);
+}
+
+void dma_channel_start(uint channel)
+{
+    channel_trigger(channel);
+}
+
+void dma_start_channel_mask(uint32_t chan_mask)
+{
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; channel++) {
+        if (chan_mask & (1u << channel)) {
+            channel_trigger(channel);
+        }
+    }
+}
+
+void dma_channel_abort(uint channel)
+{
+    pthread_mutex_lock(&s_channels[channel].transfer);
+    s_channels[channel].busy = false;
+    pthread_mutex_unlock(&s_channels[channel].transfer);
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+    pthread_mutex_lock(&s_channels[channel].transfer);
+    const bool busy = s_channels[channel].busy;
+    pthread_mutex_unlock(&s_channels[channel].transfer);
+    return busy;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel)
+{
+    while (dma_channel_is_busy(channel)) {
+        sched_yield();
+    }
+}
+
+// The SDK picks DMA_IRQ_1 for any non-zero index, which is what makes the logger's
+// dma_irqn_*(DMA_IRQ_1, ...) calls work on the hardware
+static uint irq_line(uint irq_index)
+{
+    return irq_index ? 1 : 0;
+}
+
+void dma_irqn_set_channel_enabled(uint irq_index, uint channel, bool enabled)
+{
+    irq_index = irq_line(irq_index);
+    pthread_mutex_lock(&s_dma_lock);
+    if (enabled) {
+        s_irq_enabled[irq_index] |= 1u << channel;
+    } else {
+        s_irq_enabled[irq_index] &= ~(1u << channel);
+    }
+    pthread_mutex_unlock(&s_dma_lock);
+}
+
+bool dma_irqn_get_channel_status(uint irq_index, uint channel)
+{
+    irq_index = irq_line(irq_index);
+    pthread_mutex_lock(&s_dma_lock);
+    const bool status = (s_irq_status & s_irq_enabled[irq_index] & (1u << channel)) != 0;
+    pthread_mutex_unlock(&s_dma_lock);
+    return status;
+}
+
+void dma_irqn_acknowledge_channel(uint irq_index, uint channel)
+{
+    (void) irq_index;
+    pthread_mutex_lock(&s_dma_lock);
+    s_irq_status &= ~(1u << channel);
+    pthread_mutex_unlock(&s_dma_lock);
+}
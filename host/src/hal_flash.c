@@ -0,0 +1,78 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The bridge's own QSPI flash. bridge_flash.c parks the other core around every erase and program,
+ * which the tasks here don't need: the image is only ever read through BRIDGE_FLASH_PTR(). Erased
+ * bytes read 0xFF and programming can only clear bits, like on the chip. After the power loss of
+ * host_flash_power_loss_after() erases and programs leave the flash alone.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "bridge_flash.h"
+#include "host_bridge.h"
+
+uint8_t host_flash[PICO_FLASH_SIZE_BYTES];
+static int32_t s_ops_left = -1;
+
+void host_flash_power_loss_after(int32_t ops)
+{
+    s_ops_left = ops;
+}
+
+static bool powered(void)
+{
+    if (s_ops_left < 0) {
+        return true;
+    }
+    if (s_ops_left == 0) {
+        return false;
+    }
+    s_ops_left--;
+    return true;
+}
+
+void bridge_flash_init(void)
+{
+    memset(host_flash, 0xff, sizeof(host_flash));
+}
+
+// No firmware image in this flash
+uint32_t bridge_flash_binary_end(void)
+{
+    return 0;
+}
+
+void bridge_flash_erase(uint32_t offset, size_t count)
+{
+    assert(offset % FLASH_SECTOR_SIZE == 0 && count % FLASH_SECTOR_SIZE == 0);
+    assert(offset + count <= sizeof(host_flash));
+    if (powered()) {
+        memset(host_flash + offset, 0xff, count);
+    }
+}
+
+void bridge_flash_program(uint32_t offset, const uint8_t *data, size_t count)
+{
+    assert(offset % FLASH_PAGE_SIZE == 0 && count % FLASH_PAGE_SIZE == 0);
+    assert(offset + count <= sizeof(host_flash));
+    if (!powered()) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        host_flash[offset + i] &= data[i];
+    }
+}
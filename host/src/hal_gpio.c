@@ -0,0 +1,299 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * GPIO, clocks and interrupt masking. A pin reads back its own output while it's an output, the
+ * level driven from outside while one is driven, and its pull otherwise.
+ */
+
+#include <pthread.h>
+#include "hardware/gpio.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "FreeRTOS.h"
+#include "host_bridge.h"
+#include "host_internal.h"
+
+#define MAX_WATCHES 4
+
+typedef struct {
+    bool out;
+    bool oe;
+    bool pull_up;
+    bool pull_down;
+    bool driven;
+    bool ext;
+    enum gpio_function fn;
+} pin_t;
+
+static pthread_mutex_t s_gpio_lock = PTHREAD_MUTEX_INITIALIZER;
+static pin_t s_pins[NUM_BANK0_GPIOS];
+static struct {
+    host_gpio_watch_t watch;
+    void *ctx;
+} s_watches[MAX_WATCHES];
+static uint32_t s_sys_clock_hz = 125000000;
+
+static bool pin_level(const pin_t *pin)
+{
+    if (pin->oe) {
+        return pin->out;
+    }
+    if (pin->driven) {
+        return pin->ext;
+    }
+    return pin->pull_up;
+}
+
+static void notify_watches(uint32_t before, uint32_t after)
+{
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++) {
+        const uint32_t bit = 1u << gpio;
+        if ((before ^ after) & bit) {
+            for (int i = 0; i < MAX_WATCHES && s_watches[i].watch; i++) {
+                s_watches[i].watch(s_watches[i].ctx, gpio, (after & bit) != 0);
+            }
+        }
+    }
+}
+
+static uint32_t levels_locked(void)
+{
+    uint32_t levels = 0;
+
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++) {
+        levels |= (uint32_t) pin_level(&s_pins[gpio]) << gpio;
+    }
+    return levels;
+}
+
+// Applies a change to the pins in mask and tells the watches about the resulting level changes
+#define PINS_UPDATE(mask, statement)                                    \
+    do {                                                                \
+        pthread_mutex_lock(&s_gpio_lock);                               \
+        const uint32_t before_ = levels_locked();                       \
+        for (uint gpio_ = 0; gpio_ < NUM_BANK0_GPIOS; gpio_++) {        \
+            if ((mask) & (1u << gpio_)) {                               \
+                pin_t *pin = &s_pins[gpio_];                            \
+                const bool bit = (value_ >> gpio_) & 1;                 \
+                (void) bit;                                             \
+                statement;                                              \
+            }                                                           \
+        }                                                               \
+        const uint32_t after_ = levels_locked();                        \
+        pthread_mutex_unlock(&s_gpio_lock);                             \
+        notify_watches(before_, after_);                                \
+    } while (0)
+
+void gpio_init(uint gpio)
+{
+    const uint32_t value_ = 0;
+    PINS_UPDATE(1u << gpio, { pin->oe = false; pin->out = false; pin->fn = GPIO_FUNC_SIO; });
+}
+
+void gpio_init_mask(uint gpio_mask)
+{
+    const uint32_t value_ = 0;
+    PINS_UPDATE(gpio_mask, { pin->oe = false; pin->out = false; pin->fn = GPIO_FUNC_SIO; });
+}
+
+void gpio_deinit(uint gpio)
+{
+    gpio_set_function(gpio, GPIO_FUNC_NULL);
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn)
+{
+    pthread_mutex_lock(&s_gpio_lock);
+    s_pins[gpio].fn = fn;
+    pthread_mutex_unlock(&s_gpio_lock);
+}
+
+enum gpio_function gpio_get_function(uint gpio)
+{
+    pthread_mutex_lock(&s_gpio_lock);
+    const enum gpio_function fn = s_pins[gpio].fn;
+    pthread_mutex_unlock(&s_gpio_lock);
+    return fn;
+}
+
+void gpio_set_dir_masked(uint32_t mask, uint32_t value)
+{
+    const uint32_t value_ = value;
+    PINS_UPDATE(mask, { pin->oe = bit; });
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    gpio_set_dir_masked(1u << gpio, out ? 1u << gpio : 0);
+}
+
+void gpio_set_dir_out_masked(uint32_t mask)
+{
+    gpio_set_dir_masked(mask, mask);
+}
+
+void gpio_set_dir_in_masked(uint32_t mask)
+{
+    gpio_set_dir_masked(mask, 0);
+}
+
+bool gpio_is_dir_out(uint gpio)
+{
+    pthread_mutex_lock(&s_gpio_lock);
+    const bool oe = s_pins[gpio].oe;
+    pthread_mutex_unlock(&s_gpio_lock);
+    return oe;
+}
+
+void gpio_put_masked(uint32_t mask, uint32_t value)
+{
+    const uint32_t value_ = value;
+    PINS_UPDATE(mask, { pin->out = bit; });
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    gpio_put_masked(1u << gpio, value ? 1u << gpio : 0);
+}
+
+void gpio_put_all(uint32_t value)
+{
+    gpio_put_masked((1u << NUM_BANK0_GPIOS) - 1, value);
+}
+
+void gpio_set_mask(uint32_t mask)
+{
+    gpio_put_masked(mask, mask);
+}
+
+void gpio_clr_mask(uint32_t mask)
+{
+    gpio_put_masked(mask, 0);
+}
+
+bool gpio_get(uint gpio)
+{
+    return host_gpio_level(gpio);
+}
+
+uint32_t gpio_get_all(void)
+{
+    pthread_mutex_lock(&s_gpio_lock);
+    const uint32_t levels = levels_locked();
+    pthread_mutex_unlock(&s_gpio_lock);
+    return levels;
+}
+
+bool gpio_get_out_level(uint gpio)
+{
+    pthread_mutex_lock(&s_gpio_lock);
+    const bool out = s_pins[gpio].out;
+    pthread_mutex_unlock(&s_gpio_lock);
+    return out;
+}
+
+void gpio_set_pulls(uint gpio, bool up, bool down)
+{
+    const uint32_t value_ = 0;
+    PINS_UPDATE(1u << gpio, { pin->pull_up = up; pin->pull_down = down; });
+}
+
+void gpio_set_input_enabled(uint gpio, bool enabled)
+{
+    (void) gpio;
+    (void) enabled;
+}
+
+void gpio_set_drive_strength(uint gpio, enum gpio_drive_strength drive)
+{
+    (void) gpio;
+    (void) drive;
+}
+
+void gpio_set_slew_rate(uint gpio, enum gpio_slew_rate slew)
+{
+    (void) gpio;
+    (void) slew;
+}
+
+void host_gpio_watch(host_gpio_watch_t watch, void *ctx)
+{
+    pthread_mutex_lock(&s_gpio_lock);
+    for (int i = 0; i < MAX_WATCHES; i++) {
+        if (s_watches[i].watch == NULL) {
+            s_watches[i].watch = watch;
+            s_watches[i].ctx = ctx;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_gpio_lock);
+}
+
+void host_gpio_drive(unsigned pin, bool level)
+{
+    const uint32_t value_ = 0;
+    PINS_UPDATE(1u << pin, { pin->driven = true; pin->ext = level; });
+}
+
+void host_gpio_release(unsigned pin)
+{
+    const uint32_t value_ = 0;
+    PINS_UPDATE(1u << pin, { pin->driven = false; });
+}
+
+bool host_gpio_level(unsigned pin)
+{
+    pthread_mutex_lock(&s_gpio_lock);
+    const bool level = pin_level(&s_pins[pin]);
+    pthread_mutex_unlock(&s_gpio_lock);
+    return level;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index)
+{
+    switch (clk_index) {
+    case clk_sys:
+        return s_sys_clock_hz;
+    case clk_usb:
+    case clk_adc:
+        return 48000000;
+    case clk_ref:
+        return 12000000;
+    case clk_rtc:
+        return 46875;
+    default:
+        return 125000000;
+    }
+}
+
+bool set_sys_clock_khz(uint32_t freq_khz, bool required)
+{
+    (void) required;
+    s_sys_clock_hz = freq_khz * 1000;
+    return true;
+}
+
+uint32_t save_and_disable_interrupts(void)
+{
+    host_critical_enter();
+    return 0;
+}
+
+void restore_interrupts(uint32_t status)
+{
+    (void) status;
+    host_critical_exit();
+}
@@ -0,0 +1,161 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * NVIC. A raised interrupt runs its handlers on the raising thread, one interrupt at a time like
+ * on a single core; an interrupt raised while it's disabled stays pending until it's enabled.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "hardware/irq.h"
+#include "FreeRTOS.h"
+#include "host_internal.h"
+
+#define MAX_SHARED_HANDLERS 4
+
+typedef struct {
+    pthread_mutex_t dispatch;
+    irq_handler_t exclusive;
+    irq_handler_t shared[MAX_SHARED_HANDLERS];
+    bool enabled;
+    bool pending;
+} irq_t;
+
+static pthread_mutex_t s_irq_lock = PTHREAD_MUTEX_INITIALIZER;
+static irq_t s_irqs[NUM_IRQS];
+
+__attribute__((constructor)) static void irq_init(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    for (uint num = 0; num < NUM_IRQS; num++) {
+        pthread_mutex_init(&s_irqs[num].dispatch, &attr);
+    }
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    pthread_mutex_lock(&s_irq_lock);
+    if (s_irqs[num].exclusive || s_irqs[num].shared[0]) {
+        fprintf(stderr, "IRQ %u already has a handler\n", num);
+        abort();
+    }
+    s_irqs[num].exclusive = handler;
+    pthread_mutex_unlock(&s_irq_lock);
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority)
+{
+    int i;
+
+    (void) order_priority;
+    pthread_mutex_lock(&s_irq_lock);
+    for (i = 0; i < MAX_SHARED_HANDLERS && s_irqs[num].shared[i]; i++) {
+    }
+    if (s_irqs[num].exclusive || i == MAX_SHARED_HANDLERS) {
+        fprintf(stderr, "IRQ %u has no room for another handler\n", num);
+        abort();
+    }
+    s_irqs[num].shared[i] = handler;
+    pthread_mutex_unlock(&s_irq_lock);
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler)
+{
+    pthread_mutex_lock(&s_irq_lock);
+    if (s_irqs[num].exclusive == handler) {
+        s_irqs[num].exclusive = NULL;
+    }
+    for (int i = 0; i < MAX_SHARED_HANDLERS; i++) {
+        if (s_irqs[num].shared[i] == handler) {
+            for (; i + 1 < MAX_SHARED_HANDLERS; i++) {
+                s_irqs[num].shared[i] = s_irqs[num].shared[i + 1];
+            }
+            s_irqs[num].shared[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&s_irq_lock);
+}
+
+static void irq_dispatch(uint num)
+{
+    irq_handler_t handlers[MAX_SHARED_HANDLERS + 1] = { NULL };
+    irq_t *irq = &s_irqs[num];
+
+    pthread_mutex_lock(&irq->dispatch);
+    pthread_mutex_lock(&s_irq_lock);
+    handlers[0] = irq->exclusive;
+    for (int i = 0; i < MAX_SHARED_HANDLERS; i++) {
+        handlers[i + 1] = irq->shared[i];
+    }
+    irq->pending = false;
+    pthread_mutex_unlock(&s_irq_lock);
+
+    host_isr_enter();
+    for (int i = 0; i <= MAX_SHARED_HANDLERS; i++) {
+        if (handlers[i]) {
+            handlers[i]();
+        }
+    }
+    host_isr_exit();
+    pthread_mutex_unlock(&irq->dispatch);
+}
+
+void host_irq_raise(uint num)
+{
+    pthread_mutex_lock(&s_irq_lock);
+    const bool enabled = s_irqs[num].enabled;
+    s_irqs[num].pending = !enabled;
+    pthread_mutex_unlock(&s_irq_lock);
+
+    if (enabled) {
+        irq_dispatch(num);
+    }
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    pthread_mutex_lock(&s_irq_lock);
+    s_irqs[num].enabled = enabled;
+    const bool pending = enabled && s_irqs[num].pending;
+    pthread_mutex_unlock(&s_irq_lock);
+
+    if (pending) {
+        irq_dispatch(num);
+    }
+}
+
+bool irq_is_enabled(uint num)
+{
+    pthread_mutex_lock(&s_irq_lock);
+    const bool enabled = s_irqs[num].enabled;
+    pthread_mutex_unlock(&s_irq_lock);
+    return enabled;
+}
+
+void irq_set_priority(uint num, uint8_t hardware_priority)
+{
+    (void) num;
+    (void) hardware_priority;
+}
+
+void irq_set_pending(uint num)
+{
+    host_irq_raise(num);
+}
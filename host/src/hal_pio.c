@@ -0,0 +1,615 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Behavioural PIO. pio_sm_init() looks up which of the bridge's programs the state machine starts
+ * in and every word written to its TX FIFO is run through a model of that program:
+ *
+ * - jtag_simple clocks the attached JTAG target once per bit and raises IRQ 4 for the bits whose
+ *   TDO is requested, a jtag_tdo_slave machine in the same PIO then shifts in the TDO pin.
+ * - uart_tx and uart_tx_2_stop_bits hand the byte to the logger capture.
+ *
+ * The clock cycles each word takes on the real state machine are accounted for, see
+ * host_pio_busy_ns().
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hardware/pio.h"
+#include "hardware/clocks.h"
+#include "jtag.pio.h"
+#include "uart_tx.pio.h"
+#include "host_bridge.h"
+#include "host_internal.h"
+
+#define RX_FIFO_DEPTH   8
+
+typedef enum {
+    PROGRAM_UNKNOWN,
+    PROGRAM_JTAG_SIMPLE,
+    PROGRAM_JTAG_TDO_SLAVE,
+    PROGRAM_UART_TX,
+    PROGRAM_UART_TX_2_STOP_BITS
+} program_kind_t;
+
+typedef struct {
+    bool claimed;
+    bool enabled;
+    program_kind_t kind;
+    pio_sm_config config;
+    uint32_t rx_fifo[RX_FIFO_DEPTH];
+    uint rx_head;
+    uint rx_count;
+    uint32_t isr;
+    uint isr_bits;
+    uint64_t rx_overflows;
+    double busy_ns;
+} sm_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t rx_cond;
+    uint32_t used_instructions;
+    program_kind_t kinds[PIO_INSTRUCTION_COUNT];
+    sm_t sm[NUM_PIO_STATE_MACHINES];
+} pio_t;
+
+pio_hw_t host_pio_hw[NUM_PIOS];
+
+static pio_t s_pios[NUM_PIOS];
+static pthread_mutex_t s_jtag_lock = PTHREAD_MUTEX_INITIALIZER;
+static host_jtag_target_t s_jtag_target;
+
+__attribute__((constructor)) static void pio_init(void)
+{
+    for (uint i = 0; i < NUM_PIOS; i++) {
+        pthread_mutex_init(&s_pios[i].lock, NULL);
+        pthread_cond_init(&s_pios[i].rx_cond, NULL);
+    }
+}
+
+static pio_t *get_pio(PIO pio)
+{
+    return &s_pios[pio_get_index(pio)];
+}
+
+static program_kind_t program_kind(const pio_program_t *program)
+{
+    static const struct {
+        const pio_program_t *program;
+        program_kind_t kind;
+    } known[] = {
+        { &jtag_simple_program, PROGRAM_JTAG_SIMPLE },
+        { &jtag_tdo_slave_program, PROGRAM_JTAG_TDO_SLAVE },
+        { &uart_tx_program, PROGRAM_UART_TX },
+        { &uart_tx_2_stop_bits_program, PROGRAM_UART_TX_2_STOP_BITS },
+    };
+
+    // Each translation unit has its own copy of a program, they're told apart by their instructions
+    for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+        if (known[i].program->length == program->length &&
+                memcmp(known[i].program->instructions, program->instructions, program->length * sizeof(uint16_t)) == 0) {
+            return known[i].kind;
+        }
+    }
+    return PROGRAM_UNKNOWN;
+}
+
+static int find_offset(pio_t *p, const pio_program_t *program)
+{
+    const uint32_t mask = (1u << program->length) - 1;
+
+    if (program->origin >= 0) {
+        return (p->used_instructions & (mask << program->origin)) ? -1 : program->origin;
+    }
+    for (int offset = PIO_INSTRUCTION_COUNT - program->length; offset >= 0; offset--) {
+        if (!(p->used_instructions & (mask << offset))) {
+            return offset;
+        }
+    }
+    return -1;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    const bool can_add = find_offset(p, program) >= 0;
+    pthread_mutex_unlock(&p->lock);
+    return can_add;
+}
+
+void pio_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    p->used_instructions |= ((1u << program->length) - 1) << offset;
+    p->kinds[offset] = program_kind(program);
+    pthread_mutex_unlock(&p->lock);
+}
+
+uint pio_add_program(PIO pio, const pio_program_t *program)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    const int offset = find_offset(p, program);
+    pthread_mutex_unlock(&p->lock);
+
+    if (offset < 0) {
+        fprintf(stderr, "No program space\n");
+        abort();
+    }
+    pio_add_program_at_offset(pio, program, (uint) offset);
+    return (uint) offset;
+}
+
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    p->used_instructions &= ~(((1u << program->length) - 1) << loaded_offset);
+    p->kinds[loaded_offset] = PROGRAM_UNKNOWN;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pio_clear_instruction_memory(PIO pio)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    p->used_instructions = 0;
+    memset(p->kinds, 0, sizeof(p->kinds));
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pio_sm_claim(PIO pio, uint sm)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    p->sm[sm].claimed = true;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pio_claim_sm_mask(PIO pio, uint sm_mask)
+{
+    for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        if (sm_mask & (1u << sm)) {
+            pio_sm_claim(pio, sm);
+        }
+    }
+}
+
+void pio_sm_unclaim(PIO pio, uint sm)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    p->sm[sm].claimed = false;
+    pthread_mutex_unlock(&p->lock);
+}
+
+int pio_claim_unused_sm(PIO pio, bool required)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        if (!p->sm[sm].claimed) {
+            p->sm[sm].claimed = true;
+            pthread_mutex_unlock(&p->lock);
+            return (int) sm;
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    if (required) {
+        fprintf(stderr, "No PIO state machines are available\n");
+        abort();
+    }
+    return -1;
+}
+
+bool pio_sm_is_claimed(PIO pio, uint sm)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    const bool claimed = p->sm[sm].claimed;
+    pthread_mutex_unlock(&p->lock);
+    return claimed;
+}
+
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    sm_t *s = &p->sm[sm];
+    s->enabled = false;
+    s->kind = p->kinds[initial_pc];
+    s->config = *config;
+    s->rx_head = 0;
+    s->rx_count = 0;
+    s->isr = 0;
+    s->isr_bits = 0;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pio_sm_set_config(PIO pio, uint sm, const pio_sm_config *config)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    p->sm[sm].config = *config;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled)
+{
+    pio_set_sm_mask_enabled(pio, 1u << sm, enabled);
+}
+
+void pio_set_sm_mask_enabled(PIO pio, uint32_t mask, bool enabled)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        if (mask & (1u << sm)) {
+            p->sm[sm].enabled = enabled;
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pio_sm_restart(PIO pio, uint sm)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    p->sm[sm].isr = 0;
+    p->sm[sm].isr_bits = 0;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pio_sm_clkdiv_restart(PIO pio, uint sm)
+{
+    (void) pio;
+    (void) sm;
+}
+
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    p->sm[sm].config.clkdiv = div;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac)
+{
+    pio_sm_set_clkdiv(pio, sm, (float) div_int + (float) div_frac / 256.0f);
+}
+
+void pio_sm_set_pins(PIO pio, uint sm, uint32_t pin_values)
+{
+    pio_sm_set_pins_with_mask(pio, sm, pin_values, 0xffffffffu);
+}
+
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask)
+{
+    (void) pio;
+    (void) sm;
+    gpio_put_masked(pin_mask, pin_values);
+}
+
+void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask)
+{
+    (void) pio;
+    (void) sm;
+    gpio_set_dir_masked(pin_mask, pin_dirs);
+}
+
+void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out)
+{
+    const uint32_t mask = ((1u << pin_count) - 1) << pin_base;
+    pio_sm_set_pindirs_with_mask(pio, sm, is_out ? mask : 0, mask);
+}
+
+void pio_gpio_init(PIO pio, uint pin)
+{
+    gpio_set_function(pin, pio_get_index(pio) ? GPIO_FUNC_PIO1 : GPIO_FUNC_PIO0);
+}
+
+/*
+ * State machine models
+ */
+
+static void account_cycles(pio_t *p, uint sm, uint64_t cycles)
+{
+    p->sm[sm].busy_ns += (double) cycles * p->sm[sm].config.clkdiv * 1e9 / clock_get_hz(clk_sys);
+}
+
+static int find_sm(pio_t *p, program_kind_t kind)
+{
+    for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        if (p->sm[sm].claimed && p->sm[sm].kind == kind) {
+            return (int) sm;
+        }
+    }
+    return -1;
+}
+
+// `in pins, 1` of the TDO slave, with the autopush. Returns true when a word was pushed.
+static bool slave_shift(pio_t *p, uint sm, bool bit)
+{
+    sm_t *s = &p->sm[sm];
+
+    if (s->config.in_shift_right) {
+        s->isr = (s->isr >> 1) | ((uint32_t) bit << 31);
+    } else {
+        s->isr = (s->isr << 1) | bit;
+    }
+    s->isr_bits++;
+
+    const uint threshold = s->config.push_threshold ? s->config.push_threshold : 32;
+    if (!s->config.autopush || s->isr_bits < threshold) {
+        return false;
+    }
+
+    if (s->rx_count < RX_FIFO_DEPTH) {
+        s->rx_fifo[(s->rx_head + s->rx_count++) % RX_FIFO_DEPTH] = s->isr;
+        pthread_cond_broadcast(&p->rx_cond);
+    } else {
+        s->rx_overflows++;
+    }
+    s->isr = 0;
+    s->isr_bits = 0;
+    return true;
+}
+
+static void jtag_simple_word(PIO pio, uint sm, uint32_t word)
+{
+    pio_t *p = get_pio(pio);
+    host_jtag_target_t target;
+
+    pthread_mutex_lock(&s_jtag_lock);
+    target = s_jtag_target;
+    pthread_mutex_unlock(&s_jtag_lock);
+
+    pthread_mutex_lock(&p->lock);
+    const int slave = find_sm(p, PROGRAM_JTAG_TDO_SLAVE);
+    const uint tdo_pin = slave >= 0 ? p->sm[slave].config.in_base : 0;
+    const uint rx_dreq = slave >= 0 ? pio_get_dreq(pio, slave, false) : 0;
+    pthread_mutex_unlock(&p->lock);
+
+    bool tdo = host_gpio_level(tdo_pin);
+
+    if (word & JTAG_CMD_FLUSH) {
+        // Flush: the slave samples TDO without TCK
+        const uint bits = ((word >> 1) & 0x7fff) + 1;
+        for (uint i = 0; i < bits; i++) {
+            pthread_mutex_lock(&p->lock);
+            const bool pushed = slave >= 0 && slave_shift(p, slave, tdo);
+            pthread_mutex_unlock(&p->lock);
+            if (pushed) {
+                host_dma_dreq(rx_dreq);
+            }
+        }
+        pthread_mutex_lock(&p->lock);
+        account_cycles(p, sm, 4 + bits * 6);
+        pthread_mutex_unlock(&p->lock);
+        return;
+    }
+
+    const uint repeat = (word >> JTAG_CMD_REPEAT_SHIFT) + 1;
+    const bool tdi = (word >> JTAG_CMD_DAT_SHIFT) & 1;
+    const bool tms = (word >> (JTAG_CMD_DAT_SHIFT + 1)) & 1;
+    const bool tdo_requested = (word >> (JTAG_CMD_DAT_SHIFT + 2)) & 1;
+
+    for (uint i = 0; i < repeat; i++) {
+        // The slave samples right after the rising edge, the target changes TDO on the falling one
+        const bool sample = tdo;
+        if (target.clock) {
+            const bool next = target.clock(target.ctx, tms, tdi);
+            if (next != tdo) {
+                host_gpio_drive(tdo_pin, next);
+                tdo = next;
+            }
+        }
+        if (tdo_requested && slave >= 0) {
+            pthread_mutex_lock(&p->lock);
+            const bool pushed = slave_shift(p, slave, sample);
+            pthread_mutex_unlock(&p->lock);
+            if (pushed) {
+                host_dma_dreq(rx_dreq);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&p->lock);
+    account_cycles(p, sm, 5 + (uint64_t) repeat * jtag_simple_cycles_per_bit);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void uart_tx_word(PIO pio, uint sm, uint32_t word, uint stop_bits)
+{
+    pio_t *p = get_pio(pio);
+    const uint8_t c = (uint8_t) word;
+
+    host_logger_capture(&c, 1);
+    pthread_mutex_lock(&p->lock);
+    account_cycles(p, sm, 8 * (1 + 8 + stop_bits));
+    pthread_mutex_unlock(&p->lock);
+}
+
+void host_pio_txf_written(PIO pio, uint sm)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    const program_kind_t kind = p->sm[sm].kind;
+    pthread_mutex_unlock(&p->lock);
+
+    const uint32_t word = pio->txf[sm];
+    switch (kind) {
+    case PROGRAM_JTAG_SIMPLE:
+        jtag_simple_word(pio, sm, word);
+        break;
+    case PROGRAM_UART_TX:
+        uart_tx_word(pio, sm, word, 1);
+        break;
+    case PROGRAM_UART_TX_2_STOP_BITS:
+        uart_tx_word(pio, sm, word, 2);
+        break;
+    default:
+        break;
+    }
+}
+
+bool host_pio_rxf_load(PIO pio, uint sm)
+{
+    pio_t *p = get_pio(pio);
+    sm_t *s = &p->sm[sm];
+
+    pthread_mutex_lock(&p->lock);
+    const bool loaded = s->rx_count > 0;
+    if (loaded) {
+        // Read-only to the firmware, the DMA model reads the word from here
+        *(io_rw_32 *) &pio->rxf[sm] = s->rx_fifo[s->rx_head];
+        s->rx_head = (s->rx_head + 1) % RX_FIFO_DEPTH;
+        s->rx_count--;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return loaded;
+}
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data)
+{
+    // The models consume a word as soon as it's written, the TX FIFO never fills up
+    pio->txf[sm] = data;
+    host_pio_txf_written(pio, sm);
+}
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data)
+{
+    pio_sm_put(pio, sm, data);
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm)
+{
+    return host_pio_rxf_load(pio, sm) ? pio->rxf[sm] : 0;
+}
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    while (p->sm[sm].rx_count == 0) {
+        pthread_cond_wait(&p->rx_cond, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return pio_sm_get(pio, sm);
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm)
+{
+    return pio_sm_get_rx_fifo_level(pio, sm) == 0;
+}
+
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm)
+{
+    return pio_sm_get_rx_fifo_level(pio, sm) == RX_FIFO_DEPTH;
+}
+
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    const uint level = p->sm[sm].rx_count;
+    pthread_mutex_unlock(&p->lock);
+    return level;
+}
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm)
+{
+    (void) pio;
+    (void) sm;
+    return true;
+}
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm)
+{
+    (void) pio;
+    (void) sm;
+    return false;
+}
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm)
+{
+    (void) pio;
+    (void) sm;
+    return 0;
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm)
+{
+    pio_t *p = get_pio(pio);
+
+    pthread_mutex_lock(&p->lock);
+    p->sm[sm].rx_head = 0;
+    p->sm[sm].rx_count = 0;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pio_sm_drain_tx_fifo(PIO pio, uint sm)
+{
+    (void) pio;
+    (void) sm;
+}
+
+void pio_sm_exec(PIO pio, uint sm, uint instr)
+{
+    (void) pio;
+    (void) sm;
+    (void) instr;
+}
+
+void host_jtag_attach(const host_jtag_target_t *target)
+{
+    pthread_mutex_lock(&s_jtag_lock);
+    s_jtag_target = *target;
+    pthread_mutex_unlock(&s_jtag_lock);
+}
+
+uint64_t host_pio_busy_ns(unsigned pio_index, unsigned sm)
+{
+    pio_t *p = &s_pios[pio_index];
+
+    pthread_mutex_lock(&p->lock);
+    const uint64_t busy_ns = (uint64_t) p->sm[sm].busy_ns;
+    pthread_mutex_unlock(&p->lock);
+    return busy_ns;
+}
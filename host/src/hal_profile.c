@@ -0,0 +1,78 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Sampler of the profiler (bridge_profile.h). Instead of a timer alarm per core, SIGPROF interrupts
+ * whichever thread uses the CPU at PROFILE_HZ and counts the PC it interrupted. PCs are relative to the
+ * start of the executable, so tools/profile_report.py can take the symbols from bridge_bench itself.
+ */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include "ubp_config.h"
+#include "FreeRTOS.h"
+#include "bridge_profile.h"
+
+#if PROFILE_ENABLED
+
+extern const char __executable_start[];
+
+// The firmware takes the samples of a core one at a time, here any thread can get the signal
+static atomic_flag s_sampling = ATOMIC_FLAG_INIT;
+
+static void on_sigprof(int sig, siginfo_t *info, void *context)
+{
+    (void) sig;
+    (void) info;
+    const ucontext_t *uc = context;
+#if defined(__x86_64__)
+    const uintptr_t pc = (uintptr_t) uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+    const uintptr_t pc = (uintptr_t) uc->uc_mcontext.pc;
+#else
+    const uintptr_t pc = 0;
+    (void) uc;
+#endif
+    if (atomic_flag_test_and_set(&s_sampling)) {
+        return;
+    }
+    bridge_profile_sample((uint32_t) (pc - (uintptr_t) __executable_start), portCHECK_IF_IN_ISR());
+    atomic_flag_clear(&s_sampling);
+}
+
+void bridge_profile_start(void)
+{
+    struct sigaction sa = { 0 };
+    sa.sa_sigaction = on_sigprof;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, NULL) != 0) {
+        perror("sigaction");
+        abort();
+    }
+
+    const struct itimerval period = {
+        .it_interval = { .tv_sec = 0, .tv_usec = 1000000 / PROFILE_HZ },
+        .it_value = { .tv_sec = 0, .tv_usec = 1000000 / PROFILE_HZ },
+    };
+    setitimer(ITIMER_PROF, &period, NULL);
+}
+
+#endif
@@ -0,0 +1,284 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * PL011 UART. Bytes written to the data register go straight to the attached target, bytes the
+ * target sends land in a FIFO of the hardware's depth whose interrupt fires while it has data.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include "hardware/uart.h"
+#include "hardware/irq.h"
+#include "host_bridge.h"
+#include "host_internal.h"
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint baudrate;
+    bool enabled;
+    bool rx_irq;
+    uint8_t rx_fifo[UART_FIFO_DEPTH];
+    uint rx_head;
+    uint rx_count;
+    uint64_t overruns;
+    host_uart_target_t target;
+} uart_t;
+
+uart_hw_t host_uart_hw[NUM_UARTS];
+
+static uart_t s_uarts[NUM_UARTS] = {
+    { .lock = PTHREAD_MUTEX_INITIALIZER },
+    { .lock = PTHREAD_MUTEX_INITIALIZER },
+};
+
+static uart_t *get_uart(uart_inst_t *uart)
+{
+    return &s_uarts[uart_get_index(uart)];
+}
+
+static void uart_tx(uart_inst_t *uart, uint8_t c)
+{
+    uart_t *u = get_uart(uart);
+
+    pthread_mutex_lock(&u->lock);
+    const host_uart_target_t target = u->target;
+    pthread_mutex_unlock(&u->lock);
+
+    if (target.tx) {
+        target.tx(target.ctx, &c, 1);
+    }
+}
+
+uint uart_init(uart_inst_t *uart, uint baudrate)
+{
+    uart_t *u = get_uart(uart);
+
+    pthread_mutex_lock(&u->lock);
+    u->enabled = true;
+    u->rx_head = 0;
+    u->rx_count = 0;
+    pthread_mutex_unlock(&u->lock);
+    return uart_set_baudrate(uart, baudrate);
+}
+
+void uart_deinit(uart_inst_t *uart)
+{
+    uart_t *u = get_uart(uart);
+
+    pthread_mutex_lock(&u->lock);
+    u->enabled = false;
+    pthread_mutex_unlock(&u->lock);
+}
+
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate)
+{
+    uart_t *u = get_uart(uart);
+
+    pthread_mutex_lock(&u->lock);
+    u->baudrate = baudrate;
+    const host_uart_target_t target = u->target;
+    pthread_mutex_unlock(&u->lock);
+
+    if (target.baudrate) {
+        target.baudrate(target.ctx, baudrate);
+    }
+    return baudrate;
+}
+
+uint uart_get_baudrate(uart_inst_t *uart)
+{
+    uart_t *u = get_uart(uart);
+
+    pthread_mutex_lock(&u->lock);
+    const uint baudrate = u->baudrate;
+    pthread_mutex_unlock(&u->lock);
+    return baudrate;
+}
+
+void uart_set_hw_flow(uart_inst_t *uart, bool cts, bool rts)
+{
+    (void) uart;
+    (void) cts;
+    (void) rts;
+}
+
+void uart_set_format(uart_inst_t *uart, uint data_bits, uint stop_bits, uart_parity_t parity)
+{
+    (void) uart;
+    (void) data_bits;
+    (void) stop_bits;
+    (void) parity;
+}
+
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data)
+{
+    uart_t *u = get_uart(uart);
+
+    (void) tx_needs_data;
+    pthread_mutex_lock(&u->lock);
+    u->rx_irq = rx_has_data;
+    pthread_mutex_unlock(&u->lock);
+}
+
+void uart_set_fifo_enabled(uart_inst_t *uart, bool enabled)
+{
+    (void) uart;
+    (void) enabled;
+}
+
+bool uart_is_enabled(uart_inst_t *uart)
+{
+    uart_t *u = get_uart(uart);
+
+    pthread_mutex_lock(&u->lock);
+    const bool enabled = u->enabled;
+    pthread_mutex_unlock(&u->lock);
+    return enabled;
+}
+
+bool uart_is_writable(uart_inst_t *uart)
+{
+    (void) uart;
+    return true;
+}
+
+bool uart_is_readable(uart_inst_t *uart)
+{
+    uart_t *u = get_uart(uart);
+
+    pthread_mutex_lock(&u->lock);
+    const bool readable = u->rx_count > 0;
+    pthread_mutex_unlock(&u->lock);
+    return readable;
+}
+
+void uart_tx_wait_blocking(uart_inst_t *uart)
+{
+    (void) uart;
+}
+
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        uart_tx(uart, src[i]);
+    }
+}
+
+void uart_read_blocking(uart_inst_t *uart, uint8_t *dst, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = (uint8_t) uart_getc(uart);
+    }
+}
+
+void uart_putc_raw(uart_inst_t *uart, char c)
+{
+    uart_tx(uart, (uint8_t) c);
+}
+
+void uart_putc(uart_inst_t *uart, char c)
+{
+    uart_tx(uart, (uint8_t) c);
+}
+
+void uart_puts(uart_inst_t *uart, const char *s)
+{
+    while (*s) {
+        uart_putc(uart, *s++);
+    }
+}
+
+char uart_getc(uart_inst_t *uart)
+{
+    uart_t *u = get_uart(uart);
+
+    while (!uart_is_readable(uart)) {
+        sched_yield();
+    }
+
+    pthread_mutex_lock(&u->lock);
+    const char c = (char) u->rx_fifo[u->rx_head];
+    u->rx_head = (u->rx_head + 1) % UART_FIFO_DEPTH;
+    u->rx_count--;
+    pthread_mutex_unlock(&u->lock);
+    return c;
+}
+
+bool uart_is_readable_within_us(uart_inst_t *uart, uint32_t us)
+{
+    const uint64_t deadline = host_time_us() + us;
+
+    while (!uart_is_readable(uart)) {
+        if (host_time_us() >= deadline) {
+            return false;
+        }
+        sched_yield();
+    }
+    return true;
+}
+
+void host_uart_dr_written(uart_inst_t *uart)
+{
+    uart_tx(uart, (uint8_t) uart_get_hw(uart)->dr);
+}
+
+void host_uart_attach(unsigned uart_index, const host_uart_target_t *target)
+{
+    uart_t *u = &s_uarts[uart_index];
+
+    pthread_mutex_lock(&u->lock);
+    u->target = *target;
+    pthread_mutex_unlock(&u->lock);
+}
+
+void host_uart_target_send(unsigned uart_index, const uint8_t *data, size_t size)
+{
+    uart_t *u = &s_uarts[uart_index];
+
+    while (size > 0) {
+        pthread_mutex_lock(&u->lock);
+        const uint space = UART_FIFO_DEPTH - u->rx_count;
+        const size_t n = size < space ? size : space;
+        for (size_t i = 0; i < n; i++) {
+            u->rx_fifo[(u->rx_head + u->rx_count++) % UART_FIFO_DEPTH] = data[i];
+        }
+        const bool raise = u->rx_irq && u->rx_count > 0;
+        // Nothing moves out of a full FIFO without its interrupt, the rest of the data is lost
+        if (n == 0) {
+            u->overruns += size;
+        }
+        pthread_mutex_unlock(&u->lock);
+
+        if (n == 0) {
+            break;
+        }
+        data += n;
+        size -= n;
+        if (raise) {
+            host_irq_raise(uart_index ? UART1_IRQ : UART0_IRQ);
+        }
+    }
+}
+
+uint64_t host_uart_overruns(unsigned uart_index)
+{
+    uart_t *u = &s_uarts[uart_index];
+
+    pthread_mutex_lock(&u->lock);
+    const uint64_t overruns = u->overruns;
+    pthread_mutex_unlock(&u->lock);
+    return overruns;
+}
@@ -0,0 +1,71 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Glue between the models of the host build, not for use by the scripts
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "FreeRTOS.h"
+#include "hardware/pio.h"
+#include "hardware/uart.h"
+#include "host_bridge.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The kernel lock guards every FreeRTOS object and the USB FIFOs. Any state change the lock
+// guards is followed by host_kernel_notify(), waiters re-check their condition after each wakeup.
+typedef struct {
+    bool forever;
+    struct timespec ts;
+} host_deadline_t;
+
+host_deadline_t host_deadline_ticks(TickType_t ticks);
+host_deadline_t host_deadline_ms(uint32_t ms);
+void host_kernel_lock(void);
+void host_kernel_unlock(void);
+void host_kernel_notify(void);
+// Returns false once the deadline has passed. A task suspended while it waits stays here until resumed.
+bool host_kernel_wait(const host_deadline_t *deadline);
+
+// Runs the handlers of an enabled interrupt on the calling thread, remembers it as pending otherwise
+void host_irq_raise(uint num);
+
+// A peripheral has data for, or room for, the DMA channels paced by dreq
+void host_dma_dreq(uint dreq);
+
+// PIO FIFOs as seen by the DMA model: the TX register was written, the RX register is to be read
+void host_pio_txf_written(PIO pio, uint sm);
+bool host_pio_rxf_load(PIO pio, uint sm);
+
+// UART data register as seen by the DMA model
+void host_uart_dr_written(uart_inst_t *uart);
+
+// Logger capture, fed by the PIO UART TX model
+void host_logger_capture(const uint8_t *data, size_t size);
+
+// Debug module side of the TAP's DTMCS and DMI registers
+#define HOST_RISCV_DMI_BITS     (34 + 7)
+uint32_t host_riscv_dtmcs(void);
+uint64_t host_riscv_dmi_capture(host_riscv_dm_t *dm);
+void host_riscv_dmi_update(host_riscv_dm_t *dm, uint64_t dr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,138 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// IEEE 1149.1 TAP controller with a 5 bit instruction register, see host_jtag_tap_t
+
+#include <string.h>
+#include "host_bridge.h"
+#include "host_internal.h"
+
+#define TAP_IR_LEN      5
+#define TAP_IR_IDCODE   0x01
+#define TAP_IR_DTMCS    0x10
+#define TAP_IR_DMI      0x11
+
+enum {
+    TEST_LOGIC_RESET,
+    RUN_TEST_IDLE,
+    SELECT_DR_SCAN,
+    CAPTURE_DR,
+    SHIFT_DR,
+    EXIT1_DR,
+    PAUSE_DR,
+    EXIT2_DR,
+    UPDATE_DR,
+    SELECT_IR_SCAN,
+    CAPTURE_IR,
+    SHIFT_IR,
+    EXIT1_IR,
+    PAUSE_IR,
+    EXIT2_IR,
+    UPDATE_IR
+};
+
+// Next state for TMS = 0 and TMS = 1
+static const uint8_t s_next_state[16][2] = {
+    [TEST_LOGIC_RESET] = { RUN_TEST_IDLE, TEST_LOGIC_RESET },
+    [RUN_TEST_IDLE] = { RUN_TEST_IDLE, SELECT_DR_SCAN },
+    [SELECT_DR_SCAN] = { CAPTURE_DR, SELECT_IR_SCAN },
+    [CAPTURE_DR] = { SHIFT_DR, EXIT1_DR },
+    [SHIFT_DR] = { SHIFT_DR, EXIT1_DR },
+    [EXIT1_DR] = { PAUSE_DR, UPDATE_DR },
+    [PAUSE_DR] = { PAUSE_DR, EXIT2_DR },
+    [EXIT2_DR] = { SHIFT_DR, UPDATE_DR },
+    [UPDATE_DR] = { RUN_TEST_IDLE, SELECT_DR_SCAN },
+    [SELECT_IR_SCAN] = { CAPTURE_IR, TEST_LOGIC_RESET },
+    [CAPTURE_IR] = { SHIFT_IR, EXIT1_IR },
+    [SHIFT_IR] = { SHIFT_IR, EXIT1_IR },
+    [EXIT1_IR] = { PAUSE_IR, UPDATE_IR },
+    [PAUSE_IR] = { PAUSE_IR, EXIT2_IR },
+    [EXIT2_IR] = { SHIFT_IR, UPDATE_IR },
+    [UPDATE_IR] = { RUN_TEST_IDLE, SELECT_DR_SCAN },
+};
+
+void host_jtag_tap_init(host_jtag_tap_t *tap, uint32_t idcode)
+{
+    memset(tap, 0, sizeof(*tap));
+    tap->idcode = idcode;
+    tap->state = TEST_LOGIC_RESET;
+    tap->ir = TAP_IR_IDCODE;
+}
+
+bool host_jtag_tap_clock(void *ctx, bool tms, bool tdi)
+{
+    host_jtag_tap_t *tap = ctx;
+
+    tap->tck_cycles++;
+
+    // Rising edge: the current state's action, then the transition
+    switch (tap->state) {
+    case CAPTURE_DR:
+        if (tap->ir == TAP_IR_IDCODE) {
+            tap->dr_shift = tap->idcode;
+            tap->dr_len = 32;
+        } else if (tap->dm && tap->ir == TAP_IR_DTMCS) {
+            tap->dr_shift = host_riscv_dtmcs();
+            tap->dr_len = 32;
+        } else if (tap->dm && tap->ir == TAP_IR_DMI) {
+            tap->dr_shift = host_riscv_dmi_capture(tap->dm);
+            tap->dr_len = HOST_RISCV_DMI_BITS;
+        } else {
+            tap->dr_shift = 0;
+            tap->dr_len = 1;
+        }
+        break;
+    case SHIFT_DR:
+        tap->dr_shift = (tap->dr_shift >> 1) | ((uint64_t) tdi << (tap->dr_len - 1));
+        break;
+    case CAPTURE_IR:
+        tap->ir_shift = 0x01;
+        break;
+    case SHIFT_IR:
+        tap->ir_shift = (uint8_t) ((tap->ir_shift >> 1) | (tdi << (TAP_IR_LEN - 1)));
+        break;
+    default:
+        break;
+    }
+
+    tap->state = s_next_state[tap->state][tms];
+
+    switch (tap->state) {
+    case TEST_LOGIC_RESET:
+        tap->ir = TAP_IR_IDCODE;
+        break;
+    case UPDATE_DR:
+        tap->dr_scans++;
+        if (tap->dm && tap->ir == TAP_IR_DMI) {
+            host_riscv_dmi_update(tap->dm, tap->dr_shift);
+        }
+        break;
+    case UPDATE_IR:
+        tap->ir = tap->ir_shift;
+        tap->ir_scans++;
+        break;
+    default:
+        break;
+    }
+
+    // Falling edge: TDO follows the shift register while shifting
+    if (tap->state == SHIFT_DR) {
+        return tap->dr_shift & 1;
+    }
+    if (tap->state == SHIFT_IR) {
+        return tap->ir_shift & 1;
+    }
+    return false;
+}
@@ -0,0 +1,220 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * pico-sdk time and alarms. The alarm pool is a sorted list served by one thread, which runs the
+ * callbacks the way the timer interrupt does on the target.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include "pico/time.h"
+#include "FreeRTOS.h"
+#include "host_bridge.h"
+#include "host_internal.h"
+
+typedef struct alarm {
+    alarm_id_t id;
+    absolute_time_t time;
+    alarm_callback_t callback;
+    void *user_data;
+    struct alarm *next;
+} alarm_t;
+
+static struct timespec s_start;
+static pthread_mutex_t s_alarm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_alarm_cond;
+static pthread_t s_alarm_thread;
+static alarm_t *s_alarms;
+static alarm_id_t s_next_id = 1;
+static alarm_id_t s_running_id;
+
+__attribute__((constructor)) static void time_init(void)
+{
+    pthread_condattr_t attr;
+
+    clock_gettime(CLOCK_MONOTONIC, &s_start);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_alarm_cond, &attr);
+}
+
+uint64_t host_time_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) (now.tv_sec - s_start.tv_sec) * 1000000 + (now.tv_nsec - s_start.tv_nsec) / 1000;
+}
+
+absolute_time_t get_absolute_time(void)
+{
+    return host_time_us();
+}
+
+static struct timespec to_timespec(absolute_time_t t)
+{
+    const uint64_t ns = s_start.tv_nsec + t * 1000;
+    struct timespec ts = {
+        .tv_sec = s_start.tv_sec + (time_t) (ns / 1000000000),
+        .tv_nsec = (long) (ns % 1000000000),
+    };
+    return ts;
+}
+
+void sleep_until(absolute_time_t target)
+{
+    const struct timespec ts = to_timespec(target);
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    }
+}
+
+void sleep_us(uint64_t us)
+{
+    sleep_until(make_timeout_time_us(us));
+}
+
+void sleep_ms(uint32_t ms)
+{
+    sleep_us((uint64_t) ms * 1000);
+}
+
+void busy_wait_us(uint64_t delay_us)
+{
+    const absolute_time_t target = make_timeout_time_us(delay_us);
+
+    while (!time_reached(target)) {
+    }
+}
+
+void busy_wait_us_32(uint32_t delay_us)
+{
+    busy_wait_us(delay_us);
+}
+
+void busy_wait_ms(uint32_t delay_ms)
+{
+    busy_wait_us((uint64_t) delay_ms * 1000);
+}
+
+static void alarm_insert(alarm_t *alarm)
+{
+    alarm_t **link = &s_alarms;
+
+    while (*link && (*link)->time <= alarm->time) {
+        link = &(*link)->next;
+    }
+    alarm->next = *link;
+    *link = alarm;
+    pthread_cond_signal(&s_alarm_cond);
+}
+
+static void *alarm_thread(void *arg)
+{
+    (void) arg;
+    pthread_mutex_lock(&s_alarm_lock);
+    for (;;) {
+        if (s_alarms == NULL) {
+            pthread_cond_wait(&s_alarm_cond, &s_alarm_lock);
+            continue;
+        }
+
+        alarm_t *alarm = s_alarms;
+        if (get_absolute_time() < alarm->time) {
+            const struct timespec ts = to_timespec(alarm->time);
+            pthread_cond_timedwait(&s_alarm_cond, &s_alarm_lock, &ts);
+            continue;
+        }
+
+        s_alarms = alarm->next;
+        s_running_id = alarm->id;
+        pthread_mutex_unlock(&s_alarm_lock);
+
+        host_isr_enter();
+        const int64_t reschedule = alarm->callback(alarm->id, alarm->user_data);
+        host_isr_exit();
+
+        pthread_mutex_lock(&s_alarm_lock);
+        // A callback that cancelled its own alarm isn't rescheduled
+        if (reschedule != 0 && s_running_id == alarm->id) {
+            alarm->time = reschedule > 0 ? get_absolute_time() + reschedule : alarm->time - reschedule;
+            alarm_insert(alarm);
+        } else {
+            free(alarm);
+        }
+        s_running_id = 0;
+    }
+    return NULL;
+}
+
+alarm_id_t add_alarm_at(absolute_time_t time, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    if (!fire_if_past && time_reached(time)) {
+        return 0;
+    }
+
+    alarm_t *alarm = calloc(1, sizeof(alarm_t));
+    alarm->time = time;
+    alarm->callback = callback;
+    alarm->user_data = user_data;
+
+    pthread_mutex_lock(&s_alarm_lock);
+    if (!s_alarm_thread) {
+        pthread_create(&s_alarm_thread, NULL, alarm_thread, NULL);
+        pthread_detach(s_alarm_thread);
+    }
+    alarm->id = s_next_id++;
+    if (s_next_id <= 0) {
+        s_next_id = 1;
+    }
+    const alarm_id_t id = alarm->id;
+    alarm_insert(alarm);
+    pthread_mutex_unlock(&s_alarm_lock);
+    return id;
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    return add_alarm_at(make_timeout_time_us(us), callback, user_data, fire_if_past);
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    return add_alarm_at(make_timeout_time_ms(ms), callback, user_data, fire_if_past);
+}
+
+bool cancel_alarm(alarm_id_t alarm_id)
+{
+    bool cancelled = false;
+
+    pthread_mutex_lock(&s_alarm_lock);
+    if (s_running_id == alarm_id) {
+        s_running_id = 0;
+        cancelled = true;
+    }
+    for (alarm_t **link = &s_alarms; *link; link = &(*link)->next) {
+        if ((*link)->id == alarm_id) {
+            alarm_t *alarm = *link;
+            *link = alarm->next;
+            free(alarm);
+            cancelled = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_alarm_lock);
+    return cancelled;
+}
@@ -0,0 +1,274 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// RISC-V debug module of one hart behind the TAP's DMI register, see host_riscv_dm_t. Only what
+// riscv_dbg.c uses is modelled: halt and resume, abstract writes of dpc and 32 bit system bus access.
+// The flasher stub runs between DMI accesses, so it is always done by the time the bridge looks.
+
+#include <stddef.h>
+#include <string.h>
+#include "host_bridge.h"
+#include "host_internal.h"
+#include "jtag_flash.h"
+
+#define DTMCS_VERSION_013       1
+#define DTMCS_ABITS             (HOST_RISCV_DMI_BITS - 34)
+
+#define DMI_OP_READ             1
+#define DMI_OP_WRITE            2
+#define DMI_STATUS_SUCCESS      0
+
+#define DM_DATA0                0x04
+#define DM_DMCONTROL            0x10
+#define DM_DMSTATUS             0x11
+#define DM_ABSTRACTCS           0x16
+#define DM_COMMAND              0x17
+#define DM_SBCS                 0x38
+#define DM_SBADDRESS0           0x39
+#define DM_SBDATA0              0x3c
+
+#define DMCONTROL_DMACTIVE      (1u << 0)
+#define DMCONTROL_RESUMEREQ     (1u << 30)
+#define DMCONTROL_HALTREQ       (1u << 31)
+#define DMSTATUS_VERSION_013    2
+#define DMSTATUS_ALLRUNNING     (1u << 11)
+#define DMSTATUS_ALLHALTED      (1u << 9)
+#define DMSTATUS_ALLRESUMEACK   (1u << 17)
+#define ABSTRACTCS_CMDERR       (7u << 8)
+#define CMDERR_NOT_SUPPORTED    (2u << 8)
+#define CMDERR_HALT_RESUME      (4u << 8)
+#define COMMAND_WRITE           (1u << 16)
+#define COMMAND_TRANSFER        (1u << 17)
+#define COMMAND_AARSIZE_MASK    (7u << 20)
+#define COMMAND_AARSIZE_32      (2u << 20)
+#define COMMAND_REGNO_MASK      0xffff
+#define CSR_DPC                 0x7b1
+#define SBCS_SBACCESS32         (1u << 2)
+#define SBCS_SBERROR            (7u << 12)
+#define SBCS_SBERROR_BAD_ADDR   (2u << 12)
+#define SBCS_SBERROR_SIZE       (4u << 12)
+#define SBCS_SBAUTOINCREMENT    (1u << 16)
+#define SBCS_SBACCESS_MASK      (7u << 17)
+#define SBCS_SBACCESS_32        (2u << 17)
+#define SBCS_SBREADONADDR       (1u << 20)
+#define SBCS_SBBUSYERROR        (1u << 22)
+#define SBCS_SBVERSION_1        (1u << 29)
+
+#define CTRL(dm, field)         ((dm)->stub_ctrl + offsetof(jtag_flash_ctrl_t, field))
+
+static uint8_t *ram_at(host_riscv_dm_t *dm, uint32_t addr, uint32_t size)
+{
+    if (addr < dm->ram_addr || addr - dm->ram_addr > dm->ram_size - size) {
+        return NULL;
+    }
+    return dm->ram + (addr - dm->ram_addr);
+}
+
+static uint32_t ram_read(host_riscv_dm_t *dm, uint32_t addr)
+{
+    uint32_t value = 0;
+    const uint8_t *p = ram_at(dm, addr, 4);
+
+    if (p) {
+        memcpy(&value, p, 4);
+    }
+    return value;
+}
+
+static void ram_write(host_riscv_dm_t *dm, uint32_t addr, uint32_t value)
+{
+    uint8_t *p = ram_at(dm, addr, 4);
+
+    if (p) {
+        memcpy(p, &value, 4);
+    }
+}
+
+static void stub_start(host_riscv_dm_t *dm)
+{
+    dm->stub_running = true;
+    dm->stub_size = dm->stub_written = 0;
+    dm->stub_starts++;
+    ram_write(dm, CTRL(dm, ring_addr), dm->ring_addr);
+    ram_write(dm, CTRL(dm, ring_size), dm->ring_size);
+    ram_write(dm, CTRL(dm, magic), JTAG_FLASH_STUB_READY);
+}
+
+static void stub_run(host_riscv_dm_t *dm)
+{
+    if (!dm->stub_running) {
+        return;
+    }
+
+    const uint32_t cmd = ram_read(dm, CTRL(dm, cmd));
+    if (cmd == JTAG_FLASH_CMD_BEGIN) {
+        dm->stub_addr = ram_read(dm, CTRL(dm, addr));
+        dm->stub_size = ram_read(dm, CTRL(dm, size));
+        dm->stub_written = 0;
+        const bool fits = dm->stub_size <= dm->flash_size && dm->stub_addr <= dm->flash_size - dm->stub_size;
+        if (fits) {
+            memset(dm->flash + dm->stub_addr, 0xff, dm->stub_size);
+        } else {
+            dm->stub_size = 0;
+        }
+        ram_write(dm, CTRL(dm, status), fits ? 0 : 1);
+        ram_write(dm, CTRL(dm, cmd), JTAG_FLASH_CMD_NONE);
+        return;
+    }
+
+    // Everything between rd and wr goes to flash, up to size bytes
+    const uint8_t *ring = ram_at(dm, dm->ring_addr, dm->ring_size);
+    const uint32_t wr = ram_read(dm, CTRL(dm, wr));
+    uint32_t rd = ram_read(dm, CTRL(dm, rd));
+    // Whatever doesn't fit is dropped, so a wr/rd pair left over from the last session costs nothing
+    const uint32_t room = dm->stub_size - dm->stub_written;
+    for (uint32_t n = wr - rd < room ? wr - rd : room; n > 0; n--, rd++) {
+        dm->flash[dm->stub_addr + dm->stub_written++] = ring[rd & (dm->ring_size - 1)];
+    }
+    ram_write(dm, CTRL(dm, rd), wr);
+
+    if (cmd == JTAG_FLASH_CMD_END) {
+        ram_write(dm, CTRL(dm, status), dm->stub_written == dm->stub_size ? 0 : 2);
+        ram_write(dm, CTRL(dm, cmd), JTAG_FLASH_CMD_NONE);
+    }
+}
+
+static void sb_access(host_riscv_dm_t *dm, bool write, uint32_t value)
+{
+    if ((dm->sbcs & SBCS_SBACCESS_MASK) != SBCS_SBACCESS_32) {
+        dm->sbcs |= SBCS_SBERROR_SIZE;
+        return;
+    }
+    if (!ram_at(dm, dm->sbaddress, 4)) {
+        dm->sbcs |= SBCS_SBERROR_BAD_ADDR;
+        return;
+    }
+
+    if (write) {
+        ram_write(dm, dm->sbaddress, value);
+    } else {
+        dm->sbdata = ram_read(dm, dm->sbaddress);
+    }
+    if (dm->sbcs & SBCS_SBAUTOINCREMENT) {
+        dm->sbaddress += 4;
+    }
+}
+
+static uint32_t dm_read(host_riscv_dm_t *dm, uint32_t addr)
+{
+    switch (addr) {
+    case DM_DATA0:
+        return dm->data0;
+    case DM_DMSTATUS:
+        return DMSTATUS_VERSION_013 | (dm->halted ? DMSTATUS_ALLHALTED : DMSTATUS_ALLRUNNING) |
+               (dm->resumeack ? DMSTATUS_ALLRESUMEACK : 0);
+    case DM_ABSTRACTCS:
+        return dm->abstractcs;
+    case DM_SBCS:
+        return SBCS_SBVERSION_1 | SBCS_SBACCESS32 | dm->sbcs;
+    case DM_SBADDRESS0:
+        return dm->sbaddress;
+    case DM_SBDATA0:
+        return dm->sbdata;
+    default:
+        return 0;
+    }
+}
+
+static void dm_write(host_riscv_dm_t *dm, uint32_t addr, uint32_t value)
+{
+    const uint32_t sbcs_errors = SBCS_SBERROR | SBCS_SBBUSYERROR;
+
+    switch (addr) {
+    case DM_DATA0:
+        dm->data0 = value;
+        break;
+    case DM_DMCONTROL:
+        if (value & DMCONTROL_HALTREQ) {
+            dm->halted = true;
+            dm->resumeack = false;
+            dm->stub_running = false;
+        } else if ((value & DMCONTROL_RESUMEREQ) && dm->halted) {
+            dm->halted = false;
+            dm->resumeack = true;
+            if (dm->dpc == dm->stub_entry) {
+                stub_start(dm);
+            }
+        }
+        break;
+    case DM_ABSTRACTCS:
+        dm->abstractcs &= ~(value & ABSTRACTCS_CMDERR);
+        break;
+    case DM_COMMAND:
+        if (dm->abstractcs & ABSTRACTCS_CMDERR) {
+            break;
+        }
+        if (!dm->halted) {
+            dm->abstractcs |= CMDERR_HALT_RESUME;
+        } else if ((value & (COMMAND_TRANSFER | COMMAND_WRITE)) == (COMMAND_TRANSFER | COMMAND_WRITE) &&
+                   (value & COMMAND_AARSIZE_MASK) == COMMAND_AARSIZE_32 && (value & COMMAND_REGNO_MASK) == CSR_DPC) {
+            dm->dpc = dm->data0;
+        } else {
+            dm->abstractcs |= CMDERR_NOT_SUPPORTED;
+        }
+        break;
+    case DM_SBCS:
+        dm->sbcs = (dm->sbcs & sbcs_errors & ~(value & sbcs_errors)) |
+                   (value & (SBCS_SBACCESS_MASK | SBCS_SBAUTOINCREMENT | SBCS_SBREADONADDR));
+        break;
+    case DM_SBADDRESS0:
+        dm->sbaddress = value;
+        if (dm->sbcs & SBCS_SBREADONADDR) {
+            sb_access(dm, false, 0);
+        }
+        break;
+    case DM_SBDATA0:
+        sb_access(dm, true, value);
+        break;
+    default:
+        break;
+    }
+}
+
+void host_riscv_dm_init(host_riscv_dm_t *dm)
+{
+    memset(dm, 0, sizeof(*dm));
+}
+
+uint32_t host_riscv_dtmcs(void)
+{
+    // No Run-Test/Idle cycles needed between DMI accesses
+    return DTMCS_VERSION_013 | (DTMCS_ABITS << 4);
+}
+
+uint64_t host_riscv_dmi_capture(host_riscv_dm_t *dm)
+{
+    // The accesses never take long enough to report busy
+    return ((uint64_t) dm->dmi_data << 2) | DMI_STATUS_SUCCESS;
+}
+
+void host_riscv_dmi_update(host_riscv_dm_t *dm, uint64_t dr)
+{
+    const uint32_t op = dr & 3;
+    const uint32_t data = (uint32_t) (dr >> 2);
+    const uint32_t addr = (uint32_t) (dr >> 34);
+
+    if (op == DMI_OP_READ) {
+        dm->dmi_data = dm_read(dm, addr);
+    } else if (op == DMI_OP_WRITE) {
+        dm_write(dm, addr, data);
+    }
+    stub_run(dm);
+}
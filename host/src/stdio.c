@@ -0,0 +1,158 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * pico_stdio. The firmware's printf(), vprintf(), puts() and putchar() are wrapped at link time
+ * and go to the enabled drivers; stdio_uart, the SDK's default, writes to stderr. What the PIO
+ * UART logger puts on its pin is kept in a buffer for host_logger_read().
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdio.h"
+#include "pico/stdio_uart.h"
+#include "FreeRTOS.h"
+#include "host_bridge.h"
+#include "host_internal.h"
+
+#define LOGGER_CAPTURE_SIZE (64 * 1024)
+
+static void stdio_uart_out_chars(const char *buf, int len)
+{
+    fwrite(buf, 1, (size_t) len, stderr);
+}
+
+stdio_driver_t stdio_uart = {
+    .out_chars = stdio_uart_out_chars,
+};
+
+static stdio_driver_t *s_drivers = &stdio_uart;
+
+static uint8_t s_capture[LOGGER_CAPTURE_SIZE];
+static size_t s_capture_head;
+static size_t s_capture_count;
+
+void stdio_uart_init(void)
+{
+    stdio_set_driver_enabled(&stdio_uart, true);
+}
+
+void stdio_set_driver_enabled(stdio_driver_t *driver, bool enabled)
+{
+    host_critical_enter();
+    stdio_driver_t **link = &s_drivers;
+    while (*link && *link != driver) {
+        link = &(*link)->next;
+    }
+    if (enabled && *link == NULL) {
+        driver->next = NULL;
+        *link = driver;
+    } else if (!enabled && *link) {
+        *link = driver->next;
+    }
+    host_critical_exit();
+}
+
+void stdio_flush(void)
+{
+    host_critical_enter();
+    for (stdio_driver_t *driver = s_drivers; driver; driver = driver->next) {
+        if (driver->out_flush) {
+            driver->out_flush();
+        }
+    }
+    host_critical_exit();
+}
+
+static void stdio_out_chars(const char *buf, int len)
+{
+    host_critical_enter();
+    for (stdio_driver_t *driver = s_drivers; driver; driver = driver->next) {
+        driver->out_chars(buf, len);
+    }
+    host_critical_exit();
+}
+
+int __wrap_vprintf(const char *format, va_list va)
+{
+    char buf[512];
+    const int len = vsnprintf(buf, sizeof(buf), format, va);
+
+    if (len > 0) {
+        stdio_out_chars(buf, MIN(len, (int) sizeof(buf) - 1));
+    }
+    return len;
+}
+
+int __wrap_printf(const char *format, ...)
+{
+    va_list va;
+
+    va_start(va, format);
+    const int len = __wrap_vprintf(format, va);
+    va_end(va);
+    return len;
+}
+
+int __wrap_puts(const char *s)
+{
+    stdio_out_chars(s, (int) strlen(s));
+    stdio_out_chars("\n", 1);
+    return 1;
+}
+
+int __wrap_putchar(int c)
+{
+    const char ch = (char) c;
+
+    stdio_out_chars(&ch, 1);
+    return c;
+}
+
+void host_logger_capture(const uint8_t *data, size_t size)
+{
+    host_kernel_lock();
+    for (size_t i = 0; i < size; i++) {
+        s_capture[(s_capture_head + s_capture_count) % LOGGER_CAPTURE_SIZE] = data[i];
+        if (s_capture_count < LOGGER_CAPTURE_SIZE) {
+            s_capture_count++;
+        } else {
+            s_capture_head = (s_capture_head + 1) % LOGGER_CAPTURE_SIZE;
+        }
+    }
+    host_kernel_notify();
+    host_kernel_unlock();
+}
+
+size_t host_logger_read(char *data, size_t size, uint32_t timeout_ms)
+{
+    const host_deadline_t deadline = host_deadline_ms(timeout_ms);
+    size_t n = 0;
+
+    host_kernel_lock();
+    while (s_capture_count == 0) {
+        if (!host_kernel_wait(&deadline)) {
+            break;
+        }
+    }
+    for (; n < size && s_capture_count > 0; n++) {
+        data[n] = (char) s_capture[s_capture_head];
+        s_capture_head = (s_capture_head + 1) % LOGGER_CAPTURE_SIZE;
+        s_capture_count--;
+    }
+    host_kernel_unlock();
+    return n;
+}
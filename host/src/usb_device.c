@@ -0,0 +1,744 @@
+/* Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * TinyUSB device stack. The endpoint FIFOs are shared with the host side under the kernel lock,
+ * like the controller's buffers; every class callback runs on the task calling tud_task(), the
+ * host side only queues them. Requests that need an answer (control transfers, line state, MSC
+ * commands) wait for tud_task() to process them.
+ *
+ * An IN FIFO hands whole packets to the host as they fill up and the rest on flush.
+ */
+
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "tusb.h"
+#include "host_bridge.h"
+#include "host_internal.h"
+
+#define MSC_BLOCK_SIZE  512
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t head;
+    uint32_t count;
+    uint32_t committed;
+    uint32_t packet_size;
+} usb_fifo_t;
+
+enum {
+    EVENT_VENDOR_RX = 1 << 0,
+    EVENT_VENDOR_TX = 1 << 1,
+    EVENT_CDC_RX = 1 << 2,
+    EVENT_CDC_TX = 1 << 3,
+    EVENT_MOUNT = 1 << 4,
+    EVENT_UMOUNT = 1 << 5,
+};
+
+typedef enum {
+    REQUEST_NONE,
+    REQUEST_CONTROL,
+    REQUEST_LINE_STATE,
+    REQUEST_LINE_CODING,
+    REQUEST_MSC_READ10,
+    REQUEST_MSC_WRITE10,
+} request_type_t;
+
+typedef struct {
+    request_type_t type;
+    bool done;
+    bool ok;
+    tusb_control_request_t setup;
+    uint8_t *data;
+    uint32_t len;
+    uint32_t lba;
+    int32_t result;
+    bool dtr;
+    bool rts;
+    cdc_line_coding_t coding;
+} request_t;
+
+static uint8_t s_vendor_rx_buf[CFG_TUD_VENDOR_RX_BUFSIZE];
+static uint8_t s_vendor_tx_buf[CFG_TUD_VENDOR_TX_BUFSIZE];
+static uint8_t s_cdc_rx_buf[CFG_TUD_CDC_RX_BUFSIZE];
+static uint8_t s_cdc_tx_buf[CFG_TUD_CDC_TX_BUFSIZE];
+
+static usb_fifo_t s_vendor_rx = { s_vendor_rx_buf, sizeof(s_vendor_rx_buf), 0, 0, 0, CFG_TUD_VENDOR_EPSIZE };
+static usb_fifo_t s_vendor_tx = { s_vendor_tx_buf, sizeof(s_vendor_tx_buf), 0, 0, 0, CFG_TUD_VENDOR_EPSIZE };
+static usb_fifo_t s_cdc_rx = { s_cdc_rx_buf, sizeof(s_cdc_rx_buf), 0, 0, 0, CFG_TUD_CDC_EP_BUFSIZE };
+static usb_fifo_t s_cdc_tx = { s_cdc_tx_buf, sizeof(s_cdc_tx_buf), 0, 0, 0, CFG_TUD_CDC_EP_BUFSIZE };
+
+static bool s_inited;
+static bool s_mounted = true;
+static uint32_t s_events;
+static request_t *s_request;
+static bool s_request_busy;
+static uint8_t s_sense_key;
+static uint8_t s_line_state;
+static cdc_line_coding_t s_line_coding = { 115200, 0, 0, 8 };
+
+/*
+ * FIFOs, called with the kernel lock held
+ */
+
+static uint32_t fifo_push(usb_fifo_t *f, const uint8_t *data, uint32_t size)
+{
+    const uint32_t n = MIN(size, f->size - f->count);
+
+    for (uint32_t i = 0; i < n; i++) {
+        f->buf[(f->head + f->count + i) % f->size] = data[i];
+    }
+    f->count += n;
+    if (n) {
+        host_kernel_notify();
+    }
+    return n;
+}
+
+static uint32_t fifo_pop(usb_fifo_t *f, uint8_t *data, uint32_t size)
+{
+    const uint32_t n = MIN(size, f->count);
+
+    for (uint32_t i = 0; i < n; i++) {
+        data[i] = f->buf[f->head];
+        f->head = (f->head + 1) % f->size;
+    }
+    f->count -= n;
+    if (n) {
+        host_kernel_notify();
+    }
+    return n;
+}
+
+static void fifo_commit(usb_fifo_t *f, bool flush)
+{
+    const uint32_t committed = flush ? f->count : f->count - f->count % f->packet_size;
+
+    if (committed > f->committed) {
+        f->committed = committed;
+        host_kernel_notify();
+    }
+}
+
+static void fifo_clear(usb_fifo_t *f)
+{
+    f->head = 0;
+    f->count = 0;
+    f->committed = 0;
+    host_kernel_notify();
+}
+
+static void post_events(uint32_t events)
+{
+    s_events |= events;
+    host_kernel_notify();
+}
+
+/*
+ * Device stack
+ */
+
+bool tud_init(uint8_t rhport)
+{
+    (void) rhport;
+    host_kernel_lock();
+    s_inited = true;
+    host_kernel_notify();
+    host_kernel_unlock();
+    return true;
+}
+
+TU_ATTR_WEAK void tud_mount_cb(void)
+{
+}
+
+TU_ATTR_WEAK void tud_umount_cb(void)
+{
+}
+
+TU_ATTR_WEAK void tud_vendor_rx_cb(uint8_t itf)
+{
+    (void) itf;
+}
+
+TU_ATTR_WEAK void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes)
+{
+    (void) itf;
+    (void) sent_bytes;
+}
+
+TU_ATTR_WEAK bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const *request)
+{
+    (void) rhport;
+    (void) stage;
+    (void) request;
+    return false;
+}
+
+TU_ATTR_WEAK void tud_cdc_rx_cb(uint8_t itf)
+{
+    (void) itf;
+}
+
+TU_ATTR_WEAK void tud_cdc_tx_complete_cb(uint8_t itf)
+{
+    (void) itf;
+}
+
+TU_ATTR_WEAK void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts)
+{
+    (void) itf;
+    (void) dtr;
+    (void) rts;
+}
+
+TU_ATTR_WEAK void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const *p_line_coding)
+{
+    (void) itf;
+    (void) p_line_coding;
+}
+
+TU_ATTR_WEAK int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void *buffer, uint32_t bufsize)
+{
+    (void) lun;
+    (void) lba;
+    (void) offset;
+    (void) buffer;
+    (void) bufsize;
+    return -1;
+}
+
+TU_ATTR_WEAK int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *buffer,
+                                        uint32_t bufsize)
+{
+    (void) lun;
+    (void) lba;
+    (void) offset;
+    (void) buffer;
+    (void) bufsize;
+    return -1;
+}
+
+static bool control_request(request_t *req)
+{
+    if (!tud_vendor_control_xfer_cb(BOARD_TUD_RHPORT, CONTROL_STAGE_SETUP, &req->setup)) {
+        return false;
+    }
+    if (req->len) {
+        tud_vendor_control_xfer_cb(BOARD_TUD_RHPORT, CONTROL_STAGE_DATA, &req->setup);
+    }
+    tud_vendor_control_xfer_cb(BOARD_TUD_RHPORT, CONTROL_STAGE_ACK, &req->setup);
+    return true;
+}
+
+// A callback returning 0 isn't ready yet and is asked again, like TinyUSB does on its next run
+static int32_t msc_request(request_t *req)
+{
+    uint32_t xferred = 0;
+
+    while (xferred < req->len) {
+        const uint32_t lba = req->lba + xferred / MSC_BLOCK_SIZE;
+        const uint32_t offset = xferred % MSC_BLOCK_SIZE;
+        const uint32_t chunk = MIN(req->len - xferred, CFG_TUD_MSC_EP_BUFSIZE);
+        const int32_t r = req->type == REQUEST_MSC_READ10 ?
+                          tud_msc_read10_cb(0, lba, offset, req->data + xferred, chunk) :
+                          tud_msc_write10_cb(0, lba, offset, req->data + xferred, chunk);
+        if (r < 0) {
+            return -1;
+        }
+        if (r == 0) {
+            vTaskDelay(1);
+            continue;
+        }
+        xferred += (uint32_t) r;
+    }
+    return (int32_t) xferred;
+}
+
+static void run_request(request_t *req)
+{
+    switch (req->type) {
+    case REQUEST_CONTROL:
+        req->ok = control_request(req);
+        break;
+    case REQUEST_LINE_STATE:
+        tud_cdc_line_state_cb(0, req->dtr, req->rts);
+        req->ok = true;
+        break;
+    case REQUEST_LINE_CODING:
+        tud_cdc_line_coding_cb(0, &req->coding);
+        req->ok = true;
+        break;
+    case REQUEST_MSC_READ10:
+    case REQUEST_MSC_WRITE10:
+        req->result = msc_request(req);
+        req->ok = req->result >= 0;
+        break;
+    default:
+        break;
+    }
+}
+
+void tud_task(void)
+{
+    const host_deadline_t forever = host_deadline_ms(UINT32_MAX);
+
+    host_kernel_lock();
+    while (s_events == 0 && s_request == NULL) {
+        host_kernel_wait(&forever);
+    }
+    const uint32_t events = s_events;
+    request_t *req = s_request;
+    s_events = 0;
+    s_request = NULL;
+    host_kernel_unlock();
+
+    if (events & EVENT_MOUNT) {
+        tud_mount_cb();
+    }
+    if (events & EVENT_UMOUNT) {
+        tud_umount_cb();
+    }
+    if (events & EVENT_VENDOR_RX) {
+        tud_vendor_rx_cb(0);
+    }
+    if (events & EVENT_VENDOR_TX) {
+        tud_vendor_tx_cb(0, 0);
+    }
+    if (events & EVENT_CDC_RX) {
+        tud_cdc_rx_cb(0);
+    }
+    if (events & EVENT_CDC_TX) {
+        tud_cdc_tx_complete_cb(0);
+    }
+
+    if (req) {
+        run_request(req);
+        host_kernel_lock();
+        req->done = true;
+        host_kernel_notify();
+        host_kernel_unlock();
+    }
+}
+
+bool tud_inited(void)
+{
+    host_kernel_lock();
+    const bool inited = s_inited;
+    host_kernel_unlock();
+    return inited;
+}
+
+bool tud_mounted(void)
+{
+    host_kernel_lock();
+    const bool mounted = s_inited && s_mounted;
+    host_kernel_unlock();
+    return mounted;
+}
+
+bool tud_ready(void)
+{
+    return tud_mounted();
+}
+
+bool tud_connected(void)
+{
+    return tud_mounted();
+}
+
+bool tud_suspended(void)
+{
+    return false;
+}
+
+bool tud_remote_wakeup(void)
+{
+    return false;
+}
+
+static request_t *s_control_req;
+
+bool tud_control_xfer(uint8_t rhport, tusb_control_request_t const *request, void *buffer, uint16_t len)
+{
+    (void) rhport;
+    request_t *req = s_control_req;
+    req->len = MIN(MIN(len, request->wLength), req->len);
+    memcpy(req->data, buffer, req->len);
+    return true;
+}
+
+bool tud_control_status(uint8_t rhport, tusb_control_request_t const *request)
+{
+    (void) rhport;
+    (void) request;
+    s_control_req->len = 0;
+    return true;
+}
+
+/*
+ * Vendor class
+ */
+
+uint32_t tud_vendor_n_available(uint8_t itf)
+{
+    (void) itf;
+    host_kernel_lock();
+    const uint32_t count = s_vendor_rx.count;
+    host_kernel_unlock();
+    return count;
+}
+
+uint32_t tud_vendor_n_read(uint8_t itf, void *buffer, uint32_t bufsize)
+{
+    (void) itf;
+    host_kernel_lock();
+    const uint32_t n = fifo_pop(&s_vendor_rx, buffer, bufsize);
+    host_kernel_unlock();
+    return n;
+}
+
+bool tud_vendor_n_peek(uint8_t itf, uint8_t *u8)
+{
+    (void) itf;
+    host_kernel_lock();
+    const bool available = s_vendor_rx.count > 0;
+    if (available) {
+        *u8 = s_vendor_rx.buf[s_vendor_rx.head];
+    }
+    host_kernel_unlock();
+    return available;
+}
+
+void tud_vendor_n_read_flush(uint8_t itf)
+{
+    (void) itf;
+    host_kernel_lock();
+    fifo_clear(&s_vendor_rx);
+    host_kernel_unlock();
+}
+
+uint32_t tud_vendor_n_write(uint8_t itf, void const *buffer, uint32_t bufsize)
+{
+    (void) itf;
+    host_kernel_lock();
+    const uint32_t n = fifo_push(&s_vendor_tx, buffer, bufsize);
+    fifo_commit(&s_vendor_tx, false);
+    host_kernel_unlock();
+    return n;
+}
+
+uint32_t tud_vendor_n_write_available(uint8_t itf)
+{
+    (void) itf;
+    host_kernel_lock();
+    const uint32_t space = s_vendor_tx.size - s_vendor_tx.count;
+    host_kernel_unlock();
+    return space;
+}
+
+uint32_t tud_vendor_n_flush(uint8_t itf)
+{
+    (void) itf;
+    host_kernel_lock();
+    fifo_commit(&s_vendor_tx, true);
+    const uint32_t committed = s_vendor_tx.committed;
+    host_kernel_unlock();
+    return committed;
+}
+
+bool tud_vendor_n_mounted(uint8_t itf)
+{
+    (void) itf;
+    return tud_mounted();
+}
+
+/*
+ * CDC class
+ */
+
+bool tud_cdc_n_connected(uint8_t itf)
+{
+    return (tud_cdc_n_get_line_state(itf) & 1) != 0;
+}
+
+uint8_t tud_cdc_n_get_line_state(uint8_t itf)
+{
+    (void) itf;
+    host_kernel_lock();
+    const uint8_t line_state = s_line_state;
+    host_kernel_unlock();
+    return line_state;
+}
+
+void tud_cdc_n_get_line_coding(uint8_t itf, cdc_line_coding_t *coding)
+{
+    (void) itf;
+    host_kernel_lock();
+    *coding = s_line_coding;
+    host_kernel_unlock();
+}
+
+uint32_t tud_cdc_n_available(uint8_t itf)
+{
+    (void) itf;
+    host_kernel_lock();
+    const uint32_t count = s_cdc_rx.count;
+    host_kernel_unlock();
+    return count;
+}
+
+uint32_t tud_cdc_n_read(uint8_t itf, void *buffer, uint32_t bufsize)
+{
+    (void) itf;
+    host_kernel_lock();
+    const uint32_t n = fifo_pop(&s_cdc_rx, buffer, bufsize);
+    host_kernel_unlock();
+    return n;
+}
+
+void tud_cdc_n_read_flush(uint8_t itf)
+{
+    (void) itf;
+    host_kernel_lock();
+    fifo_clear(&s_cdc_rx);
+    host_kernel_unlock();
+}
+
+uint32_t tud_cdc_n_write(uint8_t itf, void const *buffer, uint32_t bufsize)
+{
+    (void) itf;
+    host_kernel_lock();
+    const uint32_t n = fifo_push(&s_cdc_tx, buffer, bufsize);
+    fifo_commit(&s_cdc_tx, false);
+    host_kernel_unlock();
+    return n;
+}
+
+uint32_t tud_cdc_n_write_flush(uint8_t itf)
+{
+    (void) itf;
+    host_kernel_lock();
+    fifo_commit(&s_cdc_tx, true);
+    const uint32_t committed = s_cdc_tx.committed;
+    host_kernel_unlock();
+    return committed;
+}
+
+uint32_t tud_cdc_n_write_available(uint8_t itf)
+{
+    (void) itf;
+    host_kernel_lock();
+    const uint32_t space = s_cdc_tx.size - s_cdc_tx.count;
+    host_kernel_unlock();
+    return space;
+}
+
+bool tud_cdc_n_write_clear(uint8_t itf)
+{
+    (void) itf;
+    host_kernel_lock();
+    fifo_clear(&s_cdc_tx);
+    host_kernel_unlock();
+    return true;
+}
+
+/*
+ * MSC class
+ */
+
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, uint8_t add_sense_qualifier)
+{
+    (void) lun;
+    (void) add_sense_code;
+    (void) add_sense_qualifier;
+    host_kernel_lock();
+    s_sense_key = sense_key;
+    host_kernel_unlock();
+    return true;
+}
+
+/*
+ * Host side
+ */
+
+void host_usb_set_mounted(bool mounted)
+{
+    host_kernel_lock();
+    if (mounted != s_mounted) {
+        s_mounted = mounted;
+        post_events(mounted ? EVENT_MOUNT : EVENT_UMOUNT);
+    }
+    host_kernel_unlock();
+}
+
+// Hands a request to tud_task() and waits for it, one request at a time
+static void submit_request(request_t *req)
+{
+    const host_deadline_t forever = host_deadline_ms(UINT32_MAX);
+
+    host_kernel_lock();
+    while (s_request_busy) {
+        host_kernel_wait(&forever);
+    }
+    s_request_busy = true;
+    s_control_req = req;
+    s_request = req;
+    host_kernel_notify();
+    while (!req->done) {
+        host_kernel_wait(&forever);
+    }
+    s_request_busy = false;
+    host_kernel_notify();
+    host_kernel_unlock();
+}
+
+// OUT endpoint: a packet moves once the device FIFO has room for all of it
+static size_t host_out(usb_fifo_t *f, uint32_t event, const void *data, size_t size, uint32_t timeout_ms)
+{
+    const host_deadline_t deadline = host_deadline_ms(timeout_ms);
+    const uint8_t *p = data;
+    size_t sent = 0;
+
+    host_kernel_lock();
+    while (sent < size) {
+        const uint32_t packet = (uint32_t) MIN(size - sent, f->packet_size);
+        if (f->size - f->count < packet) {
+            if (!host_kernel_wait(&deadline)) {
+                break;
+            }
+            continue;
+        }
+        sent += fifo_push(f, p + sent, packet);
+        post_events(event);
+    }
+    host_kernel_unlock();
+    return sent;
+}
+
+// IN endpoint: whatever the device committed, waiting for the first byte
+static size_t host_in(usb_fifo_t *f, uint32_t event, void *data, size_t size, uint32_t timeout_ms)
+{
+    const host_deadline_t deadline = host_deadline_ms(timeout_ms);
+    size_t received = 0;
+
+    host_kernel_lock();
+    while (f->committed == 0) {
+        if (!host_kernel_wait(&deadline)) {
+            break;
+        }
+    }
+    if (f->committed) {
+        received = fifo_pop(f, data, (uint32_t) MIN(size, f->committed));
+        f->committed -= (uint32_t) received;
+        post_events(event);
+    }
+    host_kernel_unlock();
+    return received;
+}
+
+size_t host_usb_vendor_write(const void *data, size_t size, uint32_t timeout_ms)
+{
+    return host_out(&s_vendor_rx, EVENT_VENDOR_RX, data, size, timeout_ms);
+}
+
+size_t host_usb_vendor_read(void *data, size_t size, uint32_t timeout_ms)
+{
+    return host_in(&s_vendor_tx, EVENT_VENDOR_TX, data, size, timeout_ms);
+}
+
+bool host_usb_vendor_control(uint8_t request, uint16_t value, uint16_t index, void *data, uint16_t *len)
+{
+    request_t req = {
+        .type = REQUEST_CONTROL,
+        .setup = {
+            .bmRequestType_bit = {
+                .recipient = TUSB_REQ_RCPT_DEVICE,
+                .type = TUSB_REQ_TYPE_VENDOR,
+                .direction = TUSB_DIR_IN,
+            },
+            .bRequest = request,
+            .wValue = value,
+            .wIndex = index,
+            .wLength = len ? *len : 0,
+        },
+        .data = data,
+        .len = len ? *len : 0,
+    };
+
+    submit_request(&req);
+    if (len) {
+        *len = req.ok ? (uint16_t) req.len : 0;
+    }
+    return req.ok;
+}
+
+size_t host_usb_cdc_write(const void *data, size_t size, uint32_t timeout_ms)
+{
+    return host_out(&s_cdc_rx, EVENT_CDC_RX, data, size, timeout_ms);
+}
+
+size_t host_usb_cdc_read(void *data, size_t size, uint32_t timeout_ms)
+{
+    return host_in(&s_cdc_tx, EVENT_CDC_TX, data, size, timeout_ms);
+}
+
+void host_usb_cdc_set_line_coding(uint32_t bit_rate)
+{
+    request_t req = { .type = REQUEST_LINE_CODING };
+
+    host_kernel_lock();
+    s_line_coding.bit_rate = bit_rate;
+    req.coding = s_line_coding;
+    host_kernel_unlock();
+    submit_request(&req);
+}
+
+void host_usb_cdc_set_line_state(bool dtr, bool rts)
+{
+    request_t req = { .type = REQUEST_LINE_STATE, .dtr = dtr, .rts = rts };
+
+    host_kernel_lock();
+    s_line_state = (uint8_t) ((dtr ? 1 : 0) | (rts ? 2 : 0));
+    host_kernel_unlock();
+    submit_request(&req);
+}
+
+int32_t host_usb_msc_read10(uint32_t lba, void *data, uint32_t size)
+{
+    request_t req = { .type = REQUEST_MSC_READ10, .lba = lba, .data = data, .len = size };
+
+    submit_request(&req);
+    return req.result;
+}
+
+int32_t host_usb_msc_write10(uint32_t lba, const void *data, uint32_t size)
+{
+    request_t req = { .type = REQUEST_MSC_WRITE10, .lba = lba, .data = (uint8_t *) data, .len = size };
+
+    submit_request(&req);
+    return req.result;
+}
+
+uint8_t host_usb_msc_take_sense(void)
+{
+    host_kernel_lock();
+    const uint8_t sense_key = s_sense_key;
+    s_sense_key = SCSI_SENSE_NONE;
+    host_kernel_unlock();
+    return sense_key;
+}
@@ -22,23 +22,27 @@
 #include "generated/jtag.pio.h"
 #include "hardware/dma.h"
 #include "stream_buffer.h"
+#include "semphr.h"
 #include "ws2812.h"
+#include "bridge_stats.h"
+#include "bridge_trace.h"
+#include "bridge_profile.h"
+#include "jtag_capture.h"
+#include "la.h"
 
 #define MAKE_DAT(tdo, tms, tdi) ((tdo << 2)|(tms << 1)|(tdi << 0))
 #define IS_TDO(dat) (dat & 0b100) ? true : false
 
-#define USB_RCVBUF_SIZE             4096
-
-// TODO: We shouldn't have to buffer up to 32k of data!  This indicates a design problem on the host side
-// and will require fixing whatever is wrong in the openocd-esp32 usb-jtag implementation.
-#define USB_SNDBUF_SIZE             (32*1024)
-
 #define ROUND_UP_BITS(x)            ((x + 7) & (~7))
 
 
 
 /* esp usb serial protocol specific definitions */
 #define JTAG_PROTO_MAX_BITS      (512)
+// Shorter runs don't last long enough at any TCK to be worth a sleep, see jtag_sleep_through()
+#define JTAG_LONG_RUN_CLOCKS     (16384)
+// jtag_task holds the engine for a whole decode pass, which can wait on the USB task that asks for it
+#define JTAG_LOCAL_ACQUIRE_MS    (100)
 #define JTAG_PROTO_CAPS_VER 1     /*Version field. */
 typedef struct __attribute__((packed))
 {
@@ -94,7 +98,7 @@ typedef struct _jtag_context_t
 
 #define JTAG_BASE_FREQ_HZ (20000000)
 #define TCK_FREQ(khz) ((khz * 2) / 10)
-#define TCK_FREQ_HZ_FROM_DIV(div)((float)JTAG_BASE_FREQ_HZ/(div))
+#define TCK_FREQ_HZ_FROM_DIV(div)(JTAG_BASE_FREQ_HZ / MAX((div), 1))
 
 static const jtag_proto_caps_t jtag_proto_caps = 
 {
@@ -113,16 +117,24 @@ typedef struct _str_buffer_t
 	StaticSemaphore_t sem_can_transfer_def;
 }str_buffer_t;
 
-uint8_t usb_recv_buf_storage[USB_RCVBUF_SIZE + 1];
 uint8_t usb_send_buf_storage[USB_SNDBUF_SIZE + 1];
 
-static str_buffer_t usb_recv_buf;
 static str_buffer_t usb_send_buf;
+// Byte count of usb_send_buf up to the end of the last CMD_FLUSH reply, the writer flushes when it gets there
+static volatile uint32_t s_usb_flush_mark;
+static uint32_t s_usb_queued;
 
-static uint8_t s_tdo_bytes[1024];
+static uint8_t s_tdo_bytes[1024] BRIDGE_DMA_BUFFER;
 static esp_chip_model_t s_target_model;
 static TaskHandle_t s_task_handle = NULL;
 
+// The PIO engine is shared between the USB host (openocd) and local clients such as the JTAG flashing backend.
+// Whoever holds s_engine_mutex owns the engine and receives the DMA completion notifications.
+static SemaphoreHandle_t s_engine_mutex;
+static StaticSemaphore_t s_engine_mutex_def;
+static volatile TaskHandle_t s_engine_owner = NULL;
+static jtag_tck_plan_t s_host_tck;
+
 static const char* USB_CTRL_TAG = "jtag-usbctl";
 static const char* USB_RX_TAG = "jtag-rx";
 static const char* USB_TX_TAG = "jtag-tx";
@@ -159,8 +171,9 @@ static void jtag_pio_dma_init(void)
 	dma_channel_set_irq0_enabled(jtag_ctx.pio_rx_dma_channel, true);
 }
 
-static inline void jtag_pio_dma_start_read(void* buf, uint trans_count)
+static inline void BRIDGE_HOT_FUNC(jtag_pio_dma_start_read)(void* buf, uint trans_count)
 {
+	TRACE(TRACE_JTAG_DMA_START, trans_count);
 	dma_channel_set_trans_count(jtag_ctx.pio_rx_dma_channel, trans_count, false);
 	dma_channel_set_write_addr(jtag_ctx.pio_rx_dma_channel, buf, true);
 }
@@ -172,13 +185,78 @@ static void __not_in_flash_func(jtag_pio_dma_handler)(void)
 	if (dma_channel_get_irq0_status(jtag_ctx.pio_rx_dma_channel))
 	{
 		dma_channel_acknowledge_irq0(jtag_ctx.pio_rx_dma_channel);
-		xTaskNotifyFromISR(s_task_handle, JTAG_PIO_DMA_RX_COMPLETE_EVENT, eSetBits, &higherPriorityTaskWoken);
+		TRACE(TRACE_JTAG_DMA_DONE, 0);
+		xTaskNotifyFromISR(s_engine_owner, JTAG_PIO_DMA_RX_COMPLETE_EVENT, eSetBits, &higherPriorityTaskWoken);
 		portYIELD_FROM_ISR(higherPriorityTaskWoken);
 	}
 }
 
+// Picks the PIO clock divider for a TCK. An integer divider puts the same number of clk_sys cycles into every
+// TCK period, it is taken unless it is more than JTAG_TCK_INTEGER_DIV_TOLERANCE percent slower than the
+// fractional one. Either kind is rounded up so the clock never runs faster than asked for.
+static void jtag_tck_solve(uint32_t tck_hz, jtag_tck_plan_t *plan)
+{
+	const uint32_t sys_hz = clock_get_hz(clk_sys);
+	const uint64_t bit_hz = (uint64_t)MAX(tck_hz, 1) * jtag_simple_cycles_per_bit;
+	uint64_t div256 = ((uint64_t)sys_hz * 256 + bit_hz - 1) / bit_hz;
+	const uint64_t int_div256 = (div256 + 0xff) & ~0xffull;
+
+	if (int_div256 * (100 - JTAG_TCK_INTEGER_DIV_TOLERANCE) <= div256 * 100)
+	{
+		div256 = int_div256;
+	}
+	div256 = MIN(MAX(div256, 1u << 8), 0xffffull << 8);
+
+	plan->requested_hz = tck_hz;
+	plan->div_int = div256 >> 8;
+	plan->div_frac = div256 & 0xff;
+	plan->cycles_per_bit = jtag_simple_cycles_per_bit;
+	plan->actual_hz = (uint64_t)sys_hz * 256 / (div256 * jtag_simple_cycles_per_bit);
+}
+
+static void jtag_set_clkdiv(const jtag_tck_plan_t *plan)
+{
+	pio_set_sm_mask_enabled(jtag_ctx.pio, (1u << jtag_ctx.sm_tx) | (1u << jtag_ctx.sm_rx), false);
+	jtag_ctx.pio_clkdiv = plan->div_int + plan->div_frac / 256.0f;
+	pio_sm_set_clkdiv_int_frac(jtag_ctx.pio, jtag_ctx.sm_tx, plan->div_int, plan->div_frac);
+	pio_sm_set_clkdiv_int_frac(jtag_ctx.pio, jtag_ctx.sm_rx, plan->div_int, plan->div_frac);
+	pio_set_sm_mask_enabled(jtag_ctx.pio, (1u << jtag_ctx.sm_tx) | (1u << jtag_ctx.sm_rx), true);
+}
+
+#if LA_ENABLED
+static la_config_t s_la_config;
+#endif
+
 bool tud_vendor_control_xfer_cb(const uint8_t rhport, const uint8_t stage, tusb_control_request_t const *request)
 {
+	// The trace and profile dumps are sent straight from RAM, which is left alone until the host has all of it
+#if TRACE_ENABLED
+	if (stage == CONTROL_STAGE_ACK && request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR && request->bRequest == VEND_TRACE)
+	{
+		bridge_trace_resume();
+	}
+#endif
+#if PROFILE_ENABLED
+	if (stage == CONTROL_STAGE_ACK && request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR && request->bRequest == VEND_PROFILE)
+	{
+		bridge_profile_resume();
+	}
+#endif
+#if JTAG_CAPTURE_ENABLED
+	if (stage == CONTROL_STAGE_ACK && request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR && request->bRequest == VEND_JTAG_CAPTURE)
+	{
+		jtag_capture_resume();
+	}
+#endif
+#if LA_ENABLED
+	// The capture config has only arrived once the data stage is done
+	if (stage == CONTROL_STAGE_ACK && request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR && request->bRequest == VEND_LA &&
+	    request->wValue == LA_CMD_START)
+	{
+		la_start(&s_la_config);
+	}
+#endif
+
 	// nothing to with DATA & ACK stage
 	if (stage != CONTROL_STAGE_SETUP)
 	{
@@ -194,6 +272,12 @@ bool tud_vendor_control_xfer_cb(const uint8_t rhport, const uint8_t stage, tusb_
 		         request->wValue,
 		         request->wIndex);
 
+		if (request->bRequest <= VEND_JTAG_SET_CHIPID)
+		{
+			JTAG_CAPTURE(JTAG_CAPTURE_CONTROL, 0, &((jtag_capture_control_t) { request->bRequest, 0, request->wValue, request->wIndex }),
+			             sizeof(jtag_capture_control_t));
+		}
+
 		switch (request->bRequest)
 		{
 		case VEND_JTAG_SETDIV:
@@ -202,12 +286,10 @@ bool tud_vendor_control_xfer_cb(const uint8_t rhport, const uint8_t stage, tusb_
 				ESP_LOGE(USB_CTRL_TAG, "can't set JTAG clock until jtag_task is fully initialized!");
 				return false;
 			}
-			pio_set_sm_mask_enabled(jtag_ctx.pio, (1u << jtag_ctx.sm_tx) | (1u << jtag_ctx.sm_rx), false);
-			jtag_ctx.pio_clkdiv = clock_get_hz(clk_sys) / (TCK_FREQ_HZ_FROM_DIV(request->wValue) * jtag_simple_cycles_per_bit);
-			pio_sm_set_clkdiv(jtag_ctx.pio, jtag_ctx.sm_tx, jtag_ctx.pio_clkdiv);
-			pio_sm_set_clkdiv(jtag_ctx.pio, jtag_ctx.sm_rx, jtag_ctx.pio_clkdiv);
-			pio_set_sm_mask_enabled(jtag_ctx.pio, (1u << jtag_ctx.sm_tx) | (1u << jtag_ctx.sm_rx), true);
-			printf("clk_div=%.02f\r\n", jtag_ctx.pio_clkdiv);
+			jtag_tck_solve(TCK_FREQ_HZ_FROM_DIV(request->wValue), &s_host_tck);
+			jtag_set_clkdiv(&s_host_tck);
+			printf("clk_div=%.02f (%s) tck=%luHz\r\n", jtag_ctx.pio_clkdiv, s_host_tck.div_frac ? "fractional" : "integer",
+			       (unsigned long)s_host_tck.actual_hz);
 			break;
 		case VEND_JTAG_SETIO:
 			// TODO: process the commands
@@ -219,6 +301,68 @@ bool tud_vendor_control_xfer_cb(const uint8_t rhport, const uint8_t stage, tusb_
 		break;
 		case VEND_JTAG_SET_CHIPID:
 			s_target_model = request->wValue;
+			break;
+		case VEND_JTAG_TCK:
+			return tud_control_xfer(rhport, request, (void *)&s_host_tck, MIN(sizeof(s_host_tck), request->wLength));
+		case VEND_STATS: {
+			size_t len;
+			const uint8_t *snapshot = bridge_stats_snapshot(&len, request->wValue & BRIDGE_STATS_RESET);
+			return tud_control_xfer(rhport, request, (void *)snapshot, MIN(len, request->wLength));
+		}
+#if TRACE_ENABLED
+		case VEND_TRACE: {
+			size_t len;
+			const uint8_t *dump = bridge_trace_dump(&len, request->wValue & BRIDGE_TRACE_CLEAR);
+			if (!tud_control_xfer(rhport, request, (void *)dump, MIN(len, request->wLength)))
+			{
+				bridge_trace_resume();
+				return false;
+			}
+			return true;
+		}
+#endif
+#if PROFILE_ENABLED
+		case VEND_PROFILE: {
+			size_t len;
+			const uint8_t *dump = bridge_profile_dump(&len, request->wValue & BRIDGE_PROFILE_RESET);
+			if (!tud_control_xfer(rhport, request, (void *)dump, MIN(len, request->wLength)))
+			{
+				bridge_profile_resume();
+				return false;
+			}
+			return true;
+		}
+#endif
+#if JTAG_CAPTURE_ENABLED
+		case VEND_JTAG_CAPTURE: {
+			size_t len;
+			const uint8_t *dump = jtag_capture_dump(&len, request->wValue & JTAG_CAPTURE_CLEAR);
+			if (!tud_control_xfer(rhport, request, (void *)dump, MIN(len, request->wLength)))
+			{
+				jtag_capture_resume();
+				return false;
+			}
+			return true;
+		}
+#endif
+#if LA_ENABLED
+		case VEND_LA:
+			switch (request->wValue)
+			{
+			case LA_CMD_START:
+				if (request->wLength != sizeof(s_la_config))
+					return false;
+				return tud_control_xfer(rhport, request, (void *)&s_la_config, sizeof(s_la_config));
+			case LA_CMD_STOP:
+				la_stop();
+				break;
+			case LA_CMD_STATUS:
+				return tud_control_xfer(rhport, request, (void *)la_status(), MIN(sizeof(la_status_t), request->wLength));
+			default:
+				return false;
+			}
+			break;
+#endif
 		}
 
 		// response with status OK
@@ -238,89 +382,101 @@ static void init_jtag_pio(void)
 
 	jtag_ctx.offset_rx = pio_add_program(jtag_ctx.pio, &jtag_tdo_slave_program);
 	jtag_simple_program_init(jtag_ctx.pio, jtag_ctx.sm_tx, jtag_ctx.offset_tx, jtag_ctx.sm_rx, jtag_ctx.offset_rx, GPIO_TDI, GPIO_TDO, GPIO_TCK, 1000000ul);
+	jtag_tck_solve(1000000ul, &s_host_tck);
+	jtag_set_clkdiv(&s_host_tck);
 }
 
 // Invoked when received new data
-void tud_vendor_rx_cb(uint8_t itf)
+void BRIDGE_HOT_FUNC(tud_vendor_rx_cb)(uint8_t itf)
 {
-	xSemaphoreGive(usb_recv_buf.sem_can_transfer_handle);
+#if LA_ENABLED
+	if (itf == LA_VENDOR_ITF)
+		return;
+#endif
+	// jtag_task decodes straight out of the vendor FIFO
+	if (s_task_handle)
+	{
+		xTaskNotifyGiveIndexed(s_task_handle, JTAG_USB_RX_NOTIFY_INDEX);
+	}
 }
 
 // Invoked when last rx transfer finished
-void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes)
+void BRIDGE_HOT_FUNC(tud_vendor_tx_cb)(uint8_t itf, uint32_t sent_bytes)
 {
+#if LA_ENABLED
+	if (itf == LA_VENDOR_ITF)
+		return;
+#endif
+	TRACE(TRACE_VENDOR_TX_DONE, sent_bytes);
 	xSemaphoreGive(usb_send_buf.sem_can_transfer_handle);
 }
 
-static void usb_reader_task(void *pvParameters)
+static void BRIDGE_HOT_FUNC(usb_writer_task)(void *pvParameters)
 {
-	uint8_t buf[CFG_TUD_VENDOR_EPSIZE];
+	uint8_t local_buf[CFG_TUD_VENDOR_TX_BUFSIZE];
+	uint32_t written = 0, flushed_mark = 0;
+	bool unflushed = false;
+	const TickType_t flush_ticks = MAX(1, pdMS_TO_TICKS(USB_TX_FLUSH_MS));
+
 	for (;;)
 	{
-		if (tud_vendor_n_available(0))
+		// Fill the vendor FIFO with as much as is queued, TinyUSB sends full packets back to back on its own
+		size_t space = tud_vendor_n_write_available(0);
+		while (space == 0)
 		{
-			uint32_t r;
-			while ((r = tud_vendor_n_read(0, buf, sizeof(buf))) > 0)
-			{
-				if (xStreamBufferSend(usb_recv_buf.handle, buf, r, pdMS_TO_TICKS(1000)) != r)
-				{
-					ESP_LOGE(USB_RX_TAG,
-					         "Cannot write to usb_rcvbuf ringbuffer (free %d of %d)!",
-					         xStreamBufferSpacesAvailable(usb_recv_buf.handle),
-					         USB_RCVBUF_SIZE);
-					eub_abort();
-				}
-			}
-
-			if (xStreamBufferSpacesAvailable(usb_recv_buf.handle) < 0.25 * USB_RCVBUF_SIZE)
-			{
-				ESP_LOGW(USB_RX_TAG, "Ringbuffer is getting full!");
-				vTaskDelay(pdMS_TO_TICKS(1000));
-			}
+			tud_vendor_n_flush(0);
+			xSemaphoreTake(usb_send_buf.sem_can_transfer_handle, portMAX_DELAY);
+			space = tud_vendor_n_write_available(0);
 		}
-		else
+
+		const size_t n = xStreamBufferReceive(usb_send_buf.handle, local_buf, MIN(space, sizeof(local_buf)),
+		                                      unflushed ? flush_ticks : portMAX_DELAY);
+		if (n == 0)
 		{
-			xSemaphoreTake(usb_recv_buf.sem_can_transfer_handle, portMAX_DELAY);
+			// Nothing more came within the deadline, send the short packet
+			tud_vendor_n_flush(0);
+			unflushed = false;
+			continue;
 		}
-	}
-	vTaskDelete(NULL);
-}
-
-static void usb_writer_task(void *pvParameters)
-{
-	uint8_t local_buf[CFG_TUD_VENDOR_EPSIZE];
-	for (;;)
-	{
-
-		size_t n = xStreamBufferReceive(usb_send_buf.handle, local_buf, sizeof(local_buf), portMAX_DELAY);
 		if (!tud_mounted())
 		{
+			written += n;
+			flushed_mark = s_usb_flush_mark;
+			unflushed = false;
 			vTaskDelay(pdMS_TO_TICKS(100));
 			continue;
 		}
-		uint8_t *buf = local_buf;
 		ESP_LOGD(USB_TX_TAG, "%d bytes", n);
-		for (int transferred = 0, to_send = n; transferred < n;)
+
+		const uint32_t sent = tud_vendor_n_write(0, local_buf, n);
+		bridge_stats_level(STATS_BUF_VENDOR_TX, CFG_TUD_VENDOR_TX_BUFSIZE - tud_vendor_n_write_available(0));
+		written += sent;
+		unflushed = true;
+
+		// The mark is set before its bytes are queued, so it can't be missed once they are written
+		const uint32_t mark = s_usb_flush_mark;
+		if (mark != flushed_mark && (int32_t)(written - mark) >= 0)
 		{
-			int space;
-			while ((space = tud_vendor_n_write_available(0)) == 0)
-			{
-				xSemaphoreTake(usb_send_buf.sem_can_transfer_handle, portMAX_DELAY);
-			}
-			
-			const int sent = tud_vendor_n_write(0, local_buf + transferred, MIN(space, to_send));
-			transferred += sent;
-			to_send -= sent;
-			// there seems to be no flush for vendor class
 			tud_vendor_n_flush(0);
+			flushed_mark = mark;
+			unflushed = false;
 		}
 	}
 	vTaskDelete(NULL);
 }
 
-static int usb_send(const uint8_t *buf, const int size)
+static int BRIDGE_HOT_FUNC(usb_send)(const uint8_t *buf, const int size, const bool flush)
 {
-	if (xStreamBufferSend(usb_send_buf.handle, buf, size, pdMS_TO_TICKS(1000)) != size)
+	// A CMD_FLUSH reply is flushed as soon as its last byte is in the FIFO instead of after USB_TX_FLUSH_MS
+	if (flush)
+	{
+		s_usb_flush_mark = s_usb_queued + size;
+	}
+	// Recorded ahead of the data, the host can have the reply and dump the capture before the send returns
+	JTAG_CAPTURE(JTAG_CAPTURE_IN, flush ? JTAG_CAPTURE_FLUSH : 0, &((uint16_t) { size }), sizeof(uint16_t));
+	const size_t queued = xStreamBufferSend(usb_send_buf.handle, buf, size, pdMS_TO_TICKS(1000));
+	s_usb_queued += queued;
+	if (queued != size)
 	{
 		ESP_LOGE(USB_TX_TAG,
 		         "Out of space! (free %d of %d)!",
@@ -328,14 +484,65 @@ static int usb_send(const uint8_t *buf, const int size)
 		         USB_SNDBUF_SIZE);
 		return 0;
 	}
+	bridge_stats_level(STATS_BUF_USB_SEND, xStreamBufferBytesAvailable(usb_send_buf.handle));
+	TRACE(TRACE_USB_SEND_QUEUED, size);
 	return size;
 }
 
-inline static void jtag_transfer(uint8_t dat, uint repeat_cnt)
+// Idle clocking (RUNTEST, flash algorithm waits) can take seconds. Sleep through it instead of spinning on the
+// TX FIFO behind it; commands queued ahead of the run only make it end later.
+static void jtag_sleep_through(uint repeat_cnt)
+{
+	const uint32_t run_ms = (float) repeat_cnt * jtag_simple_cycles_per_bit * jtag_ctx.pio_clkdiv / (clock_get_hz(clk_sys) / 1000);
+	if (run_ms >= 2)
+	{
+		vTaskDelay(pdMS_TO_TICKS(run_ms - 1));
+	}
+}
+
+// Queues the TDO captured so far for the host and starts over at the head of s_tdo_bytes. Only the vendor
+// decoder gets here, jtag_local_clock() keeps its runs within the buffer.
+static void BRIDGE_HOT_FUNC(jtag_tdo_drain)(void)
+{
+	uint32_t notify_value;
+	if (dma_channel_is_busy(jtag_ctx.pio_rx_dma_channel))
+	{
+		xTaskNotifyWait(0xFFFFFFFF, 0, &notify_value, 0);
+		if (dma_channel_is_busy(jtag_ctx.pio_rx_dma_channel))
+			xTaskNotifyWait(0, JTAG_PIO_DMA_RX_COMPLETE_EVENT, &notify_value, portMAX_DELAY);
+	}
+	if (jtag_ctx.tdo_bits_sent < jtag_ctx.tdo_bits_total)
+	{
+		usb_send(s_tdo_bytes + (jtag_ctx.tdo_bits_sent / 8), (jtag_ctx.tdo_bits_total - jtag_ctx.tdo_bits_sent) / 8, false);
+	}
+	jtag_ctx.tdo_bits_total = jtag_ctx.tdo_bits_sent = 0;
+}
+
+inline static void BRIDGE_HOT_FUNC(jtag_transfer)(uint8_t dat, uint repeat_cnt)
 {
 	if (repeat_cnt == 0) return;
 
-	uint pio_tx_cmd = (dat << 12) | ((repeat_cnt - 1) << 1);
+	if (IS_TDO(dat))
+	{
+		// The capture DMA writes straight into s_tdo_bytes, a run that doesn't fit goes in pieces with what
+		// has been captured sent in between. The bits still in the ISR land at the head of the next piece.
+		uint room = sizeof(s_tdo_bytes) * 8 - jtag_ctx.tdo_bits_total - jtag_ctx.pio_rx_bits_cached;
+		while (repeat_cnt > room)
+		{
+			jtag_transfer(dat, room);
+			jtag_tdo_drain();
+			repeat_cnt -= room;
+			room = sizeof(s_tdo_bytes) * 8 - jtag_ctx.pio_rx_bits_cached;
+		}
+	}
+
+	if (repeat_cnt > JTAG_CMD_REPEAT_MAX)
+	{
+		jtag_transfer(dat, repeat_cnt - JTAG_CMD_REPEAT_MAX);
+		repeat_cnt = JTAG_CMD_REPEAT_MAX;
+	}
+
+	uint pio_tx_cmd = (dat << JTAG_CMD_DAT_SHIFT) | ((repeat_cnt - 1) << JTAG_CMD_REPEAT_SHIFT);
 	uint32_t notify_value;
 	if (IS_TDO(dat))
 	{
@@ -362,11 +569,13 @@ inline static void jtag_transfer(uint8_t dat, uint repeat_cnt)
 	else
 	{
 		pio_sm_put_blocking(jtag_ctx.pio, jtag_ctx.sm_tx, pio_tx_cmd);
+		if (repeat_cnt >= JTAG_LONG_RUN_CLOCKS)
+			jtag_sleep_through(repeat_cnt);
 	}
 
 }
 
-inline static void jtag_flush(void)
+inline static void BRIDGE_HOT_FUNC(jtag_flush)(void)
 {
 	uint32_t notify_value;
 	if (dma_channel_is_busy(jtag_ctx.pio_rx_dma_channel))
@@ -379,7 +588,7 @@ inline static void jtag_flush(void)
 	if (jtag_ctx.pio_rx_bits_cached)
 	{
 		uint flush_count = (JTAG_RX_PUSH_THRESHOLD - jtag_ctx.pio_rx_bits_cached);
-		uint pio_tx_cmd =  ((flush_count - 1) << 1) | 0x01;
+		uint pio_tx_cmd =  ((flush_count - 1) << 1) | JTAG_CMD_FLUSH;
 
 		pio_sm_put_blocking(jtag_ctx.pio, jtag_ctx.sm_tx, pio_tx_cmd);
 		uint tdo = pio_sm_get_blocking(jtag_ctx.pio, jtag_ctx.sm_rx);
@@ -412,6 +621,63 @@ int jtag_get_target_model(void)
 	return s_target_model;
 }
 
+bool jtag_local_acquire(uint32_t tck_hz)
+{
+	if (s_task_handle == NULL)
+	{
+		ESP_LOGE(JTAG_TASK_TAG, "jtag_task is not initialized!");
+		return false;
+	}
+
+	if (xSemaphoreTake(s_engine_mutex, pdMS_TO_TICKS(JTAG_LOCAL_ACQUIRE_MS)) != pdTRUE)
+	{
+		ESP_LOGW(JTAG_TASK_TAG, "JTAG is busy with the host");
+		return false;
+	}
+
+	// Don't cut into a sequence the host hasn't flushed yet
+	if (jtag_ctx.tdo_bits_total || jtag_ctx.pio_rx_bits_cached)
+	{
+		xSemaphoreGive(s_engine_mutex);
+		ESP_LOGW(JTAG_TASK_TAG, "JTAG is in use by the host");
+		return false;
+	}
+
+	s_engine_owner = xTaskGetCurrentTaskHandle();
+	xTaskNotifyStateClear(NULL);
+	jtag_tck_plan_t plan;
+	jtag_tck_solve(tck_hz, &plan);
+	jtag_set_clkdiv(&plan);
+	return true;
+}
+
+void jtag_local_release(void)
+{
+	jtag_flush();
+	jtag_ctx.tdo_bits_total = jtag_ctx.tdo_bits_sent = 0;
+	jtag_set_clkdiv(&s_host_tck);
+	s_engine_owner = s_task_handle;
+	xSemaphoreGive(s_engine_mutex);
+}
+
+void jtag_local_clock(bool tms, bool tdi, bool capture, uint32_t count)
+{
+	const uint8_t dat = MAKE_DAT(capture, tms, tdi);
+
+	assert(!capture || jtag_ctx.tdo_bits_total + jtag_ctx.pio_rx_bits_cached + count <= sizeof(s_tdo_bytes) * 8);
+	jtag_transfer(dat, count);
+}
+
+uint32_t jtag_local_read_tdo(uint8_t *buf, uint32_t max_bits)
+{
+	jtag_flush();
+
+	uint32_t bits = MIN(jtag_ctx.tdo_bits_total, max_bits);
+	memcpy(buf, s_tdo_bytes, (bits + 7) / 8);
+	jtag_ctx.tdo_bits_total = jtag_ctx.tdo_bits_sent = 0;
+	return bits;
+}
+
 void jtag_task_suspend(void)
 {
 	if (s_task_handle)
@@ -442,29 +708,21 @@ void __not_in_flash_func(jtag_task)(void *pvParameters)
 	jtag_pio_dma_init();
 	irq_add_shared_handler(DMA_IRQ_0, jtag_pio_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
 	irq_set_enabled(DMA_IRQ_0, true);
+	s_engine_mutex = xSemaphoreCreateMutexStatic(&s_engine_mutex_def);
+	s_engine_owner = xTaskGetCurrentTaskHandle();
 	s_task_handle = xTaskGetCurrentTaskHandle();
 
 	memset(s_tdo_bytes, 0x00, sizeof(s_tdo_bytes));
 
 	// create stream buffers
-	usb_recv_buf.handle = xStreamBufferGenericCreateStatic(sizeof(usb_recv_buf_storage), 1, pdFALSE, usb_recv_buf_storage, &usb_recv_buf.def);
 	usb_send_buf.handle = xStreamBufferGenericCreateStatic(sizeof(usb_send_buf_storage), 1, pdFALSE, usb_send_buf_storage, &usb_send_buf.def);
 
 	// create transfer semapthores
-	usb_recv_buf.sem_can_transfer_handle = xSemaphoreCreateBinaryStatic(&usb_recv_buf.sem_can_transfer_def);
 	usb_send_buf.sem_can_transfer_handle = xSemaphoreCreateBinaryStatic(&usb_send_buf.sem_can_transfer_def);
 
-	xSemaphoreTake(usb_recv_buf.sem_can_transfer_handle, 0);
 	xSemaphoreTake(usb_send_buf.sem_can_transfer_handle, 0);
 
-
-	if (xTaskCreateAffinitySet(usb_reader_task, "usb_reader_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, uxTaskPriorityGet(NULL) - 1, CORE_AFFINITY_JTAG_TASK, NULL) != pdPASS)
-	{
-		ESP_LOGE(JTAG_TASK_TAG, "Cannot create USB reader task!");
-		eub_abort();
-	}
-
-	if (xTaskCreateAffinitySet(usb_writer_task, "usb_send_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, uxTaskPriorityGet(NULL) + 1, CORE_AFFINITY_JTAG_TASK, NULL) != pdPASS)
+	if (xTaskCreateAffinitySet(usb_writer_task, "usb_send_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_USB_WRITER_TASK, CORE_AFFINITY_JTAG_TASK, NULL) != pdPASS)
 	{
 		ESP_LOGE(JTAG_TASK_TAG, "Cannot create USB send task!");
 		eub_abort();
@@ -509,12 +767,24 @@ void __not_in_flash_func(jtag_task)(void *pvParameters)
 	while (1)
 	{
 		bool was_reset = false;
-		cnt = xStreamBufferReceive(usb_recv_buf.handle, nibbles, sizeof(nibbles), portMAX_DELAY);
+		// One copy out of the vendor FIFO, a full FIFO NAKs the host until the decoder catches up
+		uint32_t available;
+		while ((available = tud_vendor_n_available(0)) == 0)
+		{
+			ulTaskNotifyTakeIndexed(JTAG_USB_RX_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+		}
+		bridge_stats_level(STATS_BUF_VENDOR_RX, available);
+		cnt = tud_vendor_n_read(0, nibbles, sizeof(nibbles));
+		TRACE(TRACE_VENDOR_RX, cnt);
+		JTAG_CAPTURE(JTAG_CAPTURE_OUT, 0, nibbles, cnt);
+		xSemaphoreTake(s_engine_mutex, portMAX_DELAY);
+		TRACE(TRACE_JTAG_DECODE_START, cnt);
 
 		for (size_t n = 0; n < cnt * 2; n++)
 		{
 			const int cmd = (n & 1) ? (nibbles[n / 2] & 0x0F) : (nibbles[n / 2] >> 4);
-			int cmd_exec = cmd, cmd_rpt_cnt = 1;
+			int cmd_exec = cmd;
+			uint32_t cmd_rpt_cnt = 1;
 
 			switch (cmd)
 			{
@@ -522,8 +792,9 @@ void __not_in_flash_func(jtag_task)(void *pvParameters)
 			case CMD_REP1:
 			case CMD_REP2:
 			case CMD_REP3:
-				//(r1*2+r0)<<(2*n)
-				cmd_rpt_cnt = (cmd - CMD_REP0) << (2 * rep_cnt++);
+				//(r1*2+r0)<<(2*n), up to 16 stacked REPs make a 32 bit count
+				cmd_rpt_cnt = (rep_cnt < 16) ? (uint32_t)(cmd - CMD_REP0) << (2 * rep_cnt) : 0;
+				rep_cnt++;
 				cmd_exec = prev_cmd;
 				break;
 			case CMD_SRST0:          // JTAG Tap reset command is not expected from host but still we are ready
@@ -547,6 +818,7 @@ void __not_in_flash_func(jtag_task)(void *pvParameters)
 			}
 			else if (cmd_exec == CMD_FLUSH)
 			{
+				TRACE(TRACE_JTAG_FLUSH, 0);
 				jtag_flush();
 				jtag_ctx.tdo_bits_total = ROUND_UP_BITS(jtag_ctx.tdo_bits_total);
 				if (jtag_ctx.tdo_bits_sent < jtag_ctx.tdo_bits_total)
@@ -555,7 +827,7 @@ void __not_in_flash_func(jtag_task)(void *pvParameters)
 					while (waiting_to_send_bits > 0)
 					{
 						int send_bits = waiting_to_send_bits > JTAG_PROTO_MAX_BITS ? JTAG_PROTO_MAX_BITS : waiting_to_send_bits;
-						usb_send(s_tdo_bytes + (jtag_ctx.tdo_bits_sent / 8), send_bits / 8);
+						usb_send(s_tdo_bytes + (jtag_ctx.tdo_bits_sent / 8), send_bits / 8, waiting_to_send_bits == send_bits);
 						jtag_ctx.tdo_bits_sent += send_bits;
 						waiting_to_send_bits -= send_bits;
 					}
@@ -578,7 +850,7 @@ void __not_in_flash_func(jtag_task)(void *pvParameters)
 				}
 				int send_bits = JTAG_PROTO_MAX_BITS;
 				int n_byte = send_bits / 8;
-				usb_send(s_tdo_bytes + (jtag_ctx.tdo_bits_sent / 8), n_byte);
+				usb_send(s_tdo_bytes + (jtag_ctx.tdo_bits_sent / 8), n_byte, false);
 				jtag_ctx.tdo_bits_sent += send_bits;
 				waiting_to_send_bits -= send_bits;
 				if (waiting_to_send_bits <= 0)
@@ -592,6 +864,8 @@ void __not_in_flash_func(jtag_task)(void *pvParameters)
 				prev_cmd = cmd;
 			}
 		}
+		TRACE(TRACE_JTAG_DECODE_END, cnt);
+		xSemaphoreGive(s_engine_mutex);
 		ESP_LOGD(JTAG_TASK_TAG, "%d bytes", cnt);
 		if (was_reset)
 		{
@@ -15,6 +15,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 /* Be carefull if you want to change the index. It must be bigger then the size of string_desc_arr
    For now 7 would be also ok. But lets reserve some fields fot the future additions
@@ -22,11 +23,46 @@
    Currently it is defined as < esp_usb_jtag_caps_descriptor 0x030A >
  */
 #define JTAG_STR_DESC_INX   0x0A
+
+// TODO: We shouldn't have to buffer up to 32k of data!  This indicates a design problem on the host side
+// and will require fixing whatever is wrong in the openocd-esp32 usb-jtag implementation.
+#define USB_SNDBUF_SIZE             (32*1024)
+
+// Longest time TDO bytes of an unfinished scan wait in the vendor TX FIFO for more to fill a packet
+#define USB_TX_FLUSH_MS             (1)
+
 #define JTAG_PIO_DMA_TX_COMPLETE_EVENT (1 << 0)
 #define JTAG_PIO_DMA_RX_COMPLETE_EVENT (1 << 1)
 
+// Notification of jtag_task that vendor OUT data arrived, index 0 carries the DMA events
+#define JTAG_USB_RX_NOTIFY_INDEX       1
+
+// Vendor control request (IN) on the JTAG interface, next to VEND_JTAG_* in jtag.c: the clock plan of the last
+// VEND_JTAG_SETDIV, as a jtag_tck_plan_t
+#define VEND_JTAG_TCK               21
+
+typedef struct __attribute__((packed))
+{
+	uint32_t requested_hz;		// TCK asked for by the host, 0 before the first VEND_JTAG_SETDIV
+	uint32_t actual_hz;			// clk_sys / (div * cycles_per_bit), rounded down
+	uint16_t div_int;			// PIO clock divider of the JTAG state machines
+	uint8_t div_frac;			// 1/256ths, 0 when the integer divider was taken
+	uint8_t cycles_per_bit;
+} jtag_tck_plan_t;
+
 int jtag_get_proto_caps(uint16_t *dest);
 int jtag_get_target_model(void);
 void jtag_task(void *pvParameters);
 void jtag_task_suspend(void);
+
+/*
+ * Local access to the JTAG engine, used by the bridge itself (e.g. the JTAG flashing backend).
+ * jtag_local_acquire() blocks the USB host stream until jtag_local_release(). It gives up
+ * and returns false when the host is using the engine.
+ * TDO bits are returned LSB first in the order they were captured.
+ */
+bool jtag_local_acquire(uint32_t tck_hz);
+void jtag_local_release(void);
+void jtag_local_clock(bool tms, bool tdi, bool capture, uint32_t count);
+uint32_t jtag_local_read_tdo(uint8_t *buf, uint32_t max_bits);
 void jtag_task_resume(void);
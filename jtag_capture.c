@@ -0,0 +1,99 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+// JTAG session capture, see jtag_capture.h.
+//
+// Records are only ever appended, so the part of the buffer a dump covers doesn't change while it is sent
+// and recording goes on meanwhile. Only a clear has to wait until the host has all of it.
+
+#include <string.h>
+#include "ubp_config.h"
+#include "pico.h"
+#include "pico/time.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "jtag_capture.h"
+
+#if JTAG_CAPTURE_ENABLED
+
+_Static_assert(sizeof(jtag_capture_header_t) + JTAG_CAPTURE_SIZE <= 0xFFFF,
+	"the dump has to fit into one control transfer, JTAG_CAPTURE_SIZE is too large");
+
+typedef struct
+{
+	jtag_capture_header_t header;
+	uint8_t records[JTAG_CAPTURE_SIZE];
+} jtag_capture_dump_t;
+
+static jtag_capture_dump_t s_capture;
+static uint32_t s_used;
+static uint32_t s_dropped;
+static bool s_clear_on_resume;
+
+void BRIDGE_HOT_FUNC(jtag_capture)(jtag_capture_type_t type, uint8_t flags, const void *data, uint16_t size)
+{
+	const jtag_capture_record_t record =
+	{
+		.time_us = time_us_32(),
+		.type = type,
+		.flags = flags,
+		.size = size,
+	};
+
+	// jtag_task and the USB task both record, and may run on different cores
+	taskENTER_CRITICAL();
+	if (s_used + sizeof(record) + size <= JTAG_CAPTURE_SIZE)
+	{
+		memcpy(&s_capture.records[s_used], &record, sizeof(record));
+		memcpy(&s_capture.records[s_used + sizeof(record)], data, size);
+		s_used += sizeof(record) + size;
+	}
+	else
+	{
+		s_dropped++;
+	}
+	taskEXIT_CRITICAL();
+}
+
+const uint8_t *jtag_capture_dump(size_t *len, bool clear)
+{
+	taskENTER_CRITICAL();
+	s_capture.header.magic = JTAG_CAPTURE_MAGIC;
+	s_capture.header.version = JTAG_CAPTURE_VERSION;
+	s_capture.header.header_size = sizeof(jtag_capture_header_t);
+	s_capture.header.capture_size = JTAG_CAPTURE_SIZE;
+	s_capture.header.used = s_used;
+	s_capture.header.dropped = s_dropped;
+	taskEXIT_CRITICAL();
+
+	s_clear_on_resume = clear;
+	*len = sizeof(jtag_capture_header_t) + s_capture.header.used;
+	return (const uint8_t *) &s_capture;
+}
+
+void jtag_capture_resume(void)
+{
+	if (s_clear_on_resume)
+	{
+		taskENTER_CRITICAL();
+		s_used = 0;
+		s_dropped = 0;
+		taskEXIT_CRITICAL();
+		s_clear_on_resume = false;
+	}
+}
+
+#endif
@@ -0,0 +1,104 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "ubp_config.h"
+
+/*
+ * JTAG session capture (JTAG_CAPTURE_ENABLED). Records what the host sends to the JTAG interface, with
+ * timestamps, into JTAG_CAPTURE_SIZE bytes of RAM: every read of vendor OUT data, the VEND_JTAG_* control
+ * requests and the size of every TDO reply. Recording starts at boot and stops when the buffer is full, a
+ * replay needs the session from its start. VEND_JTAG_CAPTURE reads the capture, with JTAG_CAPTURE_CLEAR
+ * the next one starts once it has been sent. bridge_bench --replay plays a capture back against the host
+ * build, tools/jtag_capture.py saves one from the bridge.
+ *
+ * The dump is little endian: jtag_capture_header_t, then `used` bytes of records. A record is a
+ * jtag_capture_record_t followed by `size` bytes:
+ *
+ *   JTAG_CAPTURE_OUT      the vendor OUT bytes jtag_task decoded in one go
+ *   JTAG_CAPTURE_CONTROL  jtag_capture_control_t of a VEND_JTAG_* control request
+ *   JTAG_CAPTURE_IN       uint16_t, TDO bytes queued for the host. JTAG_CAPTURE_FLUSH in flags if they
+ *                         end the reply to a CMD_FLUSH
+ *
+ * Records that no longer fit are counted in `dropped`.
+ */
+
+#define JTAG_CAPTURE_MAGIC			0x53434a42	// "BJCS"
+#define JTAG_CAPTURE_VERSION		1
+
+// Vendor control request (IN) on the JTAG interface, next to VEND_JTAG_* in jtag.c
+#define VEND_JTAG_CAPTURE			20
+
+// wValue bit of VEND_JTAG_CAPTURE: start a new capture once the dump has been sent
+#define JTAG_CAPTURE_CLEAR			(1 << 0)
+
+// The numbers are part of the dump format, only ever append
+typedef enum
+{
+	JTAG_CAPTURE_OUT = 1,
+	JTAG_CAPTURE_CONTROL,
+	JTAG_CAPTURE_IN,
+} jtag_capture_type_t;
+
+#define JTAG_CAPTURE_FLUSH			(1 << 0)
+
+typedef struct __attribute__((packed))
+{
+	uint32_t time_us;
+	uint8_t type;
+	uint8_t flags;
+	uint16_t size;
+} jtag_capture_record_t;
+
+typedef struct __attribute__((packed))
+{
+	uint8_t request;
+	uint8_t reserved;
+	uint16_t value;
+	uint16_t index;
+} jtag_capture_control_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;
+	uint8_t version;
+	uint8_t header_size;
+	uint16_t reserved;
+	uint32_t capture_size;
+	uint32_t used;
+	uint32_t dropped;
+} jtag_capture_header_t;
+
+#if JTAG_CAPTURE_ENABLED
+
+#define JTAG_CAPTURE(type, flags, data, size)	jtag_capture((type), (flags), (data), (size))
+
+void jtag_capture(jtag_capture_type_t type, uint8_t flags, const void *data, uint16_t size);
+
+// Returns the dump, records written later are past its end. Called from the USB task.
+const uint8_t *jtag_capture_dump(size_t *len, bool clear);
+// Applies JTAG_CAPTURE_CLEAR once the dump has been sent
+void jtag_capture_resume(void);
+
+#else
+
+#define JTAG_CAPTURE(type, flags, data, size)	do { } while (0)
+
+#endif
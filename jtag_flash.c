@@ -0,0 +1,261 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// JTAG flashing backend, see jtag_flash.h for the stub protocol.
+//
+// Only targets with a RISC-V core are handled: memory is accessed through the system bus of the RISC-V debug
+// module, which works while the stub is running. Xtensa targets need the OCD register interface and always
+// use the UART backend.
+
+#include <pico/stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "ubp_config.h"
+#include "esp_log.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "jtag.h"
+#include "riscv_dbg.h"
+#include "jtag_flash.h"
+#include "serial_io.h"
+#include "components/esp_loader/port/rp2040_port.h"
+
+#if JTAG_FLASH_ENABLED
+
+static const char *TAG = "jtag_flash";
+
+#define CTRL_FIELD(field)           (s_stub->ctrl_addr + offsetof(jtag_flash_ctrl_t, field))
+
+#define STUB_START_TIMEOUT_MS       1000
+#define CMD_TIMEOUT_MS              3000
+#define ERASE_TIMEOUT_PER_MB_MS     10000
+
+static const jtag_flash_stub_t *s_stub;
+static bool s_engine_held;
+static uint32_t s_ring_addr;
+static uint32_t s_ring_size;
+static uint32_t s_wr;
+static uint32_t s_rd;
+// Bytes of a partial word, sent with the next call or padded by jtag_flash_finish()
+static uint8_t s_tail[4];
+static uint32_t s_tail_len;
+
+__attribute__ ((weak)) const jtag_flash_stub_t *jtag_flash_stub_find(uint32_t uf2_family)
+{
+	return NULL;
+}
+
+static bool ctrl_wait(uint32_t field_addr, uint32_t expected, uint32_t timeout_ms)
+{
+	const TickType_t start = xTaskGetTickCount();
+	uint32_t value;
+
+	do
+	{
+		if (!riscv_dbg_read_word(field_addr, &value))
+			return false;
+		if (value == expected)
+			return true;
+		vTaskDelay(1);
+	} while ((xTaskGetTickCount() - start) < pdMS_TO_TICKS(timeout_ms));
+
+	ESP_LOGE(TAG, "stub timeout (%#08x = %#08x)", field_addr, value);
+	return false;
+}
+
+static bool ctrl_status_ok(void)
+{
+	uint32_t status;
+
+	if (!riscv_dbg_read_word(CTRL_FIELD(status), &status))
+		return false;
+	if (status != 0)
+	{
+		ESP_LOGE(TAG, "stub error %d", status);
+		return false;
+	}
+
+	return true;
+}
+
+static bool stub_load(void)
+{
+	if (!riscv_dbg_halt())
+		return false;
+
+	// A READY left over from an earlier run must not be mistaken for this one
+	if (!riscv_dbg_write_word(CTRL_FIELD(magic), 0))
+		return false;
+
+	for (uint32_t i = 0; i < s_stub->segment_count; i++)
+	{
+		const jtag_flash_stub_segment_t *seg = &s_stub->segments[i];
+
+		ESP_LOGD(TAG, "segment %d: %d bytes at %#08x", i, seg->size, seg->addr);
+		if (!riscv_dbg_write_mem(seg->addr, seg->data, seg->size))
+			return false;
+	}
+
+	if (!riscv_dbg_write_reg(RISCV_CSR_DPC, s_stub->entry) || !riscv_dbg_resume())
+		return false;
+
+	if (!ctrl_wait(CTRL_FIELD(magic), JTAG_FLASH_STUB_READY, STUB_START_TIMEOUT_MS))
+		return false;
+
+	return riscv_dbg_read_word(CTRL_FIELD(ring_addr), &s_ring_addr) &&
+	       riscv_dbg_read_word(CTRL_FIELD(ring_size), &s_ring_size) &&
+	       s_ring_size != 0 && (s_ring_size & (s_ring_size - 1)) == 0;
+}
+
+bool jtag_flash_begin(uint32_t uf2_family, uint32_t addr, uint32_t size)
+{
+	uint32_t idcode;
+
+	s_stub = jtag_flash_stub_find(uf2_family);
+	if (s_stub == NULL)
+	{
+		ESP_LOGW(TAG, "no flasher stub for family %#08x", uf2_family);
+		return false;
+	}
+
+	if (!jtag_local_acquire(JTAG_FLASH_TCK_HZ))
+		return false;
+	s_engine_held = true;
+
+	// Park the ROM in download mode so nothing but the stub touches the flash. Only the
+	// primary target is wired to the JTAG pins.
+	loader_port_rp2040_set_targets(1u << 0);
+	loader_port_enter_bootloader();
+
+	if (!riscv_dbg_init(&idcode) || !stub_load())
+	{
+		ESP_LOGE(TAG, "cannot start the flasher stub");
+		jtag_flash_abort();
+		return false;
+	}
+
+	s_wr = s_rd = 0;
+	s_tail_len = 0;
+	const uint32_t erase_timeout = MAX(CMD_TIMEOUT_MS, (uint64_t)size * ERASE_TIMEOUT_PER_MB_MS / (1024 * 1024));
+	if (!riscv_dbg_write_word(CTRL_FIELD(addr), addr) ||
+	    !riscv_dbg_write_word(CTRL_FIELD(size), size) ||
+	    !riscv_dbg_write_word(CTRL_FIELD(wr), 0) ||
+	    !riscv_dbg_write_word(CTRL_FIELD(rd), 0) ||
+	    !riscv_dbg_write_word(CTRL_FIELD(cmd), JTAG_FLASH_CMD_BEGIN) ||
+	    !ctrl_wait(CTRL_FIELD(cmd), JTAG_FLASH_CMD_NONE, erase_timeout) ||
+	    !ctrl_status_ok())
+	{
+		jtag_flash_abort();
+		return false;
+	}
+
+	ESP_LOGI(TAG, "stub ready, ring of %d bytes at %#08x", s_ring_size, s_ring_addr);
+	return true;
+}
+
+// size is a multiple of 4
+static bool ring_write(const uint8_t *data, uint32_t size)
+{
+	const TickType_t start = xTaskGetTickCount();
+
+	while (size > 0)
+	{
+		uint32_t space = s_ring_size - (s_wr - s_rd);
+		if (space < 4)
+		{
+			// Only go back to the target for rd when the ring looks full
+			if (!riscv_dbg_read_word(CTRL_FIELD(rd), &s_rd) || !ctrl_status_ok())
+				return false;
+			if ((xTaskGetTickCount() - start) > pdMS_TO_TICKS(CMD_TIMEOUT_MS))
+			{
+				ESP_LOGE(TAG, "stub stopped draining the ring");
+				return false;
+			}
+			continue;
+		}
+
+		const uint32_t ring_offset = s_wr & (s_ring_size - 1);
+		const uint32_t chunk = MIN(MIN(size, space), s_ring_size - ring_offset) & ~3u;
+
+		if (!riscv_dbg_write_mem(s_ring_addr + ring_offset, data, chunk))
+			return false;
+
+		s_wr += chunk;
+		data += chunk;
+		size -= chunk;
+
+		if (!riscv_dbg_write_word(CTRL_FIELD(wr), s_wr))
+			return false;
+	}
+
+	return true;
+}
+
+bool jtag_flash_write(const uint8_t *data, uint32_t size)
+{
+	// Only whole words go into the ring, so the image stays contiguous whatever the call sizes are
+	if (s_tail_len > 0)
+	{
+		const uint32_t fill = MIN(size, sizeof(s_tail) - s_tail_len);
+
+		memcpy(s_tail + s_tail_len, data, fill);
+		s_tail_len += fill;
+		data += fill;
+		size -= fill;
+		if (s_tail_len < sizeof(s_tail))
+			return true;
+		if (!ring_write(s_tail, sizeof(s_tail)))
+			return false;
+		s_tail_len = 0;
+	}
+
+	const uint32_t words = size & ~3u;
+	if (!ring_write(data, words))
+		return false;
+
+	s_tail_len = size - words;
+	memcpy(s_tail, data + words, s_tail_len);
+	return true;
+}
+
+bool jtag_flash_finish(void)
+{
+	// The stub stops at size, the padding of the last word is never written to flash
+	if (s_tail_len > 0)
+		memset(s_tail + s_tail_len, 0xff, sizeof(s_tail) - s_tail_len);
+
+	bool ok = (s_tail_len == 0 || ring_write(s_tail, sizeof(s_tail))) &&
+	          riscv_dbg_write_word(CTRL_FIELD(cmd), JTAG_FLASH_CMD_END) &&
+	          ctrl_wait(CTRL_FIELD(cmd), JTAG_FLASH_CMD_NONE, CMD_TIMEOUT_MS) &&
+	          ctrl_status_ok();
+
+	s_tail_len = 0;
+	jtag_local_release();
+	s_engine_held = false;
+	loader_port_reset_target();
+
+	return ok;
+}
+
+void jtag_flash_abort(void)
+{
+	if (s_engine_held)
+	{
+		jtag_local_release();
+		s_engine_held = false;
+	}
+	loader_port_reset_target();
+}
+
+#endif // JTAG_FLASH_ENABLED
@@ -0,0 +1,83 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * JTAG flashing backend.
+ *
+ * A flash writer stub is loaded into target RAM over JTAG and started. The stub and the bridge talk through a
+ * jtag_flash_ctrl_t block in target RAM:
+ *
+ * 1. The bridge clears magic, loads the stub segments, points the PC at entry and resumes the hart.
+ * 2. The stub attaches the SPI flash, fills in ring_addr/ring_size and sets magic to JTAG_FLASH_STUB_READY.
+ * 3. BEGIN: the bridge sets addr, size, wr = rd = 0, then cmd. The stub erases the region, sets status and
+ *    clears cmd.
+ * 4. Data: the bridge copies image data to ring_addr + (wr % ring_size) and advances wr. The stub writes
+ *    data between rd and wr to flash and advances rd. wr may run up to 3 bytes past size (word padding),
+ *    the stub never writes more than size bytes. A non-zero status stops the transfer.
+ * 5. END: the bridge sets cmd once all data is in the ring. The stub drains the ring, sets status and
+ *    clears cmd.
+ *
+ * ring_size is a power of two and a multiple of 4. All fields are 32 bit words.
+ */
+
+#define JTAG_FLASH_STUB_READY   0x534c464a  // "JFLS"
+
+#define JTAG_FLASH_CMD_NONE     0
+#define JTAG_FLASH_CMD_BEGIN    1
+#define JTAG_FLASH_CMD_END      2
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t cmd;
+	uint32_t status;
+	uint32_t addr;
+	uint32_t size;
+	uint32_t ring_addr;
+	uint32_t ring_size;
+	uint32_t wr;
+	uint32_t rd;
+} jtag_flash_ctrl_t;
+
+typedef struct
+{
+	uint32_t addr;
+	uint32_t size;
+	const uint8_t *data;
+} jtag_flash_stub_segment_t;
+
+typedef struct
+{
+	uint32_t entry;
+	uint32_t ctrl_addr;		// target RAM address of the stub's jtag_flash_ctrl_t
+	uint32_t segment_count;
+	const jtag_flash_stub_segment_t *segments;
+} jtag_flash_stub_t;
+
+/*
+ * Stubs are not part of this repository. A stub source generated by tools/jtag_stub_to_c.py provides this
+ * function; without one, the weak default returns NULL and drops fall back to the UART backend.
+ */
+const jtag_flash_stub_t *jtag_flash_stub_find(uint32_t uf2_family);
+
+bool jtag_flash_begin(uint32_t uf2_family, uint32_t addr, uint32_t size);
+// Any size: a partial last word waits for the next call, jtag_flash_finish() pads it
+bool jtag_flash_write(const uint8_t *data, uint32_t size);
+bool jtag_flash_finish(void);
+void jtag_flash_abort(void);
@@ -0,0 +1,78 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <assert.h>
+#include "jtag.h"
+#include "jtag_tap.h"
+
+void jtag_tap_reset(void)
+{
+	// 5 clocks with TMS=1 reach Test-Logic-Reset from any state
+	jtag_local_clock(true, false, false, 5);
+	jtag_local_clock(false, false, false, 1);
+}
+
+void jtag_tap_idle(uint32_t cycles)
+{
+	jtag_local_clock(false, false, false, cycles);
+}
+
+static uint64_t jtag_tap_shift(bool ir, uint64_t out, uint32_t bits)
+{
+	uint8_t tdo[JTAG_TAP_MAX_SCAN_BITS / 8];
+	uint64_t in = 0;
+
+	assert(bits > 0 && bits <= JTAG_TAP_MAX_SCAN_BITS);
+
+	// Run-Test/Idle -> Select-DR-Scan [-> Select-IR-Scan] -> Capture -> Shift
+	jtag_local_clock(true, false, false, ir ? 2 : 1);
+	jtag_local_clock(false, false, false, 2);
+
+	// Runs of equal TDI bits go out as one engine command
+	uint32_t i = 0;
+	while (i < bits - 1)
+	{
+		const bool tdi = (out >> i) & 1;
+		uint32_t run = 1;
+		while (i + run < bits - 1 && (((out >> (i + run)) & 1) == tdi))
+			run++;
+		jtag_local_clock(false, tdi, true, run);
+		i += run;
+	}
+
+	// The last bit leaves Shift for Exit1, then Update -> Run-Test/Idle
+	jtag_local_clock(true, (out >> (bits - 1)) & 1, true, 1);
+	jtag_local_clock(true, false, false, 1);
+	jtag_local_clock(false, false, false, 1);
+
+	jtag_local_read_tdo(tdo, bits);
+	for (uint32_t b = 0; b < bits; b++)
+	{
+		if (tdo[b / 8] & (1u << (b % 8)))
+			in |= 1ull << b;
+	}
+
+	return in;
+}
+
+uint64_t jtag_tap_shift_ir(uint64_t out, uint32_t bits)
+{
+	return jtag_tap_shift(true, out, bits);
+}
+
+uint64_t jtag_tap_shift_dr(uint64_t out, uint32_t bits)
+{
+	return jtag_tap_shift(false, out, bits);
+}
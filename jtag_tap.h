@@ -0,0 +1,30 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Largest scan jtag_tap_shift_ir/dr handle in one call
+#define JTAG_TAP_MAX_SCAN_BITS  64
+
+/*
+ * TAP state helpers on top of the local JTAG engine access. A single TAP on the chain is assumed and every
+ * helper starts and ends in Run-Test/Idle. Scan data is LSB first.
+ */
+void jtag_tap_reset(void);
+void jtag_tap_idle(uint32_t cycles);
+uint64_t jtag_tap_shift_ir(uint64_t out, uint32_t bits);
+uint64_t jtag_tap_shift_dr(uint64_t out, uint32_t bits);
@@ -0,0 +1,296 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Wear levelled key-value store in the last KV_STORE_SECTORS sectors of the bridge's own flash.
+//
+// One sector at a time holds a log of fixed size records, the last valid record of a key is its value. A set
+// appends a record by programming one page that is 0xFF everywhere else, so nothing already in the sector is
+// touched. Once the active sector is full, the latest record of every key is copied to the next sector and its
+// header is written last: a power loss before that leaves the old sector active. Rotating through the sectors
+// spreads the erases over all of them.
+
+#include <pico/stdlib.h>
+#include <string.h>
+#include "ubp_config.h"
+#include "esp_log.h"
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "bridge_flash.h"
+#include "kv_store.h"
+
+#if TARGET_SETTINGS_ENABLED
+
+static const char *TAG = "kv_store";
+
+#define KV_MAGIC                0x53564b42      // "BKVS", key of the sector header in record 0
+#define KEY_FREE                0xffffffff
+#define RECORD_SIZE             32
+#define RECORDS_PER_SECTOR      (FLASH_SECTOR_SIZE / RECORD_SIZE)
+#define RECORDS_PER_PAGE        (FLASH_PAGE_SIZE / RECORD_SIZE)
+
+_Static_assert(KV_STORE_SECTORS >= 2, "KV_STORE_SECTORS must be at least 2");
+
+typedef struct __attribute__((packed))
+{
+	uint32_t key;
+	uint8_t len;
+	uint8_t reserved;
+	uint16_t crc;			// CRC-16/CCITT of everything else
+	uint8_t value[KV_STORE_VALUE_MAX];
+} kv_record_t;
+
+_Static_assert(sizeof(kv_record_t) == RECORD_SIZE, "kv_record_t must fill a record slot");
+
+static SemaphoreHandle_t kv_mutex_handle;
+static StaticSemaphore_t kv_mutex_def;
+
+static bool kv_usable;
+static int active_sector = -1;		// -1 until the first set formats one
+static uint32_t active_seq;
+static uint32_t next_slot;
+static uint8_t page_buf[FLASH_PAGE_SIZE];
+
+static inline uint32_t sector_offset(int sector)
+{
+	return KV_STORE_OFFSET + sector * FLASH_SECTOR_SIZE;
+}
+
+static inline const kv_record_t *record_at(int sector, uint32_t slot)
+{
+	return (const kv_record_t *) BRIDGE_FLASH_PTR(sector_offset(sector) + slot * RECORD_SIZE);
+}
+
+static uint16_t record_crc(const kv_record_t *r)
+{
+	const uint8_t *p = (const uint8_t *) r;
+	uint16_t crc = 0xffff;
+
+	for (size_t i = 0; i < sizeof(kv_record_t); i++)
+	{
+		if (i == offsetof(kv_record_t, crc) || i == offsetof(kv_record_t, crc) + 1)
+			continue;
+		crc ^= p[i] << 8;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+
+	return crc;
+}
+
+static bool record_valid(const kv_record_t *r)
+{
+	return r->key != KEY_FREE && r->len <= KV_STORE_VALUE_MAX && r->crc == record_crc(r);
+}
+
+// A slot is free only if a program never touched it, an interrupted one may have left the key erased
+static bool slot_free(int sector, uint32_t slot)
+{
+	const uint32_t *w = (const uint32_t *) BRIDGE_FLASH_PTR(sector_offset(sector) + slot * RECORD_SIZE);
+
+	for (size_t i = 0; i < sizeof(kv_record_t) / 4; i++)
+	{
+		if (w[i] != 0xffffffff)
+			return false;
+	}
+
+	return true;
+}
+
+static bool sector_seq(int sector, uint32_t *seq)
+{
+	const kv_record_t *header = record_at(sector, 0);
+
+	if (header->key != KV_MAGIC || header->len != sizeof(uint32_t) || !record_valid(header))
+		return false;
+	memcpy(seq, header->value, sizeof(uint32_t));
+
+	return true;
+}
+
+static const kv_record_t *find_latest(uint32_t key)
+{
+	const kv_record_t *latest = NULL;
+
+	for (uint32_t slot = 1; active_sector >= 0 && slot < next_slot; slot++)
+	{
+		const kv_record_t *r = record_at(active_sector, slot);
+		if (r->key == key && record_valid(r))
+			latest = r;
+	}
+
+	return latest;
+}
+
+static void make_record(kv_record_t *r, uint32_t key, const void *value, size_t len)
+{
+	memset(r, 0, sizeof(*r));
+	r->key = key;
+	r->len = len;
+	memcpy(r->value, value, len);
+	r->crc = record_crc(r);
+}
+
+// The rest of the page stays 0xFF, which leaves the records around it as they are
+static void program_record(int sector, uint32_t slot, const kv_record_t *r)
+{
+	const uint32_t offset = sector_offset(sector) + slot * RECORD_SIZE;
+
+	memset(page_buf, 0xff, sizeof(page_buf));
+	memcpy(page_buf + (offset % FLASH_PAGE_SIZE), r, sizeof(*r));
+	bridge_flash_program(offset & ~(FLASH_PAGE_SIZE - 1), page_buf, FLASH_PAGE_SIZE);
+}
+
+// Queues a record for the sector compact() is filling, a full page is programmed
+static void compact_add(int sector, uint32_t *slot, const kv_record_t *r)
+{
+	memcpy(page_buf + (*slot % RECORDS_PER_PAGE) * RECORD_SIZE, r, RECORD_SIZE);
+	if (++*slot % RECORDS_PER_PAGE == 0)
+	{
+		bridge_flash_program(sector_offset(sector) + *slot * RECORD_SIZE - FLASH_PAGE_SIZE, page_buf, FLASH_PAGE_SIZE);
+		memset(page_buf, 0xff, sizeof(page_buf));
+	}
+}
+
+// Copies the latest record of every other key and then r to the next sector and makes it the active one.
+// r goes in before the header, so either the old value or the new one survives a power loss. Returns false
+// if there was no room left for r.
+static bool compact(const kv_record_t *r)
+{
+	const int sector = (active_sector + 1) % KV_STORE_SECTORS;
+	uint32_t slot = 1;
+
+	bridge_flash_erase(sector_offset(sector), FLASH_SECTOR_SIZE);
+
+	memset(page_buf, 0xff, sizeof(page_buf));
+	for (uint32_t from = 1; active_sector >= 0 && from < next_slot; from++)
+	{
+		const kv_record_t *old = record_at(active_sector, from);
+		if (old->key == r->key || !record_valid(old) || find_latest(old->key) != old)
+			continue;
+
+		compact_add(sector, &slot, old);
+	}
+	const bool added = slot < RECORDS_PER_SECTOR;
+	if (added)
+	{
+		compact_add(sector, &slot, r);
+	}
+	if (slot % RECORDS_PER_PAGE != 0 && slot > 1)
+	{
+		bridge_flash_program(sector_offset(sector) + (slot & ~(RECORDS_PER_PAGE - 1)) * RECORD_SIZE, page_buf,
+		                     FLASH_PAGE_SIZE);
+	}
+
+	kv_record_t header;
+	const uint32_t seq = active_seq + 1;
+	make_record(&header, KV_MAGIC, &seq, sizeof(seq));
+	program_record(sector, 0, &header);
+
+	ESP_LOGI(TAG, "compacted into sector %d, %u records", sector, slot - 1);
+	active_sector = sector;
+	active_seq = seq;
+	next_slot = slot;
+	return added;
+}
+
+void kv_store_init(void)
+{
+	if (kv_mutex_handle == NULL)
+		kv_mutex_handle = xSemaphoreCreateMutexStatic(&kv_mutex_def);
+
+	if (KV_STORE_OFFSET < bridge_flash_binary_end())
+	{
+		ESP_LOGE(TAG, "store at %#08x overlaps the firmware (ends at %#08x)", KV_STORE_OFFSET,
+		         bridge_flash_binary_end());
+		kv_usable = false;
+		return;
+	}
+
+	active_sector = -1;
+	active_seq = 0;
+	next_slot = 1;
+	for (int sector = 0; sector < KV_STORE_SECTORS; sector++)
+	{
+		uint32_t seq;
+		if (sector_seq(sector, &seq) && (active_sector < 0 || (int32_t)(seq - active_seq) > 0))
+		{
+			active_sector = sector;
+			active_seq = seq;
+		}
+	}
+
+	while (active_sector >= 0 && next_slot < RECORDS_PER_SECTOR && !slot_free(active_sector, next_slot))
+	{
+		next_slot++;
+	}
+
+	ESP_LOGI(TAG, "sector %d active, %u of %u records used", active_sector, next_slot - 1, RECORDS_PER_SECTOR - 1);
+	kv_usable = true;
+}
+
+bool kv_store_get(uint32_t key, void *value, size_t len)
+{
+	if (!kv_usable)
+		return false;
+
+	xSemaphoreTake(kv_mutex_handle, portMAX_DELAY);
+	const kv_record_t *r = find_latest(key);
+	const bool found = r != NULL && r->len == len;
+	if (found)
+	{
+		memcpy(value, r->value, len);
+	}
+	xSemaphoreGive(kv_mutex_handle);
+
+	return found;
+}
+
+bool kv_store_set(uint32_t key, const void *value, size_t len)
+{
+	if (!kv_usable || len > KV_STORE_VALUE_MAX || key == KEY_FREE)
+		return false;
+
+	xSemaphoreTake(kv_mutex_handle, portMAX_DELAY);
+
+	// Rewriting an unchanged value would only wear the flash
+	const kv_record_t *r = find_latest(key);
+	if (r != NULL && r->len == len && memcmp(r->value, value, len) == 0)
+	{
+		xSemaphoreGive(kv_mutex_handle);
+		return true;
+	}
+
+	kv_record_t record;
+	make_record(&record, key, value, len);
+
+	bool ok = true;
+	if (active_sector < 0 || next_slot >= RECORDS_PER_SECTOR)
+	{
+		ok = compact(&record);
+	}
+	else
+	{
+		program_record(active_sector, next_slot++, &record);
+	}
+	if (!ok)
+	{
+		ESP_LOGE(TAG, "no room for key %#08x", key);
+	}
+
+	xSemaphoreGive(kv_mutex_handle);
+	return ok;
+}
+
+#endif
@@ -0,0 +1,35 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "ubp_config.h"
+#include "bridge_flash.h"
+
+// Small values keyed by a 32 bit ID in the last KV_STORE_SECTORS sectors of the bridge's own flash
+#if TARGET_SETTINGS_ENABLED
+#define KV_STORE_SIZE           (KV_STORE_SECTORS * FLASH_SECTOR_SIZE)
+#else
+#define KV_STORE_SIZE           (0)
+#endif
+#define KV_STORE_OFFSET         (PICO_FLASH_SIZE_BYTES - KV_STORE_SIZE)
+#define KV_STORE_VALUE_MAX      (24)
+
+void kv_store_init(void);
+bool kv_store_get(uint32_t key, void *value, size_t len);
+bool kv_store_set(uint32_t key, const void *value, size_t len);
@@ -0,0 +1,495 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Logic analyzer, see la.h.
+//
+// The two DMA channels take turns on the ring segments: each one writes a segment, triggers the other one
+// and gets pointed at the segment after the one the other channel is writing by la_dma_handler(). la_task()
+// is woken for every finished segment and has LA_SEGMENTS - 1 segment times to encode it before the DMA
+// comes around again.
+
+#include <pico/stdlib.h>
+#include <string.h>
+#include "ubp_config.h"
+#include "esp_log.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "tusb.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "la.pio.h"
+#include "la.h"
+
+#if LA_ENABLED
+
+static const char *TAG = "la";
+
+#define LA_PIO                  pio1
+#define SEGMENT_WORDS           (LA_RING_SIZE / LA_SEGMENTS / 4)
+#define RING_WORDS              (LA_RING_SIZE / 4)
+#define FLUSH_MS                50
+
+_Static_assert(LA_SEGMENTS >= 4, "LA_SEGMENTS must be at least 4");
+_Static_assert((LA_RING_SIZE % (LA_SEGMENTS * 4)) == 0, "LA_RING_SIZE must be a multiple of 4 * LA_SEGMENTS");
+
+static uint32_t ring[RING_WORDS];
+static uint8_t out_buf[CFG_TUD_VENDOR_EPSIZE * 4];
+static size_t out_len;
+
+static const uint8_t la_pins[LA_CHANNELS] = { GPIO_TCK, GPIO_TMS, GPIO_TDI, GPIO_TDO, GPIO_TXD, GPIO_RXD, GPIO_BOOT, GPIO_RST };
+static uint32_t pin_mask;
+
+static TaskHandle_t la_task_handle;
+static la_config_t pending_config;
+static volatile bool start_requested;
+static volatile bool stop_requested;
+
+static la_config_t config;
+static la_status_t status;
+
+static int sm = -1;
+static uint program_offset;
+static int dma_chan[2] = { -1, -1 };
+static volatile uint32_t segments_done;
+
+// Encoder and trigger state
+static uint32_t run_raw;
+static uint32_t run_len;
+static uint32_t trigger_raw_mask;
+static uint32_t trigger_raw_value;
+static bool trigger_prev_match;
+
+static uint8_t channels_of(uint32_t raw)
+{
+	uint8_t levels = 0;
+
+	for (int ch = 0; ch < LA_CHANNELS; ch++)
+	{
+		levels |= ((raw >> la_pins[ch]) & 1) << ch;
+	}
+
+	return levels;
+}
+
+static uint32_t raw_of(uint8_t levels)
+{
+	uint32_t raw = 0;
+
+	for (int ch = 0; ch < LA_CHANNELS; ch++)
+	{
+		raw |= (uint32_t)((levels >> ch) & 1) << la_pins[ch];
+	}
+
+	return raw;
+}
+
+static void BRIDGE_HOT_FUNC(la_dma_handler)(void)
+{
+	BaseType_t woken = pdFALSE;
+
+	// The channel of the older segment first, in case both finished before the IRQ was taken
+	for (int n = 0; n < 2; n++)
+	{
+		const int i = (segments_done + n) & 1;
+		if (dma_chan[i] < 0 || !dma_channel_get_irq1_status(dma_chan[i]))
+			continue;
+
+		dma_channel_acknowledge_irq1(dma_chan[i]);
+		// The other channel has started on the next segment, this one takes the one after it
+		const uint32_t next = ++segments_done + 1;
+		dma_channel_set_write_addr(dma_chan[i], &ring[(next % LA_SEGMENTS) * SEGMENT_WORDS], false);
+		vTaskNotifyGiveFromISR(la_task_handle, &woken);
+	}
+
+	portYIELD_FROM_ISR(woken);
+}
+
+static void out_send(void)
+{
+	size_t sent = 0;
+
+	while (sent < out_len && tud_vendor_n_mounted(LA_VENDOR_ITF))
+	{
+		const uint32_t space = tud_vendor_n_write_available(LA_VENDOR_ITF);
+		if (space == 0)
+		{
+			// A host that stopped reading can't hold up LA_CMD_STOP
+			if (stop_requested)
+				break;
+			vTaskDelay(1);
+			continue;
+		}
+		sent += tud_vendor_n_write(LA_VENDOR_ITF, out_buf + sent, MIN(space, out_len - sent));
+	}
+	out_len = 0;
+}
+
+static inline void out_put(uint8_t byte)
+{
+	if (out_len == sizeof(out_buf))
+		out_send();
+	out_buf[out_len++] = byte;
+}
+
+static void out_flush(void)
+{
+	out_send();
+	tud_vendor_n_flush(LA_VENDOR_ITF);
+}
+
+static void put_run(void)
+{
+	uint32_t len = run_len;
+
+	while (len >= 0x80)
+	{
+		out_put((len & 0x7f) | 0x80);
+		len >>= 7;
+	}
+	out_put(len);
+	out_put(channels_of(run_raw));
+	run_len = 0;
+}
+
+static void BRIDGE_HOT_FUNC(encode)(const uint32_t *samples, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint32_t raw = samples[i] & pin_mask;
+		if (raw == run_raw && run_len != 0 && run_len != UINT32_MAX)
+		{
+			run_len++;
+			continue;
+		}
+		if (run_len != 0)
+			put_run();
+		run_raw = raw;
+		run_len = 1;
+	}
+	status.sent += count;
+}
+
+// Samples at absolute positions [pos, pos + count) that are still in the ring
+static void encode_ring(uint64_t pos, uint32_t count)
+{
+	while (count > 0)
+	{
+		const uint32_t index = pos % RING_WORDS;
+		const uint32_t n = MIN(count, RING_WORDS - index);
+		encode(&ring[index], n);
+		pos += n;
+		count -= n;
+	}
+}
+
+static int BRIDGE_HOT_FUNC(find_trigger)(const uint32_t *samples, uint32_t count)
+{
+	if (trigger_raw_mask == 0)
+		return 0;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const bool match = (samples[i] & trigger_raw_mask) == trigger_raw_value;
+		if (match && !((config.flags & LA_TRIGGER_EDGE) && trigger_prev_match))
+			return i;
+		trigger_prev_match = match;
+	}
+
+	return -1;
+}
+
+static void begin_stream(uint64_t trigger_pos)
+{
+	// Segments up to the one the DMA queued next may already be overwritten, keep one more as margin
+	const uint32_t done = segments_done;
+	const uint64_t oldest = (done + 3 > LA_SEGMENTS) ? (uint64_t)(done + 3 - LA_SEGMENTS) * SEGMENT_WORDS : 0;
+	const uint32_t pretrigger = (trigger_pos > oldest) ? MIN(config.pretrigger, trigger_pos - oldest) : 0;
+
+	const la_stream_header_t header = {
+		.magic = LA_STREAM_MAGIC,
+		.version = LA_STREAM_VERSION,
+		.channels = LA_CHANNELS,
+		.header_size = sizeof(la_stream_header_t),
+		.rate_hz = status.rate_hz,
+		.pretrigger = pretrigger,
+	};
+	for (size_t i = 0; i < sizeof(header); i++)
+	{
+		out_put(((const uint8_t *) &header)[i]);
+	}
+
+	ESP_LOGI(TAG, "triggered at sample %u", (uint32_t) trigger_pos);
+	status.state = LA_STATE_RUNNING;
+	run_len = 0;
+	encode_ring(trigger_pos - pretrigger, pretrigger);
+	status.sent = 0;
+}
+
+// Returns true once config.samples have been sent
+static bool process(uint64_t pos, const uint32_t *samples, uint32_t count)
+{
+	if (status.state == LA_STATE_ARMED)
+	{
+		const int trigger = find_trigger(samples, count);
+		if (trigger < 0)
+			return false;
+		begin_stream(pos + trigger);
+		samples += trigger;
+		count -= trigger;
+	}
+
+	if (config.samples != 0)
+	{
+		count = MIN(count, config.samples - status.sent);
+	}
+	encode(samples, count);
+
+	return config.samples != 0 && status.sent >= config.samples;
+}
+
+static bool hw_start(void)
+{
+	if (!pio_can_add_program(LA_PIO, &la_sample_program) || (sm = pio_claim_unused_sm(LA_PIO, false)) < 0)
+		return false;
+	program_offset = pio_add_program(LA_PIO, &la_sample_program);
+
+	for (int i = 0; i < 2; i++)
+	{
+		dma_chan[i] = dma_claim_unused_channel(false);
+		if (dma_chan[i] < 0)
+			return false;
+	}
+
+	const uint32_t clk = clock_get_hz(clk_sys);
+	const uint32_t rate = MAX(config.rate_hz, 1);
+	const uint32_t min_div = MAX(1, (clk + LA_MAX_RATE_HZ - 1) / LA_MAX_RATE_HZ);
+	const uint32_t div = MIN(MAX((clk + rate - 1) / rate, min_div), 0xffff);
+	status.rate_hz = clk / div;
+	la_sample_program_init(LA_PIO, sm, program_offset, div);
+
+	segments_done = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		dma_channel_config c = dma_channel_get_default_config(dma_chan[i]);
+		channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+		channel_config_set_read_increment(&c, false);
+		channel_config_set_write_increment(&c, true);
+		channel_config_set_dreq(&c, pio_get_dreq(LA_PIO, sm, false));
+		channel_config_set_chain_to(&c, dma_chan[i ^ 1]);
+		dma_channel_configure(dma_chan[i], &c, &ring[i * SEGMENT_WORDS], &LA_PIO->rxf[sm], SEGMENT_WORDS, false);
+		dma_channel_acknowledge_irq1(dma_chan[i]);
+		dma_channel_set_irq1_enabled(dma_chan[i], true);
+	}
+
+	static bool irq_installed;
+	if (!irq_installed)
+	{
+		// Late handling lets a channel run into the segment of the other one, keep it ahead of everything else
+		irq_add_shared_handler(DMA_IRQ_1, la_dma_handler, PICO_SHARED_IRQ_HANDLER_HIGHEST_ORDER_PRIORITY);
+		irq_set_priority(DMA_IRQ_1, PICO_HIGHEST_IRQ_PRIORITY);
+		irq_set_enabled(DMA_IRQ_1, true);
+		irq_installed = true;
+	}
+
+	dma_channel_start(dma_chan[0]);
+	pio_sm_set_enabled(LA_PIO, sm, true);
+
+	return true;
+}
+
+// Stops sampling, returns how many samples the DMA wrote since the start
+static uint64_t hw_stop(void)
+{
+	uint64_t end = (uint64_t) segments_done * SEGMENT_WORDS;
+
+	if (sm >= 0)
+	{
+		pio_sm_set_enabled(LA_PIO, sm, false);
+	}
+
+	if (dma_chan[0] >= 0 && dma_chan[1] >= 0)
+	{
+		// Without DREQs neither channel can finish and trigger the other, so both can be aborted
+		const uint32_t mask = (1u << dma_chan[0]) | (1u << dma_chan[1]);
+		dma_channel_set_irq1_enabled(dma_chan[0], false);
+		dma_channel_set_irq1_enabled(dma_chan[1], false);
+		dma_hw->abort = mask;
+		while (dma_hw->abort & mask)
+		{
+			tight_loop_contents();
+		}
+
+		// A segment may have been finished without its IRQ having been taken
+		for (uint32_t seg = segments_done; seg < segments_done + 2; seg++)
+		{
+			const uintptr_t start = (uintptr_t) &ring[(seg % LA_SEGMENTS) * SEGMENT_WORDS];
+			const uint32_t words = MIN((dma_hw->ch[dma_chan[seg & 1]].write_addr - start) / 4, SEGMENT_WORDS);
+			end += words;
+			if (words < SEGMENT_WORDS)
+				break;
+		}
+		dma_channel_acknowledge_irq1(dma_chan[0]);
+		dma_channel_acknowledge_irq1(dma_chan[1]);
+	}
+
+	for (int i = 0; i < 2; i++)
+	{
+		if (dma_chan[i] >= 0)
+		{
+			const int chan = dma_chan[i];
+			dma_chan[i] = -1;
+			dma_channel_unclaim(chan);
+		}
+	}
+	if (sm >= 0)
+	{
+		pio_remove_program(LA_PIO, &la_sample_program, program_offset);
+		pio_sm_unclaim(LA_PIO, sm);
+		sm = -1;
+	}
+
+	return end;
+}
+
+static la_end_t capture(void)
+{
+	uint32_t seg = 0;
+	TickType_t last_flush = xTaskGetTickCount();
+
+	if (!hw_start())
+	{
+		hw_stop();
+		return LA_END_NO_RESOURCES;
+	}
+	ESP_LOGI(TAG, "armed at %u Hz", status.rate_hz);
+
+	for (;;)
+	{
+		while (segments_done == seg)
+		{
+			if (stop_requested)
+			{
+				// Caught up, so everything the DMA wrote until it stopped is still in the ring
+				const uint64_t end = hw_stop();
+				for (uint64_t pos = (uint64_t) seg * SEGMENT_WORDS; pos < end; pos += SEGMENT_WORDS)
+				{
+					if (process(pos, &ring[pos % RING_WORDS], MIN(end - pos, SEGMENT_WORDS)))
+						return LA_END_DONE;
+				}
+				return LA_END_STOPPED;
+			}
+			ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FLUSH_MS));
+
+			// Idle pins make no records, send the open run so the host sees time pass
+			if (status.state == LA_STATE_RUNNING && xTaskGetTickCount() - last_flush >= pdMS_TO_TICKS(FLUSH_MS))
+			{
+				if (run_len != 0)
+					put_run();
+				out_flush();
+				last_flush = xTaskGetTickCount();
+			}
+		}
+
+		const bool done = process((uint64_t) seg * SEGMENT_WORDS, &ring[(seg % LA_SEGMENTS) * SEGMENT_WORDS], SEGMENT_WORDS);
+		status.samples = (uint64_t) segments_done * SEGMENT_WORDS;
+		if (done)
+		{
+			hw_stop();
+			return LA_END_DONE;
+		}
+		// Leave a segment of margin for a late DMA IRQ
+		if (segments_done - seg >= LA_SEGMENTS - 1)
+		{
+			hw_stop();
+			return LA_END_OVERFLOW;
+		}
+		seg++;
+	}
+}
+
+void la_task(void *pvParameters)
+{
+	la_task_handle = xTaskGetCurrentTaskHandle();
+	for (uint32_t ch = 0; ch < LA_CHANNELS; ch++)
+	{
+		pin_mask |= 1u << la_pins[ch];
+	}
+
+	for (;;)
+	{
+		while (!start_requested)
+		{
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		}
+
+		taskENTER_CRITICAL();
+		config = pending_config;
+		start_requested = false;
+		stop_requested = false;
+		taskEXIT_CRITICAL();
+
+		trigger_raw_mask = raw_of(config.trigger_mask);
+		trigger_raw_value = raw_of(config.trigger_value) & trigger_raw_mask;
+		trigger_prev_match = true;
+		out_len = 0;
+		run_len = 0;
+		status.samples = 0;
+		status.sent = 0;
+		status.state = LA_STATE_ARMED;
+
+		const la_end_t end = capture();
+		if (status.state == LA_STATE_ARMED)
+		{
+			// Never triggered, the host still gets a well formed stream
+			begin_stream(0);
+		}
+		if (run_len != 0)
+			put_run();
+		out_put(0);
+		out_put(end);
+		out_flush();
+
+		ESP_LOGI(TAG, "capture ended (%d), %u samples sent", end, (uint32_t) status.sent);
+		status.end = end;
+		status.state = LA_STATE_IDLE;
+	}
+}
+
+void la_start(const la_config_t *new_config)
+{
+	taskENTER_CRITICAL();
+	pending_config = *new_config;
+	start_requested = true;
+	// A running capture ends first
+	stop_requested = status.state != LA_STATE_IDLE;
+	taskEXIT_CRITICAL();
+
+	xTaskNotifyGive(la_task_handle);
+}
+
+void la_stop(void)
+{
+	stop_requested = true;
+	xTaskNotifyGive(la_task_handle);
+}
+
+const la_status_t *la_status(void)
+{
+	return &status;
+}
+
+#endif
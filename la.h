@@ -0,0 +1,117 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ubp_config.h"
+
+/*
+ * Logic analyzer (LA_ENABLED). A pio1 state machine snapshots GPIO 0-31 at the sample rate, two chained DMA
+ * channels write the snapshots into a RAM ring of LA_SEGMENTS segments. la_task() picks the bridge's pins out
+ * of every segment, waits for the trigger and streams run length encoded samples to the bulk IN endpoint of
+ * the second vendor interface. Idle pins cost a few bytes per segment, so full speed USB keeps up with long
+ * captures as long as the pins are quiet most of the time. tools/la_capture.py turns the stream into a sigrok
+ * session or a VCD file.
+ *
+ * The stream is little endian: la_stream_header_t, then one record per run of equal samples: the run length
+ * as an unsigned LEB128, followed by one byte of channel levels (bit n = channel n). A run length of 0 ends
+ * the capture, it is followed by one la_end_t byte. The trigger sample is the pretrigger'th sample of the
+ * stream.
+ */
+
+#define LA_STREAM_MAGIC			0x43414c42	// "BLAC"
+#define LA_STREAM_VERSION		1
+
+// Vendor control request on the JTAG interface, next to VEND_JTAG_* in jtag.c. wValue is one of la_cmd_t.
+#define VEND_LA					19
+
+// TinyUSB vendor instance of the sample stream, the JTAG interface is 0
+#define LA_VENDOR_ITF			1
+
+typedef enum
+{
+	LA_CMD_START = 1,		// OUT, data: la_config_t
+	LA_CMD_STOP,			// ends a capture, the stream ends with LA_END_STOPPED
+	LA_CMD_STATUS,			// IN, la_status_t
+} la_cmd_t;
+
+typedef enum
+{
+	LA_CH_TCK,
+	LA_CH_TMS,
+	LA_CH_TDI,
+	LA_CH_TDO,
+	LA_CH_TXD,
+	LA_CH_RXD,
+	LA_CH_BOOT,
+	LA_CH_RST,
+	LA_CHANNELS
+} la_channel_t;
+
+// Only trigger when the condition becomes true, not on a sample where it already was
+#define LA_TRIGGER_EDGE			(1 << 0)
+
+typedef struct __attribute__((packed))
+{
+	uint32_t rate_hz;			// rounded to clk_sys / n, at most LA_MAX_RATE_HZ
+	uint32_t pretrigger;		// samples before the trigger to send along, capped at what the ring keeps
+	uint32_t samples;			// samples from the trigger on, 0: until LA_CMD_STOP
+	uint8_t trigger_mask;		// channels the trigger looks at, 0: trigger on the first sample
+	uint8_t trigger_value;
+	uint8_t flags;				// LA_TRIGGER_*
+	uint8_t reserved;
+} la_config_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;
+	uint8_t version;
+	uint8_t channels;
+	uint16_t header_size;
+	uint32_t rate_hz;
+	uint32_t pretrigger;
+} la_stream_header_t;
+
+typedef enum
+{
+	LA_END_DONE,				// config.samples sent
+	LA_END_STOPPED,				// LA_CMD_STOP
+	LA_END_OVERFLOW,			// the encoder or USB fell behind the sampler, the DMA overwrote unsent samples
+	LA_END_NO_RESOURCES,		// no free pio1 state machine, program space or DMA channel
+} la_end_t;
+
+typedef enum
+{
+	LA_STATE_IDLE,
+	LA_STATE_ARMED,				// waiting for the trigger
+	LA_STATE_RUNNING,
+} la_state_t;
+
+typedef struct __attribute__((packed))
+{
+	uint8_t state;				// la_state_t
+	uint8_t end;				// la_end_t of the last capture
+	uint16_t reserved;
+	uint32_t rate_hz;
+	uint64_t samples;			// sampled since the start
+	uint64_t sent;				// streamed since the trigger
+} la_status_t;
+
+void la_task(void *pvParameters);
+void la_start(const la_config_t *config);
+void la_stop(void);
+const la_status_t *la_status(void);
@@ -28,6 +28,13 @@
 #include "jtag.h"
 #include "serial.h"
 #include "msc.h"
+#include "uf2_flash.h"
+#include "bridge_flash.h"
+#include "kv_store.h"
+#include "standalone.h"
+#include "flash_bin.h"
+#include "bridge_profile.h"
+#include "la.h"
 
 #include "pio_uart_logger/pio_uart_logger.h"
 
@@ -70,12 +77,33 @@ int main(void)
 	ws2812_pio_init(pio0);
 	ws2812_start_task();
 
-	xTaskCreateAffinitySet(tusb_device_task, "tusb_device_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, 5, CORE_AFFINITY_USB_TASK, NULL);
+	xTaskCreateAffinitySet(tusb_device_task, "tusb_device_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_USB_TASK, CORE_AFFINITY_USB_TASK, NULL);
 #if MSC_ENABLED
-	xTaskCreateAffinitySet(msc_task, "msc_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, 5, CORE_AFFINITY_MSC_TASK, NULL);
+	uf2_flash_init();
+	xTaskCreateAffinitySet(msc_task, "msc_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_BRIDGE_TASK, CORE_AFFINITY_MSC_TASK, NULL);
+#if MSC_FLASH_BIN_ENABLED
+	xTaskCreateAffinitySet(flash_bin_task, "flash_bin_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_BRIDGE_TASK, CORE_AFFINITY_FLASH_BIN_TASK, NULL);
+#endif
+#endif
+	xTaskCreateAffinitySet(start_serial_task, "start_serial_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_BRIDGE_TASK, CORE_AFFINITY_SERIAL_TASK, NULL);
+	xTaskCreateAffinitySet(jtag_task, "jtag_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_BRIDGE_TASK, CORE_AFFINITY_JTAG_TASK, NULL);
+#if STANDALONE_ENABLED || TARGET_SETTINGS_ENABLED
+	bridge_flash_init();
+#endif
+#if TARGET_SETTINGS_ENABLED
+	kv_store_init();
+#endif
+#if STANDALONE_ENABLED
+	xTaskCreateAffinitySet(standalone_task, "standalone_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_BRIDGE_TASK, CORE_AFFINITY_STANDALONE_TASK, NULL);
+#endif
+#if LA_ENABLED
+	xTaskCreateAffinitySet(la_task, "la_task", STACK_SIZE_FROM_BYTES(2 * 1024), NULL, PRIORITY_LA_TASK, CORE_AFFINITY_LA_TASK, NULL);
+#endif
+#if PROFILE_ENABLED
+	// One per core, the sampler has to be set up on the core it samples
+	xTaskCreateAffinitySet(bridge_profile_task, "profile_start", STACK_SIZE_FROM_BYTES(1024), NULL, configMAX_PRIORITIES - 1, 1 << 0, NULL);
+	xTaskCreateAffinitySet(bridge_profile_task, "profile_start", STACK_SIZE_FROM_BYTES(1024), NULL, configMAX_PRIORITIES - 1, 1 << 1, NULL);
 #endif
-	xTaskCreateAffinitySet(start_serial_task, "start_serial_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, 5, CORE_AFFINITY_SERIAL_TASK, NULL);
-	xTaskCreateAffinitySet(jtag_task, "jtag_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, 5, CORE_AFFINITY_JTAG_TASK, NULL);
 	
 	
 	vTaskStartScheduler();
@@ -24,10 +24,12 @@
 // - tud_msc_scsi_cb - desired actions to SCSI disc commands can be handler there.
 // - tud_msc_read10_cb - invoked in order to read from the disc. A skeleton structure of FAT16 file system is
 //   pre-defined by variables msc_disk_boot_sector, msc_disk_fat_table_sector0, msc_disk_readme_sector0 and
-//   msc_disk_root_directory_sector0. A disc read outside of these variables returns all zeroes.
+//   msc_disk_root_directory_sector0. FLASH.BIN reads are forwarded to flash_bin.c, STATUS.TXT is rendered by
+//   flash_status.c. A disc read outside of these returns all zeroes.
 // - tud_msc_write10_cb - invoked in order to write the disc. The above mentioned file system structure is not modified.
-//   Each write is interpreted as a block for flashing. UF2 block format is used where the flashing address is encoded
-//   among other information. The flashing is done by the esp-serial-flasher IDF component.
+//   Each written sector holding a UF2 block is a block for flashing, the blocks of a multi-sector write are flashed in
+//   one go. UF2 block format is used where the flashing address is encoded among other information. The flashing is
+//   done by the esp-serial-flasher IDF component.
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -38,8 +40,11 @@
 #include "esp_err.h"
 #include "tusb.h"
 #include "msc.h"
-#include "esp_loader.h"
-#include "serial.h"
+#include "uf2_flash.h"
+#include "standalone.h"
+#include "flash_bin.h"
+#include "flash_status.h"
+#include "bridge_trace.h"
 
 #define FAT_CLUSTERS                    (6 * 1024)
 #define FAT_SECTORS_PER_CLUSTER         8
@@ -57,6 +62,15 @@
 #define FAT16_CLUSTER_BYTES             2
 #define FAT_TABLE_SECTORS               (FAT_CLUSTERS * FAT16_CLUSTER_BYTES / FAT_SECTOR_SIZE)
 #define FAT_BOOT_SECTORS                1
+#define FAT_CLUSTER_SIZE                (FAT_SECTORS_PER_CLUSTER * FAT_SECTOR_SIZE)
+
+// FLASH.BIN takes the clusters right after the README
+#define FLASH_BIN_FIRST_CLUSTER         3
+#define FLASH_BIN_CLUSTERS              (MSC_FLASH_BIN_SIZE / FAT_CLUSTER_SIZE)
+
+// STATUS.TXT is one cluster after FLASH.BIN. Its size is fixed, the text is padded with spaces.
+#define STATUS_CLUSTER                  (FLASH_BIN_FIRST_CLUSTER + (MSC_FLASH_BIN_ENABLED ? FLASH_BIN_CLUSTERS : 0))
+#define MSC_STATUS_SIZE                 FAT_CLUSTER_SIZE
 
 typedef struct __attribute__((__packed__))
 {
@@ -100,6 +114,11 @@ _Static_assert(FAT_TABLE_SECTORS == (FAT_TABLE_SECTORS & 0xFFFF), "FAT table sec
 _Static_assert(FAT_BOOT_SECTORS == (FAT_BOOT_SECTORS & 0xFFFF), "FAT boot sectors must fit into a 16-bit field");
 _Static_assert(sizeof(msc_boot_sector_t) == FAT_SECTOR_SIZE, "The boot sector has incorrect size!");
 _Static_assert(strlen(CONFIG_BRIDGE_MSC_VOLUME_LABEL) <= FAT_VOLUME_NAME_SIZE, "BRIDGE_MSC_VOLUME_LABEL is too long");
+#if MSC_FLASH_BIN_ENABLED
+_Static_assert(FLASH_BIN_FIRST_CLUSTER + FLASH_BIN_CLUSTERS <= FAT_CLUSTERS, "MSC_FLASH_BIN_SIZE doesn't fit on the disk");
+_Static_assert((MSC_FLASH_BIN_SIZE % FAT_CLUSTER_SIZE) == 0, "MSC_FLASH_BIN_SIZE must be a multiple of the cluster size");
+#endif
+_Static_assert(STATUS_CLUSTER < FAT_CLUSTERS, "STATUS.TXT doesn't fit on the disk");
 
 static msc_boot_sector_t msc_disk_boot_sector = {
 	.jump_instructions = {0xEB, 0x3C, 0x90},
@@ -172,6 +191,22 @@ static uint8_t msc_disk_root_directory_sector0[] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,                                                                               // time and date for creation & modification
 	0x02, 0,                                                                                                                // starting cluster in the FAT table
 	GET_BYTE(MSC_README_SIZE, 0), GET_BYTE(MSC_README_SIZE, 1), GET_BYTE(MSC_README_SIZE, 2), GET_BYTE(MSC_README_SIZE, 3), // size
+#if MSC_FLASH_BIN_ENABLED
+	// target flash
+	'F', 'L', 'A', 'S', 'H', ' ', ' ', ' ', 'B', 'I', 'N',
+	0x01,                                                                                                                   // attribute byte where read-only bit is set
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,                                                                               // time and date for creation & modification
+	GET_BYTE(FLASH_BIN_FIRST_CLUSTER, 0), GET_BYTE(FLASH_BIN_FIRST_CLUSTER, 1),                                             // starting cluster in the FAT table
+	GET_BYTE(MSC_FLASH_BIN_SIZE, 0), GET_BYTE(MSC_FLASH_BIN_SIZE, 1), GET_BYTE(MSC_FLASH_BIN_SIZE, 2), GET_BYTE(MSC_FLASH_BIN_SIZE, 3), // size
+#endif
+#if MSC_STATUS_ENABLED
+	// flashing status
+	'S', 'T', 'A', 'T', 'U', 'S', ' ', ' ', 'T', 'X', 'T',
+	0x01,                                                                                                                   // attribute byte where read-only bit is set
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,                                                                               // time and date for creation & modification
+	GET_BYTE(STATUS_CLUSTER, 0), GET_BYTE(STATUS_CLUSTER, 1),                                                               // starting cluster in the FAT table
+	GET_BYTE(MSC_STATUS_SIZE, 0), GET_BYTE(MSC_STATUS_SIZE, 1), GET_BYTE(MSC_STATUS_SIZE, 2), GET_BYTE(MSC_STATUS_SIZE, 3), // size
+#endif
 };
 
 void tud_msc_inquiry_cb(const uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4])
@@ -243,14 +278,80 @@ bool tud_msc_start_stop_cb(const uint8_t lun, const uint8_t power_condition, con
 #define IS_LBA_ROOT(lba)      ((lba) >= FIRST_ROOT_SECTOR && (lba) < FIRST_README_SECTOR)
 #define IS_LBA_README(lba)    ((lba) >= FIRST_README_SECTOR && (lba) < FIRST_ELSE_SECTOR)
 #define IS_LBA_ELSE(lba)      ((lba) >= FIRST_ELSE_SECTOR)
-
-int32_t tud_msc_read10_cb(const uint8_t lun, const uint32_t lba, const uint32_t offset, void *buffer, const uint32_t bufsize)
+#define FIRST_FLASH_BIN_SECTOR (FIRST_README_SECTOR + (FLASH_BIN_FIRST_CLUSTER - 2) * FAT_SECTORS_PER_CLUSTER)
+#define IS_LBA_FLASH_BIN(lba) (MSC_FLASH_BIN_ENABLED && (lba) >= FIRST_FLASH_BIN_SECTOR && \
+                               (lba) < FIRST_FLASH_BIN_SECTOR + FLASH_BIN_CLUSTERS * FAT_SECTORS_PER_CLUSTER)
+#define FIRST_STATUS_SECTOR   (FIRST_README_SECTOR + (STATUS_CLUSTER - 2) * FAT_SECTORS_PER_CLUSTER)
+#define IS_LBA_STATUS(lba)    (MSC_STATUS_ENABLED && (lba) >= FIRST_STATUS_SECTOR && \
+                               (lba) < FIRST_STATUS_SECTOR + FAT_SECTORS_PER_CLUSTER)
+
+#if MSC_FLASH_BIN_ENABLED || MSC_STATUS_ENABLED
+// FAT sectors covering the FLASH.BIN cluster chain and STATUS.TXT are generated on the fly
+static void msc_fat_sector(const uint32_t fat_sector, uint8_t *buffer)
 {
-	ESP_LOGD(TAG, "tud_msc_read10_cb() invoked, lun=%d, lba=%d, offset=%d, bufsize=%d", lun, lba, offset, bufsize);
+	const uint32_t first_entry = fat_sector * (FAT_SECTOR_SIZE / FAT16_CLUSTER_BYTES);
+
+	memset(buffer, 0, FAT_SECTOR_SIZE);
+	if (fat_sector == 0)
+	{
+		memcpy(buffer, msc_disk_fat_table_sector0, sizeof(msc_disk_fat_table_sector0));
+	}
 
+	for (uint32_t i = 0; i < FAT_SECTOR_SIZE / FAT16_CLUSTER_BYTES; i++)
+	{
+		const uint32_t cluster = first_entry + i;
+		uint16_t next;
+		if (MSC_STATUS_ENABLED && cluster == STATUS_CLUSTER)
+		{
+			next = 0xFFFF;
+		}
+		else if (MSC_FLASH_BIN_ENABLED && cluster >= FLASH_BIN_FIRST_CLUSTER && cluster < FLASH_BIN_FIRST_CLUSTER + FLASH_BIN_CLUSTERS)
+		{
+			next = (cluster == FLASH_BIN_FIRST_CLUSTER + FLASH_BIN_CLUSTERS - 1) ? 0xFFFF : cluster + 1;
+		}
+		else
+		{
+			continue;
+		}
+
+		buffer[i * FAT16_CLUSTER_BYTES] = GET_BYTE(next, 0);
+		buffer[i * FAT16_CLUSTER_BYTES + 1] = GET_BYTE(next, 1);
+	}
+}
+#endif
+
+// Fills len bytes of a sector that isn't part of FLASH.BIN, starting at offset within the sector
+static void msc_read_sector(const uint32_t lba, const uint32_t offset, uint8_t *buffer, const uint32_t len)
+{
 	const uint8_t *addr = NULL;
 	size_t size = FAT_SECTOR_SIZE;
 
+#if MSC_FLASH_BIN_ENABLED || MSC_STATUS_ENABLED
+	static uint8_t fat_sector[FAT_SECTOR_SIZE];
+
+	if (IS_LBA_FAT(lba))
+	{
+		msc_fat_sector(lba - FIRST_FAT_SECTOR, fat_sector);
+		addr = fat_sector;
+	}
+	else
+#endif
+#if MSC_STATUS_ENABLED
+	if (IS_LBA_STATUS(lba))
+	{
+		// Rendered when the file is read from its start, so the sectors of one read fit together
+		static char status_text[MSC_STATUS_SIZE];
+		static bool status_rendered;
+
+		if ((lba == FIRST_STATUS_SECTOR && offset == 0) || !status_rendered)
+		{
+			flash_status_render(status_text, sizeof(status_text));
+			status_rendered = true;
+		}
+		addr = (const uint8_t *) status_text + (lba - FIRST_STATUS_SECTOR) * FAT_SECTOR_SIZE;
+	}
+	else
+#endif
 	if (IS_LBA_BOOT(lba))
 	{
 		addr = (const uint8_t *) &msc_disk_boot_sector;
@@ -272,193 +373,157 @@ int32_t tud_msc_read10_cb(const uint8_t lun, const uint32_t lba, const uint32_t
 	} // else lba sector is not kept in RAM
 
 	int done = 0;
-	int left_to_do = bufsize;
+	int left_to_do = len;
 
 	if (addr)
 	{
 		const int available = size - offset;
 		if (available > 0)
 		{
-			const int len = MIN(available, left_to_do);
-			memcpy(buffer, addr + offset, len);
-			done = len;
-			left_to_do -= len;
+			const int n = MIN(available, left_to_do);
+			memcpy(buffer, addr + offset, n);
+			done = n;
+			left_to_do -= n;
 		}
 	}
 
 	if (left_to_do > 0)
 	{
-		memset((uint8_t *)buffer + done, 0, left_to_do);
+		memset(buffer + done, 0, left_to_do);
 	}
-
-	return bufsize;
 }
 
+int32_t tud_msc_read10_cb(const uint8_t lun, const uint32_t lba, const uint32_t offset, void *buffer, const uint32_t bufsize)
+{
+	ESP_LOGD(TAG, "tud_msc_read10_cb() invoked, lun=%d, lba=%d, offset=%d, bufsize=%d", lun, lba, offset, bufsize);
 
-#define UF2_BLOCK_SIZE                  512
-#define UF2_DATA_SIZE                   476
-#define UF2_FIRST_MAGIC                 0x0A324655
-#define UF2_SECOND_MAGIC                0x9E5D5157
-#define UF2_FINAL_MAGIC                 0x0AB16F30
-#define UF2_FLAG_FAMILYID_PRESENT       0x00002000
-#define UF2_FLAG_MD5_PRESENT            0x00004000
+#if MSC_FLASH_BIN_ENABLED
+	if (IS_LBA_FLASH_BIN(lba))
+	{
+		// A read running past the end of FLASH.BIN is finished by the next callback
+		const uint32_t left = (FIRST_FLASH_BIN_SECTOR + FLASH_BIN_CLUSTERS * FAT_SECTORS_PER_CLUSTER - lba) * FAT_SECTOR_SIZE - offset;
+		const int32_t ret = flash_bin_read((lba - FIRST_FLASH_BIN_SECTOR) * FAT_SECTOR_SIZE + offset, buffer, MIN(bufsize, left));
+		if (ret < 0)
+		{
+			tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00);
+		}
+		return ret;
+	}
+#endif
 
-typedef struct
-{
-	uint32_t magic0;
-	uint32_t magic1;
-	uint32_t flags;
-	uint32_t addr;
-	uint32_t payload_size;
-	uint32_t block_no;
-	uint32_t blocks;
-	uint32_t chip_id;
-	uint8_t data[UF2_DATA_SIZE];
-	uint32_t magic3;
-} uf2_block_t;
-
-#define UF2_ESP8266_ID      0x7eab61ed
-
-static const char *chipid_to_name(const uint32_t id)
-{
-	// IDs can be found at https://github.com/Microsoft/uf2
-	switch (id)
+	// The endpoint buffer holds several sectors, a read stops short where FLASH.BIN begins
+	uint32_t done = 0;
+	while (done < bufsize)
 	{
-	case UF2_ESP8266_ID:
-		return "ESP8266";
-	case 0x1c5f21b0:
-		return "ESP32";
-	case 0xbfdd4eee:
-		return "ESP32-S2";
-	case 0xd42ba06c:
-		return "ESP32-C3";
-	case 0xc47e5767:
-		return "ESP32-S3";
-	default:
-		return "unknown";
+		const uint32_t sector = lba + (offset + done) / FAT_SECTOR_SIZE;
+		const uint32_t sector_offset = (offset + done) % FAT_SECTOR_SIZE;
+		if (IS_LBA_FLASH_BIN(sector))
+		{
+			break;
+		}
+
+		const uint32_t len = MIN(bufsize - done, FAT_SECTOR_SIZE - sector_offset);
+		msc_read_sector(sector, sector_offset, (uint8_t *)buffer + done, len);
+		done += len;
 	}
+
+	return done;
 }
 
-#define MSC_FLASH_HIGH_BAUDRATE             230400
-#define MSC_FLASH_DEFAULT_BAUDRATE          115200
 
-static int msc_last_block_written = -1;
-static int msc_chunk_size;
-static int msc_blocks;
+#define MSC_FLASH_HIGH_BAUDRATE             230400
 
-static bool msc_change_baudrate(const uint32_t chip_id, const uint32_t baud)
+static bool msc_flash_uf2(const uint8_t lun, const uf2_block_t *blocks, const uint32_t count)
 {
-	if (chip_id == UF2_ESP8266_ID)
+	if (count == 0)
 	{
 		return true;
 	}
-	return (esp_loader_change_baudrate(baud) == ESP_LOADER_SUCCESS) && serial_set_baudrate(baud);
-}
 
-int32_t tud_msc_write10_cb(const uint8_t lun, const uint32_t lba, const uint32_t offset, uint8_t *buffer, const uint32_t bufsize)
-{
-	ESP_LOGD(TAG, "tud_msc_write10_cb() invoked, lun=%d, lba=%d, offset=%d", lun, lba, offset);
-	ESP_LOG_BUFFER_HEXDUMP(TAG, buffer, bufsize, ESP_LOG_DEBUG);
+	TRACE(TRACE_UF2_BLOCK_START, blocks[0].block_no);
+	const uf2_flash_result_t result = uf2_flash_blocks(blocks, count, MSC_FLASH_HIGH_BAUDRATE);
+	TRACE(TRACE_UF2_BLOCK_DONE, blocks[count - 1].block_no);
+	if (result != UF2_FLASH_OK)
+	{
+		// Returning 0 would make TinyUSB retry the same blocks forever
+		tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+		return false;
+	}
 
-	assert(bufsize == UF2_BLOCK_SIZE);
+	return true;
+}
 
-	// Linux and Windows write files differently. Windows also creates system volume information files on the first
-	// mount. In an ideal case, FAT and ROOT content would be analyzed and the flash file detected.
-	// However, the only reliable way to detect files for flashing is look at the content.
+// Hands a run of UF2 blocks from one write to the flasher, minus those the standalone programmer stores
+static bool msc_write_uf2(const uint8_t lun, const uf2_block_t *blocks, const uint32_t count)
+{
+	uint32_t first = 0;
 
-	if (IS_LBA_ELSE(lba))
+	for (uint32_t i = 0; i < count; i++)
 	{
-		const uf2_block_t *p = (uf2_block_t *) buffer;
-
-		if (p->magic0 == UF2_FIRST_MAGIC && p->magic1 == UF2_SECOND_MAGIC && p->magic3 == UF2_FINAL_MAGIC)
+#if MSC_FLASH_BIN_ENABLED
+		if (blocks[i].block_no == 0)
 		{
-			// UF2 block detected
-
-			const char *chip_name = (p->flags & UF2_FLAG_FAMILYID_PRESENT) ? chipid_to_name(p->chip_id) : "???";
-
-			if (p->flags & UF2_FLAG_MD5_PRESENT)
-			{
-				// TODO check MD5 optionally based on Kconfig option
-			}
-
-			ESP_LOGI(TAG, "LBA %d: UF2 block %d of %d for chip %s at %#08x with length %d", lba, p->block_no, p->blocks,
-			         chip_name, p->addr, p->payload_size);
-
-			if (msc_last_block_written + 1 != p->block_no)
-			{
-				ESP_LOGE(TAG, "Trying to write block no. %d but last time %d was written!", p->block_no,
-				         msc_last_block_written);
-				return 0;
-			}
+			// The target may still be held in download mode for reading FLASH.BIN
+			flash_bin_release();
+		}
+#endif
 
-			if (p->block_no == 0)
+#if STANDALONE_ENABLED
+		// With the trigger held down while the copy starts, the image is stored for standalone use instead.
+		// Blocks ahead of it, the tail of an image being flashed, still go to the flasher first.
+		if (standalone_capture_block(&blocks[i]))
+		{
+			if (!msc_flash_uf2(lun, &blocks[first], i - first))
 			{
-				serial_set(false);
-
-				esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
-				if (esp_loader_connect(&connect_config) != ESP_LOADER_SUCCESS)
-				{
-					ESP_LOGE(TAG, "ESP LOADER connection failed!");
-					return 0;
-				}
-				ESP_LOGD(TAG, "ESP LOADER connection success!");
-
-				if (!msc_change_baudrate(p->chip_id, MSC_FLASH_HIGH_BAUDRATE))
-				{
-					ESP_LOGW(TAG, "ESP LOADER cannot change baudrate to %d", MSC_FLASH_HIGH_BAUDRATE);
-				}
-
-				msc_chunk_size = p->payload_size;
-				msc_blocks = p->blocks;
-				const uint32_t image_size = msc_blocks * msc_chunk_size;
-				if (esp_loader_flash_start(p->addr, image_size, msc_chunk_size) != ESP_LOADER_SUCCESS)
-				{
-					ESP_LOGE(TAG, "Ereasing flash failed at addr %d of length %d with block size %d", p->addr,
-					         image_size, p->payload_size);
-					return 0;
-				}
-				ESP_LOGD(TAG, "ESP LOADER flash start success!");
+				return false;
 			}
+			first = i + 1;
+		}
+#endif
+	}
 
+	return msc_flash_uf2(lun, &blocks[first], count - first);
+}
 
-			if (p->payload_size > msc_chunk_size)
-			{
-				ESP_LOGE(TAG, "UF2 block %d is of size %d and should be at most %d", p->block_no, p->payload_size,
-				         msc_chunk_size);
-				eub_abort();
-			}
+int32_t tud_msc_write10_cb(const uint8_t lun, const uint32_t lba, const uint32_t offset, uint8_t *buffer, const uint32_t bufsize)
+{
+	ESP_LOGD(TAG, "tud_msc_write10_cb() invoked, lun=%d, lba=%d, offset=%d, bufsize=%d", lun, lba, offset, bufsize);
+	ESP_LOG_BUFFER_HEXDUMP(TAG, buffer, bufsize, ESP_LOG_DEBUG);
+	TRACE(TRACE_MSC_WRITE, lba);
 
-			if (p->blocks != msc_blocks)
-			{
-				ESP_LOGE(TAG, "UF2 block %d has %d as total block number but it should be %d", p->block_no, p->blocks,
-				         msc_blocks);
-				eub_abort();
-			}
+	// The endpoint buffer is a multiple of the sector size, so every callback starts on a sector
+	assert(offset == 0 && (bufsize % UF2_BLOCK_SIZE) == 0);
 
-			if (esp_loader_flash_write((void *) p->data, p->payload_size) != ESP_LOADER_SUCCESS)
-			{
-				ESP_LOGE(TAG, "UF2 block %d of %d could not be written at %#08x with length %d", p->block_no, p->blocks,
-				         p->addr, p->payload_size);
-				eub_abort();
-			}
+	// Linux and Windows write files differently. Windows also creates system volume information files on the first
+	// mount. In an ideal case, FAT and ROOT content would be analyzed and the flash file detected.
+	// However, the only reliable way to detect files for flashing is look at the content.
 
-			ESP_LOGD(TAG, "ESP LOADER flash write success!");
-			msc_last_block_written = p->block_no;
+	const uint32_t sectors = bufsize / UF2_BLOCK_SIZE;
+	uint32_t n = 0;
+	while (n < sectors)
+	{
+		uint32_t count = 0;
+		while (n + count < sectors && IS_LBA_ELSE(lba + n + count) && uf2_is_block(buffer + (n + count) * UF2_BLOCK_SIZE))
+		{
+			count++;
+		}
+		if (count == 0)
+		{
+			n++;
+			continue;
+		}
 
-			if (p->block_no == (p->blocks - 1))
-			{
-				if (!msc_change_baudrate(p->chip_id, MSC_FLASH_DEFAULT_BAUDRATE))
-				{
-					ESP_LOGW(TAG, "ESP LOADER cannot change baudrate to %d", MSC_FLASH_DEFAULT_BAUDRATE);
-				}
-				esp_loader_flash_finish(true);
-				esp_loader_reset_target();
-				serial_set(true);
-				msc_last_block_written = -1;
-			}
+		// UF2 blocks detected
+		ESP_LOGI(TAG, "LBA %d: %d UF2 blocks", lba + n, count);
+		if (!msc_write_uf2(lun, (const uf2_block_t *)(buffer + n * UF2_BLOCK_SIZE), count))
+		{
+			TRACE(TRACE_MSC_WRITE_DONE, lba);
+			return -1;
 		}
+		n += count;
 	}
 
+	TRACE(TRACE_MSC_WRITE_DONE, lba);
 	return bufsize;
 }
 
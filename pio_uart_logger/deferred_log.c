@@ -0,0 +1,187 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Deferred logging, see deferred_log.h.
+//
+// Each core has its own ring and is its only writer, with its interrupts masked for the copy so a task and
+// an ISR on the same core can't interleave. The logger task is the only reader. Nothing is shared between
+// the cores but the ring indexes, so no spinlock is taken and the other core is never held up.
+
+#include <stdarg.h>
+#include <string.h>
+#include "ubp_config.h"
+#include "pico.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "FreeRTOS.h"
+#include "deferred_log.h"
+
+#if LOG_DEFERRED_ENABLED
+
+_Static_assert((LOG_DEFERRED_RING_SIZE & (LOG_DEFERRED_RING_SIZE - 1)) == 0, "LOG_DEFERRED_RING_SIZE must be a power of two");
+
+typedef struct
+{
+	uint8_t buf[LOG_DEFERRED_RING_SIZE];
+	volatile uint32_t head;		// written by the owning core
+	volatile uint32_t tail;		// written by the logger task
+	volatile uint32_t dropped;
+	uint32_t dropped_reported;
+} deferred_log_ring_t;
+
+static deferred_log_ring_t s_rings[NUM_CORES];
+
+// Base of the format string table, provided by the linker for the "logfmt" section
+extern const char __start_logfmt[];
+
+static inline uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+	return p + 4;
+}
+
+static inline uint8_t *put_u64(uint8_t *p, uint64_t v)
+{
+	return put_u32(put_u32(p, (uint32_t) v), (uint32_t) (v >> 32));
+}
+
+void __not_in_flash_func(deferred_log_write)(const char *format, uint32_t types, ...)
+{
+	uint8_t record[DEFERRED_LOG_HEADER_SIZE + DEFERRED_LOG_MAX_PAYLOAD];
+	uint8_t *const payload = record + DEFERRED_LOG_HEADER_SIZE;
+	uint8_t *p = payload;
+	const uint32_t count = types >> 28;
+	va_list args;
+
+	va_start(args, types);
+	for (uint32_t n = 0; n < count; n++)
+	{
+		// Worst case is a string, anything that doesn't fit any more is left out
+		if (p + 1 + DEFERRED_LOG_MAX_STRING > payload + DEFERRED_LOG_MAX_PAYLOAD)
+			break;
+
+		switch ((types >> (2 * n)) & 3)
+		{
+		case DEFERRED_LOG_ARG_32:
+			p = put_u32(p, va_arg(args, uint32_t));
+			break;
+		case DEFERRED_LOG_ARG_64:
+			p = put_u64(p, va_arg(args, uint64_t));
+			break;
+		case DEFERRED_LOG_ARG_DOUBLE: {
+			const double d = va_arg(args, double);
+			uint64_t bits;
+			memcpy(&bits, &d, sizeof(bits));
+			p = put_u64(p, bits);
+			break;
+		}
+		case DEFERRED_LOG_ARG_STRING: {
+			const char *s = va_arg(args, const char *);
+			const size_t len = s ? strnlen(s, DEFERRED_LOG_MAX_STRING) : 0;
+			*p++ = (uint8_t) len;
+			memcpy(p, s, len);
+			p += len;
+			break;
+		}
+		}
+	}
+	va_end(args);
+
+	const uint32_t len = DEFERRED_LOG_HEADER_SIZE + (uint32_t) (p - payload);
+	const uint16_t offset = (uint16_t) (format - __start_logfmt);
+	record[0] = offset;
+	record[1] = offset >> 8;
+	record[2] = (uint8_t) (p - payload);
+	record[3] = (get_core_num() ? DEFERRED_LOG_FLAG_CORE1 : 0) | (portCHECK_IF_IN_ISR() ? DEFERRED_LOG_FLAG_ISR : 0);
+	put_u32(record + 4, time_us_32());
+
+	const uint32_t irq = save_and_disable_interrupts();
+	deferred_log_ring_t *ring = &s_rings[get_core_num()];
+	const uint32_t head = ring->head;
+	if (LOG_DEFERRED_RING_SIZE - (head - ring->tail) < len)
+	{
+		ring->dropped++;
+	}
+	else
+	{
+		const uint32_t pos = head & (LOG_DEFERRED_RING_SIZE - 1);
+		const uint32_t first = MIN(len, LOG_DEFERRED_RING_SIZE - pos);
+		memcpy(&ring->buf[pos], record, first);
+		memcpy(ring->buf, record + first, len - first);
+		// The record has to be in the ring before the reader on the other core sees the new head
+		__dmb();
+		ring->head = head + len;
+	}
+	restore_interrupts(irq);
+}
+
+static void ring_read(const deferred_log_ring_t *ring, uint32_t from, uint8_t *dst, uint32_t len)
+{
+	const uint32_t pos = from & (LOG_DEFERRED_RING_SIZE - 1);
+	const uint32_t first = MIN(len, LOG_DEFERRED_RING_SIZE - pos);
+	memcpy(dst, &ring->buf[pos], first);
+	memcpy(dst + first, ring->buf, len - first);
+}
+
+size_t deferred_log_drain(uint8_t *buf, size_t size)
+{
+	size_t out = 0;
+
+	for (uint core = 0; core < NUM_CORES; core++)
+	{
+		deferred_log_ring_t *ring = &s_rings[core];
+
+		const uint32_t dropped = ring->dropped;
+		if (dropped != ring->dropped_reported && out + 1 + DEFERRED_LOG_HEADER_SIZE + 4 <= size)
+		{
+			uint8_t *p = buf + out;
+			*p++ = DEFERRED_LOG_FRAME_START;
+			*p++ = DEFERRED_LOG_DROPPED & 0xFF;
+			*p++ = DEFERRED_LOG_DROPPED >> 8;
+			*p++ = 4;
+			*p++ = core ? DEFERRED_LOG_FLAG_CORE1 : 0;
+			p = put_u32(p, time_us_32());
+			put_u32(p, dropped - ring->dropped_reported);
+			ring->dropped_reported = dropped;
+			out += 1 + DEFERRED_LOG_HEADER_SIZE + 4;
+		}
+
+		uint32_t tail = ring->tail;
+		const uint32_t head = ring->head;
+		__dmb();
+		while (tail != head)
+		{
+			uint8_t header[DEFERRED_LOG_HEADER_SIZE];
+			ring_read(ring, tail, header, sizeof(header));
+			const uint32_t len = DEFERRED_LOG_HEADER_SIZE + header[2];
+			if (out + 1 + len > size)
+				break;
+
+			buf[out] = DEFERRED_LOG_FRAME_START;
+			ring_read(ring, tail, &buf[out + 1], len);
+			out += 1 + len;
+			tail += len;
+		}
+		// Done with the bytes before the writer may reuse them
+		__dmb();
+		ring->tail = tail;
+	}
+	return out;
+}
+
+#endif
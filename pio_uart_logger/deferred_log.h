@@ -0,0 +1,89 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Deferred logging (LOG_DEFERRED_ENABLED). DEFERRED_LOG() doesn't format anything: the format string is
+ * placed in the "logfmt" section and only its offset there is recorded, together with the raw arguments,
+ * into a ring of the calling core. The logger task sends the records out as binary frames between the
+ * text, tools/logfmt.py turns them back into text with the table it extracts from the ELF.
+ *
+ * Frame on the logger UART, little endian:
+ *   DEFERRED_LOG_FRAME_START, u16 format offset, u8 payload length, u8 flags, u32 time_us_32(), payload
+ * The payload holds the arguments in order: 4 bytes for integers and pointers, 8 for 64 bit integers and
+ * doubles, a length byte and the characters for strings. Offset DEFERRED_LOG_DROPPED reports records lost
+ * to a full ring, the payload is their number.
+ */
+
+#define DEFERRED_LOG_FRAME_START	0x1E		// ASCII record separator, never part of the text
+#define DEFERRED_LOG_HEADER_SIZE	8
+#define DEFERRED_LOG_MAX_PAYLOAD	128
+#define DEFERRED_LOG_MAX_STRING		31
+#define DEFERRED_LOG_DROPPED		0xFFFF
+
+#define DEFERRED_LOG_FLAG_CORE1		(1 << 0)
+#define DEFERRED_LOG_FLAG_ISR		(1 << 1)
+
+// Argument types, two bits each in the descriptor DEFERRED_LOG() builds at compile time
+#define DEFERRED_LOG_ARG_32			0
+#define DEFERRED_LOG_ARG_64			1
+#define DEFERRED_LOG_ARG_DOUBLE		2
+#define DEFERRED_LOG_ARG_STRING		3
+
+#define DEFERRED_LOG_ARG_TYPE(x) _Generic((x),										\
+	char *: DEFERRED_LOG_ARG_STRING,												\
+	const char *: DEFERRED_LOG_ARG_STRING,											\
+	long: (sizeof(long) > 4 ? DEFERRED_LOG_ARG_64 : DEFERRED_LOG_ARG_32),			\
+	unsigned long: (sizeof(long) > 4 ? DEFERRED_LOG_ARG_64 : DEFERRED_LOG_ARG_32),	\
+	long long: DEFERRED_LOG_ARG_64,												\
+	unsigned long long: DEFERRED_LOG_ARG_64,										\
+	float: DEFERRED_LOG_ARG_DOUBLE,												\
+	double: DEFERRED_LOG_ARG_DOUBLE,												\
+	default: DEFERRED_LOG_ARG_32)
+
+#define _DL_T(n, x)						((uint32_t) DEFERRED_LOG_ARG_TYPE(x) << (2 * (n)))
+#define _DL_TYPES_0()					0
+#define _DL_TYPES_1(a)					_DL_T(0, a)
+#define _DL_TYPES_2(a, b)				_DL_TYPES_1(a) | _DL_T(1, b)
+#define _DL_TYPES_3(a, b, c)			_DL_TYPES_2(a, b) | _DL_T(2, c)
+#define _DL_TYPES_4(a, b, c, d)			_DL_TYPES_3(a, b, c) | _DL_T(3, d)
+#define _DL_TYPES_5(a, b, c, d, e)		_DL_TYPES_4(a, b, c, d) | _DL_T(4, e)
+#define _DL_TYPES_6(a, b, c, d, e, f)	_DL_TYPES_5(a, b, c, d, e) | _DL_T(5, f)
+#define _DL_TYPES_7(a, b, c, d, e, f, g)	_DL_TYPES_6(a, b, c, d, e, f) | _DL_T(6, g)
+#define _DL_TYPES_8(a, b, c, d, e, f, g, h)	_DL_TYPES_7(a, b, c, d, e, f, g) | _DL_T(7, h)
+#define _DL_TYPES_9(a, b, c, d, e, f, g, h, i)	_DL_TYPES_8(a, b, c, d, e, f, g, h) | _DL_T(8, i)
+#define _DL_TYPES_10(a, b, c, d, e, f, g, h, i, j)	_DL_TYPES_9(a, b, c, d, e, f, g, h, i) | _DL_T(9, j)
+#define _DL_NARGS(...)					_DL_NARGS_(_0, ## __VA_ARGS__, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define _DL_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, n, ...)	n
+#define _DL_CAT(a, b)					a ## b
+#define _DL_TYPES(n, ...)				_DL_CAT(_DL_TYPES_, n)(__VA_ARGS__)
+
+// Argument count in the top 4 bits, the types below
+#define DEFERRED_LOG_TYPES(...)	(((uint32_t) _DL_NARGS(__VA_ARGS__) << 28) | (_DL_TYPES(_DL_NARGS(__VA_ARGS__), ## __VA_ARGS__)))
+
+#define DEFERRED_LOG(format, ...) do {																\
+	static const char _log_fmt[] __attribute__((section("logfmt"), used)) = format;				\
+	deferred_log_write(_log_fmt, DEFERRED_LOG_TYPES(__VA_ARGS__), ## __VA_ARGS__);				\
+} while (0)
+
+// Records one message into the ring of the calling core, from any task or ISR. Drops it when the ring is full.
+void deferred_log_write(const char *format, uint32_t types, ...);
+
+// Moves whole frames out of the rings into buf, returns the bytes written. Called by the logger task only.
+size_t deferred_log_drain(uint8_t *buf, size_t size);
@@ -1,20 +1,58 @@
+#include <string.h>
 #include "pio_uart_logger.h"
 #include "pico/stdio_uart.h"
 #include "FreeRTOS.h"
 #include "task.h"
-#include "stream_buffer.h"
 #include "hardware/dma.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
 #include "uart_tx.pio.h"
 #include "semphr.h"
 #include "pico/stdio/driver.h"
+#include "deferred_log.h"
+#include "bridge_stats.h"
 
 #define PIO_DMA_IRQ (DMA_IRQ_1)
 
+/*
+ * Every core has two rings, one for tasks and one for ISRs, and only ever writes into its own. A writer masks
+ * the interrupts of its core just long enough to reserve space and write the record header, the text is copied
+ * with interrupts enabled and the record is marked ready afterwards. Nothing is shared with the other core, so
+ * a log line from one core never holds up the other. The logger task takes the ready records of all rings
+ * oldest first.
+ *
+ * Records are LOG_RECORD_ALIGN aligned so a header never wraps around the end of a ring. A record that is
+ * still being written holds back the ones behind it in the same ring.
+ */
+#define LOG_RING_TASK			0
+#define LOG_RING_ISR			1
+#define LOG_RECORD_ALIGN		8
+#define LOG_RECORD_MAX_TEXT		256
+
+_Static_assert((LOGGER_RING_SIZE & (LOGGER_RING_SIZE - 1)) == 0, "LOGGER_RING_SIZE must be a power of two");
+_Static_assert(LOGGER_RING_SIZE >= 2 * (LOG_RECORD_MAX_TEXT + LOG_RECORD_ALIGN), "LOGGER_RING_SIZE is too small");
+
+typedef struct
+{
+	uint32_t time_us;
+	uint16_t len;
+	volatile uint8_t ready;
+	uint8_t reserved;
+} log_record_t;
+
+_Static_assert(sizeof(log_record_t) == LOG_RECORD_ALIGN, "log_record_t must be LOG_RECORD_ALIGN bytes");
+
+typedef struct
+{
+	uint8_t buf[LOGGER_RING_SIZE] __attribute__((aligned(LOG_RECORD_ALIGN)));
+	volatile uint32_t head;		// written by the owning core
+	volatile uint32_t tail;		// written by the logger task
+	volatile uint32_t dropped;	// bytes, written by the owning core
+} log_ring_t;
 
 typedef struct _logger_t
 {
 	TaskHandle_t task_handle;
-	StreamBufferHandle_t stream_handle;
 	bool is_ready;
 	uint32_t dma_chan;
 	PIO pio;
@@ -26,24 +64,96 @@ typedef struct _logger_t
 }logger_t;
 
 static logger_t logger;
+static log_ring_t log_rings[NUM_CORES][2];
+
+static void __not_in_flash_func(log_ring_write)(const char *buf, uint32_t len)
+{
+	const uint32_t size = (sizeof(log_record_t) + len + LOG_RECORD_ALIGN - 1) & ~(LOG_RECORD_ALIGN - 1);
+	const uint32_t time_us = time_us_32();
+
+	// The ring can only be picked with interrupts masked, a task could move to the other core otherwise
+	const uint32_t irq = save_and_disable_interrupts();
+	log_ring_t *ring = &log_rings[get_core_num()][portCHECK_IF_IN_ISR() ? LOG_RING_ISR : LOG_RING_TASK];
+	const uint32_t head = ring->head;
+	if (LOGGER_RING_SIZE - (head - ring->tail) < size)
+	{
+		ring->dropped += len;
+		restore_interrupts(irq);
+		return;
+	}
+	log_record_t *record = (log_record_t *) &ring->buf[head & (LOGGER_RING_SIZE - 1)];
+	record->time_us = time_us;
+	record->len = len;
+	record->ready = false;
+	// The reader must not see the new head before the record is marked as not ready
+	__dmb();
+	ring->head = head + size;
+	bridge_stats_level(STATS_BUF_LOG, head + size - ring->tail);
+	restore_interrupts(irq);
+
+	const uint32_t pos = (head + sizeof(log_record_t)) & (LOGGER_RING_SIZE - 1);
+	const uint32_t first = MIN(len, LOGGER_RING_SIZE - pos);
+	memcpy(&ring->buf[pos], buf, first);
+	memcpy(ring->buf, buf + first, len - first);
+	__dmb();
+	record->ready = true;
+}
 
 static void __not_in_flash_func(pio_uart_log_func)(const char *buf, int len)
 {
 	if (!logger.is_ready) return;
-	
-	if (portCHECK_IF_IN_ISR())
+
+	while (len > 0)
 	{
-		BaseType_t higherPriorityTaskWoken;
-		portENTER_CRITICAL();
-		xStreamBufferSendFromISR(logger.stream_handle, buf, len, &higherPriorityTaskWoken);
-		portEXIT_CRITICAL();
-		portYIELD_FROM_ISR(higherPriorityTaskWoken);
+		const int chunk = MIN(len, LOG_RECORD_MAX_TEXT);
+		log_ring_write(buf, chunk);
+		buf += chunk;
+		len -= chunk;
 	}
-	else
+}
+
+// Moves the ready records of all rings into buf, oldest first, and returns the bytes written
+static size_t log_rings_drain(uint8_t *buf, size_t size)
+{
+	size_t out = 0;
+
+	for (;;)
 	{
-		portENTER_CRITICAL();
-		xStreamBufferSend(logger.stream_handle, buf, len, 0);
-		portEXIT_CRITICAL();
+		log_ring_t *oldest = NULL;
+		const log_record_t *oldest_record = NULL;
+
+		for (uint core = 0; core < NUM_CORES; core++)
+		{
+			for (uint ctx = 0; ctx < 2; ctx++)
+			{
+				log_ring_t *ring = &log_rings[core][ctx];
+				if (ring->tail == ring->head)
+					continue;
+				const log_record_t *record = (const log_record_t *) &ring->buf[ring->tail & (LOGGER_RING_SIZE - 1)];
+				if (!record->ready)
+					continue;
+				if (!oldest_record || (int32_t) (record->time_us - oldest_record->time_us) < 0)
+				{
+					oldest = ring;
+					oldest_record = record;
+				}
+			}
+		}
+		if (!oldest || out + oldest_record->len > size)
+			return out;
+
+		// The text has to be read after the ready flag
+		__dmb();
+		const uint32_t len = oldest_record->len;
+		const uint32_t pos = (oldest->tail + sizeof(log_record_t)) & (LOGGER_RING_SIZE - 1);
+		const uint32_t first = MIN(len, LOGGER_RING_SIZE - pos);
+		memcpy(&buf[out], &oldest->buf[pos], first);
+		memcpy(&buf[out + first], oldest->buf, len - first);
+		out += len;
+
+		// Done with the record before the writer may reuse it
+		__dmb();
+		oldest->tail += (sizeof(log_record_t) + len + LOG_RECORD_ALIGN - 1) & ~(LOG_RECORD_ALIGN - 1);
 	}
 }
 
@@ -119,38 +229,46 @@ static void stdio_pio_init(void)
 
 static void pio_uart_logger_task(void* p)
 {
-	static uint8_t temp_buffer[2][1024];
+	static uint8_t temp_buffer[2][1024] BRIDGE_DMA_BUFFER;
+	static uint32_t dropped_reported[NUM_CORES][2];
 	stdio_pio_init();
 	stdio_dma_init();
 	uint buf_index = 0;
-	size_t minSpaceAvail = UINT32_MAX;
 	logger.is_ready = true;
 	printf("welcome to esp-usb-bridge-pico programmer and debugger v%u.%u!\r\n\tBy Travis Robinson (libusbdotnet@gmail.com)\r\n", FWVER_MAJOR, FWVER_MINOR);
 
 	for (;;)
 	{
-		size_t len = xStreamBufferReceive(logger.stream_handle, temp_buffer[buf_index], sizeof(temp_buffer[0]), portMAX_DELAY /* pdMS_TO_TICKS(5000) */);
-		if (len)
+		size_t len = 0;
+
+		// Writers never wake the logger, that would take the scheduler lock. The rings are polled instead.
+		for (uint core = 0; core < NUM_CORES; core++)
 		{
-			size_t spaceAvail = xStreamBufferSpacesAvailable(logger.stream_handle);
-			if (spaceAvail < minSpaceAvail)
-				minSpaceAvail = spaceAvail;
-			
-			xSemaphoreTake(logger.dma_idle_sem, portMAX_DELAY);
-			dma_channel_set_read_addr(logger.dma_chan, temp_buffer[buf_index], false);
-			dma_channel_set_trans_count(logger.dma_chan, len, true);
-			buf_index ^= 1;
+			for (uint ctx = 0; ctx < 2; ctx++)
+			{
+				const uint32_t dropped = log_rings[core][ctx].dropped;
+				if (dropped != dropped_reported[core][ctx])
+				{
+					len += sprintf((char*)temp_buffer[buf_index] + len, "*** core %u%s: %u log bytes dropped ***\r\n",
+						core, ctx == LOG_RING_ISR ? " ISR" : "", (unsigned) (dropped - dropped_reported[core][ctx]));
+					dropped_reported[core][ctx] = dropped;
+				}
+			}
 		}
-		else
+		len += log_rings_drain(temp_buffer[buf_index] + len, sizeof(temp_buffer[0]) - len);
+#if LOG_DEFERRED_ENABLED
+		len += deferred_log_drain(temp_buffer[buf_index] + len, sizeof(temp_buffer[0]) - len);
+#endif
+		if (!len)
 		{
-			len = sprintf((char*)temp_buffer[buf_index], "Min Log Space = %u\r\n", minSpaceAvail);
-			
-			xSemaphoreTake(logger.dma_idle_sem, portMAX_DELAY);
-			dma_channel_set_read_addr(logger.dma_chan, temp_buffer[buf_index], false);
-			dma_channel_set_trans_count(logger.dma_chan, len, true);
-			buf_index ^= 1;
-			
+			vTaskDelay(pdMS_TO_TICKS(LOGGER_FLUSH_MS));
+			continue;
 		}
+
+		xSemaphoreTake(logger.dma_idle_sem, portMAX_DELAY);
+		dma_channel_set_read_addr(logger.dma_chan, temp_buffer[buf_index], false);
+		dma_channel_set_trans_count(logger.dma_chan, len, true);
+		buf_index ^= 1;
 	}
 }
 
@@ -169,6 +287,5 @@ void start_pio_uart_logger(PIO pio, uint32_t pin, uint32_t bit_rate)
 	// disable the default uart driver for stdio.  We will use our PIO uart logger
 	stdio_set_driver_enabled(&stdio_uart, false);
 
-	logger.stream_handle = xStreamBufferCreate(8192, 1);
-	xTaskCreateAffinitySet(pio_uart_logger_task, "logger_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, tskIDLE_PRIORITY+1, CORE_AFFINITY_LOGGER_TASK, &logger.task_handle);
+	xTaskCreateAffinitySet(pio_uart_logger_task, "logger_task", STACK_SIZE_FROM_BYTES(4 * 1024), NULL, PRIORITY_BACKGROUND_TASK, CORE_AFFINITY_LOGGER_TASK, &logger.task_handle);
 }
@@ -0,0 +1,172 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <pico/stdlib.h>
+#include <string.h>
+#include "ubp_config.h"
+#include "esp_log.h"
+#include "esp_loader.h"
+#include "ram_load.h"
+
+static const char *TAG = "ram_load";
+
+#define ESP_IMAGE_MAGIC                 0xE9
+#define ESP_IMAGE_HEADER_SIZE           8
+#define ESP_IMAGE_EXT_HEADER_SIZE       16
+#define ESP_SEGMENT_HEADER_SIZE         8
+#define RAM_BLOCK_SIZE                  1024
+
+typedef enum
+{
+	STATE_IMAGE_HEADER,
+	STATE_SEGMENT_HEADER,
+	STATE_SEGMENT_DATA,
+	STATE_TRAILER,			// checksum and hash, not needed for RAM
+	STATE_ERROR,
+} ram_load_state_t;
+
+static ram_load_state_t state;
+static uint32_t header_size;
+static uint32_t segments_left;
+static uint32_t segment_left;
+static uint32_t entry;
+static uint32_t buf_len;
+static uint8_t buf[RAM_BLOCK_SIZE];
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// Collects up to "want" bytes into buf, returns the number of bytes consumed
+static uint32_t collect(const uint8_t *data, uint32_t size, uint32_t want)
+{
+	const uint32_t len = MIN(size, want - buf_len);
+
+	memcpy(buf + buf_len, data, len);
+	buf_len += len;
+
+	return len;
+}
+
+static void parse_image_header(void)
+{
+	if (buf[0] != ESP_IMAGE_MAGIC || buf[1] == 0)
+	{
+		ESP_LOGE(TAG, "not an ESP application image (magic %#02x)", buf[0]);
+		state = STATE_ERROR;
+		return;
+	}
+
+	segments_left = buf[1];
+	entry = get_u32(&buf[4]);
+	ESP_LOGI(TAG, "%d segments, entry %#08x", segments_left, entry);
+	state = STATE_SEGMENT_HEADER;
+}
+
+static void parse_segment_header(void)
+{
+	const uint32_t addr = get_u32(&buf[0]);
+	segment_left = get_u32(&buf[4]);
+
+	ESP_LOGI(TAG, "segment at %#08x, %d bytes", addr, segment_left);
+	if (esp_loader_mem_start(addr, segment_left, RAM_BLOCK_SIZE) != ESP_LOADER_SUCCESS)
+	{
+		ESP_LOGE(TAG, "MEM_BEGIN at %#08x failed, is the segment linked to RAM?", addr);
+		state = STATE_ERROR;
+		return;
+	}
+
+	segments_left--;
+	state = segment_left ? STATE_SEGMENT_DATA : (segments_left ? STATE_SEGMENT_HEADER : STATE_TRAILER);
+}
+
+void ram_load_begin(bool esp8266_header)
+{
+	header_size = ESP_IMAGE_HEADER_SIZE + (esp8266_header ? 0 : ESP_IMAGE_EXT_HEADER_SIZE);
+	state = STATE_IMAGE_HEADER;
+	segments_left = 0;
+	entry = 0;
+	buf_len = 0;
+}
+
+bool ram_load_write(const uint8_t *data, uint32_t size)
+{
+	while (size > 0 && state != STATE_ERROR)
+	{
+		uint32_t used;
+
+		switch (state)
+		{
+		case STATE_IMAGE_HEADER:
+			used = collect(data, size, header_size);
+			if (buf_len == header_size)
+			{
+				buf_len = 0;
+				parse_image_header();
+			}
+			break;
+
+		case STATE_SEGMENT_HEADER:
+			used = collect(data, size, ESP_SEGMENT_HEADER_SIZE);
+			if (buf_len == ESP_SEGMENT_HEADER_SIZE)
+			{
+				buf_len = 0;
+				parse_segment_header();
+			}
+			break;
+
+		case STATE_SEGMENT_DATA:
+			used = collect(data, size, MIN(RAM_BLOCK_SIZE, segment_left));
+			if (buf_len == RAM_BLOCK_SIZE || buf_len == segment_left)
+			{
+				if (esp_loader_mem_write(buf, buf_len) != ESP_LOADER_SUCCESS)
+				{
+					ESP_LOGE(TAG, "MEM_DATA failed");
+					state = STATE_ERROR;
+					break;
+				}
+				segment_left -= buf_len;
+				buf_len = 0;
+				if (segment_left == 0)
+				{
+					state = segments_left ? STATE_SEGMENT_HEADER : STATE_TRAILER;
+				}
+			}
+			break;
+
+		default:
+			used = size;
+			break;
+		}
+
+		data += used;
+		size -= used;
+	}
+
+	return state != STATE_ERROR;
+}
+
+bool ram_load_finish(void)
+{
+	if (state != STATE_TRAILER)
+	{
+		ESP_LOGE(TAG, "image ended early (%d segments left)", segments_left + (state == STATE_SEGMENT_DATA));
+		return false;
+	}
+
+	ESP_LOGI(TAG, "starting the image at %#08x", entry);
+	return esp_loader_mem_finish(entry) == ESP_LOADER_SUCCESS;
+}
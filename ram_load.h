@@ -0,0 +1,31 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Loads an ESP application image into target RAM while it streams in, the way "esptool.py load_ram" does.
+ * The image header and segment headers are parsed on the fly; each segment goes out as MEM_BEGIN and
+ * MEM_DATA commands and ram_load_finish() jumps to the entry point with MEM_END. Every segment must be
+ * linked to RAM, the image is never written to flash.
+ */
+
+// esp8266_header: the image uses the 8 byte ESP8266 header instead of the 24 byte extended one
+void ram_load_begin(bool esp8266_header);
+bool ram_load_write(const uint8_t *data, uint32_t size);
+bool ram_load_finish(void);
@@ -0,0 +1,269 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "esp_log.h"
+#include "jtag_tap.h"
+#include "riscv_dbg.h"
+
+static const char *TAG = "riscv_dbg";
+
+#define RV_IR_LEN               5
+#define RV_IR_DTMCS             0x10
+#define RV_IR_DMI               0x11
+
+#define DTMCS_VERSION(v)        ((v) & 0xf)
+#define DTMCS_ABITS(v)          (((v) >> 4) & 0x3f)
+#define DTMCS_IDLE(v)           (((v) >> 12) & 0x7)
+#define DTMCS_DMIRESET          (1u << 16)
+
+#define DMI_OP_NOP              0
+#define DMI_OP_READ             1
+#define DMI_OP_WRITE            2
+#define DMI_STATUS_SUCCESS      0
+#define DMI_STATUS_FAILED       2
+#define DMI_STATUS_BUSY         3
+#define DMI_RETRIES             8
+
+#define DM_DATA0                0x04
+#define DM_DMCONTROL            0x10
+#define DM_DMSTATUS             0x11
+#define DM_ABSTRACTCS           0x16
+#define DM_COMMAND              0x17
+#define DM_SBCS                 0x38
+#define DM_SBADDRESS0           0x39
+#define DM_SBDATA0              0x3c
+
+#define DMCONTROL_DMACTIVE      (1u << 0)
+#define DMCONTROL_RESUMEREQ     (1u << 30)
+#define DMCONTROL_HALTREQ       (1u << 31)
+#define DMSTATUS_ALLHALTED      (1u << 9)
+#define DMSTATUS_ALLRESUMEACK   (1u << 17)
+#define ABSTRACTCS_CMDERR       (7u << 8)
+#define ABSTRACTCS_BUSY         (1u << 12)
+#define COMMAND_WRITE           (1u << 16)
+#define COMMAND_TRANSFER        (1u << 17)
+#define COMMAND_AARSIZE_32      (2u << 20)
+#define SBCS_SBERROR            (7u << 12)
+#define SBCS_SBAUTOINCREMENT    (1u << 16)
+#define SBCS_SBACCESS_32        (2u << 17)
+#define SBCS_SBREADONADDR       (1u << 20)
+#define SBCS_SBBUSYERROR        (1u << 22)
+
+#define POLL_TRIALS             100
+
+static uint32_t s_abits;
+static uint32_t s_idle;
+
+// One DMI scan, returns the status of the previous operation
+static uint32_t dmi_scan(uint32_t op, uint32_t addr, uint32_t data, uint32_t *data_out)
+{
+	const uint64_t out = ((uint64_t)addr << 34) | ((uint64_t)data << 2) | op;
+	const uint64_t in = jtag_tap_shift_dr(out, 34 + s_abits);
+
+	if (s_idle)
+		jtag_tap_idle(s_idle);
+	if (data_out)
+		*data_out = (uint32_t)(in >> 2);
+
+	return (uint32_t)(in & 3);
+}
+
+static void dmi_reset(void)
+{
+	jtag_tap_shift_ir(RV_IR_DTMCS, RV_IR_LEN);
+	jtag_tap_shift_dr(DTMCS_DMIRESET, 32);
+	jtag_tap_shift_ir(RV_IR_DMI, RV_IR_LEN);
+}
+
+static bool dmi_access(uint32_t op, uint32_t addr, uint32_t data, uint32_t *value)
+{
+	for (int retry = 0; retry < DMI_RETRIES; retry++)
+	{
+		dmi_scan(op, addr, data, NULL);
+		uint32_t status = dmi_scan(DMI_OP_NOP, 0, 0, value);
+		if (status == DMI_STATUS_SUCCESS)
+			return true;
+
+		dmi_reset();
+		if (status != DMI_STATUS_BUSY)
+			break;
+		// The DM needs more Run-Test/Idle cycles between accesses
+		s_idle++;
+	}
+
+	ESP_LOGE(TAG, "DMI %s of %#02x failed", op == DMI_OP_READ ? "read" : "write", addr);
+	return false;
+}
+
+static inline bool dmi_read(uint32_t addr, uint32_t *value)
+{
+	return dmi_access(DMI_OP_READ, addr, 0, value);
+}
+
+static inline bool dmi_write(uint32_t addr, uint32_t value)
+{
+	return dmi_access(DMI_OP_WRITE, addr, value, NULL);
+}
+
+static bool dm_poll(uint32_t addr, uint32_t mask, uint32_t expected, uint32_t *value)
+{
+	for (int trial = 0; trial < POLL_TRIALS; trial++)
+	{
+		if (!dmi_read(addr, value))
+			return false;
+		if ((*value & mask) == expected)
+			return true;
+	}
+
+	ESP_LOGE(TAG, "timeout waiting for DM reg %#02x (%#08x)", addr, *value);
+	return false;
+}
+
+static bool sbcs_check(void)
+{
+	uint32_t sbcs;
+
+	if (!dmi_read(DM_SBCS, &sbcs))
+		return false;
+	if (sbcs & (SBCS_SBBUSYERROR | SBCS_SBERROR))
+	{
+		// Both are write-1-to-clear
+		dmi_write(DM_SBCS, sbcs & (SBCS_SBBUSYERROR | SBCS_SBERROR));
+		ESP_LOGW(TAG, "system bus error, sbcs=%#08x", sbcs);
+		return false;
+	}
+
+	return true;
+}
+
+bool riscv_dbg_init(uint32_t *idcode)
+{
+	jtag_tap_reset();
+
+	// IDCODE is the instruction selected by Test-Logic-Reset
+	*idcode = (uint32_t) jtag_tap_shift_dr(0, 32);
+	if (*idcode == 0 || *idcode == 0xffffffff)
+	{
+		ESP_LOGE(TAG, "no TAP found (idcode %#08x)", *idcode);
+		return false;
+	}
+
+	jtag_tap_shift_ir(RV_IR_DTMCS, RV_IR_LEN);
+	const uint32_t dtmcs = (uint32_t) jtag_tap_shift_dr(0, 32);
+	if (DTMCS_VERSION(dtmcs) != 1)
+	{
+		ESP_LOGE(TAG, "unsupported DTM (dtmcs %#08x)", dtmcs);
+		return false;
+	}
+	s_abits = DTMCS_ABITS(dtmcs);
+	s_idle = DTMCS_IDLE(dtmcs);
+
+	jtag_tap_shift_ir(RV_IR_DMI, RV_IR_LEN);
+	ESP_LOGI(TAG, "idcode %#08x, abits %d, idle %d", *idcode, s_abits, s_idle);
+
+	return dmi_write(DM_DMCONTROL, DMCONTROL_DMACTIVE);
+}
+
+bool riscv_dbg_halt(void)
+{
+	uint32_t dmstatus;
+
+	if (!dmi_write(DM_DMCONTROL, DMCONTROL_DMACTIVE | DMCONTROL_HALTREQ))
+		return false;
+	if (!dm_poll(DM_DMSTATUS, DMSTATUS_ALLHALTED, DMSTATUS_ALLHALTED, &dmstatus))
+		return false;
+
+	return dmi_write(DM_DMCONTROL, DMCONTROL_DMACTIVE);
+}
+
+bool riscv_dbg_resume(void)
+{
+	uint32_t dmstatus;
+
+	if (!dmi_write(DM_DMCONTROL, DMCONTROL_DMACTIVE | DMCONTROL_RESUMEREQ))
+		return false;
+	if (!dm_poll(DM_DMSTATUS, DMSTATUS_ALLRESUMEACK, DMSTATUS_ALLRESUMEACK, &dmstatus))
+		return false;
+
+	return dmi_write(DM_DMCONTROL, DMCONTROL_DMACTIVE);
+}
+
+bool riscv_dbg_write_reg(uint32_t regno, uint32_t value)
+{
+	uint32_t abstractcs;
+
+	if (!dmi_write(DM_DATA0, value) ||
+	    !dmi_write(DM_COMMAND, COMMAND_AARSIZE_32 | COMMAND_TRANSFER | COMMAND_WRITE | regno) ||
+	    !dm_poll(DM_ABSTRACTCS, ABSTRACTCS_BUSY, 0, &abstractcs))
+	{
+		return false;
+	}
+
+	if (abstractcs & ABSTRACTCS_CMDERR)
+	{
+		ESP_LOGE(TAG, "writing reg %#04x failed, abstractcs=%#08x", regno, abstractcs);
+		dmi_write(DM_ABSTRACTCS, ABSTRACTCS_CMDERR);
+		return false;
+	}
+
+	return true;
+}
+
+bool riscv_dbg_write_mem(uint32_t addr, const void *data, uint32_t size)
+{
+	const uint8_t *p = data;
+
+	for (int retry = 0; retry < DMI_RETRIES; retry++)
+	{
+		if (!dmi_write(DM_SBCS, SBCS_SBACCESS_32 | SBCS_SBAUTOINCREMENT) || !dmi_write(DM_SBADDRESS0, addr))
+			return false;
+
+		// One scan per word: every scan returns the status of the previous one, so the stream only
+		// stops when the DM reports busy.
+		bool busy = false;
+		for (uint32_t offset = 0; offset < size && !busy; offset += 4)
+		{
+			uint32_t word = 0xffffffff;
+			memcpy(&word, p + offset, size - offset < 4 ? size - offset : 4);
+			busy = dmi_scan(DMI_OP_WRITE, DM_SBDATA0, word, NULL) == DMI_STATUS_BUSY;
+		}
+		busy |= dmi_scan(DMI_OP_NOP, 0, 0, NULL) == DMI_STATUS_BUSY;
+
+		if (busy)
+		{
+			dmi_reset();
+			s_idle++;
+		}
+		if (sbcs_check() && !busy)
+			return true;
+	}
+
+	ESP_LOGE(TAG, "writing %d bytes at %#08x failed", size, addr);
+	return false;
+}
+
+bool riscv_dbg_read_word(uint32_t addr, uint32_t *value)
+{
+	// Writing sbaddress0 starts the read
+	return dmi_write(DM_SBCS, SBCS_SBACCESS_32 | SBCS_SBREADONADDR) &&
+	       dmi_write(DM_SBADDRESS0, addr) &&
+	       dmi_read(DM_SBDATA0, value) &&
+	       sbcs_check();
+}
+
+bool riscv_dbg_write_word(uint32_t addr, uint32_t value)
+{
+	return riscv_dbg_write_mem(addr, &value, sizeof(value));
+}
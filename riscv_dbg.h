@@ -0,0 +1,34 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// RISC-V CSR numbers used with riscv_dbg_write_reg()
+#define RISCV_CSR_DPC           0x7b1
+
+/*
+ * Minimal RISC-V external debug (spec 0.13) access over the local JTAG engine: DTM/DMI, hart halt and
+ * resume, register writes through abstract commands and memory access through the system bus.
+ * The JTAG engine must be held with jtag_local_acquire() while any of these are used.
+ */
+bool riscv_dbg_init(uint32_t *idcode);
+bool riscv_dbg_halt(void);
+bool riscv_dbg_resume(void);
+bool riscv_dbg_write_reg(uint32_t regno, uint32_t value);
+bool riscv_dbg_write_mem(uint32_t addr, const void *data, uint32_t size);
+bool riscv_dbg_read_word(uint32_t addr, uint32_t *value);
+bool riscv_dbg_write_word(uint32_t addr, uint32_t value);
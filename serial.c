@@ -30,6 +30,9 @@
 #include "components/esp_loader/port/rp2040_port.h"
 #include "stream_buffer.h"
 #include "ws2812.h"
+#include "gang.h"
+#include "bridge_stats.h"
+#include "bridge_trace.h"
 
 static const char *TAG = "bridge_serial";
 
@@ -48,7 +51,7 @@ typedef struct _uart_dma_tx_t
 	int channel;
 	StaticSemaphore_t sem_ready_def;
 	SemaphoreHandle_t sem_ready_handle;
-	uint8_t buf[CFG_TUD_CDC_EP_BUFSIZE];
+	uint8_t buf[CFG_TUD_CDC_EP_BUFSIZE] BRIDGE_DMA_BUFFER;
 }uart_dma_tx_t;
 
 static uart_dma_tx_t uart_dma_tx;
@@ -72,8 +75,9 @@ static inline void set_esp_pin(uint pin, bool val)
 	}
 }
 
-static void dma_uart_tx_start(const uint8_t* buf, uint32_t len)
+static void BRIDGE_HOT_FUNC(dma_uart_tx_start)(const uint8_t* buf, uint32_t len)
 {
+	TRACE(TRACE_UART_TX_START, len);
 	dma_channel_set_read_addr(uart_dma_tx.channel, buf, false);
 	dma_channel_set_trans_count(uart_dma_tx.channel, len, true);
 }
@@ -86,6 +90,7 @@ static void __not_in_flash_func(dma_handler_uart_tx)(void)
 	if (dma_channel_get_irq0_status(uart_dma_tx.channel))
 	{
 		dma_channel_acknowledge_irq0(uart_dma_tx.channel);
+		TRACE(TRACE_UART_TX_DONE, 0);
 		xSemaphoreGiveFromISR(uart_dma_tx.sem_ready_handle, &higherPriorityTaskWoken);
 		portYIELD_FROM_ISR(higherPriorityTaskWoken);
 	}
@@ -138,19 +143,23 @@ static void __not_in_flash_func(uart_rx_isr)(void)
 		temp_buffer[temp_buffer_len++] = uart_getc(PROG_UART);
 		if (temp_buffer_len == sizeof(temp_buffer))
 		{
+			TRACE(TRACE_UART_RX, temp_buffer_len);
 			xStreamBufferSendFromISR(uart_to_cdc_stream_handle, temp_buffer, temp_buffer_len, &higherPriorityTaskWoken);
 			temp_buffer_len = 0;
 		}
 	}
 	if (temp_buffer_len > 0 && uart_to_cdc_stream_handle)
 	{
+		TRACE(TRACE_UART_RX, temp_buffer_len);
 		xStreamBufferSendFromISR(uart_to_cdc_stream_handle, temp_buffer, temp_buffer_len, &higherPriorityTaskWoken);
 	}
+	if (uart_to_cdc_stream_handle)
+		bridge_stats_level(STATS_BUF_UART_TO_CDC, xStreamBufferBytesAvailable(uart_to_cdc_stream_handle));
 
 	portYIELD_FROM_ISR(higherPriorityTaskWoken);
 }
 
-static void cdc_to_uart_task(void* param)
+static void BRIDGE_HOT_FUNC(cdc_to_uart_task)(void* param)
 {
 	(void)(param);
 
@@ -159,16 +168,18 @@ static void cdc_to_uart_task(void* param)
 	{
 		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 		if (!tud_inited() || !tud_ready()) continue;
-		while (tud_cdc_available())
+		while ((len = tud_cdc_available()))
 		{
+			bridge_stats_level(STATS_BUF_CDC_RX, len);
 			xSemaphoreTake(uart_dma_tx.sem_ready_handle, portMAX_DELAY);
 			len = tud_cdc_read(uart_dma_tx.buf, sizeof(uart_dma_tx.buf));
+			TRACE(TRACE_CDC_RX, len);
 			dma_uart_tx_start(uart_dma_tx.buf, len);
 		}
 	}
 }
 
-static void uart_to_cdc_task(void* param)
+static void BRIDGE_HOT_FUNC(uart_to_cdc_task)(void* param)
 {
 	uint8_t transfer_buffer[64];
 	uint32_t length;
@@ -185,19 +196,28 @@ static void uart_to_cdc_task(void* param)
 				continue;
 			}
 			uint32_t sent = tud_cdc_write(p_buf, length);
+			bridge_stats_level(STATS_BUF_CDC_TX, CFG_TUD_CDC_TX_BUFSIZE - tud_cdc_write_available());
 			length -= sent;
 			p_buf += sent;
 		}
 		tud_cdc_write_flush();
+		TRACE(TRACE_CDC_TX, p_buf - transfer_buffer);
 	}
 }
 
-void tud_cdc_rx_cb(uint8_t itf)
+void BRIDGE_HOT_FUNC(tud_cdc_rx_cb)(uint8_t itf)
 {
 	if (cdc_to_uart_task_handle)
 		xTaskNotifyGive(cdc_to_uart_task_handle);
 }
 
+#if TRACE_ENABLED
+void BRIDGE_HOT_FUNC(tud_cdc_tx_complete_cb)(uint8_t itf)
+{
+	TRACE(TRACE_CDC_TX_DONE, 0);
+}
+#endif
+
 
 void tud_cdc_line_coding_cb(const uint8_t itf, cdc_line_coding_t const *p_line_coding)
 {
@@ -294,7 +314,7 @@ void tud_cdc_line_state_cb(const uint8_t itf, const bool dtr, const bool rts)
 	}
 }
 
-static int32_t uart_read_for_loader(uint8_t* buf, uint32_t len, uint32_t timeout_ms)
+static int32_t BRIDGE_HOT_FUNC(uart_read_for_loader)(void *ctx, uint8_t* buf, uint32_t len, uint32_t timeout_ms)
 {
 	int total_transferred = 0;
 	absolute_time_t timeout_time = make_timeout_time_ms(timeout_ms);
@@ -313,24 +333,25 @@ static int32_t uart_read_for_loader(uint8_t* buf, uint32_t len, uint32_t timeout
 	return total_transferred;
 }
 
-static int32_t uart_write_for_loader(const uint8_t* buf, uint32_t len, uint32_t timeout_ms)
+static int32_t BRIDGE_HOT_FUNC(uart_write_for_loader)(void *ctx, const uint8_t* buf, uint32_t len, uint32_t timeout_ms)
 {
 	xSemaphoreTake(uart_dma_tx.sem_ready_handle, portMAX_DELAY);
 	dma_uart_tx_start(buf, len);
 	return len;
 }
 
-static uint32_t uart_set_baudrate_for_loader(uint32_t baudrate)
+static uint32_t uart_set_baudrate_for_loader(void *ctx, uint32_t baudrate)
 {
-	return uart_set_baudrate(PROG_UART, baudrate);
+	// Go through serial_set_baudrate() so it doesn't skip the next CDC line coding change
+	return serial_set_baudrate(baudrate) ? baudrate : 0;
 }
 
-static void gpio_set_boot_pin_for_loader(bool val)
+static void gpio_set_boot_pin_for_loader(void *ctx, bool val)
 {
 	set_esp_pin(GPIO_BOOT, val);
 }
 
-static void gpio_set_rst_pin_for_loader(bool val)
+static void gpio_set_rst_pin_for_loader(void *ctx, bool val)
 {
 	set_esp_pin(GPIO_RST, val);
 }
@@ -395,9 +416,12 @@ void start_serial_task(void *pvParameters)
 
 	};
 	loader_port_rp2040_init(&loader_cfg);
+#if GANG_ENABLED
+	gang_init();
+#endif
 
-	xTaskCreateAffinitySet(uart_to_cdc_task, "uart_to_cdc", STACK_SIZE_FROM_BYTES(8 * 1024), NULL, 5, CORE_AFFINITY_SERIAL_TASK, (TaskHandle_t *)&uart_to_cdc_task_handle);
-	xTaskCreateAffinitySet(cdc_to_uart_task, "cdc_to_uart", STACK_SIZE_FROM_BYTES(8 * 1024), NULL, 5, CORE_AFFINITY_SERIAL_TASK, (TaskHandle_t *)&cdc_to_uart_task_handle);
+	xTaskCreateAffinitySet(uart_to_cdc_task, "uart_to_cdc", STACK_SIZE_FROM_BYTES(8 * 1024), NULL, PRIORITY_BRIDGE_TASK, CORE_AFFINITY_SERIAL_TASK, (TaskHandle_t *)&uart_to_cdc_task_handle);
+	xTaskCreateAffinitySet(cdc_to_uart_task, "cdc_to_uart", STACK_SIZE_FROM_BYTES(8 * 1024), NULL, PRIORITY_BRIDGE_TASK, CORE_AFFINITY_SERIAL_TASK, (TaskHandle_t *)&cdc_to_uart_task_handle);
 
 	vTaskDelete(NULL);
 }
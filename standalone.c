@@ -0,0 +1,270 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Standalone programmer.
+//
+// UF2 images are kept in the top STANDALONE_STORAGE_SIZE bytes of the bridge's own flash, below the KV store
+// when TARGET_SETTINGS_ENABLED. Images are stored as the raw 512 byte UF2 blocks they arrived in, back to back,
+// each one starting on a flash sector boundary. An image is complete when its last block is present; the first
+// location that doesn't hold block 0 of a complete image ends the store.
+//
+// Flashing a target reads the blocks straight from XIP and hands them to the same pipeline the MSC disk uses,
+// so no image is ever copied to RAM.
+
+#include <pico/stdlib.h>
+#include <string.h>
+#include "ubp_config.h"
+#include "esp_log.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "ws2812.h"
+#include "bridge_flash.h"
+#include "kv_store.h"
+#include "uf2_flash.h"
+#include "standalone.h"
+
+#if STANDALONE_ENABLED
+
+static const char *TAG = "standalone";
+
+// Below the KV store, if there is one
+#define STORAGE_OFFSET          (KV_STORE_OFFSET - STANDALONE_STORAGE_SIZE)
+#define STORAGE_END             (KV_STORE_OFFSET)
+#define TRIGGER_POLL_MS         20
+
+_Static_assert((STANDALONE_STORAGE_SIZE % FLASH_SECTOR_SIZE) == 0, "STANDALONE_STORAGE_SIZE must be a multiple of the flash sector size");
+
+typedef struct
+{
+	bool active;
+	uint32_t start;			// flash offset of block 0
+	uint32_t next_block;
+	uint32_t blocks;
+	uint32_t erased_end;	// everything below this offset (and above start) has been erased for this image
+} capture_t;
+
+static capture_t capture;
+static volatile bool capture_seen;
+static bool storage_usable;
+
+static inline bool trigger_held(void)
+{
+	return !gpio_get(STANDALONE_TRIGGER_GPIO);
+}
+
+static inline const uf2_block_t *storage_block(uint32_t offset)
+{
+	return (const uf2_block_t *) BRIDGE_FLASH_PTR(offset);
+}
+
+static inline uint32_t image_size(const uf2_block_t *first)
+{
+	return first->blocks * UF2_BLOCK_SIZE;
+}
+
+static inline uint32_t sector_align_up(uint32_t offset)
+{
+	return (offset + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+}
+
+// Returns true if a complete image starts at offset
+static bool image_valid(uint32_t offset)
+{
+	const uf2_block_t *first = storage_block(offset);
+
+	if (!uf2_is_block(first) || first->block_no != 0 || first->blocks == 0)
+		return false;
+	if (image_size(first) > STORAGE_END - offset)
+		return false;
+
+	const uf2_block_t *last = storage_block(offset + image_size(first) - UF2_BLOCK_SIZE);
+	return uf2_is_block(last) && last->block_no == first->blocks - 1;
+}
+
+// Offset right after the last complete image
+static uint32_t storage_append_offset(uint32_t *images)
+{
+	uint32_t offset = STORAGE_OFFSET;
+	uint32_t count = 0;
+
+	while (offset < STORAGE_END && image_valid(offset))
+	{
+		offset = sector_align_up(offset + image_size(storage_block(offset)));
+		count++;
+	}
+	if (images)
+		*images = count;
+
+	return offset;
+}
+
+static void storage_erase_all(void)
+{
+	ESP_LOGW(TAG, "erasing stored images");
+
+	for (uint32_t offset = STORAGE_OFFSET; offset < STORAGE_END; offset += FLASH_SECTOR_SIZE)
+	{
+		const uint32_t *p = (const uint32_t *) BRIDGE_FLASH_PTR(offset);
+		for (uint32_t i = 0; i < FLASH_SECTOR_SIZE / sizeof(uint32_t); i++)
+		{
+			if (p[i] != 0xFFFFFFFF)
+			{
+				bridge_flash_erase(offset, FLASH_SECTOR_SIZE);
+				break;
+			}
+		}
+	}
+}
+
+bool standalone_capture_block(const uf2_block_t *p)
+{
+	if (!storage_usable)
+		return false;
+
+	if (p->block_no == 0)
+	{
+		capture.active = false;
+		if (!trigger_held())
+			return false;
+
+		capture_seen = true;
+		capture.start = storage_append_offset(NULL);
+		capture.blocks = p->blocks;
+		capture.next_block = 0;
+		capture.erased_end = capture.start;
+
+		if (capture.start >= STORAGE_END || image_size(p) > STORAGE_END - capture.start)
+		{
+			ESP_LOGE(TAG, "no room for an image of %d blocks", p->blocks);
+			// Swallow the rest of the copy instead of flashing the target by surprise
+			capture.blocks = 0;
+		}
+		capture.active = true;
+		ws2812_set_rgb_state(RGB_LED_STATE_MSC_START);
+	}
+
+	if (!capture.active)
+		return false;
+
+	if (capture.blocks == 0 || p->block_no != capture.next_block || p->blocks != capture.blocks)
+	{
+		if (capture.blocks != 0)
+			ESP_LOGE(TAG, "unexpected block %d, image discarded", p->block_no);
+		capture.blocks = 0;
+		if (p->block_no == p->blocks - 1)
+		{
+			capture.active = false;
+			ws2812_set_rgb_state(RGB_LED_STATE_END);
+		}
+		return true;
+	}
+
+	const uint32_t offset = capture.start + p->block_no * UF2_BLOCK_SIZE;
+	if (offset + UF2_BLOCK_SIZE > capture.erased_end)
+	{
+		bridge_flash_erase(capture.erased_end, FLASH_SECTOR_SIZE);
+		capture.erased_end += FLASH_SECTOR_SIZE;
+	}
+	bridge_flash_program(offset, (const uint8_t *) p, UF2_BLOCK_SIZE);
+	capture.next_block++;
+
+	if (capture.next_block == capture.blocks)
+	{
+		uint32_t images;
+		storage_append_offset(&images);
+		ESP_LOGI(TAG, "stored image %u at %#08x, %d blocks", images, capture.start, capture.blocks);
+		capture.active = false;
+		ws2812_set_rgb_state(RGB_LED_STATE_END);
+	}
+
+	return true;
+}
+
+static void flash_stored_images(void)
+{
+	uint32_t offset = STORAGE_OFFSET;
+	uint32_t image = 0;
+
+	while (offset < STORAGE_END && image_valid(offset))
+	{
+		const uf2_block_t *first = storage_block(offset);
+
+		ESP_LOGI(TAG, "flashing image %u, %d blocks", image, first->blocks);
+		for (uint32_t block = 0; block < first->blocks; block++)
+		{
+			if (uf2_flash_block(storage_block(offset + block * UF2_BLOCK_SIZE), STANDALONE_FLASH_BAUDRATE) != UF2_FLASH_OK)
+			{
+				ESP_LOGE(TAG, "image %u failed at block %u", image, block);
+				return;
+			}
+		}
+
+		offset = sector_align_up(offset + image_size(first));
+		image++;
+	}
+
+	ESP_LOGI(TAG, "%u images flashed", image);
+}
+
+void standalone_task(void *pvParameters)
+{
+	gpio_init(STANDALONE_TRIGGER_GPIO);
+	gpio_set_dir(STANDALONE_TRIGGER_GPIO, false);
+	gpio_pull_up(STANDALONE_TRIGGER_GPIO);
+	vTaskDelay(pdMS_TO_TICKS(TRIGGER_POLL_MS));
+
+	if (STORAGE_OFFSET < bridge_flash_binary_end())
+	{
+		ESP_LOGE(TAG, "image storage at %#08x overlaps the firmware (ends at %#08x)", STORAGE_OFFSET,
+		         bridge_flash_binary_end());
+		vTaskDelete(NULL);
+	}
+
+	if (trigger_held())
+	{
+		storage_erase_all();
+		while (trigger_held())
+			vTaskDelay(pdMS_TO_TICKS(TRIGGER_POLL_MS));
+	}
+
+	uint32_t images;
+	uint32_t end = storage_append_offset(&images);
+	ESP_LOGI(TAG, "%u stored images, %u bytes free", images, STORAGE_END - end);
+	storage_usable = true;
+
+	bool pressed = false;
+	for (;;)
+	{
+		vTaskDelay(pdMS_TO_TICKS(TRIGGER_POLL_MS));
+
+		bool held = trigger_held();
+		if (held == pressed)
+			continue;
+		pressed = held;
+
+		if (pressed)
+		{
+			capture_seen = false;
+			continue;
+		}
+
+		// Flash on release, unless the trigger was only held to store an image
+		if (!capture_seen && !capture.active && !uf2_flash_busy())
+		{
+			flash_stored_images();
+		}
+	}
+}
+
+#endif // STANDALONE_ENABLED
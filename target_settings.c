@@ -0,0 +1,87 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Per target settings: targets connected through esp_loader are told apart by the factory MAC address in their
+// eFuses, the settings learned while flashing one are stored under a hash of it.
+
+#include <string.h>
+#include "ubp_config.h"
+#include "esp_log.h"
+#include "esp_loader.h"
+#include "kv_store.h"
+#include "target_settings.h"
+
+#if TARGET_SETTINGS_ENABLED
+
+static const char *TAG = "target_settings";
+
+_Static_assert(sizeof(target_settings_t) <= KV_STORE_VALUE_MAX, "target_settings_t doesn't fit a KV store value");
+
+// FNV-1a, with the top bit cleared to keep clear of TARGET_SETTINGS_CHIP_KEY()
+static uint32_t mac_key(const uint8_t *mac)
+{
+	uint32_t hash = 0x811c9dc5;
+
+	for (int i = 0; i < 6; i++)
+	{
+		hash = (hash ^ mac[i]) * 0x01000193;
+	}
+
+	return hash & 0x7fffffff;
+}
+
+// Call with esp_loader connected, returns the key to store the settings under
+uint32_t target_settings_load(target_settings_t *settings)
+{
+	const target_chip_t chip = esp_loader_get_target();
+	uint8_t mac[6];
+	static const uint8_t no_mac[6];
+	uint32_t key = TARGET_SETTINGS_CHIP_KEY(chip);
+
+	if (esp_loader_read_mac(mac) == ESP_LOADER_SUCCESS && memcmp(mac, no_mac, sizeof(mac)) != 0)
+	{
+		key = mac_key(mac);
+	}
+
+	if (!kv_store_get(key, settings, sizeof(*settings)) || settings->chip != chip)
+	{
+		memset(settings, 0, sizeof(*settings));
+		settings->chip = chip;
+	}
+	ESP_LOGI(TAG, "target %#08x: %u baud, %u bytes of flash", key, settings->uart_baudrate, settings->flash_size);
+
+	return key;
+}
+
+void target_settings_store(uint32_t key, const target_settings_t *settings)
+{
+	if (!kv_store_set(key, settings, sizeof(*settings)))
+	{
+		ESP_LOGW(TAG, "target %#08x: settings not stored", key);
+	}
+}
+
+// The rate to start flashing at: what the last session with this target fell back to, if it asked for as much
+uint32_t target_settings_baudrate(const target_settings_t *settings, uint32_t baudrate)
+{
+	if (settings->uart_baudrate != 0 && settings->uart_baudrate < baudrate && settings->uart_requested >= baudrate)
+	{
+		return settings->uart_baudrate;
+	}
+
+	return baudrate;
+}
+
+#endif
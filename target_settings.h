@@ -0,0 +1,35 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <stdint.h>
+#include "ubp_config.h"
+
+// What earlier sessions learned about a target, kept in the KV store
+typedef struct __attribute__((packed))
+{
+	uint32_t uart_baudrate;		// rate the last UF2 session finished at, 0 if never flashed
+	uint32_t uart_requested;	// rate that session asked for
+	uint32_t flash_size;		// SPI flash size, 0 if not detected yet
+	uint8_t chip;			// target_chip_t
+} target_settings_t;
+
+// Targets without a readable MAC address share one entry per chip type
+#define TARGET_SETTINGS_CHIP_KEY(chip)  (0x80000000u | (chip))
+
+uint32_t target_settings_load(target_settings_t *settings);
+void target_settings_store(uint32_t key, const target_settings_t *settings);
+uint32_t target_settings_baudrate(const target_settings_t *settings, uint32_t baudrate);
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Reads a JTAG session capture (JTAG_CAPTURE_ENABLED, see jtag_capture.h) over pyusb
+# (VEND_JTAG_CAPTURE) or from a file, and summarizes it: command bytes, control
+# requests, TDO replies and the gaps between the host's packets. Saved captures
+# play back against the host build with bridge_bench --replay.
+#
+#   jtag_capture.py --clear --save halt_step.bin
+#   jtag_capture.py halt_step.bin --records
+
+import argparse
+import struct
+import sys
+
+VID = 0x303A
+PID = 0x1002
+VEND_JTAG_CAPTURE = 20
+JTAG_CAPTURE_CLEAR = 1 << 0
+MAGIC = 0x53434a42
+VERSION = 1
+
+HEADER = struct.Struct('<IBBHIII')
+RECORD = struct.Struct('<IBBH')
+CONTROL = struct.Struct('<BBHH')
+FLAG_FLUSH = 1 << 0
+
+OUT, CONTROL_REQUEST, IN = 1, 2, 3
+REQUESTS = {0: 'SETDIV', 1: 'SETIO', 2: 'GETTDO', 3: 'SET_CHIPID'}
+
+
+def parse(data):
+    magic, version, header_size, _, capture_size, used, dropped = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError('not a JTAG capture (magic 0x{:08x}, version {})'.format(magic, version))
+    if header_size + used > len(data):
+        raise ValueError('capture truncated ({} of {} bytes)'.format(len(data), header_size + used))
+    if dropped:
+        print('{} records did not fit into the {} byte capture'.format(dropped, capture_size), file=sys.stderr)
+
+    records = []
+    pos = header_size
+    while pos < header_size + used:
+        time_us, kind, flags, size = RECORD.unpack_from(data, pos)
+        records.append((time_us, kind, flags, bytes(data[pos + RECORD.size:pos + RECORD.size + size])))
+        pos += RECORD.size + size
+    return records
+
+
+def percentile(values, p):
+    return values[min(len(values) - 1, len(values) * p // 100)] if values else 0
+
+
+def summarize(records):
+    out = [r for r in records if r[1] == OUT]
+    replies = [struct.unpack('<H', r[3])[0] for r in records if r[1] == IN]
+    flushes = sum(1 for r in records if r[1] == IN and r[2] & FLAG_FLUSH)
+    # The 32 bit timestamps wrap every 71 minutes
+    gaps = sorted((b[0] - a[0]) & 0xFFFFFFFF for a, b in zip(out, out[1:]))
+    duration = (records[-1][0] - records[0][0]) & 0xFFFFFFFF if records else 0
+    return {
+        'records': len(records),
+        'duration_us': duration,
+        'out_packets': len(out),
+        'command_bytes': sum(len(r[3]) for r in out),
+        'controls': sum(1 for r in records if r[1] == CONTROL_REQUEST),
+        'replies': len(replies),
+        'reply_bytes': sum(replies),
+        'flushes': flushes,
+        'gap_us': {'p50': percentile(gaps, 50), 'p90': percentile(gaps, 90), 'p99': percentile(gaps, 99),
+                   'max': gaps[-1] if gaps else 0},
+    }
+
+
+def read_usb(clear):
+    import usb.core
+    dev = usb.core.find(idVendor=VID, idProduct=PID)
+    if dev is None:
+        raise RuntimeError('no bridge found ({:04x}:{:04x})'.format(VID, PID))
+    return bytes(dev.ctrl_transfer(0xC0, VEND_JTAG_CAPTURE, JTAG_CAPTURE_CLEAR if clear else 0, 0, 0xFFFF))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Bridge JTAG session capture')
+    parser.add_argument('dump', nargs='?', help='saved capture, read from the bridge if omitted')
+    parser.add_argument('--clear', action='store_true', help='start a new capture after reading this one')
+    parser.add_argument('--save', metavar='FILE', help='write the capture read from the bridge to FILE')
+    parser.add_argument('--records', action='store_true', help='print the records as well')
+    args = parser.parse_args()
+
+    if args.dump:
+        with open(args.dump, 'rb') as f:
+            data = f.read()
+    else:
+        data = read_usb(args.clear)
+        if args.save:
+            with open(args.save, 'wb') as f:
+                f.write(data)
+
+    records = parse(data)
+    if args.records:
+        start = records[0][0] if records else 0
+        for time_us, kind, flags, payload in records:
+            t = (time_us - start) & 0xFFFFFFFF
+            if kind == OUT:
+                print('{:>12} OUT     {}'.format(t, payload.hex()))
+            elif kind == CONTROL_REQUEST:
+                request, _, value, index = CONTROL.unpack(payload)
+                print('{:>12} CONTROL {} value {} index {}'.format(t, REQUESTS.get(request, request), value, index))
+            elif kind == IN:
+                print('{:>12} IN      {} bytes{}'.format(t, struct.unpack('<H', payload)[0],
+                                                         ' (flush)' if flags & FLAG_FLUSH else ''))
+        print()
+
+    for key, value in summarize(records).items():
+        print('{:<14} {}'.format(key, value))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Converts a JTAG flasher stub ELF (see jtag_flash.h) into a C source providing
+# jtag_flash_stub_find(). The stub must export its jtag_flash_ctrl_t as jtag_flash_ctrl.
+#
+#   jtag_stub_to_c.py esp32c3=stub_c3.elf [esp32s3=...] -o jtag_flash_stubs.c
+#
+# Needs pyelftools.
+
+import argparse
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+FAMILIES = {
+    'esp32c3': 0xd42ba06c,
+}
+
+CTRL_SYMBOL = 'jtag_flash_ctrl'
+
+
+def load_stub(path):
+    with open(path, 'rb') as f:
+        elf = ELFFile(f)
+        symtab = elf.get_section_by_name('.symtab')
+        ctrl = symtab.get_symbol_by_name(CTRL_SYMBOL) if symtab else None
+        if not ctrl:
+            sys.exit('{}: no {} symbol'.format(path, CTRL_SYMBOL))
+
+        segments = [(seg['p_paddr'], seg.data()) for seg in elf.iter_segments()
+                    if seg['p_type'] == 'PT_LOAD' and seg['p_filesz'] > 0]
+        return elf['e_entry'], ctrl[0]['st_value'], segments
+
+
+def c_array(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append('\t' + ' '.join('0x{:02x},'.format(b) for b in data[i:i + 16]))
+    return '\n'.join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert JTAG flasher stubs to C')
+    parser.add_argument('stubs', nargs='+', metavar='CHIP=ELF', help='one of: ' + ', '.join(FAMILIES))
+    parser.add_argument('-o', '--output', required=True)
+    args = parser.parse_args()
+
+    out = ['// Generated by tools/jtag_stub_to_c.py, do not edit', '',
+           '#include <stddef.h>', '#include "jtag_flash.h"', '']
+    cases = []
+    for arg in args.stubs:
+        chip, _, path = arg.partition('=')
+        if chip not in FAMILIES or not path:
+            sys.exit('bad stub argument: ' + arg)
+
+        entry, ctrl_addr, segments = load_stub(path)
+        for n, (_, data) in enumerate(segments):
+            out += ['static const uint8_t {}_seg{}[] = {{'.format(chip, n), c_array(data), '};', '']
+        out.append('static const jtag_flash_stub_segment_t {}_segments[] = {{'.format(chip))
+        for n, (addr, data) in enumerate(segments):
+            out.append('\t{{ 0x{:08x}, {}, {}_seg{} }},'.format(addr, len(data), chip, n))
+        out += ['};', '',
+                'static const jtag_flash_stub_t {}_stub = {{'.format(chip),
+                '\t.entry = 0x{:08x},'.format(entry),
+                '\t.ctrl_addr = 0x{:08x},'.format(ctrl_addr),
+                '\t.segment_count = {},'.format(len(segments)),
+                '\t.segments = {}_segments,'.format(chip),
+                '};', '']
+        cases += ['\tcase 0x{:08x}:'.format(FAMILIES[chip]), '\t\treturn &{}_stub;'.format(chip)]
+
+    out += ['const jtag_flash_stub_t *jtag_flash_stub_find(uint32_t uf2_family)', '{',
+            '\tswitch (uf2_family)', '\t{'] + cases + ['\tdefault:', '\t\treturn NULL;', '\t}', '}', '']
+
+    with open(args.output, 'w') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
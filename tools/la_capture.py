@@ -0,0 +1,244 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Captures the bridge's pins with its logic analyzer (LA_ENABLED, see la.h) and writes
+# a sigrok session (.sr, opens in PulseView) or a VCD file, picked by the extension.
+#
+#   la_capture.py --rate 10M --samples 1M --trigger RST=1 --edge boot.sr
+#   la_capture.py --rate 1M --duration 5 --pretrigger 1000 --save-raw uart.bin uart.vcd
+#   la_capture.py --stream uart.bin uart.sr
+
+import argparse
+import struct
+import sys
+import time
+import zipfile
+
+VID = 0x303A
+PID = 0x1002
+VEND_LA = 19
+LA_CMD_START = 1
+LA_CMD_STOP = 2
+LA_CMD_STATUS = 3
+EP_IN = 0x85
+MAGIC = 0x43414c42
+VERSION = 1
+
+CHANNELS = ['TCK', 'TMS', 'TDI', 'TDO', 'TXD', 'RXD', 'BOOT', 'RST']
+TRIGGER_EDGE = 1 << 0
+CONFIG = struct.Struct('<IIIBBBB')
+HEADER = struct.Struct('<IBBHII')
+STATUS = struct.Struct('<BBHIQQ')
+ENDS = ['done', 'stopped', 'overflow: the sample stream was faster than USB',
+        'no free pio1 state machine or DMA channel']
+
+
+def parse_count(text):
+    # 10M, 2.5k, 1000
+    scale = {'k': 1e3, 'K': 1e3, 'M': 1e6, 'G': 1e9}.get(text[-1:], None)
+    return int(float(text[:-1]) * scale) if scale else int(text)
+
+
+def parse_trigger(specs):
+    mask = value = 0
+    for spec in specs:
+        name, _, level = spec.partition('=')
+        if name.upper() not in CHANNELS or level not in ('0', '1'):
+            raise ValueError('bad trigger "{}", expected CHANNEL=0|1 with CHANNEL one of {}'.format(
+                spec, ', '.join(CHANNELS)))
+        bit = 1 << CHANNELS.index(name.upper())
+        mask |= bit
+        if level == '1':
+            value |= bit
+    return mask, value
+
+
+class Stream:
+    # Incremental decoder of the la.h stream
+    def __init__(self):
+        self.data = bytearray()
+        self.header = None
+        self.runs = []
+        self.end = None
+
+    def feed(self, chunk):
+        self.data += chunk
+        if self.header is None:
+            if len(self.data) < HEADER.size:
+                return
+            magic, version, channels, header_size, rate_hz, pretrigger = HEADER.unpack_from(self.data)
+            if magic != MAGIC or version != VERSION:
+                raise ValueError('not a logic analyzer stream (magic 0x{:08x}, version {})'.format(magic, version))
+            if len(self.data) < header_size:
+                return
+            self.header = {'channels': channels, 'rate_hz': rate_hz, 'pretrigger': pretrigger}
+            del self.data[:header_size]
+
+        pos = 0
+        while self.end is None:
+            length = shift = 0
+            n = pos
+            while n < len(self.data) and self.data[n] & 0x80:
+                length |= (self.data[n] & 0x7f) << shift
+                shift += 7
+                n += 1
+            if n + 1 >= len(self.data):
+                break
+            length |= self.data[n] << shift
+            if length == 0:
+                self.end = self.data[n + 1]
+            else:
+                self.runs.append((length, self.data[n + 1]))
+            pos = n + 2
+        del self.data[:pos]
+
+
+def read_usb(args, trigger, raw):
+    import usb.core
+    dev = usb.core.find(idVendor=VID, idProduct=PID)
+    if dev is None:
+        raise RuntimeError('no bridge found ({:04x}:{:04x})'.format(VID, PID))
+
+    config = CONFIG.pack(args.rate, args.pretrigger, args.samples, trigger[0], trigger[1],
+                         TRIGGER_EDGE if args.edge else 0, 0)
+    dev.ctrl_transfer(0x40, VEND_LA, LA_CMD_START, 0, config)
+    stream = Stream()
+    start = time.monotonic()
+    stopped = False
+    try:
+        while stream.end is None:
+            if not stopped and args.duration and time.monotonic() - start >= args.duration:
+                dev.ctrl_transfer(0x40, VEND_LA, LA_CMD_STOP, 0, None)
+                stopped = True
+            try:
+                chunk = bytes(dev.read(EP_IN, 16384, timeout=200))
+            except usb.core.USBTimeoutError:
+                continue
+            if raw:
+                raw.write(chunk)
+            stream.feed(chunk)
+    except KeyboardInterrupt:
+        # Let the bridge end the stream, otherwise the next capture starts with the rest of this one
+        dev.ctrl_transfer(0x40, VEND_LA, LA_CMD_STOP, 0, None)
+        while stream.end is None:
+            chunk = bytes(dev.read(EP_IN, 16384, timeout=1000))
+            if raw:
+                raw.write(chunk)
+            stream.feed(chunk)
+
+    state, end, _, rate_hz, sampled, sent = STATUS.unpack(
+        bytes(dev.ctrl_transfer(0xC0, VEND_LA, LA_CMD_STATUS, 0, STATUS.size)))
+    print('{} samples taken, {} sent at {} Hz'.format(sampled, sent, rate_hz), file=sys.stderr)
+    return stream
+
+
+def rate_text(rate_hz):
+    for unit, scale in (('GHz', 1e9), ('MHz', 1e6), ('kHz', 1e3)):
+        if rate_hz >= scale and rate_hz % scale == 0:
+            return '{} {}'.format(rate_hz // int(scale), unit)
+    return '{} Hz'.format(rate_hz)
+
+
+def write_sr(path, stream):
+    channels = stream.header['channels']
+    metadata = ['[global]', 'sigrok version=0.5.1', '', '[device 1]', 'capturefile=logic-1',
+                'total probes={}'.format(channels), 'samplerate={}'.format(rate_text(stream.header['rate_hz'])),
+                'total analog=0']
+    metadata += ['probe{}={}'.format(n + 1, CHANNELS[n] if n < len(CHANNELS) else 'CH{}'.format(n))
+                 for n in range(channels)]
+    metadata += ['unitsize=1', '']
+    with zipfile.ZipFile(path, 'w', zipfile.ZIP_DEFLATED) as sr:
+        sr.writestr('version', '2')
+        sr.writestr('metadata', '\n'.join(metadata))
+        with sr.open('logic-1-1', 'w') as logic:
+            for length, levels in stream.runs:
+                sample = bytes([levels])
+                while length > 0:
+                    n = min(length, 1 << 20)
+                    logic.write(sample * n)
+                    length -= n
+
+
+def write_vcd(path, stream):
+    channels = stream.header['channels']
+    rate_hz = stream.header['rate_hz']
+    ids = [chr(ord('!') + n) for n in range(channels)]
+    with open(path, 'w') as vcd:
+        vcd.write('$timescale 1 ns $end\n$scope module bridge $end\n')
+        for n in range(channels):
+            vcd.write('$var wire 1 {} {} $end\n'.format(ids[n], CHANNELS[n] if n < len(CHANNELS) else 'CH{}'.format(n)))
+        vcd.write('$upscope $end\n$enddefinitions $end\n')
+        sample = 0
+        previous = None
+        for length, levels in stream.runs:
+            changed = [n for n in range(channels) if previous is None or (levels ^ previous) >> n & 1]
+            if changed:
+                vcd.write('#{}\n'.format(sample * 1000000000 // rate_hz))
+                for n in changed:
+                    vcd.write('{}{}\n'.format(levels >> n & 1, ids[n]))
+            previous = levels
+            sample += length
+        vcd.write('#{}\n'.format(sample * 1000000000 // rate_hz))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Bridge logic analyzer capture')
+    parser.add_argument('output', help='.sr (sigrok session) or .vcd file to write')
+    parser.add_argument('--rate', type=parse_count, default=1000000, help='sample rate in Hz, 10M, 250k, ...')
+    parser.add_argument('--samples', type=parse_count, default=0,
+                        help='samples to capture from the trigger on, 0: until --duration or Ctrl-C')
+    parser.add_argument('--pretrigger', type=parse_count, default=0, help='samples to keep before the trigger')
+    parser.add_argument('--trigger', action='append', default=[], metavar='CH=0|1',
+                        help='trigger condition, can be repeated, channels: ' + ', '.join(CHANNELS))
+    parser.add_argument('--edge', action='store_true', help='only trigger when the condition becomes true')
+    parser.add_argument('--duration', type=float, help='stop the capture after this many seconds')
+    parser.add_argument('--save-raw', metavar='FILE', help='also write the stream as sent by the bridge to FILE')
+    parser.add_argument('--stream', metavar='FILE', help='convert a stream saved with --save-raw instead of capturing')
+    args = parser.parse_args()
+
+    if args.stream:
+        stream = Stream()
+        with open(args.stream, 'rb') as f:
+            stream.feed(f.read())
+    else:
+        trigger = parse_trigger(args.trigger)
+        raw = open(args.save_raw, 'wb') if args.save_raw else None
+        try:
+            stream = read_usb(args, trigger, raw)
+        finally:
+            if raw:
+                raw.close()
+
+    if stream.header is None:
+        print('no samples received', file=sys.stderr)
+        return 1
+    if stream.end is None:
+        print('warning: the stream is incomplete', file=sys.stderr)
+    else:
+        print('capture ended: {}'.format(ENDS[stream.end] if stream.end < len(ENDS) else stream.end), file=sys.stderr)
+    samples = sum(length for length, _ in stream.runs)
+    print('{} samples at {} Hz, trigger at sample {}'.format(samples, stream.header['rate_hz'],
+                                                             stream.header['pretrigger']), file=sys.stderr)
+
+    if args.output.endswith('.vcd'):
+        write_vcd(args.output, stream)
+    else:
+        write_sr(args.output, stream)
+    return 0 if stream.end != 2 else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
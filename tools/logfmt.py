@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Decodes the logger UART output of a build with LOG_DEFERRED_ENABLED (see
+# pio_uart_logger/deferred_log.h). The format strings are taken from the "logfmt"
+# section of the firmware ELF, either directly or from a table extracted at build time.
+#
+#   logfmt.py extract dev_usbbridge_jtag.elf -o dev_usbbridge_jtag.logfmt
+#   logfmt.py decode --table dev_usbbridge_jtag.logfmt /dev/ttyUSB0
+#   logfmt.py decode --elf dev_usbbridge_jtag.elf --timestamps capture.bin
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+SECTION = 'logfmt'
+FRAME_START = 0x1E
+HEADER_SIZE = 8
+DROPPED = 0xFFFF
+FLAG_CORE1 = 1 << 0
+FLAG_ISR = 1 << 1
+
+CONVERSION = re.compile(r'%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|j|z|t|L)?([diouxXcspfFeEgGaA%])')
+
+
+def read_elf_section(path, name):
+    with open(path, 'rb') as f:
+        elf = f.read()
+    if elf[:4] != b'\x7fELF' or elf[5] != 1:
+        raise ValueError('{}: not a little endian ELF file'.format(path))
+    elf_class = 64 if elf[4] == 2 else 32
+    if elf_class == 64:
+        shoff, = struct.unpack_from('<Q', elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from('<HHH', elf, 0x3A)
+        shdr = '<IIQQQQIIQQ'
+    else:
+        shoff, = struct.unpack_from('<I', elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from('<HHH', elf, 0x2E)
+        shdr = '<IIIIIIIIII'
+    sections = [struct.unpack_from(shdr, elf, shoff + n * shentsize) for n in range(shnum)]
+    strtab = sections[shstrndx]
+    for sh in sections:
+        start = strtab[4] + sh[0]
+        if elf[start:elf.index(b'\0', start)].decode() == name:
+            return elf_class, elf[sh[4]:sh[4] + sh[5]]
+    return elf_class, b''
+
+
+def table_from_elf(path):
+    elf_class, data = read_elf_section(path, SECTION)
+    formats = {}
+    offset = 0
+    while offset < len(data):
+        end = data.index(b'\0', offset)
+        formats[offset] = data[offset:end].decode('utf-8', 'replace')
+        offset = end + 1
+        # Skip the padding between the strings of different objects
+        while offset < len(data) and data[offset] == 0:
+            offset += 1
+    return {'elf_class': elf_class, 'formats': formats}
+
+
+def load_table(args):
+    if args.elf:
+        return table_from_elf(args.elf)
+    with open(args.table) as f:
+        table = json.load(f)
+    table['formats'] = {int(k): v for k, v in table['formats'].items()}
+    return table
+
+
+def format_message(fmt, payload, elf_class):
+    pos = 0
+
+    def take(size, signed=False):
+        nonlocal pos
+        if pos + size > len(payload):
+            return None
+        value = int.from_bytes(payload[pos:pos + size], 'little', signed=signed)
+        pos += size
+        return value
+
+    def convert(m):
+        nonlocal pos
+        flags, width, precision, length, conv = m.groups()
+        if conv == '%':
+            return '%'
+        # Arguments the writer ran out of room for are shown as '?'
+        if width == '*':
+            width = take(4, True)
+            width = '' if width is None else str(width)
+        if precision == '*':
+            precision = take(4, True)
+            precision = None if precision is None else str(max(precision, 0))
+        spec = '%' + flags + (width or '') + ('.' + precision if precision is not None else '')
+
+        if conv == 's':
+            size = take(1)
+            if size is None or pos + size > len(payload):
+                return '?'
+            value = payload[pos:pos + size].decode('utf-8', 'replace')
+            pos += size
+            return (spec + 's') % value
+        if conv in 'fFeEgGaA':
+            value = take(8)
+            if value is None:
+                return '?'
+            value = struct.unpack('<d', struct.pack('<Q', value))[0]
+            return (spec + ('f' if conv in 'aA' else conv)) % value
+        wide = length in ('ll', 'j') or (elf_class == 64 and length in ('l', 'z', 't'))
+        value = take(8 if wide else 4, conv in 'di')
+        if value is None:
+            return '?'
+        if conv == 'p':
+            return '0x%x' % value
+        if conv == 'c':
+            return (spec + 'c') % (value & 0xFF)
+        return (spec + ('d' if conv in 'diu' else conv)) % value
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def decode_frame(frame, table, timestamps):
+    offset, length, flags, time_us = struct.unpack_from('<HBBI', frame)
+    payload = frame[HEADER_SIZE:HEADER_SIZE + length]
+    core = 1 if flags & FLAG_CORE1 else 0
+    prefix = ''
+    if timestamps:
+        prefix = '{:10.6f} C{}{} '.format(time_us / 1e6, core, ' ISR' if flags & FLAG_ISR else '')
+    if offset == DROPPED:
+        return '{}*** core {} dropped {} messages ***\n'.format(prefix, core, int.from_bytes(payload, 'little'))
+    fmt = table['formats'].get(offset)
+    if fmt is None:
+        return '{}*** unknown format 0x{:04x}: {} ***\n'.format(prefix, offset, payload.hex())
+    return prefix + format_message(fmt, payload, table['elf_class'])
+
+
+def decode(stream, out, table, timestamps):
+    pending = b''
+    while True:
+        chunk = stream.read1(4096) if hasattr(stream, 'read1') else stream.read(4096)
+        if not chunk:
+            break
+        pending += chunk
+        while pending:
+            start = pending.find(bytes([FRAME_START]))
+            if start < 0:
+                out.write(pending.decode('utf-8', 'replace'))
+                pending = b''
+                break
+            if start:
+                out.write(pending[:start].decode('utf-8', 'replace'))
+                pending = pending[start:]
+            if len(pending) < 1 + HEADER_SIZE or len(pending) < 1 + HEADER_SIZE + pending[3]:
+                break
+            end = 1 + HEADER_SIZE + pending[3]
+            out.write(decode_frame(pending[1:end], table, timestamps))
+            pending = pending[end:]
+        out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Deferred log format table extractor and decoder')
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    p = sub.add_parser('extract', help='write the format table of an ELF file')
+    p.add_argument('elf', help='firmware ELF file')
+    p.add_argument('-o', '--output', required=True, help='table file to write')
+
+    p = sub.add_parser('decode', help='decode logger output')
+    src = p.add_mutually_exclusive_group(required=True)
+    src.add_argument('--elf', help='firmware ELF file')
+    src.add_argument('--table', help='table written by extract')
+    p.add_argument('--timestamps', action='store_true', help='prefix each message with its time and core')
+    p.add_argument('input', nargs='?', default='-', help='capture file or serial device, - for stdin (default)')
+
+    args = parser.parse_args()
+
+    if args.command == 'extract':
+        table = table_from_elf(args.elf)
+        with open(args.output, 'w') as f:
+            json.dump({'elf_class': table['elf_class'], 'formats': {str(k): v for k, v in table['formats'].items()}}, f, indent=1)
+        return 0
+
+    table = load_table(args)
+    stream = sys.stdin.buffer if args.input == '-' else open(args.input, 'rb', buffering=0)
+    try:
+        decode(stream, sys.stdout, table, args.timestamps)
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Prints where the bridge spends its CPU time, from the sampling profiler (PROFILE_ENABLED, see
+# bridge_profile.h). The sampled PCs are resolved to functions with the symbol table of the firmware
+# ELF. The dump is read over pyusb (VEND_PROFILE) or from a file saved with --save or
+# bridge_bench --profile.
+#
+#   profile_report.py --reset                       start a new profile
+#   profile_report.py --elf dev_usbbridge_jtag.elf  run the workload, then report it
+#   profile_report.py profile.bin --elf dev_usbbridge_jtag.elf --addresses
+
+import argparse
+import bisect
+import json
+import struct
+import sys
+
+VID = 0x303A
+PID = 0x1002
+VEND_PROFILE = 18
+BRIDGE_PROFILE_RESET = 1 << 0
+MAGIC = 0x46525042
+VERSION = 1
+
+HEADER = struct.Struct('<IBBBBIII')
+SLOT = struct.Struct('<II')
+EM_ARM = 40
+STT_FUNC = 2
+
+# RP2040 address map
+REGIONS = [(0x00000000, 0x00004000, 'rom'), (0x10000000, 0x15000000, 'flash'), (0x20000000, 0x20042000, 'sram')]
+
+
+def parse(data):
+    magic, version, header_size, cores, slot_size, rate_hz, slots, elapsed_us = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError('not a bridge profile (magic 0x{:08x}, version {})'.format(magic, version))
+    counters = struct.unpack_from('<{}I'.format(3 * cores + 2), data, HEADER.size)
+    profile = {
+        'rate_hz': rate_hz,
+        'elapsed_us': elapsed_us,
+        'cores': [],
+        'xip_hit': counters[3 * cores],
+        'xip_acc': counters[3 * cores + 1],
+    }
+    for core in range(cores):
+        pcs = {}
+        base = header_size + core * slots * slot_size
+        for n in range(slots):
+            pc, count = SLOT.unpack_from(data, base + n * slot_size)
+            if count:
+                pcs[pc] = count
+        profile['cores'].append({'samples': counters[core], 'isr_samples': counters[cores + core],
+                                 'missed': counters[2 * cores + core], 'pcs': pcs})
+    return profile
+
+
+class Symbols:
+    def __init__(self, path=None):
+        self.starts = []
+        self.funcs = []
+        if path:
+            self.load(path)
+
+    def load(self, path):
+        with open(path, 'rb') as f:
+            elf = f.read()
+        if elf[:4] != b'\x7fELF' or elf[5] != 1:
+            raise ValueError('{}: not a little endian ELF file'.format(path))
+        machine, = struct.unpack_from('<H', elf, 0x12)
+        if elf[4] == 2:
+            shoff, = struct.unpack_from('<Q', elf, 0x28)
+            shentsize, shnum = struct.unpack_from('<HH', elf, 0x3A)
+            shdr, sym, sym_size = '<IIQQQQIIQQ', '<IBBHQQ', 24
+        else:
+            shoff, = struct.unpack_from('<I', elf, 0x20)
+            shentsize, shnum = struct.unpack_from('<HH', elf, 0x2E)
+            shdr, sym, sym_size = '<IIIIIIIIII', '<IIIBBH', 16
+        sections = [struct.unpack_from(shdr, elf, shoff + n * shentsize) for n in range(shnum)]
+        funcs = []
+        for sh in sections:
+            if sh[1] != 2:      # SHT_SYMTAB
+                continue
+            strtab = sections[sh[6]]
+            for offset in range(sh[4], sh[4] + sh[5], sym_size):
+                fields = struct.unpack_from(sym, elf, offset)
+                if elf[4] == 2:
+                    name, info, _, _, value, size = fields
+                else:
+                    name, value, size, info, _, _ = fields
+                if info & 0xF != STT_FUNC or value == 0:
+                    continue
+                if machine == EM_ARM:
+                    value &= ~1     # Thumb bit
+                start = strtab[4] + name
+                funcs.append((value, size, elf[start:elf.index(b'\0', start)].decode('utf-8', 'replace')))
+        funcs.sort()
+        self.starts = [f[0] for f in funcs]
+        self.funcs = funcs
+
+    def lookup(self, pc):
+        n = bisect.bisect_right(self.starts, pc) - 1
+        if n < 0:
+            return None, 0
+        start, size, name = self.funcs[n]
+        # A symbol without a size reaches up to the next one
+        if not size:
+            size = self.starts[n + 1] - start if n + 1 < len(self.starts) else 0
+        if pc >= start + size:
+            return None, 0
+        return name, pc - start
+
+
+def region(pc):
+    for low, high, name in REGIONS:
+        if low <= pc < high:
+            return name
+    return 'other'
+
+
+def report(profile, symbols, top, addresses):
+    cores = profile['cores']
+    total = sum(c['samples'] for c in cores)
+    funcs = {}
+    regions = {}
+    hot_pcs = {}
+    for n, core in enumerate(cores):
+        for pc, count in core['pcs'].items():
+            name, offset = symbols.lookup(pc)
+            if name is None:
+                name, offset = '0x{:08x}'.format(pc), None
+            per_core = funcs.setdefault(name, [0] * len(cores))
+            per_core[n] += count
+            regions[region(pc)] = regions.get(region(pc), 0) + count
+            hot_pcs[pc] = (hot_pcs.get(pc, (0, name, offset))[0] + count, name, offset)
+
+    result = {
+        'elapsed_s': profile['elapsed_us'] / 1e6,
+        'rate_hz': profile['rate_hz'],
+        'cores': [{k: v for k, v in c.items() if k != 'pcs'} for c in cores],
+        'regions': regions,
+        'functions': sorted(({'name': name, 'samples': sum(c), 'per_core': c} for name, c in funcs.items()),
+                            key=lambda f: -f['samples'])[:top],
+    }
+    if profile['xip_acc']:
+        result['xip_hit_rate'] = profile['xip_hit'] / profile['xip_acc']
+    if addresses:
+        result['addresses'] = [{'pc': pc, 'samples': count, 'name': name, 'offset': offset}
+                               for pc, (count, name, offset) in sorted(hot_pcs.items(), key=lambda p: -p[1][0])[:top]]
+    result['samples'] = total
+    return result
+
+
+def print_report(result):
+    for n, core in enumerate(result['cores']):
+        print('core {}: {} samples, {} in ISRs, {} without a slot'.format(n, core['samples'], core['isr_samples'], core['missed']))
+    print('over {:.3f} s at {} Hz'.format(result['elapsed_s'], result['rate_hz']))
+    if 'xip_hit_rate' in result:
+        print('XIP cache hit rate {:.1f}%'.format(100.0 * result['xip_hit_rate']))
+    total = result['samples']
+    if not total:
+        return
+    # Only meaningful for the RP2040, the host build's PCs are offsets into bridge_bench
+    if any(name != 'rom' and name != 'other' for name in result['regions']):
+        print('code in ' + ', '.join('{} {:.1f}%'.format(name, 100.0 * count / total)
+                                     for name, count in sorted(result['regions'].items(), key=lambda r: -r[1])))
+    print()
+
+    header = ''.join('{:>8}'.format('core{}'.format(n)) for n in range(len(result['cores'])))
+    print('{:>8} {:>6}{}  {}'.format('samples', '%', header, 'function'))
+    for f in result['functions']:
+        print('{:>8} {:>6.1f}{}  {}'.format(f['samples'], 100.0 * f['samples'] / total,
+                                             ''.join('{:>8}'.format(c) for c in f['per_core']), f['name']))
+    if 'addresses' in result:
+        print()
+        print('{:>8} {:>6}  {:<10}  {}'.format('samples', '%', 'pc', 'function'))
+        for a in result['addresses']:
+            where = '?' if a['offset'] is None else '{}+0x{:x}'.format(a['name'], a['offset'])
+            print('{:>8} {:>6.1f}  0x{:08x}  {}'.format(a['samples'], 100.0 * a['samples'] / total, a['pc'], where))
+
+
+def read_usb(reset):
+    import usb.core
+    dev = usb.core.find(idVendor=VID, idProduct=PID)
+    if dev is None:
+        raise RuntimeError('no bridge found ({:04x}:{:04x})'.format(VID, PID))
+    return bytes(dev.ctrl_transfer(0xC0, VEND_PROFILE, BRIDGE_PROFILE_RESET if reset else 0, 0, 0xFFFF))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Bridge sampling profiler report')
+    parser.add_argument('dump', nargs='?', help='saved profile dump, read from the bridge if omitted')
+    parser.add_argument('--elf', help='firmware ELF file to resolve the PCs with')
+    parser.add_argument('--reset', action='store_true', help='start a new profile after reading this one')
+    parser.add_argument('--save', metavar='FILE', help='write the dump read from the bridge to FILE')
+    parser.add_argument('--top', type=int, default=30, help='number of functions to list (default 30)')
+    parser.add_argument('--addresses', action='store_true', help='list the hottest PCs as well')
+    parser.add_argument('--json', action='store_true', help='print the report as JSON')
+    args = parser.parse_args()
+
+    if args.dump:
+        with open(args.dump, 'rb') as f:
+            data = f.read()
+    else:
+        data = read_usb(args.reset)
+        if args.save:
+            with open(args.save, 'wb') as f:
+                f.write(data)
+
+    result = report(parse(data), Symbols(args.elf), args.top, args.addresses)
+    if args.json:
+        print(json.dumps(result, indent=1))
+    else:
+        print_report(result)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
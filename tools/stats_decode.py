@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Reads the run time statistics of the bridge (VEND_STATS, see bridge_stats.h) and prints
+# the buffer high-water marks and, per task, the CPU load and the smallest free stack.
+# The CPU load is measured between two snapshots taken --interval seconds apart.
+# Reading the bridge needs pyusb, saved snapshots can be decoded without it.
+#
+#   stats_decode.py --interval 5
+#   stats_decode.py --reset --save before.bin
+#   stats_decode.py before.bin after.bin
+
+import argparse
+import struct
+import sys
+import time
+
+VID = 0x303A
+PID = 0x1002
+VEND_STATS = 16
+BRIDGE_STATS_RESET = 1 << 0
+MAGIC = 0x53545342
+VERSION = 2
+
+HEADER = struct.Struct('<IBBBBQI')
+BUFFER = struct.Struct('<II')
+TASK = struct.Struct('<16sIIBBH')
+
+BUFFERS = ['usb_send', 'uart_to_cdc', 'cdc_rx', 'cdc_tx', 'vendor_rx', 'vendor_tx', 'log']
+STATES = ['running', 'ready', 'blocked', 'suspended', 'deleted', 'invalid']
+
+
+def parse(data):
+    magic, version, header_size, buffer_count, task_count, time_us, run_time_total = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError('not a bridge statistics snapshot (magic 0x{:08x}, version {})'.format(magic, version))
+    pos = header_size
+    buffers = []
+    for n in range(buffer_count):
+        capacity, high_water = BUFFER.unpack_from(data, pos)
+        buffers.append((BUFFERS[n] if n < len(BUFFERS) else 'buffer{}'.format(n), capacity, high_water))
+        pos += BUFFER.size
+    tasks = {}
+    for n in range(task_count):
+        name, run_time, stack_free, priority, state, _ = TASK.unpack_from(data, pos)
+        name = name.rstrip(b'\0').decode('ascii', 'replace')
+        tasks[name] = {'run_time': run_time, 'stack_free': stack_free, 'priority': priority,
+                       'state': STATES[state] if state < len(STATES) else str(state)}
+        pos += TASK.size
+    return {'time_us': time_us, 'run_time_total': run_time_total, 'buffers': buffers, 'tasks': tasks}
+
+
+def read_usb(reset):
+    import usb.core
+    dev = usb.core.find(idVendor=VID, idProduct=PID)
+    if dev is None:
+        raise RuntimeError('no bridge found ({:04x}:{:04x})'.format(VID, PID))
+    return bytes(dev.ctrl_transfer(0xC0, VEND_STATS, BRIDGE_STATS_RESET if reset else 0, 0, 4096))
+
+
+def print_stats(first, second):
+    print('{:<12} {:>8} {:>10} {:>6}'.format('buffer', 'size', 'high water', 'use'))
+    for name, capacity, high_water in second['buffers']:
+        print('{:<12} {:>8} {:>10} {:>5.0f}%'.format(name, capacity, high_water, 100.0 * high_water / capacity))
+    print()
+
+    # The 32 bit run time counters wrap, only their differences are meaningful
+    elapsed = (second['run_time_total'] - first['run_time_total']) & 0xFFFFFFFF if first else 0
+    print('{:<16} {:>4} {:<10} {:>7} {:>11}'.format('task', 'prio', 'state', 'cpu', 'stack free'))
+    for name, task in sorted(second['tasks'].items(), key=lambda t: -t[1]['run_time']):
+        cpu = '-'
+        if elapsed and name in first['tasks']:
+            delta = (task['run_time'] - first['tasks'][name]['run_time']) & 0xFFFFFFFF
+            cpu = '{:.1f}%'.format(100.0 * delta / elapsed)
+        print('{:<16} {:>4} {:<10} {:>7} {:>11}'.format(name, task['priority'], task['state'], cpu, task['stack_free']))
+    if elapsed:
+        print('\nover {:.3f} s, the load of a task can reach 200% on two cores'.format(elapsed / 1e6))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Bridge run time statistics decoder')
+    parser.add_argument('snapshot', nargs='*', help='saved snapshots to decode (one or two) instead of reading the bridge')
+    parser.add_argument('--interval', type=float, default=1.0, help='seconds between the two snapshots taken from the bridge')
+    parser.add_argument('--reset', action='store_true', help='clear the high-water marks after reading them')
+    parser.add_argument('--save', metavar='FILE', help='write the last snapshot read from the bridge to FILE')
+    args = parser.parse_args()
+
+    if args.snapshot:
+        raw = []
+        for path in args.snapshot[:2]:
+            with open(path, 'rb') as f:
+                raw.append(f.read())
+    else:
+        raw = [read_usb(False)]
+        time.sleep(args.interval)
+        raw.append(read_usb(args.reset))
+        if args.save:
+            with open(args.save, 'wb') as f:
+                f.write(raw[-1])
+
+    snapshots = [parse(data) for data in raw]
+    print_stats(snapshots[0] if len(snapshots) > 1 else None, snapshots[-1])
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Reconstructs transaction latencies from a bridge trace (TRACE_ENABLED, see bridge_trace.h)
+# and prints a histogram per transaction type:
+#
+#   jtag     first vendor OUT packet .. the host took the TDO bytes of the CMD_FLUSH
+#   esptool  first CDC OUT packet of a command .. the target's reply went out on CDC IN
+#   uf2      one UF2 block written to the target, and the MSC write it came in
+#
+# The dump is read over pyusb (VEND_TRACE) or from a file saved with --save or
+# bridge_bench --trace.
+#
+#   trace_latency.py --clear --save trace.bin
+#   trace_latency.py trace.bin --events
+
+import argparse
+import json
+import struct
+import sys
+
+VID = 0x303A
+PID = 0x1002
+VEND_TRACE = 17
+BRIDGE_TRACE_CLEAR = 1 << 0
+MAGIC = 0x43525442
+VERSION = 1
+
+HEADER = struct.Struct('<IBBBBI')
+EVENT = struct.Struct('<IBBH')
+FLAG_CORE1 = 1 << 0
+FLAG_ISR = 1 << 1
+
+EVENTS = [None, 'VENDOR_RX', 'JTAG_DECODE_START', 'JTAG_DECODE_END', 'JTAG_DMA_START', 'JTAG_DMA_DONE',
+          'JTAG_FLUSH', 'USB_SEND_QUEUED', 'VENDOR_TX_DONE', 'CDC_RX', 'UART_TX_START', 'UART_TX_DONE',
+          'UART_RX', 'CDC_TX', 'CDC_TX_DONE', 'MSC_WRITE', 'MSC_WRITE_DONE', 'UF2_BLOCK_START', 'UF2_BLOCK_DONE']
+
+
+class Event:
+    def __init__(self, time_us, name, flags, arg):
+        self.time_us = time_us
+        self.name = name
+        self.flags = flags
+        self.arg = arg
+
+
+def parse(data):
+    magic, version, header_size, cores, event_size, ring_size = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError('not a bridge trace (magic 0x{:08x}, version {})'.format(magic, version))
+    counts = struct.unpack_from('<{}I'.format(cores), data, HEADER.size)
+    events = []
+    for core in range(cores):
+        base = header_size + core * ring_size * event_size
+        valid = min(counts[core], ring_size)
+        for n in range(counts[core] - valid, counts[core]):
+            time_us, event_id, flags, arg = EVENT.unpack_from(data, base + (n % ring_size) * event_size)
+            name = EVENTS[event_id] if event_id < len(EVENTS) else 'EVENT_{}'.format(event_id)
+            events.append(Event(time_us, name, flags, arg))
+        if counts[core] > ring_size:
+            print('core {}: {} older events were overwritten'.format(core, counts[core] - ring_size), file=sys.stderr)
+
+    # The 32 bit timestamps wrap every 71 minutes, order them relative to the newest event
+    if events:
+        newest = max(events, key=lambda e: e.time_us).time_us
+        for e in events:
+            e.time_us = newest - ((newest - e.time_us) & 0xFFFFFFFF)
+    events.sort(key=lambda e: e.time_us)
+    return events
+
+
+def jtag_transactions(events):
+    result = []
+    start = flushed = queued = decode = None
+    for e in events:
+        if e.name == 'VENDOR_RX' and start is None:
+            start, flushed, queued, decode = e.time_us, None, None, None
+        elif start is None:
+            continue
+        elif e.name == 'JTAG_DECODE_START' and decode is None:
+            decode = e.time_us
+        elif e.name == 'JTAG_FLUSH' and flushed is None:
+            flushed = e.time_us
+        elif e.name == 'USB_SEND_QUEUED' and flushed is not None and queued is None:
+            queued = e.time_us
+        elif e.name == 'VENDOR_TX_DONE' and queued is not None:
+            result.append((e.time_us - start, {
+                'usb_to_decode': (decode or start) - start,
+                'decode_to_flush': flushed - (decode or start),
+                'flush_to_queued': queued - flushed,
+                'queued_to_host': e.time_us - queued,
+            }))
+            start = None
+    return result
+
+
+def esptool_transactions(events):
+    result = []
+    start = tx_done = rx = cdc_tx = None
+    for e in events:
+        if e.name == 'CDC_RX' and start is None:
+            start, tx_done, rx, cdc_tx = e.time_us, None, None, None
+        elif start is None:
+            continue
+        elif e.name == 'UART_TX_DONE' and rx is None:
+            tx_done = e.time_us
+        elif e.name == 'UART_RX' and tx_done is not None and rx is None:
+            rx = e.time_us
+        elif e.name == 'CDC_TX' and rx is not None:
+            cdc_tx = e.time_us
+        elif e.name == 'CDC_TX_DONE' and cdc_tx is not None:
+            result.append((e.time_us - start, {
+                'usb_to_uart': tx_done - start,
+                'target': rx - tx_done,
+                'uart_to_usb': e.time_us - rx,
+            }))
+            start = None
+    return result
+
+
+def paired(events, begin, end):
+    result = []
+    started = {}
+    for e in events:
+        if e.name == begin:
+            started[e.arg] = e.time_us
+        elif e.name == end and e.arg in started:
+            result.append((e.time_us - started.pop(e.arg), {}))
+    return result
+
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def summarize(name, transactions):
+    latencies = sorted(t[0] for t in transactions)
+    summary = {'count': len(latencies)}
+    if not latencies:
+        return summary
+    summary.update({'min_us': latencies[0], 'p50_us': percentile(latencies, 50), 'p90_us': percentile(latencies, 90),
+                    'p99_us': percentile(latencies, 99), 'max_us': latencies[-1]})
+    stages = {}
+    for _, parts in transactions:
+        for stage, us in parts.items():
+            stages[stage] = stages.get(stage, 0) + us
+    summary['stages_mean_us'] = {stage: total / len(transactions) for stage, total in stages.items()}
+    # Power of two buckets: [1, 2), [2, 4), ...
+    buckets = {}
+    for us in latencies:
+        bucket = max(us, 1).bit_length() - 1
+        buckets[bucket] = buckets.get(bucket, 0) + 1
+    summary['histogram'] = {1 << b: buckets[b] for b in sorted(buckets)}
+    return summary
+
+
+def print_summary(name, summary):
+    print('{}: {} transactions'.format(name, summary['count']))
+    if not summary['count']:
+        print()
+        return
+    print('  min {min_us} us, p50 {p50_us} us, p90 {p90_us} us, p99 {p99_us} us, max {max_us} us'.format(**summary))
+    for stage, us in summary['stages_mean_us'].items():
+        print('  {:<16} {:>10.1f} us mean'.format(stage, us))
+    peak = max(summary['histogram'].values())
+    for low, count in summary['histogram'].items():
+        print('  {:>8} us {:>7} {}'.format('>= {}'.format(low), count, '#' * max(1, 50 * count // peak)))
+    print()
+
+
+def read_usb(clear):
+    import usb.core
+    dev = usb.core.find(idVendor=VID, idProduct=PID)
+    if dev is None:
+        raise RuntimeError('no bridge found ({:04x}:{:04x})'.format(VID, PID))
+    return bytes(dev.ctrl_transfer(0xC0, VEND_TRACE, BRIDGE_TRACE_CLEAR if clear else 0, 0, 0xFFFF))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Bridge transaction latency tracer')
+    parser.add_argument('dump', nargs='?', help='saved trace dump, read from the bridge if omitted')
+    parser.add_argument('--clear', action='store_true', help='empty the trace rings after reading them')
+    parser.add_argument('--save', metavar='FILE', help='write the dump read from the bridge to FILE')
+    parser.add_argument('--events', action='store_true', help='print the raw events as well')
+    parser.add_argument('--json', action='store_true', help='print the summaries as JSON')
+    args = parser.parse_args()
+
+    if args.dump:
+        with open(args.dump, 'rb') as f:
+            data = f.read()
+    else:
+        data = read_usb(args.clear)
+        if args.save:
+            with open(args.save, 'wb') as f:
+                f.write(data)
+
+    events = parse(data)
+    if args.events:
+        start = events[0].time_us if events else 0
+        for e in events:
+            print('{:>12} C{}{} {:<18} {}'.format(e.time_us - start, 1 if e.flags & FLAG_CORE1 else 0,
+                                                  ' ISR' if e.flags & FLAG_ISR else '    ', e.name, e.arg))
+        print()
+
+    summaries = {
+        'jtag': summarize('jtag', jtag_transactions(events)),
+        'esptool': summarize('esptool', esptool_transactions(events)),
+        'uf2_block': summarize('uf2_block', paired(events, 'UF2_BLOCK_START', 'UF2_BLOCK_DONE')),
+        'msc_write': summarize('msc_write', paired(events, 'MSC_WRITE', 'MSC_WRITE_DONE')),
+    }
+    if args.json:
+        print(json.dumps(summaries, indent=1))
+    else:
+        for name, summary in summaries.items():
+            print_summary(name, summary)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
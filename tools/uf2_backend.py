@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Selects the flashing backend of a UF2 file dropped on the bridge's disk by adding
+# the UF2_TAG_BRIDGE_BACKEND extension tag (see uf2_flash.h) to its first block.
+#
+#   uf2_backend.py uf2.bin jtag
+#   uf2_backend.py uf2.bin uart -o uf2_uart.bin
+
+import argparse
+import struct
+import sys
+
+UF2_BLOCK_SIZE = 512
+UF2_DATA_OFFSET = 32
+UF2_DATA_SIZE = 476
+UF2_FLAG_EXTENSION_TAGS = 0x00008000
+UF2_TAG_BRIDGE_BACKEND = 0xb7e6a1
+BACKENDS = {'uart': 0, 'jtag': 1}
+
+
+def set_backend(block, backend):
+    magic0, magic1, flags, addr, payload_size, block_no, blocks, family = struct.unpack_from('<8I', block)
+    if magic0 != 0x0A324655 or magic1 != 0x9E5D5157:
+        raise ValueError('not a UF2 file')
+
+    data = block[UF2_DATA_OFFSET:UF2_DATA_OFFSET + UF2_DATA_SIZE]
+    pos = (payload_size + 3) & ~3
+
+    # Keep every other tag, replace an existing backend tag
+    tags = b''
+    if flags & UF2_FLAG_EXTENSION_TAGS:
+        while pos + 4 <= UF2_DATA_SIZE and data[pos] != 0:
+            size = data[pos]
+            tag_type = data[pos + 1] | (data[pos + 2] << 8) | (data[pos + 3] << 16)
+            if tag_type != UF2_TAG_BRIDGE_BACKEND:
+                tags += data[pos:pos + ((size + 3) & ~3)]
+            pos += (size + 3) & ~3
+
+    tags += struct.pack('<I', 5 | (UF2_TAG_BRIDGE_BACKEND << 8)) + bytes([backend, 0, 0, 0])
+    start = (payload_size + 3) & ~3
+    if start + len(tags) + 4 > UF2_DATA_SIZE:
+        raise ValueError('no room for the tag in block 0')
+
+    data[start:start + len(tags) + 4] = tags + b'\0\0\0\0'
+    block[UF2_DATA_OFFSET:UF2_DATA_OFFSET + UF2_DATA_SIZE] = data
+    struct.pack_into('<I', block, 8, flags | UF2_FLAG_EXTENSION_TAGS)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Select the ESP USB Bridge flashing backend of a UF2 file')
+    parser.add_argument('uf2', help='UF2 file, e.g. build/uf2.bin')
+    parser.add_argument('backend', choices=BACKENDS.keys())
+    parser.add_argument('-o', '--output', help='output file (default: modify in place)')
+    args = parser.parse_args()
+
+    with open(args.uf2, 'rb') as f:
+        image = bytearray(f.read())
+    if len(image) < UF2_BLOCK_SIZE or len(image) % UF2_BLOCK_SIZE:
+        sys.exit('{}: not a UF2 file'.format(args.uf2))
+
+    block = image[:UF2_BLOCK_SIZE]
+    try:
+        set_backend(block, BACKENDS[args.backend])
+    except ValueError as e:
+        sys.exit('{}: {}'.format(args.uf2, e))
+    image[:UF2_BLOCK_SIZE] = block
+
+    with open(args.output or args.uf2, 'wb') as f:
+        f.write(image)
+
+
+if __name__ == '__main__':
+    main()
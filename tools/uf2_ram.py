@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Wraps an ESP application image linked to RAM into a UF2 file the bridge loads to
+# target RAM and starts, without touching the flash (see ram_load.h). The blocks carry
+# UF2_FLAG_NOT_MAIN_FLASH, so any other UF2 flasher skips them.
+#
+#   uf2_ram.py build/app.bin --chip esp32c3 -o app_ram.uf2
+
+import argparse
+import struct
+import sys
+
+UF2_FIRST_MAGIC = 0x0A324655
+UF2_SECOND_MAGIC = 0x9E5D5157
+UF2_FINAL_MAGIC = 0x0AB16F30
+UF2_FLAG_NOT_MAIN_FLASH = 0x00000001
+UF2_FLAG_FAMILYID_PRESENT = 0x00002000
+UF2_DATA_SIZE = 476
+PAYLOAD_SIZE = 256
+ESP_IMAGE_MAGIC = 0xE9
+
+FAMILIES = {
+    'esp8266': 0x7eab61ed,
+    'esp32': 0x1c5f21b0,
+    'esp32s2': 0xbfdd4eee,
+    'esp32c3': 0xd42ba06c,
+    'esp32s3': 0xc47e5767,
+}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert an ESP RAM application image to a RAM-load UF2')
+    parser.add_argument('image', help='application image, e.g. build/app.bin')
+    parser.add_argument('--chip', required=True, choices=FAMILIES.keys())
+    parser.add_argument('-o', '--output', required=True)
+    args = parser.parse_args()
+
+    with open(args.image, 'rb') as f:
+        image = f.read()
+    if len(image) < 8 or image[0] != ESP_IMAGE_MAGIC:
+        sys.exit('{}: not an ESP application image'.format(args.image))
+
+    blocks = (len(image) + PAYLOAD_SIZE - 1) // PAYLOAD_SIZE
+    with open(args.output, 'wb') as f:
+        for block_no in range(blocks):
+            payload = image[block_no * PAYLOAD_SIZE:(block_no + 1) * PAYLOAD_SIZE]
+            header = struct.pack('<8I', UF2_FIRST_MAGIC, UF2_SECOND_MAGIC,
+                                 UF2_FLAG_NOT_MAIN_FLASH | UF2_FLAG_FAMILYID_PRESENT,
+                                 block_no * PAYLOAD_SIZE, len(payload), block_no, blocks, FAMILIES[args.chip])
+            f.write(header + payload.ljust(UF2_DATA_SIZE, b'\0') + struct.pack('<I', UF2_FINAL_MAGIC))
+
+
+if __name__ == '__main__':
+    main()
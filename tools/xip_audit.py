@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Lists what the bridge firmware runs from XIP flash. Every function on the JTAG, serial and UF2
+# flashing paths that is still in flash is reported, with BRIDGE_HOT_PATH_IN_RAM there should be none.
+# The build writes the report next to the ELF (dev_usbbridge_jtag.xip.txt). With a profile dump
+# (tools/profile_report.py --save) the sampled time is split by where the code ran from, too.
+#
+#   xip_audit.py dev_usbbridge_jtag.elf
+#   xip_audit.py dev_usbbridge_jtag.elf --profile profile.bin --strict
+
+import argparse
+import bisect
+import fnmatch
+import struct
+import sys
+
+EM_ARM = 40
+STT_FUNC = 2
+
+FLASH = (0x10000000, 0x15000000)
+SRAM = (0x20000000, 0x20042000)
+
+# Functions of the hot paths, as fnmatch patterns
+HOT_PATH = [
+    # JTAG bridge
+    'jtag_task', 'jtag_transfer', 'jtag_flush', 'jtag_pio_dma_start_read', 'jtag_pio_dma_handler',
+    'usb_writer_task', 'usb_send', 'tud_vendor_rx_cb', 'tud_vendor_tx_cb',
+    'tud_vendor_n_*', 'vendord_*',
+    # Serial bridge
+    'cdc_to_uart_task', 'uart_to_cdc_task', 'dma_uart_tx_start', 'dma_handler_uart_tx', 'uart_rx_isr',
+    'tud_cdc_rx_cb', 'tud_cdc_tx_complete_cb', 'tud_cdc_n_*', 'cdcd_*',
+    # UF2 flashing
+    'uart_read_for_loader', 'uart_write_for_loader', 'loader_port_serial_*', 'loader_flash_data_cmd',
+    'SLIP_*', 'send_cmd', 'receive_response', 'check_response', 'compute_checksum',
+    # TinyUSB core and the RP2040 driver
+    'tud_task_ext', 'tud_task', 'usbd_*', 'dcd_*', 'hw_endpoint_*', 'tu_fifo_*', '_ff_*', 'ff_*',
+    # FreeRTOS calls of the paths above
+    'xStreamBuffer*', 'prv*StreamBuffer*', 'prvWriteBytesToBuffer', 'prvReadBytesFromBuffer', 'prvBytesInBuffer',
+    'xTaskGenericNotify*', 'xTaskGenericNotifyWait', 'ulTaskGenericNotifyTake', 'vTaskGenericNotifyGiveFromISR',
+    'xQueueGenericSend*', 'xQueueGiveFromISR', 'xQueueSemaphoreTake', 'xQueueReceive', 'vTaskSwitchContext',
+    'xTaskIncrementTick', 'xTaskResumeAll', 'vTaskSuspendAll', 'xTaskRemoveFromEventList',
+]
+
+
+def read_functions(path):
+    with open(path, 'rb') as f:
+        elf = f.read()
+    if elf[:4] != b'\x7fELF' or elf[4] != 1 or elf[5] != 1:
+        raise ValueError('{}: not a 32 bit little endian ELF file'.format(path))
+    machine, = struct.unpack_from('<H', elf, 0x12)
+    shoff, = struct.unpack_from('<I', elf, 0x20)
+    shentsize, shnum = struct.unpack_from('<HH', elf, 0x2E)
+    sections = [struct.unpack_from('<IIIIIIIIII', elf, shoff + n * shentsize) for n in range(shnum)]
+    funcs = {}
+    for sh in sections:
+        if sh[1] != 2:      # SHT_SYMTAB
+            continue
+        strtab = sections[sh[6]]
+        for offset in range(sh[4], sh[4] + sh[5], 16):
+            name, value, size, info, _, _ = struct.unpack_from('<IIIBBH', elf, offset)
+            if info & 0xF != STT_FUNC or value == 0:
+                continue
+            if machine == EM_ARM:
+                value &= ~1     # Thumb bit
+            start = strtab[4] + name
+            funcs[value] = (size, elf[start:elf.index(b'\0', start)].decode('utf-8', 'replace'))
+    return sorted((addr, size, name) for addr, (size, name) in funcs.items())
+
+
+def in_range(addr, bounds):
+    return bounds[0] <= addr < bounds[1]
+
+
+def read_profile(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    magic, version, header_size, cores, slot_size, _, slots, _ = struct.unpack_from('<IBBBBIII', data)
+    if magic != 0x46525042:
+        raise ValueError('{}: not a bridge profile dump'.format(path))
+    samples = {}
+    for n in range(cores * slots):
+        pc, count = struct.unpack_from('<II', data, header_size + n * slot_size)
+        if count:
+            samples[pc] = samples.get(pc, 0) + count
+    return samples
+
+
+def audit(funcs, samples):
+    lines = []
+    flash = [f for f in funcs if in_range(f[0], FLASH)]
+    sram = [f for f in funcs if in_range(f[0], SRAM)]
+    lines.append('code in SRAM:  {:>7} bytes, {} functions'.format(sum(f[1] for f in sram), len(sram)))
+    lines.append('code in flash: {:>7} bytes, {} functions'.format(sum(f[1] for f in flash), len(flash)))
+    lines.append('')
+
+    hot = [f for f in flash if any(fnmatch.fnmatchcase(f[2], p) for p in HOT_PATH)]
+    lines.append('hot path functions in flash: {}'.format(len(hot)))
+    for addr, size, name in hot:
+        lines.append('  0x{:08x} {:>6}  {}'.format(addr, size, name))
+
+    if samples is not None:
+        starts = [f[0] for f in funcs]
+        by_func = {}
+        where = {'flash': 0, 'sram': 0, 'other': 0}
+        for pc, count in samples.items():
+            where['flash' if in_range(pc, FLASH) else 'sram' if in_range(pc, SRAM) else 'other'] += count
+            n = bisect.bisect_right(starts, pc) - 1
+            if in_range(pc, FLASH) and n >= 0 and pc < funcs[n][0] + max(funcs[n][1], 1):
+                by_func[funcs[n][2]] = by_func.get(funcs[n][2], 0) + count
+        total = max(sum(where.values()), 1)
+        lines.append('')
+        lines.append('sampled time: ' + ', '.join('{} {:.1f}%'.format(k, 100.0 * v / total) for k, v in where.items()))
+        lines.append('functions sampled in flash:')
+        for name, count in sorted(by_func.items(), key=lambda f: -f[1])[:30]:
+            lines.append('  {:>6.1f}%  {}'.format(100.0 * count / total, name))
+    return lines, hot
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Bridge XIP flash audit')
+    parser.add_argument('elf', help='firmware ELF file')
+    parser.add_argument('-o', '--output', help='write the report to a file instead of stdout')
+    parser.add_argument('--profile', metavar='DUMP', help='profile dump saved by tools/profile_report.py --save')
+    parser.add_argument('--strict', action='store_true', help='exit with 1 when a hot path function is in flash')
+    args = parser.parse_args()
+
+    lines, hot = audit(read_functions(args.elf), read_profile(args.profile) if args.profile else None)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write('\n'.join(lines) + '\n')
+    else:
+        print('\n'.join(lines))
+    return 1 if args.strict and hot else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
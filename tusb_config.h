@@ -99,7 +99,13 @@ extern "C" {
 #define CFG_TUD_MSC               1	
 #define CFG_TUD_HID               0
 #define CFG_TUD_MIDI              0
+// JTAG, plus the logic analyzer with LA_ENABLED. ubp_config.h can't be included here, it
+// pulls this file in through bsp/board.h, so LA_ENABLED only counts as a project define.
+#ifdef LA_ENABLED
+#define CFG_TUD_VENDOR            (1 + LA_ENABLED)
+#else
 #define CFG_TUD_VENDOR            1
+#endif
 
 // Vendor FIFO size of TX and RX
 // If not configured vendor endpoints will not be buffered
@@ -115,8 +121,9 @@ extern "C" {
 // CDC Endpoint transfer buffer size, more is faster
 #define CFG_TUD_CDC_EP_BUFSIZE   (64)
 
-// MSC Buffer size of Device Mass storage
-#define CFG_TUD_MSC_EP_BUFSIZE   512
+// MSC Buffer size of Device Mass storage, a multiple of the sector size. Larger SCSI writes reach
+// tud_msc_write10_cb() eight sectors at a time, so the UF2 blocks in them are flashed in one go.
+#define CFG_TUD_MSC_EP_BUFSIZE   4096
 
 #ifdef __cplusplus
 }
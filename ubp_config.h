@@ -14,6 +14,33 @@
  */
 #define RP2040_OVERCLOCK_ENABLED (1)
 
+/*
+ * Hot paths in SRAM
+ *
+ * The JTAG, serial and UF2 flashing paths normally run from QSPI flash
+ * through the 16kB XIP cache, and every cache miss stalls them. With
+ * BRIDGE_HOT_PATH_IN_RAM the bridge functions marked BRIDGE_HOT_FUNC, the
+ * esp_loader SLIP routines and the FreeRTOS and TinyUSB objects they call are
+ * linked into SRAM instead. Set it with cmake -DBRIDGE_HOT_PATH_IN_RAM=ON,
+ * which also swaps the linker script; tools/xip_audit.py lists what is
+ * left in flash.
+ *
+ * DMA buffers (BRIDGE_DMA_BUFFER) are word aligned in SRAM0-3, which the
+ * memory map stripes word by word across the four banks, so a DMA stream
+ * spreads over all of them instead of blocking the CPU on one.
+ */
+#ifndef BRIDGE_HOT_PATH_IN_RAM
+#define BRIDGE_HOT_PATH_IN_RAM (0)
+#endif
+
+#if BRIDGE_HOT_PATH_IN_RAM
+#define BRIDGE_HOT_FUNC(func_name) __not_in_flash_func(func_name)
+#else
+#define BRIDGE_HOT_FUNC(func_name) func_name
+#endif
+
+#define BRIDGE_DMA_BUFFER __attribute__((aligned(4)))
+
 /*
  * PICO_DEFAULT_WS2812_PIN is generally defined in the boards header file for those that have it.
  * You can specify your board at the top of the parent CMakeList.txt file. 
@@ -94,6 +121,25 @@
 #define GPIO_TDO (14)
 #endif
 
+/*
+ * TCK clock plan
+ *
+ * jtag.pio takes 10 clk_sys cycles per TCK and clk_sys also clocks the UARTs
+ * and the other state machines, so the PIO clock divider is all there is to
+ * pick. An integer divider has no cycle-to-cycle jitter but only reaches
+ * clk_sys / (n * 10), the fractional one hits the requested TCK on average
+ * with one clk_sys cycle of jitter on every edge. The integer divider is
+ * taken when it comes within JTAG_TCK_INTEGER_DIV_TOLERANCE percent of the
+ * requested TCK, otherwise the fractional one; with 0 only an exact integer
+ * divider is taken. Neither runs faster than asked for. VEND_JTAG_TCK
+ * reports the plan.
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef JTAG_TCK_INTEGER_DIV_TOLERANCE
+#define JTAG_TCK_INTEGER_DIV_TOLERANCE 5
+#endif
+
 ////////////////////////////////////////////////////////////////////
 
 _Static_assert(GPIO_TMS == GPIO_TDI+1, "TDI and TMS pins must be sequential! EG: If TDI=27 then TMS must be 28");
@@ -108,6 +154,22 @@ _Static_assert(GPIO_TMS == GPIO_TDI+1, "TDI and TMS pins must be sequential! EG:
 #define CORE_AFFINITY_JTAG_TASK (1)
 #define CORE_AFFINITY_SERIAL_TASK (1)
 #define CORE_AFFINITY_MSC_TASK (1)
+#define CORE_AFFINITY_STANDALONE_TASK (1)
+#define CORE_AFFINITY_FLASH_BIN_TASK (2)
+#define CORE_AFFINITY_LA_TASK (2)
+
+/*
+ * Task priorities. The USB device task blocks on the event queue fed by the
+ * USB interrupt and only dispatches class callbacks, so it goes above the
+ * bridges to hand them their data without waiting for a time slice. TDO
+ * replies go out ahead of new JTAG work. The logic analyzer's encoder
+ * gives way to the bridges it watches.
+ */
+#define PRIORITY_USB_TASK (7)
+#define PRIORITY_USB_WRITER_TASK (6)
+#define PRIORITY_BRIDGE_TASK (5)
+#define PRIORITY_LA_TASK (4)
+#define PRIORITY_BACKGROUND_TASK (1)
 
 /**
  * @brief Chip models
@@ -164,12 +226,42 @@ typedef enum
 #define LOGGER_UART_BITRATE	(1500000)
 #endif
 
+/*
+ * Log text is buffered in a ring per core for tasks and another one for ISRs
+ * (four rings of LOGGER_RING_SIZE bytes, a power of two). The logger task
+ * polls them every LOGGER_FLUSH_MS.
+ */
+#ifndef LOGGER_RING_SIZE
+#define LOGGER_RING_SIZE	(2048)
+#endif
+
+#ifndef LOGGER_FLUSH_MS
+#define LOGGER_FLUSH_MS		(5)
+#endif
+
 /*
  * Only show warning and errors by default
  */
 #ifndef LOG_LEVEL
 #define LOG_LEVEL (ESP_LOG_NONE)
 #endif
+
+/*
+ * Deferred logging: ESP_LOGx records the format string's ID and the raw
+ * arguments into a ring of the calling core instead of calling printf(),
+ * the logger task sends the records as binary frames. Read the logger UART
+ * with tools/logfmt.py (see pio_uart_logger/deferred_log.h).
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef LOG_DEFERRED_ENABLED
+#define LOG_DEFERRED_ENABLED	(0)
+#endif
+
+// Bytes per core, a power of two
+#ifndef LOG_DEFERRED_RING_SIZE
+#define LOG_DEFERRED_RING_SIZE	(4096)
+#endif
 ////////////////////////////////////////////////////////////////////
 
 #define LOGGING_ENABLED() (LOG_LEVEL > ESP_LOG_NONE)
@@ -177,4 +269,264 @@ typedef enum
 #ifndef MSC_ENABLED
 #define MSC_ENABLED 0
 #endif
+
+/*
+ * Transaction latency tracer
+ *
+ * Records timestamped events of the JTAG, serial and MSC paths into a RAM
+ * ring of TRACE_RING_SIZE events (a power of two) per core. Read them with
+ * tools/trace_latency.py, see bridge_trace.h.
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE	(1024)
+#endif
+
+/*
+ * JTAG session capture
+ *
+ * Records the commands, control requests and reply sizes the host sends to
+ * the JTAG interface from boot on, until JTAG_CAPTURE_SIZE bytes of RAM are
+ * full. Save a capture with tools/jtag_capture.py and play it back with
+ * bridge_bench --replay, see jtag_capture.h.
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef JTAG_CAPTURE_ENABLED
+#define JTAG_CAPTURE_ENABLED 0
+#endif
+
+#ifndef JTAG_CAPTURE_SIZE
+#define JTAG_CAPTURE_SIZE	(48 * 1024)
+#endif
+
+/*
+ * Sampling profiler
+ *
+ * Counts the PC of each core PROFILE_HZ times a second into a hash table of
+ * PROFILE_SLOTS entries (a power of two) per core. Read it with
+ * tools/profile_report.py, see bridge_profile.h. The default rate is a prime
+ * so the samples don't lock onto the tick or other periodic work.
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 0
+#endif
+
+#ifndef PROFILE_HZ
+#define PROFILE_HZ		(997)
+#endif
+
+#ifndef PROFILE_SLOTS
+#define PROFILE_SLOTS	(2048)
+#endif
+
+/*
+ * FLASH.BIN
+ *
+ * A read-only FLASH.BIN file on the MSC disk holding the first
+ * MSC_FLASH_BIN_SIZE bytes of the target's SPI flash. Reading it puts the
+ * target into download mode, it is reset after MSC_FLASH_BIN_IDLE_MS without
+ * a read. Bytes past the detected flash size read as 0xFF.
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef MSC_FLASH_BIN_ENABLED
+#define MSC_FLASH_BIN_ENABLED 1
+#endif
+
+#ifndef MSC_FLASH_BIN_SIZE
+#define MSC_FLASH_BIN_SIZE	(4 * 1024 * 1024)
+#endif
+
+#ifndef MSC_FLASH_BIN_BAUDRATE
+#define MSC_FLASH_BIN_BAUDRATE	(921600)
+#endif
+
+#ifndef MSC_FLASH_BIN_IDLE_MS
+#define MSC_FLASH_BIN_IDLE_MS	(2000)
+#endif
+
+/*
+ * STATUS.TXT
+ *
+ * A read-only STATUS.TXT file on the MSC disk showing the UF2 session in
+ * progress and the MSC_STATUS_HISTORY before it: blocks written, throughput,
+ * baud rate and the time spent connecting, erasing, writing and finishing.
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef MSC_STATUS_ENABLED
+#define MSC_STATUS_ENABLED 1
+#endif
+
+#ifndef MSC_STATUS_HISTORY
+#define MSC_STATUS_HISTORY	(4)
+#endif
+
+/*
+ * UF2 flash writes
+ *
+ * Consecutive UF2 payloads are collected into FLASH_DATA commands of
+ * UF2_FLASH_WRITE_SIZE bytes when the payload size of the image divides it
+ * (256 byte payloads make 1 kB writes), otherwise every payload is a command
+ * of its own. esptool uses 1 kB with the ESP ROM loaders as well.
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef UF2_FLASH_WRITE_SIZE
+#define UF2_FLASH_WRITE_SIZE	(1024)
+#endif
+
+/*
+ * Gang programming
+ *
+ * When enabled, a UF2 dropped on the MSC disk is flashed to several targets
+ * at once. The serial programming interface above is always target 0, the
+ * targets listed in GANG_TARGETS follow it. Each one needs its own TXD, RXD,
+ * BOOT and RST pins and runs either on the PL011 UART not used by PROG_UART
+ * or on a pair of pio1 state machines (two PIO targets at most). It can't be
+ * combined with LA_ENABLED, which samples with a pio1 state machine too.
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef GANG_ENABLED
+#define GANG_ENABLED 0
+#endif
+
+#ifndef GANG_TARGETS
+#define GANG_TARGETS \
+	GANG_TARGET_UART(uart0, 16, 17, 18, 19), \
+	GANG_TARGET_PIO(8, 9, 10, 11), \
+	GANG_TARGET_PIO(12, 13, 20, 21)
+#endif
+
+#ifndef GANG_RX_BUF_SIZE
+#define GANG_RX_BUF_SIZE	(512)
+#endif
+
+/*
+ * Standalone programmer
+ *
+ * UF2 images are stored in the top STANDALONE_STORAGE_SIZE bytes of the
+ * bridge's own flash and can be flashed to the target without a host.
+ * - Hold STANDALONE_TRIGGER_GPIO low while copying a UF2 file to the MSC
+ *   disk to store it instead of flashing it.
+ * - Press and release the trigger to flash all stored images in order.
+ * - Hold the trigger while the bridge powers up to erase all stored images.
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef STANDALONE_ENABLED
+#define STANDALONE_ENABLED 0
+#endif
+
+#ifndef STANDALONE_TRIGGER_GPIO
+#define STANDALONE_TRIGGER_GPIO	(26)
+#endif
+
+#ifndef STANDALONE_STORAGE_SIZE
+#define STANDALONE_STORAGE_SIZE	(1024 * 1024)
+#endif
+
+/*
+ * Stored images are flashed at the highest rate the ESP ROM loader handles
+ * reliably without a host in the loop.
+ */
+#ifndef STANDALONE_FLASH_BAUDRATE
+#define STANDALONE_FLASH_BAUDRATE	(921600)
+#endif
+
+/*
+ * JTAG flashing (experimental)
+ *
+ * When enabled, a UF2 drop can be flashed over the JTAG pins instead of the
+ * programming UART: a flash writer stub is loaded into target RAM and fed
+ * through a ring buffer. Only RISC-V targets with a stub linked into the
+ * firmware (see jtag_flash.h) are supported, every other drop uses the UART.
+ * No stub ships with this project.
+ * UF2_DEFAULT_BACKEND is used for drops without a backend tag, see
+ * tools/uf2_backend.py.
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef JTAG_FLASH_ENABLED
+#define JTAG_FLASH_ENABLED 0
+#endif
+
+#ifndef JTAG_FLASH_TCK_HZ
+#define JTAG_FLASH_TCK_HZ	(10000000)
+#endif
+
+#ifndef UF2_DEFAULT_BACKEND
+#define UF2_DEFAULT_BACKEND	(UF2_BACKEND_UART)
+#endif
+
+/*
+ * Target settings
+ *
+ * When enabled, what flashing over the UART learns about a target is kept in
+ * a wear levelled key-value store in the last KV_STORE_SECTORS sectors of the
+ * bridge's own flash, keyed by the target's factory MAC address: the baud
+ * rate a UF2 session had to fall back to and the size of the SPI flash. The
+ * next session with that target starts at the rate that worked and FLASH.BIN
+ * skips the flash size detection. Stored standalone images move down by the
+ * size of the store.
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef TARGET_SETTINGS_ENABLED
+#define TARGET_SETTINGS_ENABLED 0
+#endif
+
+#ifndef KV_STORE_SECTORS
+#define KV_STORE_SECTORS	(2)
+#endif
+
+/*
+ * Logic analyzer
+ *
+ * When enabled, a second vendor interface samples the bridge's JTAG, UART,
+ * BOOT and RST pins with a pio1 state machine at up to LA_MAX_RATE_HZ and
+ * streams them run length encoded to tools/la_capture.py, which writes a
+ * sigrok session or a VCD file. LA_RING_SIZE bytes of RAM hold the samples
+ * in LA_SEGMENTS DMA segments, they bound the pretrigger depth and how far
+ * the encoder may fall behind on busy pins.
+ * NOTE: These can also be set with a project define or from the
+ * make command line.
+ */
+#ifndef LA_ENABLED
+#define LA_ENABLED 0
+#endif
+
+#ifndef LA_RING_SIZE
+#define LA_RING_SIZE	(32 * 1024)
+#endif
+
+#ifndef LA_SEGMENTS
+#define LA_SEGMENTS		(8)
+#endif
+
+#ifndef LA_MAX_RATE_HZ
+#define LA_MAX_RATE_HZ	(50000000)
+#endif
+
+#if STANDALONE_ENABLED && !MSC_ENABLED
+#error "STANDALONE_ENABLED needs MSC_ENABLED to store images"
+#endif
+
+#if defined(CFG_TUD_VENDOR) && CFG_TUD_VENDOR != 1 + LA_ENABLED
+#error "Set LA_ENABLED with a project define, tusb_config.h sizes the vendor interfaces before this file"
+#endif
+
+#if GANG_ENABLED && LA_ENABLED
+// pio0 is taken by JTAG, the logger and the LED, the gang targets and the sampler would share pio1
+#error "GANG_ENABLED and LA_ENABLED both need pio1 state machines"
+#endif
 #endif
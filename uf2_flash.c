@@ -0,0 +1,489 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// UF2 flashing pipeline shared by the MSC disk and the standalone programmer.
+// UF2 blocks are translated to esp-serial-flasher calls, consecutive payloads share a FLASH_DATA command.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ubp_config.h"
+#include "esp_log.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "esp_loader.h"
+#include "serial_io.h"
+#include "serial.h"
+#include "gang.h"
+#include "jtag_flash.h"
+#include "ram_load.h"
+#include "target_settings.h"
+#include "flash_status.h"
+#include "uf2_flash.h"
+
+static const char *TAG = "uf2_flash";
+
+#define UF2_FLASH_DEFAULT_BAUDRATE      PROG_UART_BITRATE
+
+static int uf2_last_block_written = -1;
+static int uf2_chunk_size;
+static int uf2_blocks;
+static uint32_t uf2_chip_id;
+static uf2_backend_t uf2_backend;
+static bool uf2_ram;
+static uint32_t uf2_baudrate;
+#if TARGET_SETTINGS_ENABLED
+static target_settings_t uf2_settings;
+static uint32_t uf2_settings_key;
+static uint32_t uf2_requested_baudrate;
+#endif
+
+// A session is owned by the task that delivered block 0 until the last block or an error
+static SemaphoreHandle_t uf2_session_handle;
+static StaticSemaphore_t uf2_session_def;
+
+static inline bool uf2_session_owned(void)
+{
+	return xSemaphoreGetMutexHolder(uf2_session_handle) == xTaskGetCurrentTaskHandle();
+}
+
+// Payloads waiting for their FLASH_DATA command, esp_loader_flash_write() pads a short last one in place.
+// The JTAG backend only uses it to pad a short block.
+static uint8_t uf2_write_buf[MAX(UF2_FLASH_WRITE_SIZE, UF2_DATA_SIZE)];
+static uint32_t uf2_write_size;
+static uint32_t uf2_write_len;
+
+bool uf2_is_block(const void *block)
+{
+	const uf2_block_t *p = (const uf2_block_t *) block;
+
+	return p->magic0 == UF2_FIRST_MAGIC && p->magic1 == UF2_SECOND_MAGIC && p->magic3 == UF2_FINAL_MAGIC;
+}
+
+const char *uf2_chipid_to_name(const uint32_t id)
+{
+	// IDs can be found at https://github.com/Microsoft/uf2
+	switch (id)
+	{
+	case UF2_ESP8266_ID:
+		return "ESP8266";
+	case 0x1c5f21b0:
+		return "ESP32";
+	case 0xbfdd4eee:
+		return "ESP32-S2";
+	case 0xd42ba06c:
+		return "ESP32-C3";
+	case 0xc47e5767:
+		return "ESP32-S3";
+	default:
+		return "unknown";
+	}
+}
+
+static bool uf2_change_baudrate(const uint32_t chip_id, const uint32_t baud)
+{
+	if (chip_id == UF2_ESP8266_ID)
+	{
+		return true;
+	}
+	// loader_port_change_baudrate() follows the target on every active gang UART
+	return (esp_loader_change_baudrate(baud) == ESP_LOADER_SUCCESS) && (loader_port_change_baudrate(baud) == ESP_LOADER_SUCCESS);
+}
+
+static uf2_backend_t uf2_block_backend(const uf2_block_t *p)
+{
+	if (!(p->flags & UF2_FLAG_EXTENSION_TAGS))
+		return UF2_DEFAULT_BACKEND;
+
+	// Tags follow the payload, word aligned: size (including the 4 byte header), 24 bit type, data
+	uint32_t pos = (p->payload_size + 3) & ~3u;
+	while (pos + 4 <= UF2_DATA_SIZE && p->data[pos] != 0)
+	{
+		const uint32_t size = p->data[pos];
+		const uint32_t type = p->data[pos + 1] | (p->data[pos + 2] << 8) | (p->data[pos + 3] << 16);
+
+		if (type == UF2_TAG_BRIDGE_BACKEND && size >= 5 && pos + 5 <= UF2_DATA_SIZE)
+			return (uf2_backend_t) p->data[pos + 4];
+		pos += (size + 3) & ~3u;
+	}
+
+	return UF2_DEFAULT_BACKEND;
+}
+
+static bool uf2_lower_baudrate(const uint32_t chip_id)
+{
+	ESP_LOGW(TAG, "Falling back from %d to %d baud", uf2_baudrate, UF2_FLASH_DEFAULT_BAUDRATE);
+	uf2_baudrate = UF2_FLASH_DEFAULT_BAUDRATE;
+	flash_status_baudrate(uf2_baudrate);
+
+	return uf2_change_baudrate(chip_id, UF2_FLASH_DEFAULT_BAUDRATE);
+}
+
+static void uf2_flash_end_session(bool ok)
+{
+	flash_status_end(ok);
+	uf2_last_block_written = -1;
+	serial_set(true);
+	xSemaphoreGive(uf2_session_handle);
+}
+
+// Leaves the target and the bridge the way the session found them, the session stays owned
+static void uf2_flash_teardown(void)
+{
+#if JTAG_FLASH_ENABLED
+	if (uf2_backend == UF2_BACKEND_JTAG)
+	{
+		jtag_flash_abort();
+	}
+	else
+#endif
+	{
+		if (uf2_baudrate != UF2_FLASH_DEFAULT_BAUDRATE)
+		{
+			uf2_change_baudrate(uf2_chip_id, UF2_FLASH_DEFAULT_BAUDRATE);
+			uf2_baudrate = UF2_FLASH_DEFAULT_BAUDRATE;
+		}
+#if GANG_ENABLED
+		gang_end();
+#endif
+	}
+	uf2_write_len = 0;
+	flash_status_end(false);
+	uf2_last_block_written = -1;
+	serial_set(true);
+}
+
+static uf2_flash_result_t uf2_flash_abort(void)
+{
+	uf2_flash_teardown();
+	xSemaphoreGive(uf2_session_handle);
+	return UF2_FLASH_ERROR;
+}
+
+// RAM images hold an ESP application image, the block address is the offset in that image
+static uf2_flash_result_t uf2_ram_block(const uf2_block_t *p)
+{
+	if (!ram_load_write(p->data, p->payload_size))
+	{
+		ESP_LOGE(TAG, "UF2 block %d of %d could not be loaded to RAM", p->block_no, p->blocks);
+		return uf2_flash_abort();
+	}
+	uf2_last_block_written = p->block_no;
+	flash_status_block(p->payload_size);
+
+	if (p->block_no == (p->blocks - 1))
+	{
+		flash_status_enter(FLASH_STATUS_FINISH);
+		// The loaded code keeps the ROM's UART settings until it sets up its own console
+		if (!uf2_change_baudrate(p->chip_id, UF2_FLASH_DEFAULT_BAUDRATE))
+		{
+			ESP_LOGW(TAG, "ESP LOADER cannot change baudrate to %d", UF2_FLASH_DEFAULT_BAUDRATE);
+		}
+		const bool started = ram_load_finish();
+#if GANG_ENABLED
+		gang_end();
+#endif
+		// No reset, that would throw the loaded code away
+		uf2_flash_end_session(started);
+		if (!started)
+		{
+			return UF2_FLASH_ERROR;
+		}
+	}
+
+	return UF2_FLASH_OK;
+}
+
+void uf2_flash_init(void)
+{
+	uf2_session_handle = xSemaphoreCreateMutexStatic(&uf2_session_def);
+}
+
+bool uf2_flash_busy(void)
+{
+	return uf2_last_block_written >= 0;
+}
+
+bool uf2_flash_claim_target(void)
+{
+	return xSemaphoreTake(uf2_session_handle, 0) == pdTRUE;
+}
+
+void uf2_flash_release_target(void)
+{
+	xSemaphoreGive(uf2_session_handle);
+}
+
+uf2_flash_result_t uf2_flash_block(const uf2_block_t *p, uint32_t flash_baudrate)
+{
+	const char *chip_name = (p->flags & UF2_FLAG_FAMILYID_PRESENT) ? uf2_chipid_to_name(p->chip_id) : "???";
+
+	if (p->flags & UF2_FLAG_MD5_PRESENT)
+	{
+		// TODO check MD5 optionally based on Kconfig option
+	}
+
+	ESP_LOGD(TAG, "UF2 block %d of %d for chip %s at %#08x with length %d", p->block_no, p->blocks,
+	         chip_name, p->addr, p->payload_size);
+
+	if (p->payload_size == 0 || p->payload_size > UF2_DATA_SIZE)
+	{
+		// Block 0 sets the chunk size of the whole image, which uf2_pad_buf and the data field have to hold
+		ESP_LOGE(TAG, "UF2 block %d has an invalid payload size of %d", p->block_no, p->payload_size);
+		return uf2_session_owned() ? uf2_flash_abort() : UF2_FLASH_ERROR;
+	}
+
+	if (p->block_no == 0)
+	{
+		if (uf2_session_owned())
+		{
+			ESP_LOGW(TAG, "Previous image was not finished, starting over");
+			// The old session still holds the JTAG engine or the UART at its flashing rate
+			uf2_flash_teardown();
+		}
+		else if (xSemaphoreTake(uf2_session_handle, 0) != pdTRUE)
+		{
+			ESP_LOGE(TAG, "Another image is being flashed!");
+			return UF2_FLASH_ERROR;
+		}
+	}
+	else if (!uf2_session_owned())
+	{
+		ESP_LOGE(TAG, "UF2 block %d without a session!", p->block_no);
+		return UF2_FLASH_ERROR;
+	}
+
+	if (uf2_last_block_written + 1 != p->block_no)
+	{
+		ESP_LOGE(TAG, "Trying to write block no. %d but last time %d was written!", p->block_no,
+		         uf2_last_block_written);
+		return uf2_flash_abort();
+	}
+
+	if (p->block_no == 0)
+	{
+		uf2_chip_id = p->chip_id;
+		uf2_chunk_size = p->payload_size;
+		uf2_blocks = p->blocks;
+		uf2_backend = uf2_block_backend(p);
+		uf2_ram = (p->flags & UF2_FLAG_NOT_MAIN_FLASH) != 0;
+		if (uf2_ram)
+		{
+			uf2_backend = UF2_BACKEND_UART;
+		}
+		flash_status_begin(p->chip_id, uf2_blocks, JTAG_FLASH_ENABLED ? uf2_backend : UF2_BACKEND_UART, uf2_ram);
+	}
+
+#if JTAG_FLASH_ENABLED
+	if (p->block_no == 0 && uf2_backend == UF2_BACKEND_JTAG)
+	{
+		// The console keeps the UART, the programming pins are only used to hold the target in reset
+		if (!jtag_flash_begin(p->chip_id, p->addr, uf2_blocks * uf2_chunk_size))
+		{
+			ESP_LOGW(TAG, "JTAG flashing not possible, using the UART");
+			uf2_backend = UF2_BACKEND_UART;
+			flash_status_backend(uf2_backend);
+		}
+		else
+		{
+			flash_status_enter(FLASH_STATUS_WRITE);
+		}
+	}
+#else
+	uf2_backend = UF2_BACKEND_UART;
+#endif
+
+	if (p->block_no == 0 && uf2_backend == UF2_BACKEND_UART)
+	{
+		serial_set(false);
+#if GANG_ENABLED
+		gang_begin();
+#endif
+
+		uf2_baudrate = UF2_FLASH_DEFAULT_BAUDRATE;
+		esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+		if (esp_loader_connect(&connect_config) != ESP_LOADER_SUCCESS)
+		{
+			ESP_LOGE(TAG, "ESP LOADER connection failed!");
+			return uf2_flash_abort();
+		}
+		ESP_LOGD(TAG, "ESP LOADER connection success!");
+
+#if TARGET_SETTINGS_ENABLED
+		// Don't try a rate again that this target already fell back from
+		uf2_settings_key = target_settings_load(&uf2_settings);
+		uf2_requested_baudrate = flash_baudrate;
+		flash_baudrate = target_settings_baudrate(&uf2_settings, flash_baudrate);
+#endif
+		if (uf2_change_baudrate(p->chip_id, flash_baudrate))
+		{
+			uf2_baudrate = flash_baudrate;
+		}
+		else
+		{
+			ESP_LOGW(TAG, "ESP LOADER cannot change baudrate to %d", flash_baudrate);
+		}
+		flash_status_baudrate(uf2_baudrate);
+		flash_status_enter(FLASH_STATUS_ERASE);
+
+		if (uf2_ram)
+		{
+			ram_load_begin(esp_loader_get_target() == ESP8266_CHIP);
+		}
+		else
+		{
+			const uint32_t image_size = uf2_blocks * uf2_chunk_size;
+			// Whole payloads per command keep every payload at its place in the image
+			uf2_write_size = (UF2_FLASH_WRITE_SIZE % uf2_chunk_size) == 0 ? UF2_FLASH_WRITE_SIZE : uf2_chunk_size;
+			uf2_write_len = 0;
+			if (esp_loader_flash_start(p->addr, image_size, uf2_write_size) != ESP_LOADER_SUCCESS)
+			{
+				ESP_LOGE(TAG, "Ereasing flash failed at addr %d of length %d with block size %d", p->addr,
+				         image_size, p->payload_size);
+				return uf2_flash_abort();
+			}
+			ESP_LOGD(TAG, "ESP LOADER flash start success!");
+		}
+		flash_status_enter(FLASH_STATUS_WRITE);
+	}
+
+	if (p->payload_size > uf2_chunk_size)
+	{
+		ESP_LOGE(TAG, "UF2 block %d is of size %d and should be at most %d", p->block_no, p->payload_size,
+		         uf2_chunk_size);
+		return uf2_flash_abort();
+	}
+
+	if (p->blocks != uf2_blocks)
+	{
+		ESP_LOGE(TAG, "UF2 block %d has %d as total block number but it should be %d", p->block_no, p->blocks,
+		         uf2_blocks);
+		return uf2_flash_abort();
+	}
+
+	if (uf2_ram)
+	{
+		return uf2_ram_block(p);
+	}
+
+	const bool last_block = p->block_no == (p->blocks - 1);
+
+#if JTAG_FLASH_ENABLED
+	if (uf2_backend == UF2_BACKEND_JTAG)
+	{
+		const uint8_t *payload = p->data;
+		if (p->payload_size < uf2_chunk_size)
+		{
+			memcpy(uf2_write_buf, p->data, p->payload_size);
+			memset(uf2_write_buf + p->payload_size, 0xff, uf2_chunk_size - p->payload_size);
+			payload = uf2_write_buf;
+		}
+		if (!jtag_flash_write(payload, uf2_chunk_size))
+		{
+			ESP_LOGE(TAG, "UF2 block %d of %d could not be written over JTAG", p->block_no, p->blocks);
+			return uf2_flash_abort();
+		}
+		uf2_last_block_written = p->block_no;
+		flash_status_block(p->payload_size);
+
+		if (last_block)
+		{
+			flash_status_enter(FLASH_STATUS_FINISH);
+			const bool ok = jtag_flash_finish();
+			uf2_flash_end_session(ok);
+			if (!ok)
+				return UF2_FLASH_ERROR;
+		}
+		return UF2_FLASH_OK;
+	}
+#endif
+
+	// A short block before the last one is padded to the chunk size, like it would be as a command of its own
+	memcpy(uf2_write_buf + uf2_write_len, p->data, p->payload_size);
+	if (!last_block && p->payload_size < uf2_chunk_size)
+	{
+		memset(uf2_write_buf + uf2_write_len + p->payload_size, 0xff, uf2_chunk_size - p->payload_size);
+	}
+	uf2_write_len += last_block ? p->payload_size : uf2_chunk_size;
+
+	if (uf2_write_len < uf2_write_size && !last_block)
+	{
+		uf2_last_block_written = p->block_no;
+		flash_status_block(p->payload_size);
+		return UF2_FLASH_OK;
+	}
+
+	esp_loader_error_t err = esp_loader_flash_write(uf2_write_buf, uf2_write_len);
+	if (err != ESP_LOADER_SUCCESS && uf2_baudrate != UF2_FLASH_DEFAULT_BAUDRATE && uf2_lower_baudrate(p->chip_id))
+	{
+		// esp_loader already resent the block a few times, one more try at the default baud rate
+		err = esp_loader_flash_write(uf2_write_buf, uf2_write_len);
+	}
+	if (err != ESP_LOADER_SUCCESS)
+	{
+		ESP_LOGE(TAG, "UF2 blocks up to %d of %d could not be written before %#08x with length %d", p->block_no,
+		         p->blocks, p->addr + p->payload_size, uf2_write_len);
+		return uf2_flash_abort();
+	}
+
+	ESP_LOGD(TAG, "ESP LOADER flash write success!");
+	uf2_write_len = 0;
+	uf2_last_block_written = p->block_no;
+	flash_status_block(p->payload_size);
+
+	if (last_block)
+	{
+		flash_status_enter(FLASH_STATUS_FINISH);
+		if (!uf2_change_baudrate(p->chip_id, UF2_FLASH_DEFAULT_BAUDRATE))
+		{
+			ESP_LOGW(TAG, "ESP LOADER cannot change baudrate to %d", UF2_FLASH_DEFAULT_BAUDRATE);
+		}
+		esp_loader_flash_finish(true);
+#if GANG_ENABLED
+		gang_end();
+#endif
+		esp_loader_reset_target();
+		uf2_flash_end_session(true);
+#if TARGET_SETTINGS_ENABLED
+		uf2_settings.uart_baudrate = uf2_baudrate;
+		uf2_settings.uart_requested = uf2_requested_baudrate;
+		target_settings_store(uf2_settings_key, &uf2_settings);
+#endif
+	}
+
+	return UF2_FLASH_OK;
+}
+
+uf2_flash_result_t uf2_flash_blocks(const uf2_block_t *blocks, uint32_t count, uint32_t flash_baudrate)
+{
+	if (count == 0)
+	{
+		return UF2_FLASH_OK;
+	}
+
+	ESP_LOGI(TAG, "UF2 blocks %d to %d of %d", blocks[0].block_no, blocks[count - 1].block_no, blocks[0].blocks);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uf2_flash_result_t result = uf2_flash_block(&blocks[i], flash_baudrate);
+		if (result != UF2_FLASH_OK)
+		{
+			return result;
+		}
+	}
+
+	return UF2_FLASH_OK;
+}
@@ -0,0 +1,101 @@
+// Copyright 2020-2021 Espressif Systems (Shanghai) CO LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UF2_BLOCK_SIZE                  512
+#define UF2_DATA_SIZE                   476
+#define UF2_FIRST_MAGIC                 0x0A324655
+#define UF2_SECOND_MAGIC                0x9E5D5157
+#define UF2_FINAL_MAGIC                 0x0AB16F30
+#define UF2_FLAG_NOT_MAIN_FLASH         0x00000001
+#define UF2_FLAG_FAMILYID_PRESENT       0x00002000
+#define UF2_FLAG_MD5_PRESENT            0x00004000
+#define UF2_FLAG_EXTENSION_TAGS         0x00008000
+
+// Extension tag selecting the flashing backend, one data byte holding a uf2_backend_t
+#define UF2_TAG_BRIDGE_BACKEND          0xb7e6a1
+
+#define UF2_ESP8266_ID                  0x7eab61ed
+
+typedef struct
+{
+	uint32_t magic0;
+	uint32_t magic1;
+	uint32_t flags;
+	uint32_t addr;
+	uint32_t payload_size;
+	uint32_t block_no;
+	uint32_t blocks;
+	uint32_t chip_id;
+	uint8_t data[UF2_DATA_SIZE];
+	uint32_t magic3;
+} uf2_block_t;
+
+_Static_assert(sizeof(uf2_block_t) == UF2_BLOCK_SIZE, "uf2_block_t must be exactly one UF2 block");
+
+typedef enum
+{
+	UF2_BACKEND_UART,		//!< esp_loader over the programming UART (and gang targets)
+	UF2_BACKEND_JTAG,		//!< Flasher stub loaded over JTAG, see jtag_flash.h
+} uf2_backend_t;
+
+typedef enum
+{
+	UF2_FLASH_OK,			//!< Block accepted
+	UF2_FLASH_ERROR,		//!< Block rejected, the session was aborted
+} uf2_flash_result_t;
+
+bool uf2_is_block(const void *block);
+const char *uf2_chipid_to_name(const uint32_t id);
+
+void uf2_flash_init(void);
+
+/*
+ * Feeds one UF2 block to the target. Block 0 connects to the target, switches to
+ * flash_baudrate and erases the image area, the last block finishes flashing and
+ * resets the target. Blocks must arrive in order.
+ *
+ * Blocks flagged UF2_FLAG_NOT_MAIN_FLASH hold an ESP application image that is
+ * loaded to target RAM and started instead, see ram_load.h.
+ *
+ * The backend is picked from the UF2_TAG_BRIDGE_BACKEND tag of block 0, or
+ * UF2_DEFAULT_BACKEND without one. A JTAG drop that can't start its stub falls
+ * back to the UART.
+ *
+ * The block is never written to, so it may point into XIP flash. Over the UART, the
+ * payloads are copied to RAM and go out UF2_FLASH_WRITE_SIZE bytes at a time, so
+ * a write error may only show up at a later block of the same command.
+ */
+uf2_flash_result_t uf2_flash_block(const uf2_block_t *block, uint32_t flash_baudrate);
+
+/*
+ * Feeds a run of UF2 blocks that arrived together, e.g. in one multi-sector MSC
+ * write, with a single log line for all of them. Stops at the first block that
+ * isn't accepted and returns its result.
+ */
+uf2_flash_result_t uf2_flash_blocks(const uf2_block_t *blocks, uint32_t count, uint32_t flash_baudrate);
+
+// True while an image is being flashed (between block 0 and the last block)
+bool uf2_flash_busy(void);
+
+/*
+ * Claims the target for something else than flashing an image, e.g. reading its flash.
+ * Fails while an image is being flashed; block 0 of an image fails while the target is claimed.
+ */
+bool uf2_flash_claim_target(void);
+void uf2_flash_release_target(void);
@@ -33,20 +33,32 @@
 #define EPNUM_CDC       2
 #define EPNUM_VENDOR    3
 #define EPNUM_MSC       4
+#define EPNUM_LA        5
 
 
 #if MSC_ENABLED
-#define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_VENDOR_DESC_LEN + TUD_MSC_DESC_LEN)
+#define TUSB_DESC_MSC_LEN TUD_MSC_DESC_LEN
 #else
-#define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_VENDOR_DESC_LEN)
+#define TUSB_DESC_MSC_LEN 0
 #endif
 
+#if LA_ENABLED
+#define TUSB_DESC_LA_LEN TUD_VENDOR_DESC_LEN
+#else
+#define TUSB_DESC_LA_LEN 0
+#endif
+
+#define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_VENDOR_DESC_LEN + TUSB_DESC_MSC_LEN + TUSB_DESC_LA_LEN)
+
 enum {
 	ITF_NUM_CDC = 0,
 	ITF_NUM_CDC_DATA,
 	ITF_NUM_VENDOR,
 #if MSC_ENABLED
 	ITF_NUM_MSC,
+#endif
+#if LA_ENABLED
+	ITF_NUM_LA,
 #endif
 	ITF_NUM_TOTAL
 };
@@ -101,6 +113,11 @@ static uint8_t const desc_configuration[] = {
 	// Interface number, string index, EP Out & EP In address, EP size
 	TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 6, EPNUM_MSC, 0x80 | EPNUM_MSC, 64),
 #endif
+
+#if LA_ENABLED
+	// Second vendor instance after the JTAG one, see LA_VENDOR_ITF
+	TUD_VENDOR_DESCRIPTOR(ITF_NUM_LA, 7, EPNUM_LA, 0x80 | EPNUM_LA, 64),
+#endif
 };
 
 static char serial_descriptor[PICO_UNIQUE_BOARD_ID_SIZE_BYTES * 2 + 1] = { '\0' }; // 2 chars per hexnumber + '\0'
@@ -113,6 +130,7 @@ static char const *string_desc_arr[] = {
 	"CDC",
 	"JTAG",
 	"MSC",
+	"Logic Analyzer",
 
 	/* JTAG_STR_DESC_INX 0x0A */
 };
@@ -206,7 +206,7 @@ static void ws2812_task(void * pvParameters)
 
 void ws2812_start_task(void)
 {
-	xTaskCreateAffinitySet(ws2812_task, "ws2812_task", STACK_SIZE_FROM_BYTES(2 * 1024), NULL, tskIDLE_PRIORITY + 1, CORE_AFFINITY_WS2812_TASK, &g_ws2812_task_handle);
+	xTaskCreateAffinitySet(ws2812_task, "ws2812_task", STACK_SIZE_FROM_BYTES(2 * 1024), NULL, PRIORITY_BACKGROUND_TASK, CORE_AFFINITY_WS2812_TASK, &g_ws2812_task_handle);
 }
 
 #endif